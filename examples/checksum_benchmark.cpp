@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <tins/utils.h>
+#include <tins/internals.h>
+
+using namespace Tins;
+
+// Computes the internet checksum over buffers of several sizes, using each
+// of the implementations supported by this CPU as well as the one 
+// Utils::do_checksum picks, and prints the time spent per call.
+
+const size_t buffer_sizes[] = { 20, 40, 64, 256, 576, 1500, 9000, 65535 };
+
+template<typename Function>
+double run(const std::vector<uint8_t>& buffer, size_t size, Function checksum) {
+    using clock_type = std::chrono::steady_clock;
+    // Roughly the same amount of bytes is processed for every size
+    const size_t iterations = 100000000 / (size + 64) + 1;
+    uint32_t total = 0;
+    auto start = clock_type::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        // Start on a different offset each time so that results can't 
+        // be reused, and unaligned loads are measured as well
+        const uint8_t* data = &buffer[i & 15];
+        total += checksum(data, data + size);
+    }
+    auto elapsed = clock_type::now() - start;
+    // Keep the compiler from optimizing the loop away
+    if (total == 0x12345678) {
+        std::cout << "";
+    }
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+int main() {
+    const struct {
+        Internals::checksum_implementation implementation;
+        const char* name;
+    } implementations[] = {
+        { Internals::CHECKSUM_SCALAR, "scalar" },
+        { Internals::CHECKSUM_SSE2, "sse2" },
+        { Internals::CHECKSUM_AVX2, "avx2" }
+    };
+    std::vector<uint8_t> buffer(65535 + 16);
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        buffer[i] = static_cast<uint8_t>(i * 7);
+    }
+    std::cout << std::setw(8) << "size";
+    for (const auto& impl : implementations) {
+        if (Internals::checksum_implementation_supported(impl.implementation)) {
+            std::cout << std::setw(12) << impl.name;
+        }
+    }
+    std::cout << std::setw(12) << "dispatched" << "  (ns/call)\n";
+    for (size_t size : buffer_sizes) {
+        std::cout << std::setw(8) << size;
+        for (const auto& impl : implementations) {
+            if (!Internals::checksum_implementation_supported(impl.implementation)) {
+                continue;
+            }
+            const auto implementation = impl.implementation;
+            double elapsed = run(buffer, size, [&](const uint8_t* start, const uint8_t* end) {
+                return Internals::do_checksum(start, end, implementation);
+            });
+            std::cout << std::setw(12) << std::fixed << std::setprecision(1) << elapsed;
+        }
+        double elapsed = run(buffer, size, [](const uint8_t* start, const uint8_t* end) {
+            return Utils::do_checksum(start, end);
+        });
+        std::cout << std::setw(12) << elapsed << "\n";
+    }
+}
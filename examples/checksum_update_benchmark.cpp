@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <tins/tins.h>
+
+using namespace Tins;
+
+// Parses full sized TCP segments, rewrites their source address and port
+// and serializes them again, as done when forwarding or NATing captured 
+// traffic. This is done both summing the whole segment, which is the 
+// default, and updating the parsed checksum incrementally, which is 
+// done while a TrustedChecksums::Scope is active.
+
+double run(const PDU::serialization_type& buffer, size_t iterations, bool trusted) {
+    using clock_type = std::chrono::steady_clock;
+    uint32_t total = 0;
+    auto start = clock_type::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        TrustedChecksums::Scope scope(trusted);
+        EthernetII eth(&buffer[0], buffer.size());
+        IP& ip = eth.rfind_pdu<IP>();
+        TCP& tcp = ip.rfind_pdu<TCP>();
+        ip.src_addr(IPv4Address(0x0a000001 + static_cast<uint32_t>(i)));
+        tcp.sport(static_cast<uint16_t>(i));
+        total += eth.serialize()[50];
+    }
+    auto elapsed = clock_type::now() - start;
+    // Keep the compiler from optimizing the loop away
+    if (total == 0x12345678) {
+        std::cout << "";
+    }
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    const size_t iterations = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    const uint32_t payload_sizes[] = { 0, 64, 512, 1460 };
+    std::cout << std::setw(8) << "payload" << std::setw(12) << "full" 
+              << std::setw(14) << "incremental" << "  (ns/packet)\n";
+    for (uint32_t payload_size : payload_sizes) {
+        EthernetII packet = EthernetII() / IP("192.168.0.100", "192.168.0.1") / 
+                            TCP(80, 40000);
+        if (payload_size > 0) {
+            packet /= RawPDU(std::string(payload_size, 'A'));
+        }
+        const PDU::serialization_type buffer = packet.serialize();
+        double full = run(buffer, iterations, false);
+        double incremental = run(buffer, iterations, true);
+        std::cout << std::setw(8) << payload_size << std::setw(12) << std::fixed 
+                  << std::setprecision(1) << full << std::setw(14) 
+                  << incremental << "\n";
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <tins/tins.h>
+
+using namespace Tins;
+
+// Sends the same set of UDP datagrams through a raw socket, first calling 
+// PacketSender::send once per packet and then using PacketSender::send_batch,
+// which submits up to a few dozen of them on each sendmmsg call. The rate
+// achieved by each of them is printed, in packets per second.
+//
+// This requires the privileges needed to open raw sockets. The datagrams 
+// are sent to the discard port, 9, of the given address, which is the 
+// loopback address by default.
+
+using clock_type = std::chrono::steady_clock;
+
+double send_loop(PacketSender& sender, std::vector<IP>& packets) {
+    auto start = clock_type::now();
+    for (IP& packet : packets) {
+        sender.send(packet);
+    }
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+double send_batch(PacketSender& sender, std::vector<IP>& packets, 
+                  size_t& completed) {
+    std::vector<uint32_t> bytes_sent;
+    auto start = clock_type::now();
+    completed = sender.send_batch(packets.begin(), packets.end(), 
+                                  sender.default_interface(), bytes_sent);
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    const size_t count = argc > 1 ? std::stoul(argv[1]) : 100000;
+    const IPv4Address destination(argc > 2 ? argv[2] : "127.0.0.1");
+    const uint32_t payload_sizes[] = { 0, 64, 512, 1400 };
+    try {
+        PacketSender sender;
+        std::cout << std::setw(8) << "payload" << std::setw(14) << "send()" 
+                  << std::setw(14) << "send_batch" << std::setw(10) 
+                  << "speedup" << "  (packets/s)\n";
+        for (uint32_t payload_size : payload_sizes) {
+            std::vector<IP> packets;
+            packets.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                packets.push_back(IP(destination) / 
+                                  UDP(9, 40000 + i % 1000));
+                if (payload_size > 0) {
+                    packets.back() /= RawPDU(std::string(payload_size, 'A'));
+                }
+                // The source address is looked up when a packet without 
+                // one is first serialized. Keep that out of the timings.
+                packets.back().serialize();
+            }
+            const double loop = send_loop(sender, packets);
+            size_t completed = 0;
+            const double batch = send_batch(sender, packets, completed);
+            if (completed != count) {
+                std::cout << "Only " << completed << " of " << count 
+                          << " packets were sent by send_batch\n";
+            }
+            std::cout << std::setw(8) << payload_size << std::setw(14) 
+                      << std::fixed << std::setprecision(0) << count / loop 
+                      << std::setw(14) << completed / batch << std::setw(10) 
+                      << std::setprecision(2) << loop / batch << "\n";
+        }
+    }
+    catch (std::exception& ex) {
+        std::cout << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+}
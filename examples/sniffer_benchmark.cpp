@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <tins/tins.h>
+
+using namespace Tins;
+
+// Reads a pcap file several times, using both BaseSniffer::sniff_loop and
+// BaseSniffer::sniff_loop_batch, and prints the time spent per packet.
+
+struct counter {
+    size_t packets = 0;
+    size_t bytes = 0;
+
+    bool operator()(const PDU& pdu) {
+        ++packets;
+        bytes += pdu.size();
+        return true;
+    }
+};
+
+template<typename Function>
+double run(const std::string& file_name, int rounds, Function read) {
+    using clock_type = std::chrono::steady_clock;
+    size_t packets = 0;
+    clock_type::duration total{};
+    for (int i = 0; i < rounds; ++i) {
+        FileSniffer sniffer(file_name);
+        counter count;
+        auto start = clock_type::now();
+        read(sniffer, count);
+        total += clock_type::now() - start;
+        packets += count.packets;
+    }
+    if (packets == 0) {
+        return 0;
+    }
+    return std::chrono::duration<double, std::nano>(total).count() / packets;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <pcap file> [rounds] [batch size]\n";
+        return 1;
+    }
+    const std::string file_name = argv[1];
+    const int rounds = argc > 2 ? std::stoi(argv[2]) : 5;
+    const uint32_t batch_size = argc > 3 ? std::stoul(argv[3]) : BaseSniffer::DEFAULT_BATCH_SIZE;
+    try {
+        double loop = run(file_name, rounds, [](BaseSniffer& sniffer, counter& count) {
+            sniffer.sniff_loop(std::ref(count));
+        });
+        double batch = run(file_name, rounds, [&](BaseSniffer& sniffer, counter& count) {
+            sniffer.sniff_loop_batch(std::ref(count), batch_size);
+        });
+        std::cout << "sniff_loop:       " << loop << " ns/packet\n";
+        std::cout << "sniff_loop_batch: " << batch << " ns/packet (batch size " 
+                  << batch_size << ")\n";
+    }
+    catch (std::exception& ex) {
+        std::cout << "[-] Error: " << ex.what() << std::endl;
+        return 1;
+    }
+}
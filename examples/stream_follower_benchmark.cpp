@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <tins/tins.h>
+#include <tins/tcp_stream.h>
+#include <tins/tcp_stream_follower_group.h>
+
+using namespace Tins;
+
+// Replays a capture file containing many TCP flows through a single 
+// TCPStreamFollower and then through TCPStreamFollowerGroups using an
+// increasing amount of workers, reporting how the throughput scales.
+// The file is read once before measuring so that it's in the page cache.
+
+using clock_type = std::chrono::steady_clock;
+
+struct counters {
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> streams{0};
+};
+
+template<typename Follower>
+double run(const std::string& file_name, Follower& follower, counters& result) {
+    FileSniffer sniffer(file_name);
+    auto start = clock_type::now();
+    follower.follow_streams(
+        sniffer,
+        [&](TCPStream& stream) {
+            result.bytes += stream.client_payload().size() + 
+                            stream.server_payload().size();
+            stream.client_payload().clear();
+            stream.server_payload().clear();
+        },
+        [&](TCPStream&) {
+            ++result.streams;
+        }
+    );
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+void report(const std::string& name, double seconds, size_t packets, 
+            const counters& result, double baseline) {
+    std::cout << std::setw(12) << name << std::setw(12) << std::fixed 
+              << std::setprecision(3) << seconds << std::setw(12) 
+              << std::setprecision(0) << packets / seconds / 1000 
+              << std::setw(10) << std::setprecision(2) << baseline / seconds
+              << std::setw(10) << result.streams << std::setw(14) 
+              << result.bytes << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <pcap_file> [max_workers]\n";
+        return 1;
+    }
+    const std::string file_name = argv[1];
+    const size_t max_workers = argc > 2 ? std::stoul(argv[2]) : 
+        std::max(4u, std::thread::hardware_concurrency());
+    try {
+        size_t packets = 0;
+        FileSniffer warmup(file_name);
+        warmup.sniff_loop([&](PDU&) {
+            ++packets;
+            return true;
+        });
+        std::cout << packets << " packets, " 
+                  << std::thread::hardware_concurrency() << " hardware threads\n";
+        std::cout << std::setw(12) << "follower" << std::setw(12) << "seconds" 
+                  << std::setw(12) << "kpackets/s" << std::setw(10) << "speedup" 
+                  << std::setw(10) << "streams" << std::setw(14) << "bytes\n";
+
+        counters single;
+        TCPStreamFollower follower;
+        const double baseline = run(file_name, follower, single);
+        report("single", baseline, packets, single, baseline);
+        for (size_t workers = 1; workers <= max_workers; workers *= 2) {
+            counters result;
+            TCPStreamFollowerGroup group(workers);
+            const double seconds = run(file_name, group, result);
+            report("group/" + std::to_string(workers), seconds, packets, 
+                   result, baseline);
+        }
+    }
+    catch (std::exception& ex) {
+        std::cout << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -46,6 +46,14 @@
 #define TINS_IS_CXX11 0
 #endif  // TINS_IS_CXX11
 
+#if TINS_IS_CXX11
+    #define TINS_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+    #define TINS_THREAD_LOCAL __declspec(thread)
+#else
+    #define TINS_THREAD_LOCAL __thread
+#endif // TINS_THREAD_LOCAL
+
 namespace Tins{
 namespace Internals {
 template<typename T>
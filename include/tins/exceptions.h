@@ -189,6 +189,17 @@ public:
     }
 };
 
+/**
+ * \brief Exception thrown when a PDU does not fit in the buffer it's 
+ * being serialized into.
+ */
+class serialization_error : public exception_base {
+public:
+    const char *what() const throw() {
+        return "Serialization error";
+    }
+};
+
 namespace Crypto {
 namespace WPA2 {
     /**
@@ -46,6 +46,7 @@
 #include "pdu.h"
 #include "endianness.h"
 #include "ip_address.h"
+#include "internals.h"
 
 namespace Tins {
 
@@ -55,6 +56,12 @@ namespace Tins {
      *
      * ICMP is the representation of the ICMP PDU. Instances of this class
      * must be sent over a level 3 PDU, this will otherwise fail.
+     *
+     * If the PDU was parsed while checksums were trusted and its payload
+     * is still the RawPDU created while parsing it, which hasn't been 
+     * modified, the checksum is updated incrementally (RFC 1624) when 
+     * serializing it, rather than summing the payload again. See 
+     * TrustedChecksums for more information.
      */
     class ICMP : public PDU {
     public:
@@ -402,6 +409,7 @@ namespace Tins {
 
         icmphdr _icmp;
         uint32_t _orig_timestamp_or_address_mask, _recv_timestamp, _trans_timestamp;
+        Internals::incremental_checksum _checksum_state;
     };
 }
 
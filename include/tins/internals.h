@@ -124,6 +124,56 @@ PDU *pdu_from_flag(PDU::PDUType type, const uint8_t *buffer, uint32_t size);
 Constants::Ethernet::e pdu_flag_to_ether_type(PDU::PDUType flag);
 Constants::IP::e pdu_flag_to_ip_type(PDU::PDUType flag);
 
+// The implementations Utils::do_checksum picks from, depending on what
+// the CPU supports
+enum checksum_implementation {
+    CHECKSUM_SCALAR,
+    CHECKSUM_SSE2,
+    CHECKSUM_AVX2
+};
+
+bool checksum_implementation_supported(checksum_implementation impl);
+uint32_t do_checksum(const uint8_t *start, const uint8_t *end,
+  checksum_implementation impl);
+
+// The implementations Utils::crc32 picks from
+enum crc32_implementation {
+    CRC32_NIBBLE,
+    CRC32_SLICING_BY_8,
+    CRC32_PCLMUL
+};
+
+bool crc32_implementation_supported(crc32_implementation impl);
+uint32_t crc32(const uint8_t *data, uint32_t data_size, 
+  crc32_implementation impl);
+
+// Updates a parsed PDU's checksum as described in RFC 1624, rather 
+// than summing its payload again. While a TrustedChecksums::Scope is 
+// active, the sum of the payload is derived from the checksum found in 
+// the packet, the header it was parsed from and, for PDUs that use it, 
+// the pseudo header. It's stored in the RawPDU, which discards it once
+// it's modified.
+class incremental_checksum {
+public:
+    incremental_checksum()
+    : payload_sum_(0), awaiting_pseudo_header_(false) { }
+
+    // header must contain the checksum, which is provided in host order
+    void parsed(const uint8_t *header, uint32_t header_size, uint16_t checksum,
+      PDU *inner, bool uses_pseudo_header);
+    // Provides the pseudo header's sum to a parsed TCP or UDP PDU
+    static void parsed_pseudo_header(PDU *transport, uint32_t pseudo_header_sum);
+    // header must be the serialized header, with its checksum set to 0.
+    static bool update(const uint8_t *header, uint32_t header_size,
+      uint32_t pseudo_header_sum, const PDU *inner, uint16_t &checksum);
+private:
+    void store_payload_sum(PDU *inner, uint32_t pseudo_header_sum);
+
+    // The payload's sum, without the pseudo header's sum subtracted
+    uint16_t payload_sum_;
+    bool awaiting_pseudo_header_;
+};
+
 template<typename T>
 bool increment_buffer(T &addr) {
     typename T::iterator it = addr.end() - 1;
@@ -180,6 +230,16 @@ inline bool is_dot3(const uint8_t *ptr, size_t sz) {
     return (sz >= 13 && ptr[12] < 8);
 }
 
+// MurmurHash3's 64 bit finalizer, used to hash the keys of flow tables
+inline uint32_t mix_hash(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return static_cast<uint32_t>(value);
+}
+
 template<typename T>
 struct is_unsigned_integral {
     static const bool value = false;
@@ -31,9 +31,13 @@
 #define TINS_IP_REASSEMBLER_H
 
 #include <vector>
-#include <map>
+#include <cstring>
+#include <stdint.h>
 #include "pdu.h"
 #include "ip_address.h"
+#include "ipv6.h"
+#include "packet.h"
+#include "timestamp.h"
 
 namespace Tins {
 /** 
@@ -41,48 +45,359 @@ namespace Tins {
  */
 class IP;
 namespace Internals {
-class IPv4Fragment {
+// Reassembles a datagram's payload in place. Holes are tracked using 
+// the algorithm described in RFC 815: each fragment's data is first
+// copied into the holes it fills. Only when it overlaps data received
+// before, the policy decides which data is kept. 
+class fragment_buffer {
 public:
-    typedef PDU::serialization_type payload_type;
+    // The way overlaps are resolved. Except for FIRST and LAST, these 
+    // compare the new fragment against the one that provided the 
+    // overlapped data, as the operating systems they're named after do
+    enum overlap_policy {
+        // The data received first is kept
+        FIRST,
+        // The data received last is kept
+        LAST,
+        // New data is kept if its fragment starts before
+        BSD,
+        // New data is kept if its fragment starts before, or at the 
+        // same offset and doesn't end before
+        LINUX,
+        // New data is kept if its fragment starts before and ends after
+        WINDOWS,
+        // New data is kept if its fragment starts before and doesn't
+        // end before
+        SOLARIS
+    };
 
-    IPv4Fragment() : offset_() { }
+    fragment_buffer();
 
-    template<typename T>
-    IPv4Fragment(T *pdu, uint16_t offset)
-    : payload_(pdu->serialize()), offset_(offset) 
-    {
-        
+    void add(uint32_t offset, const uint8_t *data, uint32_t size, 
+             bool last_fragment, overlap_policy policy = FIRST);
+
+    bool is_complete() const {
+        return received_end && holes.empty();
     }
-    
-    const payload_type &payload() const {
-        return payload_;
+
+    const uint8_t *data() const {
+        return buffer.empty() ? 0 : &buffer[0];
     }
-    
-    uint16_t offset() const {
-        return offset_;
+
+    // The amount of bytes allocated for the payload
+    size_t size() const {
+        return buffer.size();
+    }
+
+    // Whether any fragment overlapped data received before, or went 
+    // past the datagram's end. Exact duplicates aren't overlaps.
+    bool overlapped() const {
+        return has_overlaps;
+    }
+
+    // The amount of bytes the buffer would grow by if a fragment 
+    // ending at the given offset were added
+    size_t growth(uint32_t end) const {
+        if(received_end || end <= buffer.size())
+            return 0;
+        return end - buffer.size();
     }
 private:
-    payload_type payload_;
-    uint16_t offset_;
+    struct hole {
+        hole(uint32_t first, uint32_t last) : first(first), last(last) { }
+
+        // The first missing byte and the one after the last
+        uint32_t first, last;
+    };
+
+    // A range of the buffer and the fragment its data came from. 
+    // These are only kept for the policies that compare fragments.
+    struct segment {
+        segment(uint32_t first, uint32_t last, uint32_t fragment_first, 
+          uint32_t fragment_last)
+        : first(first), last(last), fragment_first(fragment_first),
+          fragment_last(fragment_last)
+        {
+
+        }
+
+        bool operator<(const segment &rhs) const {
+            return first < rhs.first;
+        }
+
+        uint32_t first, last;
+        uint32_t fragment_first, fragment_last;
+    };
+
+    typedef std::vector<hole> holes_type;
+    typedef std::vector<segment> segments_type;
+
+    static bool new_data_wins(overlap_policy policy, uint32_t first, 
+                              uint32_t last, const segment &current);
+
+    uint32_t fill_holes(uint32_t offset, uint32_t end, const uint8_t *data);
+    void add_segment(uint32_t offset, uint32_t end, const uint8_t *data,
+                     bool overlaps, overlap_policy policy);
+    void set_end(uint32_t end);
+
+    std::vector<uint8_t> buffer;
+    holes_type holes;
+    segments_type segments;
+    bool received_end, has_overlaps;
 };
 
 class IPv4Stream {
 public:
     IPv4Stream();
     
-    void add_fragment(IP *ip);
+    void add_fragment(IP *ip, 
+                      fragment_buffer::overlap_policy policy = fragment_buffer::FIRST);
     bool is_complete() const;
     PDU *allocate_pdu() const;
+
+    // The amount of bytes the stream would grow by if the given 
+    // fragment were added
+    size_t growth(const IP *ip) const {
+        return payload.growth(fragment_end(ip));
+    }
+
+    // The offset right after the given fragment's payload
+    static uint32_t fragment_end(const IP *ip);
+
+    // The amount of bytes allocated for the payload
+    size_t buffered_size() const {
+        return payload.size();
+    }
+
+    bool overlapped() const {
+        return payload.overlapped();
+    }
 private:
-    typedef std::vector<IPv4Fragment> fragments_type;
-    
-    uint16_t extract_offset(const IP *ip);
-    bool extract_more_frag(const IP *ip);
+    static uint32_t extract_offset(const IP *ip);
 
-    fragments_type fragments;
-    bool received_end;
+    fragment_buffer payload;
     uint8_t transport_proto;
-    size_t received_size, total_size;
+};
+
+class IPv6Stream {
+public:
+    IPv6Stream();
+    
+    // The header is the fragment's fragment extension header
+    void add_fragment(IPv6 *ip, const IPv6::ext_header &header);
+    bool is_complete() const;
+    PDU *allocate_pdu() const;
+
+    size_t growth(const IPv6 *ip, const IPv6::ext_header &header) const {
+        return payload.growth(fragment_end(ip, header));
+    }
+
+    static uint32_t fragment_end(const IPv6 *ip, const IPv6::ext_header &header);
+
+    size_t buffered_size() const {
+        return payload.size();
+    }
+
+    bool overlapped() const {
+        return payload.overlapped();
+    }
+private:
+    fragment_buffer payload;
+    uint8_t next_header;
+};
+
+// Identifies the fragments of a datagram, as described in RFC 791
+struct ipv4_fragment_key {
+    ipv4_fragment_key() : src_addr(0), dst_addr(0), id(0), protocol(0) { }
+
+    ipv4_fragment_key(const IP *ip);
+
+    bool operator==(const ipv4_fragment_key &rhs) const {
+        return src_addr == rhs.src_addr && dst_addr == rhs.dst_addr &&
+               id == rhs.id && protocol == rhs.protocol;
+    }
+
+    uint32_t hash() const;
+
+    uint32_t src_addr, dst_addr;
+    uint16_t id;
+    uint8_t protocol;
+};
+
+// Identifies the fragments of a datagram, as described in RFC 8200
+struct ipv6_fragment_key {
+    ipv6_fragment_key();
+
+    ipv6_fragment_key(const IPv6 *ip, const IPv6::ext_header &header);
+
+    bool operator==(const ipv6_fragment_key &rhs) const {
+        return id == rhs.id && 
+               std::memcmp(src_addr, rhs.src_addr, sizeof(src_addr)) == 0 &&
+               std::memcmp(dst_addr, rhs.dst_addr, sizeof(dst_addr)) == 0;
+    }
+
+    uint32_t hash() const;
+
+    uint8_t src_addr[IPv6Address::address_size];
+    uint8_t dst_addr[IPv6Address::address_size];
+    uint32_t id;
+};
+
+// An open addressing hash table which holds the datagrams being 
+// reassembled, and keeps them sorted by the time their first fragment
+// was seen. Datagrams are referred to by their index, which remains
+// valid until they're removed.
+//
+// It's only instantiated for the key and stream types used by the 
+// reassemblers.
+template<typename Key, typename Stream>
+class fragment_table {
+public:
+    typedef Key key_type;
+    typedef Stream stream_type;
+
+    static const uint32_t npos = static_cast<uint32_t>(-1);
+
+    fragment_table();
+
+    uint32_t find(const key_type &key) const;
+    uint32_t insert(const key_type &key, uint64_t now);
+    void remove(uint32_t index);
+    void clear();
+
+    // The datagram that was created first, or npos
+    uint32_t oldest() const {
+        return tail_;
+    }
+
+    // The datagram that was created right after the given one, or npos
+    uint32_t newer(uint32_t index) const {
+        return nodes_[index].prev;
+    }
+
+    stream_type &stream(uint32_t index) {
+        return nodes_[index].stream;
+    }
+
+    const key_type &key(uint32_t index) const {
+        return nodes_[index].key;
+    }
+
+    uint64_t created(uint32_t index) const {
+        return nodes_[index].created;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+private:
+    struct node {
+        key_type key;
+        stream_type stream;
+        uint64_t created;
+        uint32_t hash;
+        // Neighbours in the creation order list. next is also used to 
+        // link free nodes
+        uint32_t prev, next;
+    };
+
+    void unlink(uint32_t index);
+    void push_front(uint32_t index);
+    void rehash(size_t slot_count);
+    void place(uint32_t index);
+
+    std::vector<node> nodes_;
+    // Each slot holds a node index + 1, or 0 if it's empty
+    std::vector<uint32_t> slots_;
+    uint32_t free_head_, head_, tail_;
+    size_t size_;
+};
+
+// The datagrams being reassembled, along with the bookkeeping both
+// reassemblers share: the current time, the timeout and the memory
+// limit. Only the keys and the way fragments are added differ per
+// family.
+template<typename Key, typename Stream>
+class fragment_store {
+public:
+    typedef fragment_table<Key, Stream> table_type;
+    typedef typename table_type::key_type key_type;
+    typedef typename table_type::stream_type stream_type;
+
+    static const uint32_t npos = table_type::npos;
+
+    fragment_store(uint32_t timeout, size_t max_buffer);
+
+    // Sets the current time, in microseconds, and removes the datagrams
+    // that timed out, adding them to timed_out
+    void advance(uint64_t now, uint64_t &timed_out);
+
+    // Makes room for growth more bytes in the datagram at index, which
+    // is created if index is npos, by evicting the oldest ones. Returns
+    // the datagram's index, or npos if it'd never fit, in which case
+    // it's removed. Every datagram removed is added to evicted
+    uint32_t reserve(const key_type &key, uint32_t index, size_t growth,
+                     uint64_t &evicted);
+
+    // Must be called after a fragment is added to a datagram
+    void resized(size_t previous_size, size_t new_size) {
+        buffered_size_ = buffered_size_ - previous_size + new_size;
+    }
+
+    void remove(uint32_t index);
+    void clear();
+
+    uint32_t find(const key_type &key) const {
+        return table_.find(key);
+    }
+
+    uint32_t oldest() const {
+        return table_.oldest();
+    }
+
+    uint32_t newer(uint32_t index) const {
+        return table_.newer(index);
+    }
+
+    stream_type &stream(uint32_t index) {
+        return table_.stream(index);
+    }
+
+    const key_type &key(uint32_t index) const {
+        return table_.key(index);
+    }
+
+    size_t size() const {
+        return table_.size();
+    }
+
+    void timeout(uint32_t seconds) {
+        timeout_ = seconds;
+    }
+
+    uint32_t timeout() const {
+        return timeout_;
+    }
+
+    void max_buffer(size_t size) {
+        max_buffer_ = size;
+    }
+
+    size_t max_buffer() const {
+        return max_buffer_;
+    }
+
+    size_t buffered_size() const {
+        return buffered_size_;
+    }
+private:
+    bool make_room(size_t size, uint32_t current, uint64_t &evicted);
+
+    table_type table_;
+    // The last timestamp seen, in microseconds
+    uint64_t now_;
+    uint32_t timeout_;
+    size_t max_buffer_, buffered_size_;
 };
 } // namespace Internals
 
@@ -92,6 +407,16 @@ private:
 
 /**
  * \brief Reassembles fragmented IP packets.
+ *
+ * Fragments are grouped by their source and destination addresses,
+ * identifier and protocol, as described in RFC 791.
+ *
+ * Datagrams that aren't completed within a timeout since their first
+ * fragment was seen are discarded. Time is measured using the packets'
+ * timestamps, so this only happens when the reassembler is given 
+ * Packets or timestamps. The amount of memory used to store fragments 
+ * is also limited. When a fragment doesn't fit, the oldest datagrams
+ * are discarded to make room for it.
  */
 class IPv4Reassembler {
 public:
@@ -105,13 +430,96 @@ public:
     };
 
     /**
-     * The type used to represent the overlapped segment 
+     * \brief The type used to represent the overlapped segment 
      * reassembly technique to be used.
+     *
+     * When a fragment overlaps data received before, the technique 
+     * determines which data is kept. Most of them reproduce the way
+     * different operating systems reassemble datagrams, by comparing
+     * the new fragment against the one which provided the overlapped
+     * data.
      */
     enum overlapping_technique {
-        NONE
+        /**
+         * The data received first is kept. This is the same as FIRST.
+         */
+        NONE,
+
+        /**
+         * The data received first is kept.
+         */
+        FIRST,
+
+        /**
+         * The data received last is kept.
+         */
+        LAST,
+
+        /**
+         * The new data is kept if its fragment starts before the 
+         * other one, as BSD systems do.
+         */
+        BSD,
+
+        /**
+         * The new data is kept if its fragment starts before the other
+         * one, or at the same offset and it doesn't end before it, as 
+         * Linux does.
+         */
+        LINUX,
+
+        /**
+         * The new data is kept if its fragment starts before the other
+         * one and ends after it, as Windows does.
+         */
+        WINDOWS,
+
+        /**
+         * The new data is kept if its fragment starts before the other
+         * one and doesn't end before it, as Solaris does.
+         */
+        SOLARIS
+    };
+
+    /**
+     * \brief Counters on the datagrams that were processed.
+     */
+    struct Stats {
+        /**
+         * The amount of datagrams that were reassembled.
+         */
+        uint64_t reassembled;
+
+        /**
+         * The amount of incomplete datagrams discarded because they 
+         * timed out.
+         */
+        uint64_t timed_out;
+
+        /**
+         * The amount of incomplete datagrams discarded to stay within
+         * the memory limit.
+         */
+        uint64_t evicted;
+
+        /**
+         * The amount of datagrams in which fragments overlapped.
+         */
+        uint64_t overlapping;
+
+        Stats();
     };
 
+    /**
+     * The default value for IPv4Reassembler::timeout, in seconds.
+     */
+    static const uint32_t DEFAULT_TIMEOUT;
+
+    /**
+     * The default value for IPv4Reassembler::max_buffer.
+     */
+    static const size_t DEFAULT_MAX_BUFFER;
+
     /**
      * Constructs an IPV4Reassembler.
      * \param technique The technique to be used for reassembling
@@ -135,15 +543,98 @@ public:
      */
     packet_status process(PDU &pdu);
 
+    /**
+     * \brief Processes a PDU captured at the given time and tries to
+     * reassemble it.
+     *
+     * Besides processing the PDU, incomplete datagrams which have 
+     * timed out are discarded.
+     *
+     * \sa IPv4Reassembler::process(PDU&)
+     * \param pdu The PDU to process.
+     * \param ts The time at which the PDU was captured.
+     */
+    packet_status process(PDU &pdu, const Timestamp &ts);
+
+    /**
+     * \brief Processes a packet and tries to reassemble it.
+     *
+     * The packet's timestamp is used to discard incomplete datagrams
+     * which have timed out.
+     *
+     * \sa IPv4Reassembler::process(PDU&)
+     * \param packet The packet to process.
+     */
+    packet_status process(Packet &packet);
+
     /**
      * Removes all of the packets and data stored.
      */
     void clear_streams();
 
+    /**
+     * \brief Sets the time after which incomplete datagrams are 
+     * discarded.
+     *
+     * \param seconds The timeout, in seconds. 0 means they're never
+     * discarded.
+     */
+    void timeout(uint32_t seconds) {
+        streams.timeout(seconds);
+    }
+
+    /**
+     * \brief Getter for the timeout, in seconds.
+     */
+    uint32_t timeout() const {
+        return streams.timeout();
+    }
+
+    /**
+     * \brief Sets the maximum amount of fragment payload bytes stored.
+     *
+     * \param size The amount of bytes. 0 means there's no limit.
+     */
+    void max_buffer(size_t size) {
+        streams.max_buffer(size);
+    }
+
+    /**
+     * \brief Getter for the maximum amount of fragment payload bytes 
+     * stored.
+     */
+    size_t max_buffer() const {
+        return streams.max_buffer();
+    }
+
+    /**
+     * \brief Returns the amount of fragment payload bytes stored.
+     */
+    size_t buffered_size() const {
+        return streams.buffered_size();
+    }
+
+    /**
+     * \brief Returns the amount of incomplete datagrams stored.
+     */
+    size_t pending_datagrams() const {
+        return streams.size();
+    }
+
+    /**
+     * \brief Getter for the datagram counters.
+     */
+    const Stats &stats() const {
+        return stats_;
+    }
+
     /**
      * \brief Removes all of the packets and data stored that 
      * belongs to IP headers whose identifier, source and destination
      * addresses are equal to the provided parameters.
+     *
+     * Datagrams going in either direction between the addresses are 
+     * removed, regardless of their protocol.
      * 
      * \param id The idenfier to search.
      * \param addr1 The source address to search.
@@ -152,15 +643,212 @@ public:
      */
     void remove_stream(uint16_t id, IPv4Address addr1, IPv4Address addr2);
 private:
-    typedef std::pair<IPv4Address, IPv4Address> address_pair;
-    typedef std::pair<uint16_t, address_pair> key_type;
-    typedef std::map<key_type, Internals::IPv4Stream> streams_type;
+    typedef Internals::fragment_store<Internals::ipv4_fragment_key, 
+                                      Internals::IPv4Stream> streams_type;
 
-    key_type make_key(const IP *ip) const;
-    address_pair make_address_pair(IPv4Address addr1, IPv4Address addr2) const;
+    packet_status process(PDU &pdu, const Timestamp *ts);
     
     streams_type streams;
     overlapping_technique technique;
+    Internals::fragment_buffer::overlap_policy policy;
+    Stats stats_;
+};
+
+/**
+ * \brief Reassembles fragmented IPv6 packets.
+ *
+ * Fragments are grouped by their source and destination addresses
+ * and the identifier in their fragment extension header, as described
+ * in RFC 8200. Once a datagram is reassembled, the fragment header is
+ * removed from the IPv6 PDU and its payload is decoded. 
+ *
+ * Datagrams are timed out and the memory used is limited just like
+ * IPv4Reassembler does.
+ *
+ * As required by RFC 5722, a datagram in which fragments overlap is
+ * discarded as a whole by default. Fragments that only repeat data 
+ * already received are not considered overlaps. 
+ * \sa IPv6Reassembler::drop_overlapping
+ */
+class IPv6Reassembler {
+public:
+    /**
+     * The status of each processed packet.
+     */
+    enum packet_status {
+        NOT_FRAGMENTED,
+        FRAGMENTED,
+        REASSEMBLED
+    };
+
+    /**
+     * \brief Counters on the datagrams that were processed.
+     *
+     * \sa IPv4Reassembler::Stats
+     */
+    typedef IPv4Reassembler::Stats Stats;
+
+    /**
+     * The default value for IPv6Reassembler::timeout, in seconds.
+     */
+    static const uint32_t DEFAULT_TIMEOUT;
+
+    /**
+     * The default value for IPv6Reassembler::max_buffer.
+     */
+    static const size_t DEFAULT_MAX_BUFFER;
+
+    /**
+     * Constructs an IPv6Reassembler.
+     */
+    IPv6Reassembler();
+
+    /**
+     * \brief Processes a PDU and tries to reassemble it.
+     *
+     * If the packet is successfully reassembled using previously
+     * processed packets, its contents will be modified so that
+     * it contains the whole payload and not just a fragment.
+     * 
+     * \param pdu The PDU to process.
+     * \return NOT_FRAGMENTED if the PDU does not contain an IPv6
+     * layer or is not fragmented, FRAGMENTED if the packet is 
+     * fragmented or REASSEMBLED if the packet was fragmented 
+     * but has now been reassembled.
+     */
+    packet_status process(PDU &pdu);
+
+    /**
+     * \brief Processes a PDU captured at the given time and tries to
+     * reassemble it.
+     *
+     * Besides processing the PDU, incomplete datagrams which have 
+     * timed out are discarded.
+     *
+     * \sa IPv6Reassembler::process(PDU&)
+     * \param pdu The PDU to process.
+     * \param ts The time at which the PDU was captured.
+     */
+    packet_status process(PDU &pdu, const Timestamp &ts);
+
+    /**
+     * \brief Processes a packet and tries to reassemble it.
+     *
+     * The packet's timestamp is used to discard incomplete datagrams
+     * which have timed out.
+     *
+     * \sa IPv6Reassembler::process(PDU&)
+     * \param packet The packet to process.
+     */
+    packet_status process(Packet &packet);
+
+    /**
+     * Removes all of the packets and data stored.
+     */
+    void clear_streams();
+
+    /**
+     * \brief Sets the time after which incomplete datagrams are 
+     * discarded.
+     *
+     * \param seconds The timeout, in seconds. 0 means they're never
+     * discarded.
+     */
+    void timeout(uint32_t seconds) {
+        streams.timeout(seconds);
+    }
+
+    /**
+     * \brief Getter for the timeout, in seconds.
+     */
+    uint32_t timeout() const {
+        return streams.timeout();
+    }
+
+    /**
+     * \brief Sets the maximum amount of fragment payload bytes stored.
+     *
+     * \param size The amount of bytes. 0 means there's no limit.
+     */
+    void max_buffer(size_t size) {
+        streams.max_buffer(size);
+    }
+
+    /**
+     * \brief Getter for the maximum amount of fragment payload bytes 
+     * stored.
+     */
+    size_t max_buffer() const {
+        return streams.max_buffer();
+    }
+
+    /**
+     * \brief Sets whether datagrams in which fragments overlap are 
+     * discarded.
+     *
+     * This is enabled by default. When disabled, the data from the 
+     * first fragment received is kept, like IPv4Reassembler::FIRST
+     * does. Either way, these datagrams are counted in 
+     * Stats::overlapping.
+     *
+     * \param enabled Whether to discard them.
+     */
+    void drop_overlapping(bool enabled) {
+        drop_overlapping_ = enabled;
+    }
+
+    /**
+     * \brief Indicates whether datagrams in which fragments overlap 
+     * are discarded.
+     */
+    bool drop_overlapping() const {
+        return drop_overlapping_;
+    }
+
+    /**
+     * \brief Returns the amount of fragment payload bytes stored.
+     */
+    size_t buffered_size() const {
+        return streams.buffered_size();
+    }
+
+    /**
+     * \brief Returns the amount of incomplete datagrams stored.
+     */
+    size_t pending_datagrams() const {
+        return streams.size();
+    }
+
+    /**
+     * \brief Getter for the datagram counters.
+     */
+    const Stats &stats() const {
+        return stats_;
+    }
+
+    /**
+     * \brief Removes all of the packets and data stored that 
+     * belongs to datagrams whose identifier, source and destination
+     * addresses are equal to the provided parameters.
+     *
+     * Datagrams going in either direction between the addresses are 
+     * removed.
+     * 
+     * \param id The idenfier to search.
+     * \param addr1 The source address to search.
+     * \param addr2 The destinatin address to search.
+     */
+    void remove_stream(uint32_t id, const IPv6Address &addr1, 
+                       const IPv6Address &addr2);
+private:
+    typedef Internals::fragment_store<Internals::ipv6_fragment_key, 
+                                      Internals::IPv6Stream> streams_type;
+
+    packet_status process(PDU &pdu, const Timestamp *ts);
+    
+    streams_type streams;
+    Stats stats_;
+    bool drop_overlapping_;
 };
 
 /**
@@ -210,6 +898,54 @@ template<typename Functor>
 IPv4ReassemblerProxy<Functor> make_ipv4_reassembler_proxy(Functor func) {
     return IPv4ReassemblerProxy<Functor>(func);
 }
+
+/**
+ * Proxy functor class that reassembles IPv6 PDUs.
+ */
+template<typename Functor>
+class IPv6ReassemblerProxy {
+public:
+    /**
+     * Constructs the proxy from a functor object.
+     *
+     * \param func The functor object.
+     */
+    IPv6ReassemblerProxy(Functor func)
+    : functor_(func)
+    {
+
+    }
+
+    /**
+     * \brief Tries to reassemble the packet and forwards it to 
+     * the functor.
+     * 
+     * \param pdu The packet to process
+     * \return true if the packet wasn't forwarded, otherwise
+     * the value returned by the functor.
+     */
+    bool operator()(PDU &pdu) {
+        // Forward it unless it's fragmented.
+        if(reassembler.process(pdu) != IPv6Reassembler::FRAGMENTED)
+            return functor_(pdu);
+        else
+            return true;
+    }
+private:
+    IPv6Reassembler reassembler;
+    Functor functor_;
+};
+
+/**
+ * Helper function that creates an IPv6ReassemblerProxy.
+ *
+ * \param func The functor object to use in the IPv6ReassemblerProxy.
+ * \return An IPv6ReassemblerProxy.
+ */
+template<typename Functor>
+IPv6ReassemblerProxy<Functor> make_ipv6_reassembler_proxy(Functor func) {
+    return IPv6ReassemblerProxy<Functor>(func);
+}
 }
 
 
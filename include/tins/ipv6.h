@@ -285,6 +285,31 @@ public:
      */
     void add_ext_header(const ext_header &header);
 
+    /**
+     * \brief Removes the first extension header that matches the 
+     * given flag.
+     *
+     * The header that preceded it is updated so that it points to the
+     * one that followed it.
+     *
+     * \param id The header identifier to be removed.
+     * \return true if the header was found and removed.
+     */
+    bool remove_ext_header(ExtensionHeader id);
+
+    /**
+     * \brief Indicates whether this packet is a fragment.
+     *
+     * This is the case when it contains a fragment extension header 
+     * whose offset is not 0 or whose more fragments flag is set.
+     *
+     * When a fragment is parsed, its payload is stored in a RawPDU 
+     * rather than being decoded.
+     *
+     * \return true if this packet is a fragment.
+     */
+    bool is_fragmented() const;
+
     /**
      * \brief Searchs for an extension header that matchs the given
      * flag.
@@ -31,6 +31,7 @@
 #define TINS_OFFLINE_PACKET_FILTER_H
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include "data_link_type.h"
 
@@ -139,6 +140,10 @@ public:
       * to the packet before constructing a PDU from it, it is recommended
       * to use the other overload over the raw buffer.
       *
+      * The packet is serialized into a buffer owned by this object, 
+      * so this method must not be called concurrently on the same 
+      * filter.
+      *
       * \param pdu The packet to be matched against the filter.
       * \return true iff the packet matches the filter.
       */
@@ -150,6 +155,7 @@ private:
 
     pcap_t* handle;
     mutable bpf_program filter;
+    mutable std::vector<uint8_t> buffer;
     std::string string_filter;
 };
 } // Tins
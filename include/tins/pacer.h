@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef TINS_PACER_H
+#define TINS_PACER_H
+
+#include <stdint.h>
+
+namespace Tins {
+
+/**
+ * \class Pacer
+ * \brief Spaces out packets so they're sent at a given rate.
+ *
+ * Pacer implements a token bucket which limits both the amount of 
+ * packets and the amount of bits sent per second. Rather than sleeping a 
+ * fixed amount of time between packets, it keeps an absolute schedule 
+ * in which every packet is given the time slot in which it should be 
+ * sent. The time spent serializing and writing packets is therefore not 
+ * added to the spacing between them, and packets sent late because of
+ * an oversleep can be sent back to back, up to the configured burst 
+ * size, so the average rate isn't lost.
+ *
+ * Waiting can be done either by sleeping, which is cheap but has the 
+ * resolution of the system's timers (tens of microseconds), or by busy 
+ * waiting on the monotonic clock, which uses a whole CPU but provides
+ * sub-microsecond spacing. When sleeping at rates whose interval is 
+ * close to that resolution, use a burst size large enough to cover it. 
+ * Otherwise every oversleep is lost and the rate won't be achieved.
+ *
+ * Pacers are usually provided to PacketSender::pacer, which applies them 
+ * to every packet it sends:
+ *
+ * \code
+ * PacketSender sender;
+ * // 100k packets per second, at most 1 Gbps, bursts of up to 16 packets
+ * sender.pacer(Pacer(100000, 1000000000, 16, Pacer::BUSY_WAIT));
+ * // send packets...
+ * 
+ * const Pacer::Stats& stats = sender.pacer().stats();
+ * std::cout << stats.packets_per_second() << std::endl;
+ * \endcode
+ *
+ * The statistics it keeps allow checking whether the packets were 
+ * actually generated fast enough to keep up with the configured rate.
+ */
+class Pacer {
+public:
+    /**
+     * The ways in which Pacer::wait_until can wait.
+     */
+    enum WaitMode {
+        SLEEP,
+        BUSY_WAIT
+    };
+
+    /**
+     * \brief Statistics about the packets which were paced.
+     *
+     * All times are in nanoseconds, and are measured using Pacer::clock.
+     */
+    struct Stats {
+        /**
+         * The amount of packets paced.
+         */
+        uint64_t packets;
+
+        /**
+         * The amount of bytes in those packets.
+         */
+        uint64_t bytes;
+
+        /**
+         * The amount of packets which had to wait for their time slot.
+         */
+        uint64_t waits;
+
+        /**
+         * The total amount of time spent waiting.
+         */
+        uint64_t wait_time;
+
+        /**
+         * The amount of packets sent more than one packet interval after
+         * their time slot. If this keeps increasing, packets are not 
+         * being generated fast enough for the configured rate.
+         */
+        uint64_t behind;
+
+        /**
+         * The largest delay between a packet's time slot and the moment
+         * it was sent.
+         */
+        uint64_t max_lag;
+
+        /**
+         * The time at which the first packet was sent.
+         */
+        uint64_t first_packet;
+
+        /**
+         * The time at which the last packet was sent.
+         */
+        uint64_t last_packet;
+
+        /**
+         * Default constructs a Stats, setting every field to 0.
+         */
+        Stats();
+
+        /**
+         * \brief Returns the time elapsed between the first and last 
+         * packets, in nanoseconds.
+         */
+        uint64_t elapsed() const;
+
+        /**
+         * \brief Returns the achieved rate, in packets per second.
+         *
+         * This is measured over the intervals between the first and last
+         * packets, so it's 0 if less than two packets were sent.
+         */
+        double packets_per_second() const;
+
+        /**
+         * \brief Returns the achieved rate, in bits per second.
+         *
+         * The last packet is not taken into account, as it's sent at the 
+         * end of the measured interval.
+         */
+        double bits_per_second() const;
+    };
+
+    /**
+     * \brief Default constructs a Pacer.
+     *
+     * Pacers constructed this way don't limit the rate at all.
+     */
+    Pacer();
+
+    /**
+     * \brief Constructs a Pacer.
+     *
+     * A rate set to 0 is not limited. If both rates are set, every packet
+     * waits for as long as the most restrictive of them requires.
+     *
+     * \param packets_per_second The maximum amount of packets per second.
+     * \param bits_per_second The maximum amount of bits per second. Only
+     * the bytes in the packets are taken into account, not the link 
+     * layer's framing overhead.
+     * \param burst The maximum amount of packets which can be sent back 
+     * to back, either after being idle or in order to catch up after 
+     * falling behind.
+     * \param mode The way in which packets wait for their time slot.
+     */
+    Pacer(double packets_per_second, double bits_per_second = 0, 
+      uint32_t burst = 1, WaitMode mode = SLEEP);
+
+    /**
+     * \brief Indicates whether this Pacer limits the rate at all.
+     */
+    bool enabled() const;
+
+    /**
+     * \brief Getter for the packets per second rate.
+     */
+    double packets_per_second() const;
+
+    /**
+     * \brief Getter for the bits per second rate.
+     */
+    double bits_per_second() const;
+
+    /**
+     * \brief Getter for the burst size.
+     */
+    uint32_t burst() const;
+
+    /**
+     * \brief Getter for the wait mode.
+     */
+    WaitMode wait_mode() const;
+
+    /**
+     * \brief Waits until a packet can be sent.
+     *
+     * This is equivalent to calling Pacer::reserve using the current time
+     * and then waiting until the returned time.
+     *
+     * \param size The size of the packet, in bytes.
+     */
+    void pace(uint32_t size);
+
+    /**
+     * \brief Reserves the next time slot for a packet.
+     *
+     * The packet is accounted as sent at the returned time, so the caller 
+     * must wait until then before sending it. This allows doing something
+     * useful before waiting, such as sending the packets which are 
+     * already due.
+     *
+     * \param size The size of the packet, in bytes.
+     * \param now The current time, as returned by Pacer::clock.
+     * \return The time at which the packet can be sent. This is never 
+     * less than now.
+     */
+    uint64_t reserve(uint32_t size, uint64_t now);
+
+    /**
+     * \brief Waits until the given time, using the configured wait mode.
+     *
+     * \param time The time to wait for, as returned by Pacer::clock.
+     */
+    void wait_until(uint64_t time) const;
+
+    /**
+     * \brief Waits until the given time, using the given wait mode.
+     *
+     * \param time The time to wait for, as returned by Pacer::clock.
+     * \param mode The way in which to wait.
+     */
+    static void wait_until(uint64_t time, WaitMode mode);
+
+    /**
+     * \brief Getter for the statistics.
+     */
+    const Stats& stats() const;
+
+    /**
+     * \brief Resets the statistics and the schedule.
+     *
+     * The next packet will be sent right away.
+     */
+    void reset();
+
+    /**
+     * \brief Returns the current time of a monotonic clock, in nanoseconds.
+     */
+    static uint64_t clock();
+private:
+    double packet_interval_, byte_interval_;
+    uint32_t burst_;
+    WaitMode mode_;
+    // Time slot of the next packet, relative to stats_.first_packet
+    double next_slot_;
+    Stats stats_;
+};
+} // Tins
+
+#endif // TINS_PACER_H
@@ -303,6 +303,8 @@ public:
         return *this;
     }
 private:
+    friend class BaseSniffer;
+
     PDU *pdu_;
     Timestamp ts;
 };
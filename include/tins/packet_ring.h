@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "config.h"
+
+#if !defined(TINS_PACKET_RING_H) && defined(HAVE_PACKET_RING)
+#define TINS_PACKET_RING_H
+
+#include <string>
+#include <stdint.h>
+#include <pcap.h>
+
+struct tpacket_block_desc;
+struct tpacket3_hdr;
+struct tpacket2_hdr;
+
+namespace Tins {
+class PDU;
+class NetworkInterface;
+
+/**
+ * \class RxPacketRing
+ * \brief Captures packets using a Linux AF_PACKET TPACKET_V3 memory 
+ * mapped ring.
+ *
+ * The kernel writes captured frames directly into blocks of a ring 
+ * buffer which is shared with userspace. Frames are handed to the 
+ * callback straight out of the mapped blocks, and each block is given
+ * back to the kernel once all of its frames have been processed. This 
+ * avoids both the copy and the system call per packet performed by 
+ * regular socket reads.
+ *
+ * This class is used by Sniffer when SnifferConfiguration::set_packet_ring
+ * is enabled, so usually there's no need to use it directly. Its interface 
+ * mimics libpcap's pcap_dispatch and pcap_loop, so the same callbacks can
+ * be used on both.
+ *
+ * This class is only available on Linux.
+ */
+class RxPacketRing {
+public:
+    /**
+     * \brief The default size of each of the ring's blocks.
+     *
+     * This is 1 MB by default.
+     */
+    static const uint32_t DEFAULT_BLOCK_SIZE;
+
+    /**
+     * \brief Constructs a RxPacketRing.
+     *
+     * This opens an AF_PACKET socket, sets up the ring and binds
+     * the socket to the given interface.
+     *
+     * \param iface The name of the interface to capture from.
+     * \param block_size The size of each block. This must be a multiple
+     * of the page size, and a power of two.
+     * \param block_count The amount of blocks in the ring.
+     * \param snap_len The maximum amount of bytes to capture of each frame.
+     * \param timeout The amount of milliseconds after which a block 
+     * which is not full is handed to userspace. This is also the 
+     * maximum amount of time RxPacketRing::dispatch will block. As with
+     * libpcap, 0 means reads block until a block is retired, in which 
+     * case the kernel picks the block timeout.
+     */
+    RxPacketRing(const std::string& iface, uint32_t block_size, 
+      uint32_t block_count, uint32_t snap_len, uint32_t timeout);
+
+    /**
+     * \brief Destructor.
+     *
+     * Unmaps the ring and closes the socket.
+     */
+    ~RxPacketRing();
+
+    /**
+     * \brief Processes the frames available in the ring.
+     *
+     * This behaves like pcap_dispatch. If no frames are available, this 
+     * waits for at most the configured timeout.
+     *
+     * \param max_packets The maximum amount of frames to process. If this
+     * is less than or equal to 0, every available frame is processed.
+     * \param handler The callback to be executed for every frame.
+     * \param user The user pointer to be provided to the callback.
+     * \return The amount of processed frames, -1 on error or -2 if 
+     * RxPacketRing::break_loop was called.
+     */
+    int dispatch(int max_packets, pcap_handler handler, u_char* user);
+
+    /**
+     * \brief Processes frames until a certain amount has been processed.
+     *
+     * This behaves like pcap_loop, so unlike RxPacketRing::dispatch
+     * this won't return when the timeout expires.
+     *
+     * \param max_packets The amount of frames to process. If this is 
+     * less than or equal to 0, frames will be processed until either an
+     * error occurs or RxPacketRing::break_loop is called.
+     * \param handler The callback to be executed for every frame.
+     * \param user The user pointer to be provided to the callback.
+     * \return 0 if max_packets frames were processed, -1 on error or -2 if
+     * RxPacketRing::break_loop was called.
+     */
+    int loop(int max_packets, pcap_handler handler, u_char* user);
+
+    /**
+     * \brief Retrieves the next frame in the ring.
+     *
+     * This behaves like pcap_next_ex. The frame is not copied, so the 
+     * returned pointers are only valid until the next call to any of 
+     * the methods that read frames. If no frames are available, this 
+     * waits for at most the configured timeout.
+     *
+     * \param header The pointer in which the frame header will be stored.
+     * \param data The pointer in which the frame data will be stored.
+     * \return 1 if a frame was read, 0 if the timeout expired, -1 on 
+     * error or -2 if RxPacketRing::break_loop was called.
+     */
+    int next(pcap_pkthdr** header, const u_char** data);
+
+    /**
+     * \brief Makes the current or next dispatch/loop call return.
+     *
+     * This can be called from another thread. A thread waiting for 
+     * frames is woken up right away.
+     */
+    void break_loop();
+
+    /**
+     * \brief Attaches a compiled BPF filter to the socket.
+     *
+     * \param program The filter to be attached.
+     * \return true iff the filter was attached successfully.
+     */
+    bool set_filter(const bpf_program& program);
+
+    /**
+     * \brief Sets the promiscuous mode on the bound interface.
+     * \param enabled Whether to enable promiscuous mode.
+     */
+    void set_promisc_mode(bool enabled);
+
+    /**
+     * \brief Retrieves the pcap DLT_* link type of the bound interface.
+     */
+    int link_type() const;
+
+    /**
+     * \brief Retrieves the socket's file descriptor.
+     */
+    int get_fd() const;
+private:
+    RxPacketRing(const RxPacketRing&);
+    RxPacketRing& operator=(const RxPacketRing&);
+
+    tpacket_block_desc* block_at(uint32_t index) const;
+    int acquire_block(bool wait);
+    const u_char* consume_frame(pcap_pkthdr& header);
+    void release_block();
+    bool take_break();
+    void cleanup();
+
+    int socket_;
+    // An eventfd used to wake up a thread blocked in poll
+    int wakeup_;
+    int link_type_;
+    int if_index_;
+    uint8_t* buffer_;
+    uint32_t block_size_, block_count_, snap_len_, timeout_;
+    uint32_t current_block_;
+    tpacket_block_desc* current_desc_;
+    tpacket3_hdr* current_frame_;
+    uint32_t frames_left_;
+    pcap_pkthdr next_header_;
+    // Accessed using atomic builtins, as break_loop can be called
+    // from another thread
+    int break_loop_;
+};
+
+/**
+ * \class TxPacketRing
+ * \brief Sends frames using a Linux AF_PACKET TPACKET_V2 memory mapped
+ * transmit ring.
+ *
+ * PDUs are serialized directly into the frames of a ring buffer which
+ * is shared with the kernel, so no intermediate buffer is used. Frames 
+ * written into the ring are not sent until TxPacketRing::flush is 
+ * called, which hands every pending frame to the kernel, usually with a
+ * single system call. 
+ *
+ * The socket is bound to the interface given on construction, so every
+ * frame is sent through it.
+ *
+ * This class is used by PacketSender when PacketSender::tx_ring is 
+ * enabled, so usually there's no need to use it directly.
+ *
+ * This class is only available on Linux.
+ */
+class TxPacketRing {
+public:
+    /**
+     * \brief The default size of each of the ring's frames.
+     *
+     * This is 2048 bytes by default, which fits a full ethernet frame.
+     */
+    static const uint32_t DEFAULT_FRAME_SIZE;
+
+    /**
+     * \brief The default amount of frames in the ring.
+     */
+    static const uint32_t DEFAULT_FRAME_COUNT;
+
+    /**
+     * \brief Constructs a TxPacketRing.
+     *
+     * This opens an AF_PACKET socket, sets up the ring and binds
+     * the socket to the given interface.
+     *
+     * \param iface The interface to send frames through.
+     * \param frame_count The amount of frames in the ring.
+     * \param frame_size The size of each frame, including the
+     * TPACKET_V2 header that precedes the data.
+     */
+    TxPacketRing(const NetworkInterface& iface, 
+      uint32_t frame_count = DEFAULT_FRAME_COUNT, 
+      uint32_t frame_size = DEFAULT_FRAME_SIZE);
+
+    /**
+     * \brief Destructor.
+     *
+     * Unmaps the ring and closes the socket. Frames which were not 
+     * flushed are discarded.
+     */
+    ~TxPacketRing();
+
+    /**
+     * \brief Serializes a PDU into the next frame of the ring.
+     *
+     * If the ring is full, the pending frames are flushed and this 
+     * waits until the kernel is done with the next frame.
+     *
+     * \param pdu The PDU to be written.
+     * \return true if the PDU was written, false if it doesn't fit in
+     * a frame.
+     * \throw socket_write_error If flushing the ring failed.
+     */
+    bool write(PDU& pdu);
+
+    /**
+     * \brief Copies an already serialized frame into the next frame of 
+     * the ring.
+     *
+     * This behaves like TxPacketRing::write(PDU&).
+     *
+     * \param data The frame's data.
+     * \param size The frame's size.
+     * \return true if the data was written, false if it doesn't fit in
+     * a frame.
+     * \throw socket_write_error If flushing the ring failed.
+     */
+    bool write(const uint8_t* data, uint32_t size);
+
+    /**
+     * \brief Sends every frame written since the last flush.
+     *
+     * This returns once the kernel has taken all of them. If the 
+     * socket's send buffer fills up, it waits until there's room for 
+     * the rest. The frames may still be in flight afterwards. 
+     * TxPacketRing::write waits for a frame to be sent before reusing 
+     * it.
+     *
+     * \throw socket_write_error If the frames could not be sent.
+     */
+    void flush();
+
+    /**
+     * \brief Retrieves the amount of frames waiting to be flushed.
+     */
+    uint32_t pending_frames() const;
+
+    /**
+     * \brief Retrieves the maximum size of a frame's data.
+     */
+    uint32_t max_frame_size() const;
+
+    /**
+     * \brief Retrieves the socket's file descriptor.
+     */
+    int get_fd() const;
+private:
+    TxPacketRing(const TxPacketRing&);
+    TxPacketRing& operator=(const TxPacketRing&);
+
+    tpacket2_hdr* frame_at(uint32_t index) const;
+    void wait_for_frame(tpacket2_hdr* frame);
+    void wait_until_writable();
+    uint8_t* next_frame_data();
+    void commit_frame(uint32_t size);
+    void cleanup();
+
+    int socket_;
+    uint8_t* buffer_;
+    uint32_t frame_size_, frame_count_;
+    uint32_t block_size_, block_count_, frames_per_block_;
+    uint32_t current_frame_, pending_frames_;
+};
+} // namespace Tins
+
+#endif // TINS_PACKET_RING_H
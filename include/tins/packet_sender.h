@@ -43,12 +43,15 @@
 #include "network_interface.h"
 #include "macros.h"
 #include "cxxstd.h"
+#include "utils.h"
+#include "pacer.h"
 
 struct timeval;
 struct sockaddr;
 
 namespace Tins {
     class PDU;
+    class TxPacketRing;
     
     /**
      * \class PacketSender
@@ -107,6 +110,35 @@ namespace Tins {
      * PacketSender also supports sending a packet and waiting for a response.
      * This can be done by using PacketSender::send_recv.
      *
+     * Sequences of packets can be sent using PacketSender::send_batch, which
+     * submits several packets on each system call when sendmmsg is 
+     * available:
+     *
+     * \code
+     * std::vector<IP> probes = ...;
+     * std::vector<uint32_t> bytes_sent;
+     *
+     * // Send them all, storing how many bytes of each packet were sent
+     * size_t sent = sender.send_batch(probes.begin(), probes.end(), 
+     *                                 sender.default_interface(), bytes_sent);
+     * \endcode
+     *
+     * The rate at which packets are sent can be limited by setting a Pacer
+     * using PacketSender::pacer. Every packet sent, including those sent 
+     * by PacketSender::send_batch, waits for its time slot. Batches only 
+     * stop to wait when a packet is not due yet, after sending the ones
+     * which already are, so packets allowed to be sent in a burst are 
+     * still submitted together:
+     *
+     * \code
+     * // At most 10000 packets per second, in bursts of up to 32 packets
+     * sender.pacer(Pacer(10000, 0, 32));
+     * sender.send_batch(probes.begin(), probes.end());
+     *
+     * // Check whether the rate was achieved
+     * double rate = sender.pacer().stats().packets_per_second();
+     * \endcode
+     *
      * This class opens sockets as it needs to, and closes them when the object
      * is destructed.
      *
@@ -134,6 +166,32 @@ namespace Tins {
             SOCKETS_END
         };
 
+        /**
+         * \brief A link layer frame which is already serialized.
+         *
+         * \sa PacketSender::send_frames
+         */
+        struct Frame {
+            /**
+             * The frame's data.
+             */
+            const uint8_t *data;
+
+            /**
+             * The frame's size.
+             */
+            uint32_t size;
+
+            /**
+             * \brief Constructs a Frame.
+             *
+             * \param data The frame's data.
+             * \param size The frame's size.
+             */
+            Frame(const uint8_t *data = 0, uint32_t size = 0) 
+            : data(data), size(size) { }
+        };
+
         /**
          * \brief Constructor for PacketSender objects.
          * 
@@ -148,7 +206,8 @@ namespace Tins {
              * \brief Move constructor.
              * \param rhs The sender to be moved.
              */
-            PacketSender(PacketSender &&rhs) TINS_NOEXCEPT {
+            PacketSender(PacketSender &&rhs) TINS_NOEXCEPT 
+            : _batch_sent(0), _batch_completed(0) {
                 *this = std::move(rhs);
             }
             
@@ -167,6 +226,11 @@ namespace Tins {
                     rhs._ether_socket = INVALID_RAW_SOCKET;
                     #endif
                 #endif
+                #ifdef HAVE_PACKET_RING
+                    _tx_rings.swap(rhs._tx_rings);
+                    _tx_ring_enabled = rhs._tx_ring_enabled;
+                #endif // HAVE_PACKET_RING
+                _pacer = rhs._pacer;
                 _types = rhs._types; // no move
                 _timeout = rhs._timeout;
                 _timeout_usec = rhs._timeout_usec;
@@ -232,6 +296,53 @@ namespace Tins {
          */
         const NetworkInterface& default_interface() const;
 
+        #ifdef HAVE_PACKET_RING
+        /**
+         * \brief Sets whether link layer PDUs are sent using a memory 
+         * mapped transmit ring.
+         *
+         * When enabled, PDUs sent through PacketSender::send_l2 are 
+         * serialized directly into the frames of a TxPacketRing, which 
+         * is created for each interface the first time a packet is sent
+         * through it. PacketSender::send flushes the ring after each 
+         * packet, while PacketSender::send_batch only does so when the 
+         * ring is full or the batch ends, so a whole batch is handed to 
+         * the kernel using a single system call. Frames which don't fit 
+         * in a ring frame are sent using the regular socket.
+         *
+         * Disabling it closes the rings that were created.
+         *
+         * This is only available on Linux.
+         *
+         * \param enabled Whether to use a transmit ring.
+         */
+        void tx_ring(bool enabled);
+
+        /**
+         * \brief Indicates whether the memory mapped transmit ring is used.
+         */
+        bool tx_ring() const;
+        #endif // HAVE_PACKET_RING
+
+        /**
+         * \brief Sets the pacer used to limit the rate at which packets 
+         * are sent.
+         *
+         * The pacer's schedule and statistics start from scratch. Setting
+         * a default constructed Pacer disables rate limiting, which is 
+         * the default.
+         *
+         * \param value The pacer to be used.
+         */
+        void pacer(const Pacer& value);
+
+        /**
+         * \brief Getter for the pacer.
+         *
+         * Its statistics can be used to check the rate achieved.
+         */
+        const Pacer& pacer() const;
+
         /** 
          * \brief Sends a PDU. 
          * 
@@ -302,6 +413,139 @@ namespace Tins {
          */
         PDU *send_recv(PDU &pdu, const NetworkInterface &iface);
 
+        /**
+         * \brief Sends all the PDUs in the range [start, end).
+         *
+         * Each element in the range is dereferenced until a PDU is found, 
+         * so the iterators can hold PDUs, pointers or smart pointers to 
+         * them. Every PDU is sent just like 
+         * PacketSender::send(PDU&, const NetworkInterface&) would, but 
+         * the packets are serialized into a buffer which is reused across
+         * calls and consecutive packets that are sent through the same 
+         * socket are submitted using a single sendmmsg call, when it's 
+         * available.
+         *
+         * Unlike PacketSender::send, a packet that can't be written does 
+         * not throw nor stop the rest of the batch from being sent. The 
+         * amount of bytes sent for each packet is stored in bytes_sent, 
+         * which will contain one element per PDU in the range. Packets 
+         * that failed to be sent have a 0 there. Errors that prevent 
+         * the packets from being sent at all, like failing to open a
+         * socket, are still thrown; the packets that were queued but 
+         * not submitted yet are discarded in that case.
+         *
+         * When PacketSender::tx_ring is enabled, link layer packets are
+         * reported as sent once they are written into the ring. Errors
+         * while flushing the rings at the end of the batch are not 
+         * reported.
+         *
+         * \param start A forward iterator pointing to the first PDU to send.
+         * \param end A forward iterator pointing to one past the last PDU.
+         * \param iface The network interface to use for link layer PDUs.
+         * \param bytes_sent The vector in which the amount of bytes sent 
+         * for each packet will be stored.
+         * \return The amount of packets that were completely sent.
+         */
+        template<typename ForwardIterator>
+        size_t send_batch(ForwardIterator start, ForwardIterator end, 
+          const NetworkInterface &iface, std::vector<uint32_t> &bytes_sent)
+        {
+            begin_batch(bytes_sent);
+            try {
+                while(start != end) 
+                    batch_send(Utils::dereference_until_pdu(*start++), iface);
+            }
+            catch(...) {
+                abort_batch();
+                throw;
+            }
+            return end_batch();
+        }
+
+        /**
+         * \brief Sends all the PDUs in the range [start, end).
+         *
+         * \sa PacketSender::send_batch
+         *
+         * \param start A forward iterator pointing to the first PDU to send.
+         * \param end A forward iterator pointing to one past the last PDU.
+         * \param iface The network interface to use for link layer PDUs.
+         * \return The amount of packets that were completely sent.
+         */
+        template<typename ForwardIterator>
+        size_t send_batch(ForwardIterator start, ForwardIterator end, 
+          const NetworkInterface &iface)
+        {
+            return send_batch(start, end, iface, _batch_results);
+        }
+
+        /**
+         * \brief Sends all the PDUs in the range [start, end) using the 
+         * default interface.
+         *
+         * \sa PacketSender::send_batch
+         *
+         * \param start A forward iterator pointing to the first PDU to send.
+         * \param end A forward iterator pointing to one past the last PDU.
+         * \return The amount of packets that were completely sent.
+         */
+        template<typename ForwardIterator>
+        size_t send_batch(ForwardIterator start, ForwardIterator end) {
+            return send_batch(start, end, default_iface, _batch_results);
+        }
+
+        #if !defined(_WIN32) || defined(HAVE_PACKET_SENDER_PCAP_SENDPACKET)
+        /**
+         * \brief Sends a link layer frame which is already serialized.
+         *
+         * The data is sent as it is through the given interface, without
+         * being parsed, so it must start with the link layer header 
+         * the interface uses. This goes through the same path as PDUs 
+         * containing a link layer protocol, so the transmit ring and the
+         * pacer are used as well.
+         *
+         * If any send error occurs, then a socket_write_error is thrown.
+         *
+         * \param data The frame's data.
+         * \param size The frame's size.
+         * \param iface The network interface to use.
+         */
+        void send_frame(const uint8_t *data, uint32_t size, const NetworkInterface &iface);
+
+        /**
+         * \brief Sends a sequence of link layer frames which are already 
+         * serialized.
+         *
+         * This is the PacketSender::send_frame counterpart of 
+         * PacketSender::send_batch. Frames are queued and submitted 
+         * using as few system calls as possible, and errors are reported
+         * through bytes_sent rather than by throwing.
+         *
+         * \param frames A pointer to the first frame.
+         * \param count The amount of frames to be sent.
+         * \param iface The network interface to use.
+         * \param bytes_sent The vector in which the amount of bytes 
+         * sent for each frame will be stored.
+         * \return The amount of frames that were completely sent.
+         */
+        size_t send_frames(const Frame *frames, size_t count, 
+          const NetworkInterface &iface, std::vector<uint32_t> &bytes_sent);
+
+        /**
+         * \brief Sends a sequence of link layer frames which are already 
+         * serialized.
+         *
+         * \sa PacketSender::send_frames
+         *
+         * \param frames A pointer to the first frame.
+         * \param count The amount of frames to be sent.
+         * \param iface The network interface to use.
+         * \return The amount of frames that were completely sent.
+         */
+        size_t send_frames(const Frame *frames, size_t count, 
+          const NetworkInterface &iface);
+        #endif // !_WIN32 || HAVE_PACKET_SENDER_PCAP_SENDPACKET
+
         #ifndef _WIN32
         /** 
          * \brief Receives a layer 2 PDU response to a previously sent PDU.
@@ -376,9 +620,19 @@ namespace Tins {
         void send_l3(PDU &pdu, struct sockaddr *link_addr, uint32_t len_addr, SocketType type);
     private:
         static const int INVALID_RAW_SOCKET;
+        static const uint32_t MAX_BATCH_MESSAGES;
 
         typedef std::map<SocketType, int> SocketTypeMap;
 
+        // A packet queued by send_batch. Its data and destination address
+        // are stored as offsets into _batch_data and _batch_addresses.
+        struct batch_message {
+            int socket;
+            uint32_t packet;
+            uint32_t data_offset, data_size;
+            uint32_t address_offset, address_size;
+        };
+
         PacketSender(const PacketSender&);
         PacketSender& operator=(const PacketSender&);
         int find_type(SocketType type);
@@ -391,6 +645,11 @@ namespace Tins {
         void send(PDU &pdu, const NetworkInterface &iface) {
             static_cast<T&>(pdu).send(*this, iface);
         }
+        #ifdef HAVE_PACKET_RING
+            TxPacketRing& get_tx_ring(const NetworkInterface& iface);
+            void flush_tx_rings();
+            void close_tx_rings();
+        #endif // HAVE_PACKET_RING
         #ifdef HAVE_PACKET_SENDER_PCAP_SENDPACKET
             pcap_t* make_pcap_handle(const NetworkInterface& iface) const;
         #endif // HAVE_PACKET_SENDER_PCAP_SENDPACKET
@@ -398,6 +657,17 @@ namespace Tins {
         PDU *recv_match_loop(const std::vector<int>& sockets, PDU &pdu, struct sockaddr* link_addr, 
             uint32_t addrlen);
 
+        void begin_batch(std::vector<uint32_t> &bytes_sent);
+        void batch_send(PDU &pdu, const NetworkInterface &iface);
+        void batch_written(uint32_t bytes);
+        uint8_t *queue_message(int sock, uint32_t size, struct sockaddr *addr, uint32_t len_addr);
+        void queue_message(int sock, PDU &pdu, struct sockaddr *addr, uint32_t len_addr);
+        void record_batch_result(const batch_message &message, uint32_t bytes);
+        void flush_batch();
+        size_t end_batch();
+        void abort_batch();
+        void pace(uint32_t size);
+
         std::vector<int> _sockets;
         #ifndef _WIN32
             #if defined(BSD) || defined(__FreeBSD_kernel__)
@@ -408,6 +678,16 @@ namespace Tins {
             #endif
         #endif
         SocketTypeMap _types;
+        // Reused by every send call, so no memory is allocated on them
+        std::vector<uint8_t> _buffer;
+        // State used while send_batch is running. _batch_sent is only
+        // non-null during that call.
+        std::vector<batch_message> _batch;
+        std::vector<uint8_t> _batch_data, _batch_addresses;
+        std::vector<uint32_t> _batch_results;
+        std::vector<uint32_t> *_batch_sent;
+        size_t _batch_completed;
+        Pacer _pacer;
         uint32_t _timeout, _timeout_usec;
         NetworkInterface default_iface;
         // In BSD we need to store the buffer size, retrieved using BIOCGBLEN
@@ -418,6 +698,11 @@ namespace Tins {
             typedef std::map<NetworkInterface, pcap_t*> PcapHandleMap; 
             PcapHandleMap pcap_handles;
         #endif // HAVE_PACKET_SENDER_PCAP_SENDPACKET
+        #ifdef HAVE_PACKET_RING
+            typedef std::map<NetworkInterface::id_type, TxPacketRing*> TxRingMap;
+            TxRingMap _tx_rings;
+            bool _tx_ring_enabled;
+        #endif // HAVE_PACKET_RING
     };
 }
 
@@ -0,0 +1,515 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef TINS_PACKET_VIEW_H
+#define TINS_PACKET_VIEW_H
+
+#include <cstring>
+#include <stdint.h>
+#include <pcap.h>
+#include "endianness.h"
+#include "small_uint.h"
+#include "hw_address.h"
+#include "ip_address.h"
+#include "ipv6_address.h"
+#include "timestamp.h"
+
+namespace Tins {
+/**
+ * \class PacketView
+ * \brief Non-owning, lazily decoded view over a captured packet.
+ *
+ * Unlike Packet, this class doesn't parse the packet into a chain of 
+ * PDUs. It only keeps a pointer to the captured buffer, and locates
+ * each of the headers the first time one of them is requested. No 
+ * memory is allocated and no data is copied, which makes it suitable
+ * for consumers which only need to read a few header fields of every 
+ * packet, such as the 5-tuple.
+ *
+ * Only Ethernet and Linux cooked capture link layers are decoded. 
+ * Up to two 802.1Q tags are skipped, the first of them being 
+ * available through PacketView::dot1q. IPv6 extension headers are
+ * skipped as well.
+ *
+ * The buffer must outlive the view. When views are delivered by 
+ * BaseSniffer::sniff_loop_view, they are only valid until the 
+ * callback returns.
+ *
+ * \code
+ * bool callback(const PacketView& view) {
+ *     if (const PacketView::TCPHeader* tcp = view.tcp()) {
+ *         std::cout << tcp->sport() << " -> " << tcp->dport() << std::endl;
+ *     }
+ *     return true;
+ * }
+ * \endcode
+ */
+class PacketView {
+public:
+    /**
+     * \cond
+     */
+    class HeaderView {
+    public:
+        HeaderView() : data_(0) { }
+
+        const uint8_t* data() const {
+            return data_;
+        }
+    protected:
+        template<typename T>
+        T read(uint32_t offset) const {
+            T value;
+            std::memcpy(&value, data_ + offset, sizeof(value));
+            return Endian::be_to_host(value);
+        }
+
+        const uint8_t* data_;
+    private:
+        friend class PacketView;
+    };
+    /**
+     * \endcond
+     */
+
+    /**
+     * \brief View over an Ethernet II header.
+     */
+    class EthernetHeader : public HeaderView {
+    public:
+        typedef HWAddress<6> address_type;
+
+        /**
+         * Getter for the destination address.
+         */
+        address_type dst_addr() const { return address_type(data_); }
+
+        /**
+         * Getter for the source address.
+         */
+        address_type src_addr() const { return address_type(data_ + 6); }
+
+        /**
+         * Getter for the payload type field.
+         */
+        uint16_t payload_type() const { return read<uint16_t>(12); }
+    };
+
+    /**
+     * \brief View over an 802.1Q tag.
+     */
+    class Dot1QHeader : public HeaderView {
+    public:
+        /**
+         * Getter for the priority field.
+         */
+        small_uint<3> priority() const { return data_[0] >> 5; }
+
+        /**
+         * Getter for the Canonical Format Identifier field.
+         */
+        small_uint<1> cfi() const { return (data_[0] >> 4) & 1; }
+
+        /**
+         * Getter for the VLAN ID field.
+         */
+        small_uint<12> id() const { return read<uint16_t>(0) & 0xfff; }
+
+        /**
+         * Getter for the payload type field.
+         */
+        uint16_t payload_type() const { return read<uint16_t>(2); }
+    };
+
+    /**
+     * \brief View over an IPv4 header.
+     */
+    class IPHeader : public HeaderView {
+    public:
+        typedef IPv4Address address_type;
+
+        /**
+         * Getter for the header length field.
+         */
+        small_uint<4> head_len() const { return data_[0] & 0x0f; }
+
+        /**
+         * Getter for the type of service field.
+         */
+        uint8_t tos() const { return data_[1]; }
+
+        /**
+         * Getter for the total length field.
+         */
+        uint16_t tot_len() const { return read<uint16_t>(2); }
+
+        /**
+         * Getter for the id field.
+         */
+        uint16_t id() const { return read<uint16_t>(4); }
+
+        /**
+         * Getter for the fragment offset field, in 8 byte units.
+         */
+        small_uint<13> fragment_offset() const { return read<uint16_t>(6) & 0x1fff; }
+
+        /**
+         * Indicates whether the more fragments flag is set.
+         */
+        bool more_fragments() const { return (data_[6] & 0x20) != 0; }
+
+        /**
+         * Getter for the time to live field.
+         */
+        uint8_t ttl() const { return data_[8]; }
+
+        /**
+         * Getter for the protocol field.
+         */
+        uint8_t protocol() const { return data_[9]; }
+
+        /**
+         * Getter for the checksum field.
+         */
+        uint16_t checksum() const { return read<uint16_t>(10); }
+
+        /**
+         * Getter for the source address.
+         */
+        address_type src_addr() const { return address_type(raw_address(12)); }
+
+        /**
+         * Getter for the destination address.
+         */
+        address_type dst_addr() const { return address_type(raw_address(16)); }
+    private:
+        uint32_t raw_address(uint32_t offset) const {
+            uint32_t value;
+            std::memcpy(&value, data_ + offset, sizeof(value));
+            return value;
+        }
+    };
+
+    /**
+     * \brief View over an IPv6 header.
+     */
+    class IPv6Header : public HeaderView {
+    public:
+        typedef IPv6Address address_type;
+
+        /**
+         * Getter for the traffic class field.
+         */
+        uint8_t traffic_class() const { return (read<uint16_t>(0) >> 4) & 0xff; }
+
+        /**
+         * Getter for the flow label field.
+         */
+        small_uint<20> flow_label() const { return read<uint32_t>(0) & 0xfffff; }
+
+        /**
+         * Getter for the payload length field.
+         */
+        uint16_t payload_length() const { return read<uint16_t>(4); }
+
+        /**
+         * Getter for the next header field.
+         *
+         * Note that this is the value stored in the fixed header, so if
+         * extension headers are present, it won't be the upper layer 
+         * protocol. Use PacketView::transport_protocol to get it.
+         */
+        uint8_t next_header() const { return data_[6]; }
+
+        /**
+         * Getter for the hop limit field.
+         */
+        uint8_t hop_limit() const { return data_[7]; }
+
+        /**
+         * Getter for the source address.
+         */
+        address_type src_addr() const { return address_type(data_ + 8); }
+
+        /**
+         * Getter for the destination address.
+         */
+        address_type dst_addr() const { return address_type(data_ + 24); }
+    };
+
+    /**
+     * \brief View over a TCP header.
+     */
+    class TCPHeader : public HeaderView {
+    public:
+        /**
+         * Getter for the source port field.
+         */
+        uint16_t sport() const { return read<uint16_t>(0); }
+
+        /**
+         * Getter for the destination port field.
+         */
+        uint16_t dport() const { return read<uint16_t>(2); }
+
+        /**
+         * Getter for the sequence number field.
+         */
+        uint32_t seq() const { return read<uint32_t>(4); }
+
+        /**
+         * Getter for the acknowledge number field.
+         */
+        uint32_t ack_seq() const { return read<uint32_t>(8); }
+
+        /**
+         * Getter for the data offset field.
+         */
+        small_uint<4> data_offset() const { return data_[12] >> 4; }
+
+        /**
+         * \brief Getter for the flags field.
+         *
+         * The returned value can be compared against TCP::Flags values.
+         */
+        small_uint<12> flags() const { return read<uint16_t>(12) & 0xfff; }
+
+        /**
+         * Getter for the window field.
+         */
+        uint16_t window() const { return read<uint16_t>(14); }
+
+        /**
+         * Getter for the checksum field.
+         */
+        uint16_t checksum() const { return read<uint16_t>(16); }
+
+        /**
+         * Getter for the urgent pointer field.
+         */
+        uint16_t urg_ptr() const { return read<uint16_t>(18); }
+    };
+
+    /**
+     * \brief View over a UDP header.
+     */
+    class UDPHeader : public HeaderView {
+    public:
+        /**
+         * Getter for the source port field.
+         */
+        uint16_t sport() const { return read<uint16_t>(0); }
+
+        /**
+         * Getter for the destination port field.
+         */
+        uint16_t dport() const { return read<uint16_t>(2); }
+
+        /**
+         * Getter for the length field.
+         */
+        uint16_t length() const { return read<uint16_t>(4); }
+
+        /**
+         * Getter for the checksum field.
+         */
+        uint16_t checksum() const { return read<uint16_t>(6); }
+    };
+
+    /**
+     * \brief View over an ICMP header.
+     */
+    class ICMPHeader : public HeaderView {
+    public:
+        /**
+         * Getter for the type field.
+         */
+        uint8_t type() const { return data_[0]; }
+
+        /**
+         * Getter for the code field.
+         */
+        uint8_t code() const { return data_[1]; }
+
+        /**
+         * Getter for the checksum field.
+         */
+        uint16_t checksum() const { return read<uint16_t>(2); }
+
+        /**
+         * Getter for the echo id field.
+         */
+        uint16_t id() const { return read<uint16_t>(4); }
+
+        /**
+         * Getter for the echo sequence field.
+         */
+        uint16_t sequence() const { return read<uint16_t>(6); }
+    };
+
+    /**
+     * \brief Constructs a PacketView.
+     *
+     * \param buffer The buffer which contains the packet.
+     * \param total_sz The size of the buffer.
+     * \param link_type The pcap DLT_* link type of the packet. Only 
+     * DLT_EN10MB and DLT_LINUX_SLL are decoded.
+     * \param ts The packet's timestamp.
+     */
+    PacketView(const uint8_t* buffer = 0, uint32_t total_sz = 0, int link_type = DLT_EN10MB,
+      const Timestamp& ts = Timestamp());
+
+    /**
+     * Returns the packet's buffer.
+     */
+    const uint8_t* buffer() const {
+        return buffer_;
+    }
+
+    /**
+     * Returns the packet's captured size.
+     */
+    uint32_t size() const {
+        return size_;
+    }
+
+    /**
+     * Returns the packet's timestamp.
+     */
+    const Timestamp& timestamp() const {
+        return ts_;
+    }
+
+    /**
+     * \brief Returns the Ethernet II header, or a null pointer if the 
+     * packet doesn't contain one.
+     */
+    const EthernetHeader* ethernet() const;
+
+    /**
+     * \brief Returns the outermost 802.1Q tag, or a null pointer if the 
+     * packet doesn't contain one.
+     */
+    const Dot1QHeader* dot1q() const;
+
+    /**
+     * \brief Returns the IPv4 header, or a null pointer if the 
+     * packet doesn't contain one.
+     */
+    const IPHeader* ip() const;
+
+    /**
+     * \brief Returns the IPv6 header, or a null pointer if the 
+     * packet doesn't contain one.
+     */
+    const IPv6Header* ipv6() const;
+
+    /**
+     * \brief Returns the TCP header, or a null pointer if the 
+     * packet doesn't contain one.
+     */
+    const TCPHeader* tcp() const;
+
+    /**
+     * \brief Returns the UDP header, or a null pointer if the 
+     * packet doesn't contain one.
+     */
+    const UDPHeader* udp() const;
+
+    /**
+     * \brief Returns the ICMP header, or a null pointer if the 
+     * packet doesn't contain one.
+     */
+    const ICMPHeader* icmp() const;
+
+    /**
+     * \brief Returns the upper layer protocol number carried by the 
+     * network layer.
+     *
+     * For IPv6 packets, this is the value found after skipping all
+     * of the extension headers. If there's no network layer, 0xff 
+     * is returned.
+     */
+    uint8_t transport_protocol() const;
+
+    /**
+     * \brief Returns the offset of the payload from the beginning of 
+     * the buffer.
+     *
+     * The payload starts after the transport layer header. If the 
+     * transport layer is unknown or the packet is a non-initial 
+     * fragment, it starts after the network layer header instead.
+     */
+    uint32_t payload_offset() const;
+
+    /**
+     * \brief Returns the payload's size.
+     *
+     * The network layer length fields are used, so Ethernet trailers
+     * are not considered part of the payload.
+     */
+    uint32_t payload_size() const;
+
+    /**
+     * \brief Returns a pointer to the payload.
+     */
+    const uint8_t* payload() const {
+        return buffer_ + payload_offset();
+    }
+private:
+    enum decode_level {
+        NOTHING,
+        LINK,
+        NETWORK,
+        TRANSPORT
+    };
+
+    void decode_link() const;
+    void decode_network() const;
+    void decode_transport() const;
+
+    const uint8_t* buffer_;
+    uint32_t size_;
+    int link_type_;
+    Timestamp ts_;
+    mutable decode_level level_;
+    mutable EthernetHeader ethernet_;
+    mutable Dot1QHeader dot1q_;
+    mutable IPHeader ip_;
+    mutable IPv6Header ipv6_;
+    mutable TCPHeader tcp_;
+    mutable UDPHeader udp_;
+    mutable ICMPHeader icmp_;
+    mutable uint32_t network_offset_, network_end_, transport_offset_, payload_offset_;
+    mutable uint16_t network_type_;
+    mutable uint8_t transport_protocol_;
+};
+} // namespace Tins
+
+#endif // TINS_PACKET_VIEW_H
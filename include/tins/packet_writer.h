@@ -31,6 +31,7 @@
 #define TINS_PACKET_WRITER_H
 
 #include <string>
+#include <vector>
 #include <iterator>
 #include <pcap.h>
 #include "data_link_type.h"
@@ -218,6 +219,7 @@ private:
 
     pcap_t *handle;
     pcap_dumper_t *dumper; 
+    std::vector<uint8_t> buffer;
 };
 }
 
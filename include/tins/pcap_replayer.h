@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "config.h"
+
+#if !defined(TINS_PCAP_REPLAYER_H) && (!defined(_WIN32) || defined(HAVE_PACKET_SENDER_PCAP_SENDPACKET))
+#define TINS_PCAP_REPLAYER_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "packet_sender.h"
+#include "pacer.h"
+#include "cxxstd.h"
+#if TINS_IS_CXX11
+    #include <atomic>
+#endif // TINS_IS_CXX11
+
+namespace Tins {
+class NetworkInterface;
+
+/**
+ * \class PcapReplayer
+ * \brief Sends the frames stored in a pcap file through an interface.
+ *
+ * The whole file is loaded into a contiguous memory cache on 
+ * construction. Frames are never parsed into PDUs: their data is sent 
+ * as it was captured using PacketSender::send_frames, so frames which 
+ * are due at the same time are submitted using a single system call, 
+ * and PacketSender::tx_ring can be used as well. Only the captured 
+ * portion of each frame is sent, so truncated frames are sent truncated.
+ *
+ * The capture's link layer must be the one used by the interface the 
+ * frames are sent through. PcapReplayer::link_type can be used to check
+ * it.
+ *
+ * Frames can be sent following the capture's timestamps, scaled by a
+ * speed multiplier, or as fast as possible. The capture can also be 
+ * replayed several times, or until PcapReplayer::stop is called:
+ *
+ * \code
+ * PcapReplayer replayer("capture.pcap");
+ * // Twice as fast as it was captured, 10 times
+ * replayer.speed(2);
+ * replayer.loops(10);
+ *
+ * PacketSender sender;
+ * PcapReplayer::Stats stats = replayer.replay(sender, "eth0");
+ * std::cout << stats.packets_per_second() << std::endl;
+ * \endcode
+ *
+ * When replaying at top speed, a Pacer set on the PacketSender can be 
+ * used to send the capture at a given rate instead.
+ */
+class PcapReplayer {
+public:
+    /**
+     * \brief Statistics about a replay.
+     */
+    struct Stats {
+        /**
+         * The amount of frames which were completely sent.
+         */
+        uint64_t packets;
+
+        /**
+         * The amount of bytes sent.
+         */
+        uint64_t bytes;
+
+        /**
+         * The amount of frames which could not be sent.
+         */
+        uint64_t failed;
+
+        /**
+         * The amount of times the whole capture was replayed.
+         */
+        uint32_t loops;
+
+        /**
+         * The largest delay between the time at which a frame should 
+         * have been sent and the moment it was sent, in nanoseconds. 
+         * This is always 0 when replaying at top speed.
+         */
+        uint64_t max_lag;
+
+        /**
+         * The time the replay took, in nanoseconds.
+         */
+        uint64_t elapsed;
+
+        /**
+         * Default constructs a Stats, setting every field to 0.
+         */
+        Stats();
+
+        /**
+         * \brief Returns the achieved rate, in packets per second.
+         */
+        double packets_per_second() const;
+
+        /**
+         * \brief Returns the achieved rate, in bits per second.
+         */
+        double bits_per_second() const;
+    };
+
+    /**
+     * \brief Constructs a PcapReplayer, loading the given file.
+     *
+     * \param file_name The pcap file to be loaded.
+     * \throw std::runtime_error If the file can't be opened or read.
+     */
+    PcapReplayer(const std::string& file_name);
+
+    /**
+     * \brief Retrieves the amount of frames in the capture.
+     */
+    size_t frame_count() const;
+
+    /**
+     * \brief Retrieves the amount of bytes used by the cached frames.
+     */
+    size_t cache_size() const;
+
+    /**
+     * \brief Retrieves the time between the first and last frames of 
+     * the capture, in nanoseconds.
+     */
+    uint64_t duration() const;
+
+    /**
+     * \brief Retrieves the capture's link layer type.
+     *
+     * This is one of the DLT_* values defined by libpcap.
+     */
+    int link_type() const;
+
+    /**
+     * \brief Sets the speed multiplier.
+     *
+     * A value of 1 sends the frames with the same spacing they were 
+     * captured with, 2 sends them twice as fast, and so on. A value of
+     * 0 sends them as fast as possible, which is the default.
+     *
+     * \param multiplier The speed multiplier.
+     */
+    void speed(double multiplier);
+
+    /**
+     * \brief Getter for the speed multiplier.
+     */
+    double speed() const;
+
+    /**
+     * \brief Sets the amount of times the capture is replayed.
+     *
+     * A value of 0 replays it until PcapReplayer::stop is called. The 
+     * default is 1.
+     *
+     * \param count The amount of times the capture is replayed.
+     */
+    void loops(uint32_t count);
+
+    /**
+     * \brief Getter for the amount of times the capture is replayed.
+     */
+    uint32_t loops() const;
+
+    /**
+     * \brief Sets the way in which frames wait for their time.
+     *
+     * Busy waiting provides a much more accurate spacing when the
+     * gaps between frames are small, at the cost of using a whole CPU.
+     * The default is Pacer::SLEEP.
+     *
+     * \param mode The wait mode.
+     */
+    void wait_mode(Pacer::WaitMode mode);
+
+    /**
+     * \brief Getter for the wait mode.
+     */
+    Pacer::WaitMode wait_mode() const;
+
+    /**
+     * \brief Replays the capture.
+     *
+     * This returns once every loop has been replayed or 
+     * PcapReplayer::stop has been called. Errors that prevent frames 
+     * from being sent at all, like failing to open a socket, are 
+     * thrown.
+     *
+     * \param sender The sender used to send the frames.
+     * \param iface The interface to send the frames through.
+     * \return The replay's statistics.
+     */
+    Stats replay(PacketSender& sender, const NetworkInterface& iface);
+
+    /**
+     * \brief Replays the capture through the sender's default interface.
+     *
+     * \sa PcapReplayer::replay
+     *
+     * \param sender The sender used to send the frames.
+     * \return The replay's statistics.
+     */
+    Stats replay(PacketSender& sender);
+
+    /**
+     * \brief Stops a replay.
+     *
+     * This can be called from another thread. The replay stops after 
+     * the frames being sent at the moment.
+     */
+    void stop();
+private:
+    static const size_t MAX_BATCH_FRAMES;
+
+    // The frames point into cache_, so copies would share it
+    PcapReplayer(const PcapReplayer&);
+    PcapReplayer& operator=(const PcapReplayer&);
+
+    uint64_t scheduled_time(size_t index) const;
+    void set_stopped(bool value);
+    bool stopped() const;
+
+    std::vector<uint8_t> cache_;
+    std::vector<PacketSender::Frame> frames_;
+    // Time of each frame relative to the first one, in nanoseconds
+    std::vector<uint64_t> times_;
+    std::vector<uint32_t> results_;
+    int link_type_;
+    double speed_;
+    uint32_t loops_;
+    Pacer::WaitMode wait_mode_;
+    // Set by stop, which can be called from another thread
+    #if TINS_IS_CXX11
+    std::atomic<bool> stop_;
+    #else
+    // Accessed using atomic builtins
+    int stop_;
+    #endif // TINS_IS_CXX11
+};
+} // Tins
+
+#endif // TINS_PCAP_REPLAYER_H
@@ -33,6 +33,7 @@
 
 #include <stdint.h>
 #include <vector>
+#include <new>
 #include "macros.h"
 #include "cxxstd.h"
 #include "exceptions.h"
@@ -221,6 +222,62 @@ namespace Tins {
          */
         virtual ~PDU();
 
+        /**
+         * \brief Allocates memory for a PDU.
+         *
+         * If a PDUArena is active on the current thread, the PDU is
+         * allocated from it. Otherwise, it's allocated on the heap. In
+         * both cases, the PDU is preceded by a 16 byte header used to 
+         * find out where it was allocated when it's deleted.
+         *
+         * \sa PDUArena
+         */
+        static void* operator new(size_t size);
+
+        /**
+         * \brief Allocates memory for a PDU, returning 0 on failure.
+         *
+         * \sa PDU::operator new(size_t)
+         */
+        static void* operator new(size_t size, const std::nothrow_t&) throw();
+
+        /**
+         * \brief Placement new, constructs a PDU on the given buffer.
+         *
+         * PDUs constructed this way must be destroyed by explicitly 
+         * calling their destructor rather than using delete. Note that
+         * their inner PDUs are still allocated using 
+         * PDU::operator new(size_t).
+         */
+        static void* operator new(size_t, void* ptr) throw() {
+            return ptr;
+        }
+
+        /**
+         * \brief Frees the memory used by a PDU.
+         *
+         * This can be called from any thread, regardless of the one that
+         * allocated the PDU.
+         */
+        static void operator delete(void* ptr);
+
+        /**
+         * \brief Frees the memory used by a PDU.
+         *
+         * \sa PDU::operator delete(void*)
+         */
+        static void operator delete(void* ptr, size_t);
+
+        /**
+         * \brief Frees the memory allocated by the nothrow operator new.
+         */
+        static void operator delete(void* ptr, const std::nothrow_t&) throw();
+
+        /**
+         * \brief Matches placement new, does nothing.
+         */
+        static void operator delete(void*, void*) throw() { }
+
         /** \brief The header's size
          */
         virtual uint32_t header_size() const = 0;
@@ -289,6 +346,31 @@ namespace Tins {
          */
         serialization_type serialize();
 
+        /**
+         * \brief Serializes the whole chain of PDU's into the given 
+         * vector.
+         *
+         * The vector is resized to size() and then filled with the 
+         * serialization of this PDU and all of the inner ones'. Since the 
+         * vector's capacity is kept, reusing the same vector across 
+         * calls avoids allocating memory each time.
+         *
+         * \param buffer The vector in which to store the serialization.
+         */
+        void serialize(serialization_type &buffer);
+
+        /**
+         * \brief Serializes the whole chain of PDU's into the given
+         * buffer.
+         *
+         * \param buffer The buffer in which to store the serialization.
+         * \param total_sz The size of the buffer.
+         * \return The amount of bytes written, which is the same as 
+         * size().
+         * \throw serialization_error If the buffer is smaller than size().
+         */
+        uint32_t serialize_into(uint8_t *buffer, size_t total_sz);
+
         /**
          * \brief Finds and returns the first PDU that matches the given flag.
          *
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef TINS_PDU_ARENA_H
+#define TINS_PDU_ARENA_H
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace Tins {
+/**
+ * \class PDUArena
+ * \brief Block based allocator used to store the PDUs created while 
+ * parsing packets.
+ *
+ * By default, every PDU in a chain is allocated separately on the heap.
+ * While a PDUArena::Scope is alive, every PDU allocated on the calling 
+ * thread (this includes the ones created by the parsing constructors and
+ * every inner PDU they create) is instead carved out of the blocks owned 
+ * by the arena in that scope. This turns each allocation into a pointer
+ * bump, and makes the PDUs in a chain contiguous in memory.
+ *
+ * Each block keeps track of the amount of PDUs living in it. Deleting an
+ * arena allocated PDU only decrements that counter, and once a block 
+ * holds no more PDUs it is rewound and reused as a whole. This means
+ * the usual parse, process and destroy cycle performed for each packet 
+ * (or each batch of packets) never returns memory to the heap.
+ *
+ * The ownership semantics of PDUs are not affected by the arena. PDUs 
+ * are still destroyed using operator delete, and PDUs that are kept 
+ * after the scope has ended (for example, by using 
+ * PDU::release_inner_pdu) remain valid. A block which still contains
+ * PDUs when the arena is destroyed is freed once the last of them is 
+ * deleted.
+ *
+ * \code
+ * PDUArena arena;
+ * while(...) {
+ *     PDUArena::Scope scope(arena);
+ *     // This chain is allocated from the arena
+ *     EthernetII eth(buffer, size);
+ *     ...
+ * }
+ * \endcode
+ *
+ * An arena must only be used, through a Scope, by one thread at a time.
+ * PDUs allocated from it can however be deleted on any thread, which 
+ * is what happens when packets are handed over to worker threads. The
+ * object counters are updated atomically, and the memory is handed back
+ * to the arena once a block holds no more PDUs.
+ *
+ * Every PDU, whether it's allocated from an arena or from the heap, is
+ * preceded by a 16 byte header which points to the block it lives on.
+ *
+ * \sa BaseSniffer::set_pdu_arena
+ */
+class PDUArena {
+public:
+    /**
+     * \brief The default size of each of the arena's blocks.
+     *
+     * This is 64 KB by default.
+     */
+    static const size_t DEFAULT_BLOCK_SIZE;
+
+    /**
+     * \class Scope
+     * \brief Makes an arena the one used to allocate PDUs on the 
+     * current thread.
+     *
+     * The previously active arena, if any, is restored when the scope
+     * object is destroyed.
+     */
+    class Scope {
+    public:
+        /**
+         * \brief Activates the given arena.
+         *
+         * \param arena The arena to be used.
+         */
+        Scope(PDUArena& arena);
+
+        /**
+         * \brief Activates the given arena, if any.
+         *
+         * If the pointer is null, the currently active arena is left
+         * untouched.
+         *
+         * \param arena A pointer to the arena to be used. Might be 0.
+         */
+        Scope(PDUArena* arena);
+
+        /**
+         * \brief Restores the previously active arena.
+         */
+        ~Scope();
+    private:
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+
+        void activate(PDUArena* arena);
+
+        PDUArena* previous_;
+        bool active_;
+    };
+
+    /**
+     * \brief Constructs a PDUArena.
+     *
+     * No memory is allocated until the first PDU is created inside a
+     * scope that uses this arena.
+     *
+     * \param block_size The size of each block.
+     */
+    PDUArena(size_t block_size = DEFAULT_BLOCK_SIZE);
+
+    /**
+     * \brief Destructor.
+     *
+     * Frees every block that contains no PDUs. The rest of them are
+     * freed once the last PDU they contain is deleted.
+     */
+    ~PDUArena();
+
+    /**
+     * \brief Getter for the size of each block.
+     */
+    size_t block_size() const { return block_size_; }
+
+    /**
+     * \brief Getter for the amount of blocks currently allocated.
+     *
+     * This includes the blocks that are currently empty and ready to 
+     * be reused.
+     */
+    size_t block_count() const { return block_count_; }
+
+    /**
+     * \brief Returns the arena that is active on the current thread.
+     *
+     * \return The active arena, or 0 if PDUs are allocated on the heap.
+     */
+    static PDUArena* current();
+
+    /**
+     * \brief Allocates memory for a PDU.
+     *
+     * This is used by PDU's operator new. The memory is taken from the
+     * current arena, if any, or from the heap otherwise.
+     *
+     * \param size The size of the object to be allocated.
+     */
+    static void* allocate(size_t size);
+
+    /**
+     * \brief Deallocates memory allocated using PDUArena::allocate.
+     *
+     * This is used by PDU's operator delete.
+     *
+     * \param ptr The pointer to the memory to be freed. Might be 0.
+     */
+    static void deallocate(void* ptr);
+    /**
+     * \cond
+     */
+    struct block;
+    /**
+     * \endcond
+     */
+private:
+    PDUArena(const PDUArena&);
+    PDUArena& operator=(const PDUArena&);
+
+    void* allocate_object(size_t size);
+    block* allocate_block(size_t capacity);
+    void retire_block(block* blk);
+    static void release_reference(block* blk);
+    static void free_block(block* blk);
+
+    block* current_block_;
+    block* free_blocks_;
+    block* retired_blocks_;
+    size_t block_size_;
+    size_t block_count_;
+};
+}
+
+#endif // TINS_PDU_ARENA_H
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "config.h"
+
+#if !defined(TINS_PROBE_ENGINE_H) && defined(HAVE_PROBE_ENGINE)
+#define TINS_PROBE_ENGINE_H
+
+#include <vector>
+#include <stdint.h>
+#include "macros.h"
+
+namespace Tins {
+class PDU;
+class PacketSender;
+class NetworkInterface;
+
+/**
+ * \cond
+ */
+namespace Internals {
+// Identifies a probe and its responses. Keys are always stored in the 
+// direction of the probe, so a response's key has its addresses and 
+// ports swapped.
+struct probe_key {
+    probe_key();
+
+    uint32_t hash() const;
+    bool operator==(const probe_key& rhs) const;
+
+    uint16_t ether_type;
+    uint8_t protocol;
+    // The ICMP/ICMPv6 request type, 0 for other protocols
+    uint8_t type;
+    // The ports, or the ICMP identifier and sequence number
+    uint16_t src_id, dst_id;
+    uint8_t src_addr[16], dst_addr[16];
+};
+
+// Builds the key of a probe that has already been sent. Returns false 
+// if responses to this probe can't be identified using a key.
+bool make_probe_key(PDU& probe, probe_key& key);
+
+// Builds the key of the probe the given network layer packet responds
+// to. This handles direct responses as well as ICMP/ICMPv6 errors that
+// contain the probe. Returns false if the packet can't be a response.
+bool make_response_key(uint16_t ether_type, const uint8_t* data, 
+  uint32_t size, probe_key& key);
+} // namespace Internals
+/**
+ * \endcond
+ */
+
+/**
+ * \class ProbeEngine
+ * \brief Sends probes and matches their responses asynchronously.
+ *
+ * Unlike PacketSender::send_recv, which sends a single packet and then 
+ * blocks until its response arrives, this class allows keeping any 
+ * amount of probes outstanding at the same time. Every probe is sent 
+ * using a PacketSender and gets an identifier. Packets are received 
+ * through an AF_PACKET socket that is polled using epoll, and every 
+ * response is matched to its probe through a hash table indexed by 
+ * protocol, addresses and ports, or ICMP identifier and sequence 
+ * number. ICMP and ICMPv6 errors that carry the probe that triggered
+ * them are also matched to it.
+ *
+ * Probes which can't be indexed this way, like those which are not
+ * TCP, UDP, ICMP echo/timestamp/address mask, ICMPv6 echo or ARP 
+ * requests, are matched by calling PDU::matches_response on every 
+ * packet received.
+ *
+ * The outcome of each probe is delivered to a callback once its 
+ * response is received or its timeout expires:
+ *
+ * \code
+ * PacketSender sender;
+ * ProbeEngine engine(sender);
+ * for (uint16_t port = 1; port < 1024; ++port) {
+ *     IP probe = IP("192.168.0.1") / TCP(port, 1337);
+ *     probe.rfind_pdu<TCP>().set_flag(TCP::SYN, 1);
+ *     engine.send(probe);
+ * }
+ * engine.run([](const ProbeEngine::Result& result) {
+ *     if (!result.timed_out()) {
+ *         // result.response holds the IP packet received
+ *     }
+ * });
+ * \endcode
+ *
+ * Responses are provided starting at their network layer, which is 
+ * either IP, IPv6 or ARP.
+ *
+ * This class is only available on Linux.
+ */
+class ProbeEngine {
+public:
+    /**
+     * The default amount of milliseconds to wait for a response.
+     */
+    static const uint32_t DEFAULT_TIMEOUT;
+
+    /**
+     * \brief The outcome of a probe.
+     */
+    struct Result {
+        /**
+         * The identifier returned by ProbeEngine::send for this probe.
+         */
+        uint32_t probe_id;
+
+        /**
+         * The response, starting at its network layer. This is null
+         * if the probe timed out. It's only valid during the callback.
+         */
+        PDU* response;
+
+        /**
+         * The amount of microseconds between the probe being sent and
+         * its response being received or its timeout expiring.
+         */
+        uint32_t elapsed;
+
+        /**
+         * \brief Indicates whether the probe timed out.
+         */
+        bool timed_out() const {
+            return response == 0;
+        }
+    };
+
+    /**
+     * \brief Constructs a ProbeEngine.
+     *
+     * This opens the socket used to receive responses, which requires 
+     * the same privileges as sending packets.
+     *
+     * \param sender The PacketSender used to send probes.
+     * \param timeout The amount of milliseconds to wait for each 
+     * probe's response.
+     */
+    ProbeEngine(PacketSender& sender, uint32_t timeout = DEFAULT_TIMEOUT);
+
+    /**
+     * \brief Destructor.
+     *
+     * Outstanding probes are discarded without invoking any callback.
+     */
+    ~ProbeEngine();
+
+    /**
+     * \brief Sends a probe.
+     *
+     * The probe is sent using PacketSender::send(PDU&). It's not stored,
+     * so it can be modified or destroyed as soon as this returns.
+     *
+     * Every few probes, the packets received so far are processed so
+     * they don't overflow the socket's buffer. The probes completed by
+     * them are delivered on the next call to dispatch or run.
+     *
+     * \param probe The probe to be sent.
+     * \return The identifier of this probe, provided in its Result.
+     */
+    uint32_t send(PDU& probe);
+
+    /**
+     * \brief Sends a probe through an interface.
+     *
+     * The probe is sent using 
+     * PacketSender::send(PDU&, const NetworkInterface&).
+     *
+     * \param probe The probe to be sent.
+     * \param iface The interface to use if the probe contains a link
+     * layer PDU.
+     * \return The identifier of this probe, provided in its Result.
+     */
+    uint32_t send(PDU& probe, const NetworkInterface& iface);
+
+    /**
+     * \brief Waits for responses and timeouts and delivers them.
+     *
+     * This waits until at least one probe has completed, either because
+     * its response was received or because it timed out, or until wait
+     * milliseconds have passed. Every probe that has completed is then
+     * provided to the callback, which must accept a const Result&. 
+     *
+     * The callback can send new probes, but it must not call dispatch 
+     * or run.
+     *
+     * \param callback The callback to be executed for each completed 
+     * probe.
+     * \param wait The maximum amount of milliseconds to wait for. If
+     * this is negative, this waits until a probe completes.
+     * \return The amount of completed probes. This is 0 if the wait 
+     * time expired, or if there are no outstanding probes.
+     */
+    template<typename Functor>
+    size_t dispatch(Functor callback, int wait = -1) {
+        return deliver(callback, wait);
+    }
+
+    /**
+     * \brief Delivers results until there are no outstanding probes.
+     *
+     * \sa ProbeEngine::dispatch
+     * \param callback The callback to be executed for each completed
+     * probe.
+     */
+    template<typename Functor>
+    void run(Functor callback) {
+        while (outstanding() > 0) {
+            deliver(callback, -1);
+        }
+    }
+
+    /**
+     * \brief Retrieves the amount of probes whose result has not been 
+     * delivered yet.
+     */
+    size_t outstanding() const;
+
+    /**
+     * \brief Retrieves the timeout, in milliseconds.
+     */
+    uint32_t timeout() const;
+
+    /**
+     * \brief Retrieves the epoll file descriptor.
+     *
+     * This becomes readable when packets are received, so it can be 
+     * added to other event loops.
+     */
+    int get_fd() const;
+private:
+    // Values stored in the probe table's index fields are index + 1,
+    // so 0 means "none"
+    struct probe_entry {
+        Internals::probe_key key;
+        uint64_t sent_at;
+        // Probes without a key keep a copy, which is used to call
+        // matches_response
+        PDU* fallback;
+        PDU* fallback_match;
+        uint32_t id;
+        uint32_t bucket_next;
+        uint32_t prev, next;
+    };
+
+    ProbeEngine(const ProbeEngine&);
+    ProbeEngine& operator=(const ProbeEngine&);
+
+    uint32_t add_probe(PDU& probe);
+    uint32_t allocate_entry();
+    void insert_keyed(uint32_t index);
+    uint32_t find(const Internals::probe_key& key) const;
+    void remove(uint32_t index);
+    void rehash(size_t bucket_count);
+    size_t collect(int wait);
+    void read_packets();
+    void process_packet(uint16_t ether_type, const uint8_t* data, uint32_t size);
+    void complete(uint32_t index, uint16_t ether_type, const uint8_t* data, 
+      uint32_t size);
+    void expire(uint64_t now);
+    static void release_results(std::vector<Result>& results);
+    void cleanup();
+
+    template<typename Functor>
+    size_t deliver(Functor& callback, int wait) {
+        const size_t count = collect(wait);
+        // Probes sent by the callback can add results, so the ones being
+        // delivered are moved out of the way
+        delivering_.swap(results_);
+        try {
+            for (size_t i = 0; i < count; ++i) {
+                callback(static_cast<const Result&>(delivering_[i]));
+            }
+        }
+        catch (...) {
+            release_results(delivering_);
+            throw;
+        }
+        release_results(delivering_);
+        return count;
+    }
+
+    PacketSender* sender_;
+    int socket_, epoll_fd_;
+    uint32_t timeout_;
+    uint32_t next_id_;
+    std::vector<probe_entry> entries_;
+    std::vector<uint32_t> buckets_;
+    std::vector<uint32_t> fallback_;
+    std::vector<Result> results_, delivering_;
+    std::vector<uint8_t> buffer_;
+    uint32_t free_, head_, tail_;
+    size_t size_;
+};
+} // namespace Tins
+
+#endif // TINS_PROBE_ENGINE_H
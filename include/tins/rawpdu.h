@@ -36,6 +36,10 @@
 #include "cxxstd.h"
 
 namespace Tins {
+    class BorrowedPayloads;
+    namespace Internals {
+        class incremental_checksum;
+    }
 
     /**
      * \class PDU
@@ -59,6 +63,14 @@ namespace Tins {
      * // don't look like DNS
      * DNS dns = raw.to<DNS>();
      * \endcode
+     *
+     * RawPDUs constructed from a buffer while a BorrowedPayloads::Scope
+     * is active don't copy their payload. Instead, they reference the 
+     * buffer they were constructed from, and only make a copy of it 
+     * when the payload is requested through RawPDU::payload or when the
+     * BorrowedPayloads object that tracks them is released. 
+     * RawPDU::payload_data and RawPDU::payload_size can be used to access
+     * the payload without copying it.
      */
     class RawPDU : public PDU {
     public:
@@ -76,7 +88,10 @@ namespace Tins {
          * \brief Creates an instance of RawPDU.
          *
          * The payload is copied, therefore the original payload's memory
-         * must be freed by the user.
+         * must be freed by the user. 
+         *
+         * If a BorrowedPayloads::Scope is active on the current thread, 
+         * the payload is referenced rather than copied. 
          * \param pload The payload which the RawPDU will contain.
          * \param size The size of the payload.
          */
@@ -93,7 +108,9 @@ namespace Tins {
          */
         template<typename ForwardIterator>
         RawPDU(ForwardIterator start, ForwardIterator end)
-        : _payload(start, end) { }
+        : _payload(start, end), _borrowed(0), _borrowed_size(0), _borrower(0),
+          _prev_borrowed(0), _next_borrowed(0), _payload_sum(0), 
+          _has_payload_sum(false) { }
 
         #if TINS_IS_CXX11
             /**
@@ -104,7 +121,9 @@ namespace Tins {
              * \param data The payload to use.
              */
             RawPDU(payload_type&& data)
-            : _payload(move(data)) { }
+            : _payload(move(data)), _borrowed(0), _borrowed_size(0), 
+              _borrower(0), _prev_borrowed(0), _next_borrowed(0), 
+              _payload_sum(0), _has_payload_sum(false) { }
         #endif // TINS_IS_CXX11
 
         /**
@@ -114,6 +133,25 @@ namespace Tins {
          */
         RawPDU(const std::string &data);
 
+        /**
+         * \brief Copy constructor.
+         *
+         * The constructed object always owns its payload.
+         */
+        RawPDU(const RawPDU &other);
+
+        /**
+         * \brief Copy assignment operator.
+         *
+         * This object will always own its payload.
+         */
+        RawPDU &operator=(const RawPDU &other);
+
+        /**
+         * \brief Destructor.
+         */
+        ~RawPDU();
+
         /**
          * \brief Setter for the payload field
          * \param pload The payload to be set.
@@ -127,20 +165,59 @@ namespace Tins {
          */
         template<typename ForwardIterator>
         void payload(ForwardIterator start, ForwardIterator end) {
+            stop_borrowing();
+            _has_payload_sum = false;
             _payload.assign(start, end);
         }
 
         /**
          * \brief Const getter for the payload.
+         *
+         * If the payload is borrowed, it is copied before returning it.
+         *
          * \return The RawPDU's payload.
          */
-        const payload_type &payload() const { return _payload; }
+        const payload_type &payload() const { 
+            own_payload();
+            return _payload; 
+        }
 
         /**
          * \brief Non-const getter for the payload.
+         *
+         * If the payload is borrowed, it is copied before returning it.
+         *
          * \return The RawPDU's payload.
          */
-        payload_type &payload() { return _payload; }
+        payload_type &payload() { 
+            own_payload();
+            _has_payload_sum = false;
+            return _payload; 
+        }
+
+        /**
+         * \brief Getter for a pointer to the payload.
+         *
+         * Unlike RawPDU::payload, this never copies a borrowed payload. 
+         * The returned pointer is only valid until this PDU is modified
+         * or destroyed, or until the payload is copied.
+         *
+         * \return A pointer to the payload. Might be 0 if the payload 
+         * is empty.
+         */
+        const uint8_t *payload_data() const {
+            if(_borrowed)
+                return _borrowed;
+            return _payload.empty() ? 0 : &_payload[0];
+        }
+
+        /**
+         * \brief Indicates whether this PDU references a buffer it
+         * doesn't own.
+         */
+        bool borrows_payload() const { 
+            return _borrowed != 0; 
+        }
 
         /**
          * \brief Returns the header size.
@@ -157,6 +234,8 @@ namespace Tins {
          * \return uint32_t containing the payload size.
          */
         uint32_t payload_size() const {
+            if(_borrowed)
+                return _borrowed_size;
             return static_cast<uint32_t>(_payload.size());
         }
 
@@ -184,7 +263,7 @@ namespace Tins {
          */
         template<typename T>
         T to() const {
-            return T(&_payload[0], static_cast<uint32_t>(_payload.size()));
+            return T(payload_data(), payload_size());
         }
 
         /**
@@ -194,9 +273,207 @@ namespace Tins {
             return new RawPDU(*this);
         }
     private:
+        friend class BorrowedPayloads;
+        friend class Internals::incremental_checksum;
+
         void write_serialization(uint8_t *buffer, uint32_t total_sz, const PDU *parent);
+        void own_payload() const {
+            if(_borrowed)
+                copy_borrowed();
+        }
+        void copy_borrowed() const;
+        void stop_borrowing() const;
+
+        mutable payload_type _payload;
+        mutable const uint8_t *_borrowed;
+        mutable uint32_t _borrowed_size;
+        mutable BorrowedPayloads *_borrower;
+        mutable const RawPDU *_prev_borrowed, *_next_borrowed;
+        // The sum of the payload, derived from the checksum found in the
+        // packet it was parsed from. Only valid while it's left untouched
+        uint16_t _payload_sum;
+        bool _has_payload_sum;
+    };
+
+    /**
+     * \class BorrowedPayloads
+     * \brief Tracks the RawPDUs that reference a buffer they don't own.
+     *
+     * While a BorrowedPayloads::Scope is active on a thread, the RawPDUs
+     * constructed from a buffer on that thread, such as the payloads 
+     * created by the transport layer parsers, don't copy it. They 
+     * reference it instead and are tracked by the BorrowedPayloads 
+     * object used in that scope.
+     *
+     * Once the buffer is about to be reused or freed, 
+     * BorrowedPayloads::release must be called. This makes every RawPDU 
+     * that is still alive and references it copy its payload, so PDUs 
+     * that outlive the buffer remain valid.
+     *
+     * \code
+     * BorrowedPayloads borrowed;
+     * {
+     *     BorrowedPayloads::Scope scope(borrowed);
+     *     // The TCP payload is not copied
+     *     EthernetII eth(buffer, size);
+     *     ...
+     * }
+     * // Copy the payloads that are still alive before the buffer is reused
+     * borrowed.release();
+     * \endcode
+     *
+     * This class is not thread safe. The RawPDUs that reference a buffer
+     * must be destroyed or copied on the thread that created them.
+     *
+     * \sa BaseSniffer::set_borrow_payloads
+     */
+    class BorrowedPayloads {
+    public:
+        /**
+         * \class Scope
+         * \brief Makes RawPDUs constructed on the current thread borrow
+         * their payload.
+         *
+         * The previously active BorrowedPayloads object, if any, is 
+         * restored when the scope object is destroyed.
+         */
+        class Scope {
+        public:
+            /**
+             * \brief Activates the given BorrowedPayloads object.
+             *
+             * \param borrowed The object that will track the RawPDUs.
+             */
+            Scope(BorrowedPayloads &borrowed);
 
-        payload_type _payload;
+            /**
+             * \brief Restores the previously active object.
+             */
+            ~Scope();
+        private:
+            Scope(const Scope&);
+            Scope &operator=(const Scope&);
+
+            BorrowedPayloads *previous_;
+        };
+
+        /**
+         * \brief Default constructor.
+         */
+        BorrowedPayloads();
+
+        /**
+         * \brief Destructor.
+         *
+         * This calls BorrowedPayloads::release.
+         */
+        ~BorrowedPayloads();
+
+        /**
+         * \brief Makes every tracked RawPDU copy its payload.
+         *
+         * After this call, no RawPDU references the borrowed buffers.
+         */
+        void release();
+
+        /**
+         * \brief Returns the amount of RawPDUs that are still borrowing
+         * their payload.
+         */
+        size_t size() const { return size_; }
+
+        /**
+         * \brief Returns the object active on the current thread.
+         *
+         * \return The active object, or 0 if RawPDUs copy their payload.
+         */
+        static BorrowedPayloads *current();
+    private:
+        friend class RawPDU;
+
+        BorrowedPayloads(const BorrowedPayloads&);
+        BorrowedPayloads &operator=(const BorrowedPayloads&);
+
+        void add(const RawPDU *pdu);
+        void remove(const RawPDU *pdu);
+
+        const RawPDU *head_;
+        size_t size_;
+    };
+
+    /**
+     * \class TrustedChecksums
+     * \brief Makes parsed TCP, UDP and ICMP PDUs reuse the checksum found
+     * in the packet.
+     *
+     * When a TCP, UDP or ICMP PDU is serialized, its checksum is computed
+     * by summing its header and its whole payload. While a 
+     * TrustedChecksums::Scope is active on a thread, the TCP, UDP and 
+     * ICMP PDUs parsed on that thread instead derive the sum of their 
+     * payload from the checksum found in the buffer, and store it in the
+     * RawPDU that holds it. As long as that RawPDU isn't modified, the 
+     * checksum is then updated incrementally (RFC 1624) on serialization,
+     * which only requires summing the new header. 
+     *
+     * This makes rewriting the headers of captured packets and sending 
+     * them much cheaper. However, the parsed checksums are not verified, 
+     * since that would require summing the payload. A packet that had an
+     * invalid checksum will therefore still have an invalid one after 
+     * being modified. Only use this on packets whose checksums are known
+     * to be valid, or when keeping invalid ones is acceptable.
+     *
+     * The parsed checksum is never used for UDP datagrams without a 
+     * checksum, IPv4 packets with a total length of 0 (as seen when using 
+     * TCP segmentation offload), packets that use IPv4 source routing or 
+     * an IPv6 routing header, nor fragmented packets.
+     *
+     * \code
+     * {
+     *     TrustedChecksums::Scope scope;
+     *     EthernetII eth(buffer, size);
+     *     eth.rfind_pdu<IP>().src_addr("10.0.0.1");
+     *     // Only the IP and TCP headers are summed
+     *     sender.send(eth);
+     * }
+     * \endcode
+     *
+     * \sa BaseSniffer::set_trust_checksums
+     */
+    class TrustedChecksums {
+    public:
+        /**
+         * \class Scope
+         * \brief Makes the PDUs parsed on the current thread trust their
+         * checksums.
+         *
+         * The previous setting is restored when the scope object is 
+         * destroyed.
+         */
+        class Scope {
+        public:
+            /**
+             * \brief Enables or disables trusting parsed checksums.
+             *
+             * \param enabled Whether to trust parsed checksums.
+             */
+            Scope(bool enabled = true);
+
+            /**
+             * \brief Restores the previous setting.
+             */
+            ~Scope();
+        private:
+            Scope(const Scope&);
+            Scope &operator=(const Scope&);
+
+            bool previous_;
+        };
+
+        /**
+         * \brief Indicates whether PDUs parsed on the current thread trust
+         * their checksums.
+         */
+        static bool enabled();
     };
 }
 
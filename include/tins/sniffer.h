@@ -36,9 +36,12 @@
 #include <string>
 #include <memory>
 #include <stdexcept>
+#include <exception>
 #include <iterator>
+#include <vector>
 #include "pdu.h"
 #include "packet.h"
+#include "packet_view.h"
 #include "cxxstd.h"
 #include "exceptions.h"
 #include "internals.h"
@@ -46,6 +49,9 @@
 namespace Tins {
     class SnifferIterator;
     class SnifferConfiguration;
+    class RxPacketRing;
+    class PDUArena;
+    class BorrowedPayloads;
 
     /**
      * \class BaseSniffer
@@ -64,13 +70,21 @@ namespace Tins {
          */
         typedef SnifferIterator iterator;
 
+        /**
+         * \brief The default batch size used by BaseSniffer::sniff_loop_batch.
+         *
+         * This is 64 by default.
+         */
+        static const uint32_t DEFAULT_BATCH_SIZE;
+
         #if TINS_IS_CXX11
             /**
              * \brief Move constructor.
              * This constructor is available only in C++11.
              */
             BaseSniffer(BaseSniffer &&rhs) TINS_NOEXCEPT
-            : handle(nullptr), mask()
+            : handle(nullptr), mask(), extract_raw(false), handler(nullptr), ring(nullptr), arena(nullptr),
+              borrowed(nullptr), trust_checksums(false)
             {
                 *this = std::move(rhs);
             }
@@ -84,6 +98,12 @@ namespace Tins {
                 using std::swap;
                 swap(handle, rhs.handle);
                 swap(mask, rhs.mask);
+                swap(extract_raw, rhs.extract_raw);
+                swap(handler, rhs.handler);
+                swap(ring, rhs.ring);
+                swap(arena, rhs.arena);
+                swap(borrowed, rhs.borrowed);
+                swap(trust_checksums, rhs.trust_checksums);
                 return *this;
             }
         #endif
@@ -129,6 +149,46 @@ namespace Tins {
          */
         PtrPacket next_packet();
 
+        /**
+         * \brief Captures up to max_packets packets using a single
+         * pcap_dispatch call.
+         *
+         * This method blocks until at least one valid packet is captured,
+         * and then appends every packet that was read in the same pcap
+         * dispatch round, up to max_packets, at the end of the provided
+         * vector. Malformed packets are skipped, the same way
+         * BaseSniffer::next_packet does.
+         *
+         * Reading packets in batches amortizes the libpcap dispatch
+         * overhead over several packets, which makes a noticeable
+         * difference when reading from high speed interfaces or large
+         * pcap files.
+         *
+         * The Packet objects appended to the vector own their PDUs.
+         *
+         * \param packets The vector in which the packets will be stored.
+         * \param max_packets The maximum amount of packets to read. This
+         * must be greater than 0.
+         * \return The amount of packets appended. If this is 0, then either
+         * an error occured, the end of the pcap file was reached or
+         * BaseSniffer::stop_sniff was called.
+         */
+        size_t next_packets(std::vector<Packet>& packets, uint32_t max_packets);
+
+        /**
+         * \brief Captures one packet and makes a PacketView point to it.
+         *
+         * The packet is neither parsed nor copied. The view points 
+         * directly into the capture buffer, so it's only valid until
+         * the next packet is read from this sniffer.
+         *
+         * \param view The view which will point to the captured packet.
+         * \return true if a packet was captured. If this is false, then 
+         * either an error occured, the end of the pcap file was reached 
+         * or BaseSniffer::stop_sniff was called.
+         */
+        bool next_packet_view(PacketView& view);
+
         /**
          * \brief Starts a sniffing loop, using a callback functor for every
          * sniffed packet.
@@ -184,6 +244,61 @@ namespace Tins {
         template<class Functor>
         void sniff_loop(Functor function, uint32_t max_packets = 0);
 
+        /**
+         * \brief Starts a sniffing loop which provides PacketView objects
+         * to the callback.
+         *
+         * The functor must implement an operator with one of the
+         * following signatures:
+         *
+         * \code
+         * bool(PacketView&);
+         * bool(const PacketView&);
+         * \endcode
+         *
+         * Packets are not decoded into PDUs and no memory is allocated 
+         * per packet. The view provided to the functor is only valid 
+         * until it returns.
+         *
+         * Other than that, this method behaves like BaseSniffer::sniff_loop.
+         *
+         * \sa PacketView
+         *
+         * \param function The callback handler object which should process packets.
+         * \param max_packets The maximum amount of packets to sniff. 0 == infinite.
+         */
+        template<class Functor>
+        void sniff_loop_view(Functor function, uint32_t max_packets = 0);
+
+        /**
+         * \brief Starts a sniffing loop which reads packets in batches.
+         *
+         * This method behaves exactly like BaseSniffer::sniff_loop, 
+         * except that up to batch_size packets are taken out of the pcap
+         * handle on every libpcap dispatch call. The functor is still 
+         * called once per packet, and the same signatures are accepted.
+         *
+         * On C++11, each packet is parsed and handed to the functor from
+         * within the dispatch callback, then destroyed, so batching only
+         * saves the dispatch calls. Exceptions thrown by the functor are
+         * caught there and rethrown once the dispatch call returns. On 
+         * C++03, where that's not possible, the batch is read using 
+         * BaseSniffer::next_packets first.
+         *
+         * Note that if the functor returns false, any packets left in
+         * the current batch are discarded.
+         *
+         * \sa BaseSniffer::sniff_loop
+         *
+         * \param function The callback handler object which should process packets.
+         * \param batch_size The maximum amount of packets to read on each
+         * dispatch call.
+         * \param max_packets The maximum amount of packets to sniff. 0 == infinite.
+         */
+        template<class Functor>
+        void sniff_loop_batch(Functor function, uint32_t batch_size = DEFAULT_BATCH_SIZE,
+          uint32_t max_packets = 0);
+
         /**
          * \brief Sets a filter on this sniffer.
          * \param filter The filter to be set.
@@ -228,6 +343,66 @@ namespace Tins {
          */
         void set_extract_raw_pdus(bool value);
 
+        /**
+         * \brief Sets whether to allocate the parsed PDUs from an arena.
+         *
+         * If this option is enabled, the PDUs created by 
+         * BaseSniffer::next_packet, BaseSniffer::next_packets and every
+         * sniff loop that uses them are allocated from a PDUArena owned
+         * by this sniffer. Since the memory used by each packet is reused
+         * once the packet is destroyed, this avoids allocating memory from
+         * the heap when processing packets one (or one batch) at a time.
+         *
+         * Packets that are kept can still be used as usual, even after
+         * the sniffer is destroyed, and they can be handed over to and
+         * destroyed on other threads.
+         * 
+         * This option is disabled by default.
+         *
+         * \param enabled Whether to use an arena or not.
+         */
+        void set_pdu_arena(bool enabled);
+
+        /**
+         * \brief Sets whether packet payloads reference the capture 
+         * buffer.
+         *
+         * If this option is enabled, the RawPDUs created by 
+         * BaseSniffer::next_packet, and therefore by 
+         * BaseSniffer::sniff_loop, reference the capture buffer instead
+         * of copying the payload. See BorrowedPayloads for more 
+         * information.
+         *
+         * Every payload that is still alive when the next packet is read
+         * is copied, so packets can still be kept as usual. However, the
+         * packets taken from this sniffer must be destroyed on the thread
+         * that reads them.
+         *
+         * This option is disabled by default. It does not affect
+         * BaseSniffer::next_packets.
+         *
+         * \param enabled Whether to borrow payloads or not.
+         */
+        void set_borrow_payloads(bool enabled);
+
+        /**
+         * \brief Sets whether the checksums of the packets read are 
+         * trusted.
+         *
+         * If this option is enabled, the packets created by this sniffer
+         * are parsed using a TrustedChecksums::Scope. This makes 
+         * modifying the headers of the captured packets and sending them
+         * cheaper, since the checksums found in them are updated 
+         * incrementally rather than summing the payloads again. However,
+         * invalid checksums won't be fixed. See TrustedChecksums for more
+         * information.
+         *
+         * This option is disabled by default.
+         *
+         * \param enabled Whether to trust the parsed checksums or not.
+         */
+        void set_trust_checksums(bool enabled);
+
         /**
          * \brief Retrieves this sniffer's link type.
          *
@@ -266,13 +441,79 @@ namespace Tins {
         void set_if_mask(bpf_u_int32 if_mask);
 
         bpf_u_int32 get_if_mask() const;
+
+        void set_packet_ring(RxPacketRing* packet_ring);
+
+        RxPacketRing* get_packet_ring();
     private:
         BaseSniffer(const BaseSniffer&);
         BaseSniffer &operator=(const BaseSniffer&);
 
+        pcap_handler get_handler();
+
+        int read_loop(int max_packets, pcap_handler link_handler, u_char* user);
+
+        int read_dispatch(int max_packets, pcap_handler link_handler, u_char* user);
+
+        int read_next(pcap_pkthdr** header, const u_char** data);
+
+        static void sniff_batch_handler(u_char *user, const struct pcap_pkthdr *h, 
+          const u_char *bytes);
+
+        #if TINS_IS_CXX11
+        typedef bool (*packet_callback)(Packet& packet, void* user);
+
+        // Reads up to max_packets packets with a single dispatch call and
+        // hands each of them to the callback, until it returns false. 
+        // Returns false if no more packets can be read or the callback
+        // asked to stop.
+        bool dispatch_packets(uint32_t max_packets, packet_callback callback, 
+          void* user);
+
+        static void sniff_callback_handler(u_char *user, const struct pcap_pkthdr *h, 
+          const u_char *bytes);
+
+        template<typename Functor>
+        struct batch_loop_state {
+            batch_loop_state(Functor& function, uint32_t max_packets) 
+            : function(function), max_packets(max_packets) { }
+
+            static bool callback(Packet& packet, void* user) {
+                batch_loop_state& state = *static_cast<batch_loop_state*>(user);
+                try {
+                    // If the functor returns false, we're done
+                    #if !defined(_MSC_VER)
+                    if (!Tins::Internals::invoke_loop_cb(state.function, packet))
+                        return false;
+                    #else
+                    if(!state.function(*packet.pdu()))
+                        return false;
+                    #endif
+                }
+                catch(malformed_packet&) { }
+                catch(pdu_not_found&) { }
+                catch(...) {
+                    // This can't go through libpcap
+                    state.error = std::current_exception();
+                    return false;
+                }
+                return !state.max_packets || --state.max_packets != 0;
+            }
+
+            Functor& function;
+            uint32_t max_packets;
+            std::exception_ptr error;
+        };
+        #endif // TINS_IS_CXX11
+
         pcap_t *handle;
         bpf_u_int32 mask;
         bool extract_raw;
+        pcap_handler handler;
+        RxPacketRing *ring;
+        PDUArena *arena;
+        BorrowedPayloads *borrowed;
+        bool trust_checksums;
     };
 
     /**
@@ -467,6 +708,9 @@ namespace Tins {
         }
     private:
         void advance() {
+            // Destroy the current packet first, so its resources can
+            // be reused by the next one.
+            delete pkt.release_pdu();
             pkt = sniffer->next_packet();
             if(!pkt)
                 sniffer = 0;
@@ -571,6 +815,27 @@ namespace Tins {
          * \param enabled The immediate mode option value.
          */
         void set_immediate_mode(bool enabled);
+
+        #ifdef HAVE_PACKET_RING
+        /**
+         * \brief Sets the packet ring option.
+         *
+         * When enabled, Sniffer objects capture packets using an 
+         * AF_PACKET TPACKET_V3 memory mapped ring instead of a libpcap 
+         * handle. See RxPacketRing for more information.
+         *
+         * The ring is made of RxPacketRing::DEFAULT_BLOCK_SIZE sized 
+         * blocks. The buffer size option, if set, determines the total
+         * size of the ring. Otherwise, 4 blocks are used. The timeout
+         * option is used as the block retire timeout. The rfmon option
+         * is ignored when using a packet ring.
+         *
+         * This option is only available on Linux.
+         *
+         * \param enabled The packet ring option value.
+         */
+        void set_packet_ring(bool enabled);
+        #endif // HAVE_PACKET_RING
     protected:
         friend class Sniffer;
         friend class FileSniffer;
@@ -580,7 +845,8 @@ namespace Tins {
             PROMISCUOUS = 2,
             RFMON = 4,
             PACKET_FILTER = 8,
-            IMMEDIATE_MODE = 16
+            IMMEDIATE_MODE = 16,
+            PACKET_RING = 32
         };
 
         void configure_sniffer_pre_activation(Sniffer& sniffer) const;
@@ -588,6 +854,10 @@ namespace Tins {
 
         void configure_sniffer_post_activation(Sniffer& sniffer) const;
 
+        #ifdef HAVE_PACKET_RING
+        void configure_packet_ring(Sniffer& sniffer, const std::string& device) const;
+        #endif // HAVE_PACKET_RING
+
         uint32_t _flags;
         unsigned _snap_len;
         unsigned _buffer_size;
@@ -617,6 +887,64 @@ namespace Tins {
                 return;
         }
     }
+
+    template<class Functor>
+    void Tins::BaseSniffer::sniff_loop_view(Functor function, uint32_t max_packets) {
+        PacketView view;
+        while(next_packet_view(view)) {
+            try {
+                // If the functor returns false, we're done
+                if(!function(view))
+                    return;
+            }
+            catch(malformed_packet&) { }
+            catch(pdu_not_found&) { }
+            if(max_packets && --max_packets == 0)
+                return;
+        }
+    }
+
+    template<class Functor>
+    void Tins::BaseSniffer::sniff_loop_batch(Functor function, uint32_t batch_size, 
+      uint32_t max_packets) 
+    {
+        #if TINS_IS_CXX11
+        batch_loop_state<Functor> state(function, max_packets);
+        while(true) {
+            uint32_t to_read = batch_size;
+            if(max_packets && state.max_packets < to_read)
+                to_read = state.max_packets;
+            const bool keep_reading = dispatch_packets(
+                to_read, &batch_loop_state<Functor>::callback, &state
+            );
+            if(state.error)
+                std::rethrow_exception(state.error);
+            if(!keep_reading)
+                return;
+        }
+        #else
+        std::vector<Packet> packets;
+        while(true) {
+            packets.clear();
+            uint32_t to_read = batch_size;
+            if(max_packets && max_packets < to_read)
+                to_read = max_packets;
+            if(next_packets(packets, to_read) == 0)
+                return;
+            for(size_t i = 0; i < packets.size(); ++i) {
+                try {
+                    // If the functor returns false, we're done
+                    if(!function(*packets[i].pdu()))
+                        return;
+                }
+                catch(malformed_packet&) { }
+                catch(pdu_not_found&) { }
+                if(max_packets && --max_packets == 0)
+                    return;
+            }
+        }
+        #endif // TINS_IS_CXX11
+    }
 }
 
 #endif // TINS_SNIFFER_H
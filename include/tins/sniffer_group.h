@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "config.h"
+
+#if !defined(TINS_SNIFFER_GROUP_H) && defined(HAVE_PACKET_FANOUT)
+#define TINS_SNIFFER_GROUP_H
+
+#include <string>
+#include <vector>
+#include "sniffer.h"
+#include "cxxstd.h"
+#if TINS_IS_CXX11
+    #include <thread>
+    #include <mutex>
+    #include <exception>
+#endif // TINS_IS_CXX11
+
+namespace Tins {
+/**
+ * \class SnifferGroup
+ * \brief Sniffs from an interface using several sniffers which share
+ * the load.
+ *
+ * This class creates several Sniffer objects on the same interface
+ * and makes them join the same AF_PACKET fanout group. The kernel 
+ * then distributes the captured packets among them using the 
+ * configured fanout mode. Using SnifferGroup::HASH guarantees that 
+ * all of the packets that belong to the same flow will be captured
+ * by the same sniffer.
+ *
+ * SnifferGroup::sniff_loop runs each sniffer on its own thread:
+ *
+ * \code
+ * SnifferConfiguration config;
+ * config.set_promisc_mode(true);
+ * SnifferGroup group("eth0", 4, SnifferGroup::HASH, config);
+ * // The functor will be called concurrently from 4 different threads
+ * group.sniff_loop(callback);
+ * \endcode
+ *
+ * This class is only available on Linux.
+ */
+class SnifferGroup {
+public:
+    /**
+     * The modes used to distribute packets among the sniffers.
+     */
+    enum fanout_mode {
+        HASH,
+        CPU,
+        ROUND_ROBIN
+    };
+
+    /**
+     * \brief Constructs a SnifferGroup.
+     *
+     * Fanout group identifiers are shared among all of the processes in
+     * the same network namespace. If group_id is 0, an identifier which
+     * no other group is using is allocated by the kernel. On kernels 
+     * older than 4.4, which can't do that, an identifier unique within 
+     * this process is used instead.
+     *
+     * \param device The device which will be sniffed.
+     * \param size The amount of sniffers to create.
+     * \param mode The mode used to distribute packets.
+     * \param configuration The configuration used on each sniffer.
+     * \param group_id The fanout group identifier.
+     * \param defragment Whether the kernel should reassemble IP fragments
+     * before distributing them, so that all of the fragments of a 
+     * datagram are captured by the same sniffer. Note that the sniffers 
+     * will then see reassembled datagrams rather than the fragments.
+     */
+    SnifferGroup(const std::string& device, size_t size, fanout_mode mode,
+      const SnifferConfiguration& configuration = SnifferConfiguration(),
+      uint16_t group_id = 0, bool defragment = false);
+
+    /**
+     * \brief Destructor.
+     *
+     * Closes all of the sniffers.
+     */
+    ~SnifferGroup();
+
+    /**
+     * \brief Retrieves the amount of sniffers in this group.
+     */
+    size_t size() const {
+        return sniffers_.size();
+    }
+
+    /**
+     * \brief Retrieves the fanout group identifier.
+     */
+    uint16_t group_id() const {
+        return group_id_;
+    }
+
+    /**
+     * \brief Retrieves the sniffer at the given index.
+     * \param index The index of the sniffer.
+     */
+    Sniffer& operator[](size_t index) {
+        return *sniffers_[index];
+    }
+
+    /**
+     * \brief Stops every sniffer in this group.
+     *
+     * This can be used to stop SnifferGroup::sniff_loop from another
+     * thread. Sniffers that don't use a packet ring only notice it once
+     * their read timeout expires.
+     *
+     * \sa BaseSniffer::stop_sniff
+     */
+    void stop_sniff();
+
+    #if TINS_IS_CXX11
+    /**
+     * \brief Runs a sniffing loop on each sniffer, each of them on 
+     * a different thread.
+     *
+     * Each thread uses its own copy of the provided functor, which is
+     * used just like on BaseSniffer::sniff_loop. Note that unless the 
+     * functor is a proxy to some other object, you should take care of
+     * synchronizing any state shared between threads. 
+     *
+     * As soon as any of the loops ends, because the functor returned 
+     * false, max_packets packets were processed or an exception was 
+     * thrown, every other sniffer that is still running is stopped 
+     * using BaseSniffer::stop_sniff. This method returns once all of the 
+     * loops have finished. If any of them threw an exception, it will 
+     * be rethrown after all of the threads have been joined.
+     *
+     * This method is only available in C++11 mode.
+     *
+     * \param function The callback handler object which should process packets.
+     * \param max_packets The maximum amount of packets each sniffer 
+     * should process. 0 == infinite.
+     */
+    template<typename Functor>
+    void sniff_loop(Functor function, uint32_t max_packets = 0) {
+        std::vector<std::thread> threads;
+        std::exception_ptr error;
+        std::vector<bool> running(sniffers_.size(), true);
+        bool stopping = false;
+        std::mutex state_mutex;
+        for (size_t i = 0; i < sniffers_.size(); ++i) {
+            Sniffer* sniffer = sniffers_[i];
+            threads.push_back(std::thread([=, &error, &running, &stopping, 
+                                           &state_mutex]() {
+                std::exception_ptr current;
+                try {
+                    sniffer->sniff_loop(function, max_packets);
+                }
+                catch (...) {
+                    current = std::current_exception();
+                }
+                std::lock_guard<std::mutex> _(state_mutex);
+                if (current && !error) {
+                    error = current;
+                }
+                running[i] = false;
+                // Otherwise, the other threads would never be joined. 
+                // Sniffers which already returned are not stopped, as 
+                // the break would be kept until their next loop.
+                if (!stopping) {
+                    stopping = true;
+                    for (size_t j = 0; j < sniffers_.size(); ++j) {
+                        if (running[j]) {
+                            sniffers_[j]->stop_sniff();
+                        }
+                    }
+                }
+            }));
+        }
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    #endif // TINS_IS_CXX11
+private:
+    SnifferGroup(const SnifferGroup&);
+    SnifferGroup& operator=(const SnifferGroup&);
+
+    void join_fanout_group(Sniffer& sniffer);
+    void cleanup();
+
+    std::vector<Sniffer*> sniffers_;
+    uint16_t group_id_;
+    int fanout_type_;
+};
+} // namespace Tins
+
+#endif // TINS_SNIFFER_GROUP_H
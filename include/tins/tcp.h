@@ -42,6 +42,7 @@
 #include "small_uint.h"
 #include "pdu_option.h"
 #include "cxxstd.h"
+#include "internals.h"
 
 namespace Tins {
     /**
@@ -51,7 +52,12 @@ namespace Tins {
      * This class represents a TCP PDU.
      *
      * When sending TCP PDUs, the checksum is calculated automatically
-     * every time you send the packet.
+     * every time you send the packet. If the PDU was parsed while 
+     * checksums were trusted, and its payload is still the RawPDU 
+     * created while parsing it, which hasn't been modified, the checksum
+     * found in the buffer is updated incrementally (RFC 1624) instead, 
+     * so the payload doesn't have to be summed again. See 
+     * TrustedChecksums for more information.
      *
      * While sniffing, the payload sent in each packet will be wrapped
      * in a RawPDU, which is set as the TCP object's inner_pdu. Therefore,
@@ -576,6 +582,8 @@ namespace Tins {
             return opt->to<T>();
         }
 
+        friend class Internals::incremental_checksum;
+
         void internal_add_option(const option &option);
         void write_serialization(uint8_t *buffer, uint32_t total_sz, const PDU *parent);
         void checksum(uint16_t new_check);
@@ -588,6 +596,7 @@ namespace Tins {
         tcphdr _tcp;
         uint16_t _options_size, _total_options_size;
         options_type _options;
+        Internals::incremental_checksum _checksum_state;
     };
 } // Tins
 
@@ -35,16 +35,261 @@
 #include <iterator>
 #include <vector>
 #include <algorithm>
+#include <cstring>
 #include <stdint.h>
 #include "sniffer.h"
 #include "tcp.h"
 #include "utils.h"
 #include "ip.h"
 #include "ip_address.h"
+#include "ipv6.h"
+#include "ipv6_address.h"
+#include "packet.h"
+#include "timestamp.h"
+#include "exceptions.h"
 
 namespace Tins {
 class Sniffer;
 class RawPDU;
+class TCPStream;
+class TCPStreamFollowerGroup;
+
+/**
+ * \cond
+ */
+namespace Internals {
+// Identifies a TCP session regardless of the direction a segment 
+// travels in. The endpoints are stored in a canonical order.
+struct tcp_session_key {
+    tcp_session_key() : addr_a(0), addr_b(0), port_a(0), port_b(0) { }
+
+    tcp_session_key(IPv4Address src_addr, uint16_t sport, 
+      IPv4Address dst_addr, uint16_t dport);
+
+    bool operator==(const tcp_session_key &rhs) const {
+        return addr_a == rhs.addr_a && addr_b == rhs.addr_b &&
+               port_a == rhs.port_a && port_b == rhs.port_b;
+    }
+
+    uint32_t hash() const;
+
+    uint32_t addr_a, addr_b;
+    uint16_t port_a, port_b;
+};
+
+// The same as tcp_session_key, for sessions over IPv6. These are kept
+// in a separate table, so the IPv4 keys don't grow.
+struct tcp_session_key_v6 {
+    tcp_session_key_v6();
+
+    tcp_session_key_v6(const IPv6Address &src_addr, uint16_t sport, 
+      const IPv6Address &dst_addr, uint16_t dport);
+
+    bool operator==(const tcp_session_key_v6 &rhs) const {
+        return port_a == rhs.port_a && port_b == rhs.port_b &&
+               std::memcmp(addr_a, rhs.addr_a, sizeof(addr_a)) == 0 &&
+               std::memcmp(addr_b, rhs.addr_b, sizeof(addr_b)) == 0;
+    }
+
+    uint32_t hash() const;
+
+    uint8_t addr_a[IPv6Address::address_size], addr_b[IPv6Address::address_size];
+    uint16_t port_a, port_b;
+};
+
+// An open addressing hash table which owns the TCPStreams stored in it
+// and keeps them sorted by the time they were last seen. Sessions are 
+// referred to by their index, which remains valid until they're removed.
+//
+// It's only instantiated for tcp_session_key and tcp_session_key_v6.
+template<typename Key>
+class tcp_session_table {
+public:
+    typedef Key key_type;
+
+    static const uint32_t npos = static_cast<uint32_t>(-1);
+
+    tcp_session_table();
+    tcp_session_table(const tcp_session_table &rhs);
+    tcp_session_table &operator=(const tcp_session_table &rhs);
+    ~tcp_session_table();
+
+    uint32_t find(const key_type &key) const;
+    uint32_t insert(const key_type &key, TCPStream *stream, uint64_t now);
+    // Marks the session as the most recently seen one
+    void touch(uint32_t index, uint64_t now);
+    // Removes the session and returns the stream, which must be freed
+    TCPStream *remove(uint32_t index);
+    void clear();
+
+    // The session that was seen the longest ago, or npos
+    uint32_t oldest() const {
+        return lru_tail_;
+    }
+
+    TCPStream &stream(uint32_t index) {
+        return *nodes_[index].stream;
+    }
+
+    uint64_t last_seen(uint32_t index) const {
+        return nodes_[index].last_seen;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    // The session that was seen right after the given one, or npos
+    uint32_t newer(uint32_t index) const {
+        return nodes_[index].prev;
+    }
+private:
+    struct node {
+        key_type key;
+        TCPStream *stream;
+        uint64_t last_seen;
+        uint32_t hash;
+        // Neighbours in the LRU list. next is also used to link free nodes
+        uint32_t prev, next;
+    };
+
+    void unlink(uint32_t index);
+    void push_front(uint32_t index);
+    void rehash(size_t slot_count);
+    void place(uint32_t index);
+
+    std::vector<node> nodes_;
+    // Each slot holds a node index + 1, or 0 if it's empty
+    std::vector<uint32_t> slots_;
+    uint32_t free_head_, lru_head_, lru_tail_;
+    size_t size_;
+};
+
+inline const Timestamp *packet_timestamp(const Packet &packet) {
+    return &packet.timestamp();
+}
+
+template<typename T>
+const Timestamp *packet_timestamp(const T &) {
+    return 0;
+}
+
+inline PDU &stream_pdu(Packet &packet) {
+    if(!packet.pdu())
+        throw pdu_not_found();
+    return *packet.pdu();
+}
+
+template<typename T>
+PDU &stream_pdu(T &value) {
+    return Utils::dereference_until_pdu(value);
+}
+
+// Memory shared by the out of order buffers of every stream in a 
+// TCPStreamFollower.
+struct tcp_buffer_budget {
+    tcp_buffer_budget() : used(0), limit(0), skipped_bytes(0) { }
+
+    size_t used, limit;
+    uint64_t skipped_bytes;
+};
+
+// Receives the data that becomes available in order, when it's not
+// meant to be kept in a stream buffer's payload.
+class tcp_data_sink {
+public:
+    virtual ~tcp_data_sink() { }
+    virtual void data(const uint8_t *data, size_t size) = 0;
+};
+
+// Reassembles one direction of a TCP stream.
+//
+// Data that arrives in order is appended to the payload directly. Data 
+// that arrives ahead of it is written into a ring buffer, at its offset
+// from the next expected sequence number, and the ranges that were 
+// written are kept in a sorted interval list. Once the first hole is 
+// filled, the data in front of the ring is moved to the payload. 
+//
+// The ring never grows past the window limit, nor past the budget. If
+// a segment doesn't fit, the first hole is skipped, since the data 
+// that's missing is unlikely to show up.
+//
+// If a sink is set, the data that becomes available in order is handed
+// to it rather than appended to the payload. Segments that arrive in 
+// order are then never copied.
+class tcp_stream_buffer {
+public:
+    typedef std::vector<uint8_t> payload_type;
+
+    tcp_stream_buffer();
+    // Copies aren't accounted in any budget
+    tcp_stream_buffer(const tcp_stream_buffer &rhs);
+    tcp_stream_buffer &operator=(const tcp_stream_buffer &rhs);
+    ~tcp_stream_buffer();
+
+    void limits(size_t window_limit, tcp_buffer_budget *budget);
+
+    void sink(tcp_data_sink *value) {
+        sink_ = value;
+    }
+
+    uint32_t next_seq() const {
+        return next_seq_;
+    }
+
+    void next_seq(uint32_t seq) {
+        next_seq_ = seq;
+    }
+
+    // Returns the amount of bytes that were appended to the payload
+    size_t add(uint32_t seq, const uint8_t *data, size_t size);
+
+    payload_type &payload() const {
+        compact();
+        return payload_;
+    }
+
+    const uint8_t *data() const {
+        return size() ? &payload_[head_] : 0;
+    }
+
+    size_t size() const {
+        return payload_.size() - head_;
+    }
+
+    void consume(size_t size);
+
+    // The amount of bytes buffered out of order
+    size_t buffered_size() const;
+private:
+    typedef std::pair<uint32_t, uint32_t> range_type;
+    typedef std::vector<range_type> ranges_type;
+
+    uint32_t offset_of(uint32_t seq) const {
+        return seq - next_seq_;
+    }
+
+    void append(const uint8_t *data, size_t size);
+    void compact() const;
+    bool reserve(size_t size);
+    void release_ring();
+    void skip(uint32_t size);
+    size_t drain();
+    void add_range(uint32_t begin, uint32_t end);
+
+    mutable payload_type payload_;
+    mutable size_t head_;
+    std::vector<uint8_t> ring_;
+    ranges_type ranges_;
+    tcp_buffer_budget *budget_;
+    tcp_data_sink *sink_;
+    size_t window_limit_;
+    uint32_t next_seq_, ring_start_;
+};
+} // namespace Internals
+/**
+ * \endcond
+ */
 
 /**
  * \class TCPStream
@@ -56,13 +301,29 @@ public:
      * The stream information.
      */
     struct StreamInfo {
+        /**
+         * The endpoints' addresses, if this is an IPv4 stream.
+         */
         IPv4Address client_addr, server_addr;
+
+        /**
+         * The endpoints' addresses, if this is an IPv6 stream.
+         */
+        IPv6Address client_addr_v6, server_addr_v6;
         uint16_t client_port, server_port;
+
+        /**
+         * Indicates whether this is an IPv6 stream.
+         */
+        bool is_v6;
         
-        StreamInfo() {}
+        StreamInfo() : client_port(0), server_port(0), is_v6(false) {}
         
         StreamInfo(IPv4Address client, IPv4Address server,
             uint16_t cport, uint16_t sport);
+
+        StreamInfo(const IPv6Address &client, const IPv6Address &server,
+            uint16_t cport, uint16_t sport);
         
         bool operator<(const StreamInfo &rhs) const;
     };
@@ -72,6 +333,37 @@ public:
      */
     typedef std::vector<uint8_t> payload_type;
 
+    /**
+     * The direction in which data was sent.
+     */
+    enum Direction {
+        CLIENT_TO_SERVER,
+        SERVER_TO_CLIENT
+    };
+
+    /**
+     * \brief Counters on the segments sent in one direction.
+     */
+    struct DirectionStats {
+        /**
+         * The amount of payload bytes sent, including retransmissions.
+         */
+        uint64_t bytes;
+
+        /**
+         * The amount of segments sent.
+         */
+        uint64_t segments;
+
+        /**
+         * The amount of segments that carried data or a SYN which 
+         * had already been sent.
+         */
+        uint64_t retransmissions;
+
+        DirectionStats() : bytes(0), segments(0), retransmissions(0) { }
+    };
+
     /**
      * \brief TCPStream constructor.
      * \param ip The IP PDU from which to take the initial parameters.
@@ -79,6 +371,14 @@ public:
      * \param identifier This stream's identifier number
      */
     TCPStream(IP *ip, TCP *tcp, uint64_t identifier);
+
+    /**
+     * \brief TCPStream constructor.
+     * \param ip The IPv6 PDU from which to take the initial parameters.
+     * \param tcp The TCP PDU from which to take the initial parameters.
+     * \param identifier This stream's identifier number
+     */
+    TCPStream(IPv6 *ip, TCP *tcp, uint64_t identifier);
     
     /**
      * Copy constructor.
@@ -103,7 +403,7 @@ public:
      * \return const payload_type& containing the payload.
      */
     const payload_type &client_payload() const {
-        return client_payload_;
+        return client_buffer.payload();
     }
     
     /**
@@ -114,7 +414,7 @@ public:
      * \return payload_type& containing the payload.
      */
     payload_type &client_payload() {
-        return client_payload_;
+        return client_buffer.payload();
     }
     
     /**
@@ -125,7 +425,7 @@ public:
      * \return const payload_type& containing the payload.
      */
     const payload_type &server_payload() const {
-        return server_payload_;
+        return server_buffer.payload();
     }
     
     /**
@@ -136,7 +436,125 @@ public:
      * \return payload_type& containing the payload.
      */
     payload_type &server_payload() {
-        return server_payload_;
+        return server_buffer.payload();
+    }
+
+    /**
+     * \brief Retrieves a pointer to the client payload.
+     *
+     * Unlike TCPStream::client_payload, this doesn't move the data 
+     * after TCPStream::consume_client_payload has been used. The
+     * pointer is valid until this stream is updated or the payload
+     * is consumed.
+     *
+     * \return A pointer to the payload, or 0 if it's empty.
+     */
+    const uint8_t *client_payload_data() const {
+        return client_buffer.data();
+    }
+
+    /**
+     * \brief Retrieves the size of the client payload.
+     */
+    size_t client_payload_size() const {
+        return client_buffer.size();
+    }
+
+    /**
+     * \brief Discards bytes from the front of the client payload.
+     *
+     * This doesn't move the rest of the payload.
+     *
+     * \param size The amount of bytes to discard.
+     */
+    void consume_client_payload(size_t size) {
+        client_buffer.consume(size);
+    }
+
+    /**
+     * \brief Retrieves a pointer to the server payload.
+     *
+     * \sa TCPStream::client_payload_data
+     * \return A pointer to the payload, or 0 if it's empty.
+     */
+    const uint8_t *server_payload_data() const {
+        return server_buffer.data();
+    }
+
+    /**
+     * \brief Retrieves the size of the server payload.
+     */
+    size_t server_payload_size() const {
+        return server_buffer.size();
+    }
+
+    /**
+     * \brief Discards bytes from the front of the server payload.
+     *
+     * \sa TCPStream::consume_client_payload
+     * \param size The amount of bytes to discard.
+     */
+    void consume_server_payload(size_t size) {
+        server_buffer.consume(size);
+    }
+
+    /**
+     * \brief Retrieves the amount of bytes buffered out of order.
+     *
+     * These are the bytes received ahead of a hole in either direction
+     * which haven't been added to the payload yet.
+     */
+    size_t buffered_size() const {
+        return client_buffer.buffered_size() + server_buffer.buffered_size();
+    }
+
+    /**
+     * \brief Retrieves the counters on the segments the client sent.
+     */
+    const DirectionStats &client_stats() const {
+        return client_stats_;
+    }
+
+    /**
+     * \brief Retrieves the counters on the segments the server sent.
+     */
+    const DirectionStats &server_stats() const {
+        return server_stats_;
+    }
+
+    /**
+     * \brief Retrieves the time at which the stream's first segment
+     * was seen.
+     *
+     * Times are taken from the timestamps of the packets given to
+     * the TCPStreamFollower. Segments processed without a timestamp
+     * are considered to be seen at the last time the follower knows 
+     * of, which is 0 if it has never been given a timestamp.
+     */
+    Timestamp first_seen() const {
+        return make_timestamp(first_seen_);
+    }
+
+    /**
+     * \brief Retrieves the time at which the stream's last segment
+     * was seen.
+     *
+     * \sa TCPStream::first_seen
+     */
+    Timestamp last_seen() const {
+        return make_timestamp(last_seen_);
+    }
+
+    /**
+     * \brief Retrieves the time it took to complete the three way 
+     * handshake, in microseconds.
+     *
+     * This is the time between the client's last SYN and its first
+     * ACK after the server's SYN/ACK. 0 is returned until that ACK
+     * is seen, or when the segments are processed without timestamps.
+     */
+    uint64_t handshake_rtt() const {
+        return handshake_rtt_;
     }
 
     /**
@@ -178,38 +596,270 @@ public:
      * any of the stored payloads.
      */
     bool update(IP *ip, TCP *tcp);
+
+    /**
+     * \brief Updates the stream data.
+     * 
+     * \sa TCPStream::update(IP*, TCP*)
+     * \param ip The IPv6 PDU from which to take information.
+     * \param tcp The TCP PDU from which to take information.
+     * \return bool indicating whether any changes have been done to 
+     * any of the stored payloads.
+     */
+    bool update(IPv6 *ip, TCP *tcp);
 private:
-    typedef std::map<uint32_t, RawPDU*> fragments_type;
-    
-    static void free_fragments(fragments_type &frags);
-    static fragments_type clone_fragments(const fragments_type &frags);
-    
-    bool generic_process(uint32_t &my_seq, uint32_t &other_seq, 
-      payload_type &pload, fragments_type &frags, TCP *tcp);
+    friend class TCPStreamFollower;
 
-    void safe_insert(fragments_type &frags, uint32_t seq, RawPDU *raw);
+    static Timestamp make_timestamp(uint64_t microseconds);
 
+    bool generic_process(Internals::tcp_stream_buffer &buffer, 
+                         DirectionStats &stats, TCP *tcp);
+    bool update_direction(bool from_client, TCP *tcp);
+    void start_time(uint64_t now);
+    void seen(uint64_t now) {
+        last_seen_ = now;
+    }
+    void buffer_limits(size_t window_limit, Internals::tcp_buffer_budget *budget);
+    void data_sinks(Internals::tcp_data_sink *client, Internals::tcp_data_sink *server);
 
-    uint32_t client_seq, server_seq;
     StreamInfo info;
     uint64_t identifier;
-    payload_type client_payload_, server_payload_;
-    fragments_type client_frags, server_frags;
-    bool syn_ack_sent, fin_sent;
+    Internals::tcp_stream_buffer client_buffer, server_buffer;
+    DirectionStats client_stats_, server_stats_;
+    // All in microseconds
+    uint64_t first_seen_, last_seen_, syn_time_, handshake_rtt_;
+    bool syn_ack_sent, fin_sent, handshake_done;
 };
 
+/**
+ * \cond
+ */
+namespace Internals {
+// Forwards the data a stream direction receives to a functor taking 
+// (TCPStream&, TCPStream::Direction, const uint8_t*, size_t).
+template<typename Functor>
+class tcp_span_sink : public tcp_data_sink {
+public:
+    tcp_span_sink(const Functor &fun, TCPStream &stream, 
+      TCPStream::Direction direction)
+    : fun_(fun), stream_(stream), direction_(direction)
+    {
+
+    }
+
+    void data(const uint8_t *data, size_t size) {
+        fun_(stream_, direction_, data, size);
+    }
+private:
+    const Functor &fun_;
+    TCPStream &stream_;
+    TCPStream::Direction direction_;
+};
+
+// Tells TCPStreamFollower that the functor wants the data as it 
+// becomes available, rather than the updated stream.
+template<typename Functor>
+struct tcp_span_functor {
+    tcp_span_functor(const Functor &fun) : fun(fun) { }
+
+    Functor fun;
+};
+} // namespace Internals
+/**
+ * \endcond
+ */
 
 /**
  * \class TCPStreamFollower
  * \brief Follows TCP streams and notifies the user when data is available.
+ *
+ * Streams carried over both IPv4 and IPv6 are followed. 
+ * TCPStream::StreamInfo::is_v6 indicates which addresses identify 
+ * each of them.
+ *
+ * Sessions are removed once either peer sends a FIN or RST. Since 
+ * that might never happen, for example under SYN scans, sessions can
+ * also be removed after they've been idle for a while and the 
+ * amount of sessions being followed can be limited. When the limit is
+ * reached, the session that was seen the longest ago is removed to 
+ * make room for the new one.
+ *
+ * Idle time is measured using the packets' timestamps, so it's only
+ * tracked when the follower is given Packets, either by sniffing or by
+ * using an iterator range that contains them.
+ *
+ * Sessions removed this way are also passed to the end functor. 
+ * TCPStream::is_finished will return false for them.
+ *
+ * Data received ahead of a hole in the sequence space is buffered until
+ * the hole is filled. The amount of bytes buffered per stream direction
+ * and the amount of memory used by all of these buffers are limited. 
+ * When a segment doesn't fit, the first hole in that direction is 
+ * skipped and the data that follows it is added to the payload.
+ *
+ * TCPStreamFollower::follow_streams keeps all of the data a stream 
+ * receives in its payload, which the data functor can inspect or clear.
+ * TCPStreamFollower::follow_stream_data instead hands the data to the
+ * functor as soon as it's available in order and doesn't keep it, so 
+ * protocols can be parsed incrementally. Data that arrives in order is
+ * not copied at all in that case.
  */
 class TCPStreamFollower {
 public:
+    /**
+     * \brief Counters on the sessions that were followed.
+     */
+    struct Stats {
+        /**
+         * The amount of sessions that were created.
+         */
+        uint64_t sessions_created;
+
+        /**
+         * The amount of sessions that were closed by a FIN or RST.
+         */
+        uint64_t sessions_closed;
+
+        /**
+         * The amount of sessions removed because they were idle.
+         */
+        uint64_t timeout_evictions;
+
+        /**
+         * The amount of sessions removed to stay within the 
+         * maximum amount of sessions.
+         */
+        uint64_t capacity_evictions;
+
+        /**
+         * The amount of bytes in holes which were skipped because 
+         * the data after them didn't fit in the buffers.
+         */
+        uint64_t skipped_bytes;
+
+        Stats();
+    };
+
+    /**
+     * The default value for TCPStreamFollower::max_stream_buffer.
+     */
+    static const size_t DEFAULT_MAX_STREAM_BUFFER;
+
     /**
      * \brief Default constructor.
+     *
+     * By default, sessions never time out, there's no limit on the
+     * amount of them nor on the total memory used to buffer out of 
+     * order data.
      */
     TCPStreamFollower();
 
+    /**
+     * \brief Copy constructor.
+     */
+    TCPStreamFollower(const TCPStreamFollower &rhs);
+
+    /**
+     * \brief Copy assignment operator.
+     */
+    TCPStreamFollower &operator=(const TCPStreamFollower &rhs);
+
+    /**
+     * \brief Sets the time after which idle sessions are removed.
+     *
+     * \param seconds The timeout, in seconds. 0 means sessions never 
+     * time out.
+     */
+    void idle_timeout(uint32_t seconds) {
+        idle_timeout_ = seconds;
+    }
+
+    /**
+     * \brief Getter for the idle timeout, in seconds.
+     */
+    uint32_t idle_timeout() const {
+        return idle_timeout_;
+    }
+
+    /**
+     * \brief Sets the maximum amount of sessions to follow.
+     *
+     * \param count The maximum amount of sessions. 0 means there's no
+     * limit.
+     */
+    void max_sessions(size_t count) {
+        max_sessions_ = count;
+    }
+
+    /**
+     * \brief Getter for the maximum amount of sessions.
+     */
+    size_t max_sessions() const {
+        return max_sessions_;
+    }
+
+    /**
+     * \brief Sets the maximum amount of out of order bytes buffered
+     * in each direction of a stream.
+     *
+     * This only applies to streams created after calling this.
+     *
+     * \param size The amount of bytes. This is 
+     * TCPStreamFollower::DEFAULT_MAX_STREAM_BUFFER by default.
+     */
+    void max_stream_buffer(size_t size) {
+        max_stream_buffer_ = size;
+    }
+
+    /**
+     * \brief Getter for the maximum amount of out of order bytes
+     * buffered in each direction of a stream.
+     */
+    size_t max_stream_buffer() const {
+        return max_stream_buffer_;
+    }
+
+    /**
+     * \brief Sets the maximum amount of memory used to buffer out of 
+     * order data by all streams.
+     *
+     * \param size The amount of bytes. 0 means there's no limit.
+     */
+    void max_total_buffer(size_t size) {
+        budget_.limit = size;
+    }
+
+    /**
+     * \brief Getter for the maximum amount of memory used to buffer out
+     * of order data by all streams.
+     */
+    size_t max_total_buffer() const {
+        return budget_.limit;
+    }
+
+    /**
+     * \brief Returns the memory currently used to buffer out of order
+     * data by all streams.
+     */
+    size_t total_buffer() const {
+        return budget_.used;
+    }
+
+    /**
+     * \brief Returns the amount of sessions being followed.
+     */
+    size_t active_sessions() const {
+        return sessions.size() + sessions_v6.size();
+    }
+
+    /**
+     * \brief Getter for the session counters.
+     */
+    const Stats &stats() const {
+        stats_.skipped_bytes = budget_.skipped_bytes;
+        return stats_;
+    }
+
     /**
      * \brief Starts following TCP streams.
      * 
@@ -286,33 +936,182 @@ public:
     template<typename ForwardIterator, typename DataFunctor>
     void follow_streams(ForwardIterator start, ForwardIterator end, 
       DataFunctor data_fun);
-private:
-    typedef std::map<TCPStream::StreamInfo, TCPStream> sessions_type;
-    
+
+    /**
+     * \brief Starts following TCP streams, notifying each chunk of data
+     * as soon as it's available.
+     * 
+     * The data functor must accept the arguments 
+     * (TCPStream&, TCPStream::Direction, const uint8_t*, size_t), 
+     * which are the stream the data belongs to, the direction it was
+     * sent in and the data itself. The data is only valid during the
+     * call, and it won't be stored in the stream's payload.
+     *
+     * The end functor must accept a TCPStream& as argument, which will
+     * point to the stream which has been closed.
+     * 
+     * \param sniffer The sniffer which will be used to sniff PDUs.
+     * \param data_fun The function which will be called whenever data
+     * is available in order.
+     * \param end_fun This function will be called when a stream is 
+     * closed.
+     */
     template<typename DataFunctor, typename EndFunctor>
-    struct proxy_caller {
-        bool callback(PDU &pdu) {
-            return stream->callback(pdu, data_fun, end_fun);
-        }
-        
-        TCPStreamFollower *stream;
-        DataFunctor data_fun;
-        EndFunctor end_fun;
-    };
+    void follow_stream_data(BaseSniffer &sniffer, DataFunctor data_fun, 
+      EndFunctor end_fun);
+
+    /**
+     * \brief Starts following TCP streams, notifying each chunk of data
+     * as soon as it's available.
+     * 
+     * This overload takes a range of iterators containing the PDUs 
+     * in which TCP streams will be looked up and followed. 
+     *
+     * \sa TCPStreamFollower::follow_stream_data(BaseSniffer&, DataFunctor, EndFunctor)
+     * \param start The start of the range of PDUs.
+     * \param end The start of the range of PDUs.
+     * \param data_fun The function which will be called whenever data
+     * is available in order.
+     * \param end_fun This function will be called when a stream is 
+     * closed.
+     */
+    template<typename ForwardIterator, typename DataFunctor, typename EndFunctor>
+    void follow_stream_data(ForwardIterator start, ForwardIterator end, 
+      DataFunctor data_fun, EndFunctor end_fun);
+
+    /**
+     * \brief Starts following TCP streams, notifying each chunk of data
+     * as soon as it's available.
+     * 
+     * \sa TCPStreamFollower::follow_stream_data(BaseSniffer&, DataFunctor, EndFunctor)
+     * \param sniffer The sniffer which will be used to sniff PDUs.
+     * \param data_fun The function which will be called whenever data
+     * is available in order.
+     */
+    template<typename DataFunctor>
+    void follow_stream_data(BaseSniffer &sniffer, DataFunctor data_fun);
+
+    /**
+     * \brief Starts following TCP streams, notifying each chunk of data
+     * as soon as it's available.
+     * 
+     * \sa TCPStreamFollower::follow_stream_data(BaseSniffer&, DataFunctor, EndFunctor)
+     * \param start The start of the range of PDUs.
+     * \param end The start of the range of PDUs.
+     * \param data_fun The function which will be called whenever data
+     * is available in order.
+     */
+    template<typename ForwardIterator, typename DataFunctor>
+    void follow_stream_data(ForwardIterator start, ForwardIterator end, 
+      DataFunctor data_fun);
+
+    /**
+     * \brief Processes a single packet.
+     *
+     * This can be used when packets are obtained some other way, 
+     * for example using Sniffer::sniff_loop. The functors work just
+     * like they do in TCPStreamFollower::follow_streams.
+     *
+     * The packet's timestamp is used to remove idle sessions and to 
+     * track the streams' times.
+     *
+     * \param packet The packet to process.
+     * \param data_fun The function which will be called whenever one of
+     * the peers in a connection sends data.
+     * \param end_fun This function will be called when a stream is 
+     * closed.
+     */
+    template<typename DataFunctor, typename EndFunctor>
+    void process(Packet &packet, DataFunctor data_fun, EndFunctor end_fun);
+
+    /**
+     * \brief Processes a single packet.
+     *
+     * \sa TCPStreamFollower::process(Packet&, DataFunctor, EndFunctor)
+     * \param packet The packet to process.
+     * \param data_fun The function which will be called whenever one of
+     * the peers in a connection sends data.
+     */
+    template<typename DataFunctor>
+    void process(Packet &packet, DataFunctor data_fun);
+
+    /**
+     * \brief Processes a single PDU.
+     *
+     * Since there's no timestamp, idle sessions are not removed and 
+     * times are not updated.
+     *
+     * \sa TCPStreamFollower::process(Packet&, DataFunctor, EndFunctor)
+     * \param pdu The PDU to process.
+     * \param data_fun The function which will be called whenever one of
+     * the peers in a connection sends data.
+     * \param end_fun This function will be called when a stream is 
+     * closed.
+     */
+    template<typename DataFunctor, typename EndFunctor>
+    void process(PDU &pdu, DataFunctor data_fun, EndFunctor end_fun);
+
+    /**
+     * \brief Processes a single PDU.
+     *
+     * \sa TCPStreamFollower::process(PDU&, DataFunctor, EndFunctor)
+     * \param pdu The PDU to process.
+     * \param data_fun The function which will be called whenever one of
+     * the peers in a connection sends data.
+     */
+    template<typename DataFunctor>
+    void process(PDU &pdu, DataFunctor data_fun);
+private:
+    friend class TCPStreamFollowerGroup;
+
+    typedef Internals::tcp_session_table<Internals::tcp_session_key> sessions_type;
+    typedef Internals::tcp_session_table<Internals::tcp_session_key_v6> sessions_v6_type;
     
+    template<typename NetworkPDU, typename DataFunctor>
+    void update_stream(TCPStream &stream, NetworkPDU *ip, TCP *tcp, 
+      const DataFunctor &data_fun);
+    template<typename NetworkPDU, typename DataFunctor>
+    void update_stream(TCPStream &stream, NetworkPDU *ip, TCP *tcp, 
+      const Internals::tcp_span_functor<DataFunctor> &data_fun);
     template<typename DataFunctor, typename EndFunctor>
-    bool callback(PDU &pdu, const DataFunctor &fun, const EndFunctor &end_fun);
+    bool callback(PDU &pdu, const Timestamp *ts, const DataFunctor &fun, 
+      const EndFunctor &end_fun);
+    template<typename Table, typename NetworkPDU, typename DataFunctor, 
+      typename EndFunctor>
+    void process_segment(Table &table, const typename Table::key_type &key, 
+      NetworkPDU *ip, TCP *tcp, const DataFunctor &data_fun, 
+      const EndFunctor &end_fun);
+    template<typename Table, typename EndFunctor>
+    void remove_session(Table &table, uint32_t index, const EndFunctor &end_fun);
+    template<typename EndFunctor>
+    void remove_oldest_session(const EndFunctor &end_fun);
+    template<typename Table, typename EndFunctor>
+    void remove_idle_sessions(Table &table, const EndFunctor &end_fun);
     static void dummy_function(TCPStream&) { }
+    void rebind_buffers();
     
     sessions_type sessions;
+    sessions_v6_type sessions_v6;
     uint64_t last_identifier;
+    // The last timestamp seen, in microseconds
+    uint64_t now_;
+    uint32_t idle_timeout_;
+    size_t max_sessions_, max_stream_buffer_;
+    Internals::tcp_buffer_budget budget_;
+    mutable Stats stats_;
 };
 
 template<typename DataFunctor, typename EndFunctor>
 void TCPStreamFollower::follow_streams(BaseSniffer &sniffer, DataFunctor data_fun, EndFunctor end_fun) {
-    typedef proxy_caller<DataFunctor, EndFunctor> proxy_type;
-    proxy_type proxy = { this, data_fun, end_fun };
-    sniffer.sniff_loop(make_sniffer_handler(&proxy, &proxy_type::callback));
+    // Iterate the sniffer ourselves, so we get to see the timestamps
+    for(BaseSniffer::iterator it = sniffer.begin(); it != sniffer.end(); ++it) {
+        try {
+            if(!callback(*it->pdu(), &it->timestamp(), data_fun, end_fun))
+                return;
+        }
+        catch(malformed_packet&) { }
+        catch(pdu_not_found&) { }
+    }
 }
 
 template<typename ForwardIterator, typename DataFunctor, typename EndFunctor>
@@ -320,7 +1119,8 @@ void TCPStreamFollower::follow_streams(ForwardIterator start, ForwardIterator en
   DataFunctor data_fun, EndFunctor end_fun) 
 {
     while(start != end) {
-        if(!callback(Utils::dereference_until_pdu(start), data_fun, end_fun))
+        if(!callback(Internals::stream_pdu(*start), 
+                     Internals::packet_timestamp(*start), data_fun, end_fun))
             return;
         start++;
     }
@@ -339,40 +1139,177 @@ void TCPStreamFollower::follow_streams(ForwardIterator start, ForwardIterator en
 }
 
 template<typename DataFunctor, typename EndFunctor>
-bool TCPStreamFollower::callback(PDU &pdu, const DataFunctor &data_fun, const EndFunctor &end_fun) {
-    IP *ip = pdu.find_pdu<IP>();
+void TCPStreamFollower::follow_stream_data(BaseSniffer &sniffer, 
+  DataFunctor data_fun, EndFunctor end_fun) 
+{
+    follow_streams(sniffer, Internals::tcp_span_functor<DataFunctor>(data_fun), 
+                   end_fun);
+}
+
+template<typename ForwardIterator, typename DataFunctor, typename EndFunctor>
+void TCPStreamFollower::follow_stream_data(ForwardIterator start, 
+  ForwardIterator end, DataFunctor data_fun, EndFunctor end_fun) 
+{
+    follow_streams(start, end, Internals::tcp_span_functor<DataFunctor>(data_fun), 
+                   end_fun);
+}
+
+template<typename DataFunctor>
+void TCPStreamFollower::follow_stream_data(BaseSniffer &sniffer, DataFunctor data_fun) {
+    follow_stream_data(sniffer, data_fun, dummy_function);
+}
+
+template<typename ForwardIterator, typename DataFunctor>
+void TCPStreamFollower::follow_stream_data(ForwardIterator start, 
+  ForwardIterator end, DataFunctor data_fun) 
+{
+    follow_stream_data(start, end, data_fun, dummy_function);
+}
+
+template<typename DataFunctor, typename EndFunctor>
+void TCPStreamFollower::process(Packet &packet, DataFunctor data_fun, 
+  EndFunctor end_fun) 
+{
+    if(packet.pdu())
+        callback(*packet.pdu(), &packet.timestamp(), data_fun, end_fun);
+}
+
+template<typename DataFunctor>
+void TCPStreamFollower::process(Packet &packet, DataFunctor data_fun) {
+    process(packet, data_fun, dummy_function);
+}
+
+template<typename DataFunctor, typename EndFunctor>
+void TCPStreamFollower::process(PDU &pdu, DataFunctor data_fun, 
+  EndFunctor end_fun) 
+{
+    callback(pdu, static_cast<const Timestamp*>(0), data_fun, end_fun);
+}
+
+template<typename DataFunctor>
+void TCPStreamFollower::process(PDU &pdu, DataFunctor data_fun) {
+    process(pdu, data_fun, dummy_function);
+}
+
+template<typename DataFunctor, typename EndFunctor>
+bool TCPStreamFollower::callback(PDU &pdu, const Timestamp *ts, 
+  const DataFunctor &data_fun, const EndFunctor &end_fun) 
+{
+    if(ts) {
+        now_ = static_cast<uint64_t>(ts->seconds()) * 1000000 + ts->microseconds();
+        remove_idle_sessions(sessions, end_fun);
+        remove_idle_sessions(sessions_v6, end_fun);
+    }
     TCP *tcp = pdu.find_pdu<TCP>();
-    if(!ip || !tcp) {
+    if(!tcp) {
         return true;
     }
-    TCPStream::StreamInfo info( 
-        ip->src_addr(), ip->dst_addr(),
-        tcp->sport(), tcp->dport()
-    );
-    sessions_type::iterator it = sessions.find(info);
-    if(it == sessions.end()) {
-        std::swap(info.client_addr, info.server_addr);
-        std::swap(info.client_port, info.server_port);
-        if((it = sessions.find(info)) == sessions.end()) {
-            if(tcp->get_flag(TCP::SYN) && !tcp->get_flag(TCP::ACK)) {
-                sessions.insert(
-                    std::make_pair(
-                        info,
-                        TCPStream(ip, tcp, last_identifier++)
-                    )
-                );
+    if(IP *ip = pdu.find_pdu<IP>()) {
+        const Internals::tcp_session_key key(
+            ip->src_addr(), tcp->sport(),
+            ip->dst_addr(), tcp->dport()
+        );
+        process_segment(sessions, key, ip, tcp, data_fun, end_fun);
+    }
+    else if(IPv6 *ip = pdu.find_pdu<IPv6>()) {
+        const Internals::tcp_session_key_v6 key(
+            ip->src_addr(), tcp->sport(),
+            ip->dst_addr(), tcp->dport()
+        );
+        process_segment(sessions_v6, key, ip, tcp, data_fun, end_fun);
+    }
+    return true;
+}
+
+template<typename Table, typename NetworkPDU, typename DataFunctor, 
+  typename EndFunctor>
+void TCPStreamFollower::process_segment(Table &table, 
+  const typename Table::key_type &key, NetworkPDU *ip, TCP *tcp, 
+  const DataFunctor &data_fun, const EndFunctor &end_fun) 
+{
+    uint32_t index = table.find(key);
+    if(index == Table::npos) {
+        if(tcp->get_flag(TCP::SYN) && !tcp->get_flag(TCP::ACK)) {
+            if(max_sessions_ && active_sessions() >= max_sessions_) {
+                stats_.capacity_evictions++;
+                remove_oldest_session(end_fun);
             }
-            return true;
+            TCPStream *stream = new TCPStream(ip, tcp, last_identifier++);
+            stream->buffer_limits(max_stream_buffer_, &budget_);
+            stream->start_time(now_);
+            table.insert(key, stream, now_);
+            stats_.sessions_created++;
         }
+        return;
     }
-    if(it->second.update(ip, tcp))
-        data_fun(it->second);
+    table.touch(index, now_);
+    TCPStream &stream = table.stream(index);
+    stream.seen(now_);
+    update_stream(stream, ip, tcp, data_fun);
     // We're done with this stream
-    if(it->second.is_finished()) {
-        end_fun(it->second);
-        sessions.erase(it);
+    if(stream.is_finished()) {
+        stats_.sessions_closed++;
+        remove_session(table, index, end_fun);
+    }
+}
+
+template<typename NetworkPDU, typename DataFunctor>
+void TCPStreamFollower::update_stream(TCPStream &stream, NetworkPDU *ip, 
+  TCP *tcp, 
+  const DataFunctor &data_fun) 
+{
+    if(stream.update(ip, tcp))
+        data_fun(stream);
+}
+
+template<typename NetworkPDU, typename DataFunctor>
+void TCPStreamFollower::update_stream(TCPStream &stream, NetworkPDU *ip, 
+  TCP *tcp, 
+  const Internals::tcp_span_functor<DataFunctor> &data_fun) 
+{
+    Internals::tcp_span_sink<DataFunctor> 
+        client_sink(data_fun.fun, stream, TCPStream::CLIENT_TO_SERVER),
+        server_sink(data_fun.fun, stream, TCPStream::SERVER_TO_CLIENT);
+    stream.data_sinks(&client_sink, &server_sink);
+    try {
+        stream.update(ip, tcp);
+    }
+    catch(...) {
+        stream.data_sinks(0, 0);
+        throw;
+    }
+    stream.data_sinks(0, 0);
+}
+
+template<typename Table, typename EndFunctor>
+void TCPStreamFollower::remove_session(Table &table, uint32_t index, 
+  const EndFunctor &end_fun) 
+{
+    end_fun(table.stream(index));
+    delete table.remove(index);
+}
+
+template<typename EndFunctor>
+void TCPStreamFollower::remove_oldest_session(const EndFunctor &end_fun) {
+    const uint32_t oldest = sessions.oldest(), oldest_v6 = sessions_v6.oldest();
+    if(oldest_v6 == sessions_v6_type::npos || (oldest != sessions_type::npos && 
+       sessions.last_seen(oldest) <= sessions_v6.last_seen(oldest_v6)))
+        remove_session(sessions, oldest, end_fun);
+    else
+        remove_session(sessions_v6, oldest_v6, end_fun);
+}
+
+template<typename Table, typename EndFunctor>
+void TCPStreamFollower::remove_idle_sessions(Table &table, const EndFunctor &end_fun) {
+    if(!idle_timeout_)
+        return;
+    const uint64_t timeout = static_cast<uint64_t>(idle_timeout_) * 1000000;
+    uint32_t index;
+    while((index = table.oldest()) != Table::npos && 
+           table.last_seen(index) + timeout <= now_) {
+        stats_.timeout_evictions++;
+        remove_session(table, index, end_fun);
     }
-    return true;
 }
 }
 
@@ -0,0 +1,679 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef TINS_TCP_STREAM_FOLLOWER_GROUP_H
+#define TINS_TCP_STREAM_FOLLOWER_GROUP_H
+
+#include "cxxstd.h"
+
+#if TINS_IS_CXX11
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <stdint.h>
+#include "tcp_stream.h"
+#include "packet_view.h"
+#include "rawpdu.h"
+#include "internals.h"
+
+namespace Tins {
+/**
+ * \cond
+ */
+namespace Internals {
+// A bounded, lock free, single producer single consumer queue. Items
+// are written and read in place, so whatever memory they own is reused.
+template<typename T>
+class spsc_queue {
+public:
+    // The capacity is rounded up to a power of 2
+    explicit spsc_queue(size_t capacity) 
+    : head_(0), cached_tail_(0), tail_(0), cached_head_(0) 
+    {
+        size_t size = 2;
+        while(size < capacity)
+            size *= 2;
+        items_.resize(size);
+        mask_ = size - 1;
+    }
+
+    // Producer side. Returns the slot to fill, or a null pointer if 
+    // the queue is full. The item is queued once push is called.
+    T *write_slot() {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if(tail - cached_head_ == items_.size()) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if(tail - cached_head_ == items_.size())
+                return 0;
+        }
+        return &items_[tail & mask_];
+    }
+
+    void push() {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, 
+                    std::memory_order_release);
+    }
+
+    // Consumer side. Returns the next item, or a null pointer if the 
+    // queue is empty. The slot is handed back once pop is called.
+    T *read_slot() {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if(head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if(head == cached_tail_)
+                return 0;
+        }
+        return &items_[head & mask_];
+    }
+
+    void pop() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, 
+                    std::memory_order_release);
+    }
+private:
+    spsc_queue(const spsc_queue&);
+    spsc_queue& operator=(const spsc_queue&);
+
+    std::vector<T> items_;
+    size_t mask_;
+    // Keep each side's indexes on their own cache line
+    char padding0_[64];
+    std::atomic<size_t> head_;
+    size_t cached_tail_;
+    char padding1_[64];
+    std::atomic<size_t> tail_;
+    size_t cached_head_;
+    char padding2_[64];
+};
+
+// Spins for a while, then yields and eventually sleeps, so idle 
+// threads don't keep a core busy.
+class backoff {
+public:
+    backoff() : count_(0) { }
+
+    void wait() {
+        if(count_ < 64) {
+            ++count_;
+        }
+        else if(count_ < 1024) {
+            ++count_;
+            std::this_thread::yield();
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    void reset() {
+        count_ = 0;
+    }
+private:
+    unsigned count_;
+};
+} // namespace Internals
+/**
+ * \endcond
+ */
+
+/**
+ * \class TCPStreamFollowerGroup
+ * \brief Follows TCP streams using several threads.
+ *
+ * This class owns several TCPStreamFollower objects, each of them
+ * running on its own worker thread. The thread calling 
+ * TCPStreamFollowerGroup::follow_streams reads the packets and hands 
+ * each of them over to a worker through a bounded lock free queue. 
+ * The worker is picked by hashing the packet's addresses and ports,
+ * in a way that both directions of a connection are always handled 
+ * by the same worker.
+ *
+ * When reading from a sniffer whose link layer is Ethernet or Linux 
+ * cooked capture, the reading thread only looks at the headers it 
+ * needs through a PacketView and copies the frame. Parsing it is left
+ * to the worker. On other link layers, packets are parsed by the 
+ * reading thread and the worker deletes them once they're processed.
+ * This is safe when the sniffer uses a PDUArena, as arena blocks can
+ * be released from any thread. Payloads borrowed from the capture 
+ * buffer (see BaseSniffer::set_borrow_payloads) are copied before the
+ * packet is handed over, since the buffer is reused by the next read.
+ *
+ * \code
+ * FileSniffer sniffer("capture.pcap");
+ * TCPStreamFollowerGroup group(4);
+ * // The functors will be called concurrently from 4 different threads
+ * group.follow_streams(sniffer, on_data, on_end);
+ * \endcode
+ *
+ * Each worker can be configured separately through 
+ * TCPStreamFollowerGroup::operator[]. Note that limits such as 
+ * TCPStreamFollower::max_sessions apply to each worker. Packets that
+ * don't contain TCP are discarded before being handed over, so idle
+ * sessions are only removed when a worker receives a TCP segment.
+ *
+ * This class is only available in C++11 mode.
+ */
+class TCPStreamFollowerGroup {
+public:
+    /**
+     * The default capacity of each worker's queue.
+     */
+    static const size_t DEFAULT_QUEUE_SIZE = 4096;
+
+    /**
+     * \brief Constructs a TCPStreamFollowerGroup.
+     *
+     * \param size The amount of workers to use.
+     * \param queue_size The amount of packets that can be queued for 
+     * each worker.
+     */
+    TCPStreamFollowerGroup(size_t size, size_t queue_size = DEFAULT_QUEUE_SIZE)
+    : failed_(false)
+    {
+        if(size == 0)
+            size = 1;
+        for(size_t i = 0; i < size; ++i)
+            shards_.push_back(new shard(queue_size));
+    }
+
+    /**
+     * \brief Destructor.
+     */
+    ~TCPStreamFollowerGroup() {
+        for(size_t i = 0; i < shards_.size(); ++i)
+            delete shards_[i];
+    }
+
+    /**
+     * \brief Retrieves the amount of workers in this group.
+     */
+    size_t size() const {
+        return shards_.size();
+    }
+
+    /**
+     * \brief Retrieves the follower used by the worker at the given 
+     * index.
+     *
+     * This can be used to configure it. It must not be accessed while
+     * streams are being followed.
+     *
+     * \param index The index of the worker.
+     */
+    TCPStreamFollower &operator[](size_t index) {
+        return shards_[index]->follower;
+    }
+
+    /**
+     * \brief Returns the amount of sessions being followed by all
+     * workers.
+     */
+    size_t active_sessions() const {
+        size_t total = 0;
+        for(size_t i = 0; i < shards_.size(); ++i)
+            total += shards_[i]->follower.active_sessions();
+        return total;
+    }
+
+    /**
+     * \brief Returns the sum of every worker's session counters.
+     */
+    TCPStreamFollower::Stats stats() const {
+        TCPStreamFollower::Stats total;
+        for(size_t i = 0; i < shards_.size(); ++i) {
+            const TCPStreamFollower::Stats &current = shards_[i]->follower.stats();
+            total.sessions_created += current.sessions_created;
+            total.sessions_closed += current.sessions_closed;
+            total.timeout_evictions += current.timeout_evictions;
+            total.capacity_evictions += current.capacity_evictions;
+            total.skipped_bytes += current.skipped_bytes;
+        }
+        return total;
+    }
+
+    /**
+     * \brief Starts following TCP streams.
+     *
+     * This works just like TCPStreamFollower::follow_streams, except 
+     * that the functors are called from the worker threads. Each 
+     * worker uses its own copy of them, so any state they share must
+     * be synchronized.
+     *
+     * This method returns once every packet has been processed. If any
+     * of the functors throws an exception, no more packets are read 
+     * and it's rethrown after all of the workers have finished.
+     *
+     * \param sniffer The sniffer which will be used to sniff PDUs.
+     * \param data_fun The function which will be called whenever one of
+     * the peers in a connection sends data.
+     * \param end_fun This function will be called when a stream is 
+     * closed.
+     */
+    template<typename DataFunctor, typename EndFunctor>
+    void follow_streams(BaseSniffer &sniffer, DataFunctor data_fun, 
+      EndFunctor end_fun) 
+    {
+        const int link_type = sniffer.link_type();
+        std::vector<std::thread> threads = start(data_fun, end_fun);
+        try {
+            if(link_type == DLT_EN10MB || link_type == DLT_LINUX_SLL)
+                dispatch_frames(sniffer, link_type);
+            else
+                dispatch_packets(sniffer);
+        }
+        catch(...) {
+            finish(threads);
+            throw;
+        }
+        finish(threads);
+    }
+
+    /**
+     * \brief Starts following TCP streams.
+     *
+     * This overload takes a range of iterators containing the PDUs 
+     * in which TCP streams will be looked up and followed. The PDUs
+     * are accessed from the worker threads, so they must not borrow 
+     * their payloads from a buffer that changes while this call runs.
+     *
+     * \sa TCPStreamFollowerGroup::follow_streams(BaseSniffer&, DataFunctor, EndFunctor)
+     * \param start The start of the range of PDUs.
+     * \param end The start of the range of PDUs.
+     * \param data_fun The function which will be called whenever one of
+     * the peers in a connection sends data.
+     * \param end_fun This function will be called when a stream is 
+     * closed.
+     */
+    template<typename ForwardIterator, typename DataFunctor, typename EndFunctor>
+    void follow_streams(ForwardIterator start, ForwardIterator end, 
+      DataFunctor data_fun, EndFunctor end_fun) 
+    {
+        std::vector<std::thread> threads = this->start(data_fun, end_fun);
+        try {
+            for(; start != end; ++start) {
+                PDU &pdu = Internals::stream_pdu(*start);
+                const size_t index = shard_of(pdu);
+                if(index == npos)
+                    continue;
+                queued_packet &packet = write_slot(index);
+                packet.set_pdu(&pdu, false, Internals::packet_timestamp(*start));
+                if(!push(index))
+                    break;
+            }
+        }
+        catch(...) {
+            finish(threads);
+            throw;
+        }
+        finish(threads);
+    }
+
+    /**
+     * \brief Starts following TCP streams.
+     *
+     * \sa TCPStreamFollowerGroup::follow_streams(BaseSniffer&, DataFunctor, EndFunctor)
+     * \param sniffer The sniffer which will be used to sniff PDUs.
+     * \param data_fun The function which will be called whenever one of
+     * the peers in a connection sends data.
+     */
+    template<typename DataFunctor>
+    void follow_streams(BaseSniffer &sniffer, DataFunctor data_fun) {
+        follow_streams(sniffer, data_fun, TCPStreamFollower::dummy_function);
+    }
+
+    /**
+     * \brief Starts following TCP streams.
+     *
+     * \sa TCPStreamFollowerGroup::follow_streams(BaseSniffer&, DataFunctor, EndFunctor)
+     * \param start The start of the range of PDUs.
+     * \param end The start of the range of PDUs.
+     * \param data_fun The function which will be called whenever one of
+     * the peers in a connection sends data.
+     */
+    template<typename ForwardIterator, typename DataFunctor>
+    void follow_streams(ForwardIterator start, ForwardIterator end, 
+      DataFunctor data_fun) 
+    {
+        follow_streams(start, end, data_fun, TCPStreamFollower::dummy_function);
+    }
+
+    /**
+     * \brief Starts following TCP streams, notifying each chunk of data
+     * as soon as it's available.
+     *
+     * This works just like TCPStreamFollower::follow_stream_data, 
+     * except that the functors are called from the worker threads.
+     *
+     * \sa TCPStreamFollowerGroup::follow_streams(BaseSniffer&, DataFunctor, EndFunctor)
+     * \param sniffer The sniffer which will be used to sniff PDUs.
+     * \param data_fun The function which will be called whenever data
+     * is available in order.
+     * \param end_fun This function will be called when a stream is 
+     * closed.
+     */
+    template<typename DataFunctor, typename EndFunctor>
+    void follow_stream_data(BaseSniffer &sniffer, DataFunctor data_fun, 
+      EndFunctor end_fun) 
+    {
+        follow_streams(sniffer, Internals::tcp_span_functor<DataFunctor>(data_fun), 
+                       end_fun);
+    }
+
+    /**
+     * \brief Starts following TCP streams, notifying each chunk of data
+     * as soon as it's available.
+     *
+     * \sa TCPStreamFollowerGroup::follow_stream_data(BaseSniffer&, DataFunctor, EndFunctor)
+     * \param start The start of the range of PDUs.
+     * \param end The start of the range of PDUs.
+     * \param data_fun The function which will be called whenever data
+     * is available in order.
+     * \param end_fun This function will be called when a stream is 
+     * closed.
+     */
+    template<typename ForwardIterator, typename DataFunctor, typename EndFunctor>
+    void follow_stream_data(ForwardIterator start, ForwardIterator end, 
+      DataFunctor data_fun, EndFunctor end_fun) 
+    {
+        follow_streams(start, end, Internals::tcp_span_functor<DataFunctor>(data_fun), 
+                       end_fun);
+    }
+
+    /**
+     * \brief Starts following TCP streams, notifying each chunk of data
+     * as soon as it's available.
+     *
+     * \sa TCPStreamFollowerGroup::follow_stream_data(BaseSniffer&, DataFunctor, EndFunctor)
+     * \param sniffer The sniffer which will be used to sniff PDUs.
+     * \param data_fun The function which will be called whenever data
+     * is available in order.
+     */
+    template<typename DataFunctor>
+    void follow_stream_data(BaseSniffer &sniffer, DataFunctor data_fun) {
+        follow_stream_data(sniffer, data_fun, TCPStreamFollower::dummy_function);
+    }
+
+    /**
+     * \brief Starts following TCP streams, notifying each chunk of data
+     * as soon as it's available.
+     *
+     * \sa TCPStreamFollowerGroup::follow_stream_data(BaseSniffer&, DataFunctor, EndFunctor)
+     * \param start The start of the range of PDUs.
+     * \param end The start of the range of PDUs.
+     * \param data_fun The function which will be called whenever data
+     * is available in order.
+     */
+    template<typename ForwardIterator, typename DataFunctor>
+    void follow_stream_data(ForwardIterator start, ForwardIterator end, 
+      DataFunctor data_fun) 
+    {
+        follow_stream_data(start, end, data_fun, TCPStreamFollower::dummy_function);
+    }
+private:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    struct queued_packet {
+        enum content_type {
+            STOP,
+            PARSED,
+            FRAME
+        };
+
+        queued_packet() 
+        : content(STOP), pdu(0), link_type(0), has_timestamp(false), owned(false) 
+        { 
+
+        }
+
+        void set_pdu(PDU *value, bool owns, const Timestamp *ts) {
+            content = PARSED;
+            pdu = value;
+            owned = owns;
+            has_timestamp = ts != 0;
+            if(ts)
+                timestamp = *ts;
+        }
+
+        void set_frame(const PacketView &view, int type) {
+            content = FRAME;
+            frame.assign(view.buffer(), view.buffer() + view.size());
+            link_type = type;
+            timestamp = view.timestamp();
+            has_timestamp = true;
+        }
+
+        content_type content;
+        PDU *pdu;
+        // Keeps its capacity, so frames don't allocate once it's grown
+        std::vector<uint8_t> frame;
+        int link_type;
+        Timestamp timestamp;
+        bool has_timestamp, owned;
+    };
+
+    struct shard {
+        shard(size_t queue_size) : queue(queue_size) { }
+
+        TCPStreamFollower follower;
+        Internals::spsc_queue<queued_packet> queue;
+        std::exception_ptr error;
+    };
+
+    TCPStreamFollowerGroup(const TCPStreamFollowerGroup&);
+    TCPStreamFollowerGroup& operator=(const TCPStreamFollowerGroup&);
+
+    size_t shard_of(uint32_t hash) const {
+        // Use the upper bits, as the lower ones index each worker's 
+        // session table
+        return static_cast<size_t>((static_cast<uint64_t>(hash) * shards_.size()) >> 32);
+    }
+
+    size_t shard_of(const PacketView &view) const {
+        const PacketView::TCPHeader *tcp = view.tcp();
+        if(!tcp)
+            return npos;
+        if(const PacketView::IPHeader *ip = view.ip()) {
+            return shard_of(Internals::tcp_session_key(
+                ip->src_addr(), tcp->sport(), ip->dst_addr(), tcp->dport()
+            ).hash());
+        }
+        if(const PacketView::IPv6Header *ip = view.ipv6()) {
+            return shard_of(Internals::tcp_session_key_v6(
+                ip->src_addr(), tcp->sport(), ip->dst_addr(), tcp->dport()
+            ).hash());
+        }
+        return npos;
+    }
+
+    size_t shard_of(PDU &pdu) const {
+        const TCP *tcp = pdu.find_pdu<TCP>();
+        if(!tcp)
+            return npos;
+        uint32_t hash;
+        if(const IP *ip = pdu.find_pdu<IP>()) {
+            hash = Internals::tcp_session_key(
+                ip->src_addr(), tcp->sport(), ip->dst_addr(), tcp->dport()
+            ).hash();
+        }
+        else if(const IPv6 *ip = pdu.find_pdu<IPv6>()) {
+            hash = Internals::tcp_session_key_v6(
+                ip->src_addr(), tcp->sport(), ip->dst_addr(), tcp->dport()
+            ).hash();
+        }
+        else {
+            return npos;
+        }
+        return shard_of(hash);
+    }
+
+    void dispatch_frames(BaseSniffer &sniffer, int link_type) {
+        PacketView view;
+        while(sniffer.next_packet_view(view)) {
+            const size_t index = shard_of(view);
+            if(index == npos)
+                continue;
+            write_slot(index).set_frame(view, link_type);
+            if(!push(index))
+                break;
+        }
+    }
+
+    void dispatch_packets(BaseSniffer &sniffer) {
+        for(BaseSniffer::iterator it = sniffer.begin(); it != sniffer.end(); ++it) {
+            if(!it->pdu())
+                continue;
+            const size_t index = shard_of(*it->pdu());
+            if(index == npos)
+                continue;
+            PDU *pdu = it->release_pdu();
+            // The sniffer tracks borrowed payloads on this thread and 
+            // reuses their buffer on the next read
+            if(const RawPDU *raw = pdu->find_pdu<RawPDU>()) {
+                if(raw->borrows_payload())
+                    raw->payload();
+            }
+            write_slot(index).set_pdu(pdu, true, &it->timestamp());
+            if(!push(index))
+                break;
+        }
+    }
+
+    template<typename DataFunctor, typename EndFunctor>
+    std::vector<std::thread> start(const DataFunctor &data_fun, 
+      const EndFunctor &end_fun) 
+    {
+        failed_.store(false);
+        std::vector<std::thread> threads;
+        try {
+            for(size_t i = 0; i < shards_.size(); ++i) {
+                shard *current = shards_[i];
+                current->error = std::exception_ptr();
+                threads.push_back(std::thread([=]() {
+                    run(*current, data_fun, end_fun);
+                }));
+            }
+        }
+        catch(...) {
+            finish(threads);
+            throw;
+        }
+        return threads;
+    }
+
+    template<typename DataFunctor, typename EndFunctor>
+    void run(shard &current, const DataFunctor &data_fun, const EndFunctor &end_fun) {
+        Internals::backoff waiter;
+        for(;;) {
+            queued_packet *packet = current.queue.read_slot();
+            if(!packet) {
+                waiter.wait();
+                continue;
+            }
+            waiter.reset();
+            if(packet->content == queued_packet::STOP) {
+                current.queue.pop();
+                break;
+            }
+            // After a failure, keep draining the queue so the reader 
+            // never blocks on it
+            if(!current.error) {
+                try {
+                    process(current, *packet, data_fun, end_fun);
+                }
+                catch(...) {
+                    current.error = std::current_exception();
+                    failed_.store(true);
+                }
+            }
+            if(packet->content == queued_packet::PARSED && packet->owned)
+                delete packet->pdu;
+            current.queue.pop();
+        }
+    }
+
+    template<typename DataFunctor, typename EndFunctor>
+    void process(shard &current, queued_packet &packet, 
+      const DataFunctor &data_fun, const EndFunctor &end_fun) 
+    {
+        const Timestamp *ts = packet.has_timestamp ? &packet.timestamp : 0;
+        try {
+            if(packet.content == queued_packet::PARSED) {
+                current.follower.callback(*packet.pdu, ts, data_fun, end_fun);
+            }
+            else {
+                std::unique_ptr<PDU> pdu(Internals::pdu_from_dlt_flag(
+                    packet.link_type, &packet.frame[0], 
+                    static_cast<uint32_t>(packet.frame.size())
+                ));
+                current.follower.callback(*pdu, ts, data_fun, end_fun);
+            }
+        }
+        catch(malformed_packet&) { }
+        catch(pdu_not_found&) { }
+    }
+
+    queued_packet &write_slot(size_t index) {
+        Internals::spsc_queue<queued_packet> &queue = shards_[index]->queue;
+        Internals::backoff waiter;
+        queued_packet *packet;
+        while((packet = queue.write_slot()) == 0)
+            waiter.wait();
+        return *packet;
+    }
+
+    // Returns false if a worker failed and no more packets should be read
+    bool push(size_t index) {
+        shards_[index]->queue.push();
+        return !failed_.load(std::memory_order_relaxed);
+    }
+
+    void finish(std::vector<std::thread> &threads) {
+        for(size_t i = 0; i < threads.size(); ++i) {
+            write_slot(i).content = queued_packet::STOP;
+            push(i);
+        }
+        for(size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+        for(size_t i = 0; i < threads.size(); ++i) {
+            if(shards_[i]->error)
+                std::rethrow_exception(shards_[i]->error);
+        }
+    }
+
+    std::vector<shard*> shards_;
+    std::atomic<bool> failed_;
+};
+} // namespace Tins
+
+#endif // TINS_IS_CXX11
+#endif // TINS_TCP_STREAM_FOLLOWER_GROUP_H
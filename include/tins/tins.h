@@ -45,6 +45,7 @@
 #include "dot3.h"
 #include "ip.h"
 #include "ipv6.h"
+#include "pacer.h"
 #include "packet_sender.h"
 #include "packet_writer.h"
 #include "pdu.h"
@@ -73,5 +74,12 @@
 #include "ipsec.h"
 #include "ip_reassembler.h"
 #include "ppi.h"
+#include "packet_ring.h"
+#include "sniffer_group.h"
+#include "packet_view.h"
+#include "pdu_arena.h"
+#include "tcp_stream_follower_group.h"
+#include "probe_engine.h"
+#include "pcap_replayer.h"
 
 #endif // TINS_TINS_H
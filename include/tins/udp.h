@@ -33,6 +33,7 @@
 #include "macros.h"
 #include "pdu.h"
 #include "endianness.h"
+#include "internals.h"
 
 namespace Tins {
 
@@ -58,6 +59,12 @@ namespace Tins {
      * const RawPDU::payload_type& payload = raw.payload();
      * \endcode
      *
+     * If the PDU was parsed while checksums were trusted, had a checksum
+     * and its payload is still the RawPDU created while parsing it, which
+     * hasn't been modified, the checksum is updated incrementally 
+     * (RFC 1624) when serializing it, rather than summing the payload 
+     * again. See TrustedChecksums for more information.
+     *
      * \sa RawPDU
      */
     class UDP : public PDU {
@@ -176,9 +183,12 @@ namespace Tins {
             uint16_t check;
         } TINS_END_PACK;
 
+        friend class Internals::incremental_checksum;
+
         void write_serialization(uint8_t *buffer, uint32_t total_sz, const PDU *parent);
 
         udphdr _udp;
+        Internals::incremental_checksum _checksum_state;
     };
 }
 
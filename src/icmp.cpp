@@ -50,6 +50,7 @@ ICMP::ICMP(Flags flag)
 
 ICMP::ICMP(const uint8_t *buffer, uint32_t total_sz) 
 {
+    const uint8_t *icmp_start = buffer;
     if(total_sz < sizeof(icmphdr))
         throw malformed_packet();
     std::memcpy(&_icmp, buffer, sizeof(icmphdr));
@@ -78,6 +79,13 @@ ICMP::ICMP(const uint8_t *buffer, uint32_t total_sz)
     }
     if(total_sz)
         inner_pdu(new RawPDU(buffer, total_sz));
+    _checksum_state.parsed(
+        icmp_start,
+        static_cast<uint32_t>(buffer - icmp_start),
+        checksum(),
+        inner_pdu(),
+        false
+    );
 }
 
 void ICMP::code(uint8_t new_code) {
@@ -213,12 +221,18 @@ void ICMP::write_serialization(uint8_t *buffer, uint32_t total_sz, const PDU *)
     // checksum calc
     _icmp.check = 0;
     memcpy(buffer, &_icmp, sizeof(icmphdr));
-    uint32_t checksum = Utils::do_checksum(buffer, buffer + total_sz);
-
-    while (checksum >> 16)
-        checksum = (checksum & 0xffff) + (checksum >> 16);
+    uint16_t new_check;
+    // Avoid summing the payload if its sum is known
+    if(!Internals::incremental_checksum::update(buffer, header_size(), 0, 
+                                                inner_pdu(), new_check)) {
+        uint32_t checksum = Utils::do_checksum(buffer, buffer + total_sz);
+
+        while (checksum >> 16)
+            checksum = (checksum & 0xffff) + (checksum >> 16);
+        new_check = ~checksum;
+    }
 
-    _icmp.check = Endian::host_to_be<uint16_t>(~checksum);
+    _icmp.check = Endian::host_to_be(new_check);
     memcpy(buffer + 2, &_icmp.check, sizeof(uint16_t));
 }
 
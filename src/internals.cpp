@@ -46,6 +46,7 @@
 #include "arp.h"
 #include "eapol.h"
 #include "rawpdu.h"
+#include "utils.h"
 #include "dot1q.h"
 #include "pppoe.h"
 #include "exceptions.h"
@@ -284,6 +285,86 @@ bool decrement(IPv6Address &addr) {
     return decrement_buffer(addr);
 }
 
+namespace {
+uint16_t fold_checksum(uint32_t sum) {
+    while(sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return static_cast<uint16_t>(sum);
+}
+} // namespace
+
+void incremental_checksum::parsed(const uint8_t *header, uint32_t header_size,
+  uint16_t checksum, PDU *inner, bool uses_pseudo_header)
+{
+    awaiting_pseudo_header_ = false;
+    // Without a payload, only the header needs to be summed anyway
+    if(!TrustedChecksums::enabled() || !inner || inner->pdu_type() != PDU::RAW)
+        return;
+    // The header's sum without the checksum field...
+    const uint16_t header_sum = fold_checksum(
+        Utils::do_checksum(header, header + header_size) + 
+        static_cast<uint16_t>(~checksum)
+    );
+    // ...and the payload's sum, which is ~checksum - header_sum. The
+    // pseudo header's sum is subtracted later on, if needed.
+    payload_sum_ = fold_checksum(
+        static_cast<uint16_t>(~checksum) + static_cast<uint16_t>(~header_sum)
+    );
+    if(uses_pseudo_header) {
+        awaiting_pseudo_header_ = true;
+    }
+    else {
+        RawPDU *raw = static_cast<RawPDU*>(inner);
+        raw->_payload_sum = payload_sum_;
+        raw->_has_payload_sum = true;
+    }
+}
+
+void incremental_checksum::store_payload_sum(PDU *inner, 
+  uint32_t pseudo_header_sum) 
+{
+    if(!awaiting_pseudo_header_)
+        return;
+    awaiting_pseudo_header_ = false;
+    if(!inner || inner->pdu_type() != PDU::RAW)
+        return;
+    RawPDU *raw = static_cast<RawPDU*>(inner);
+    raw->_payload_sum = fold_checksum(
+        payload_sum_ + 
+        static_cast<uint16_t>(~fold_checksum(pseudo_header_sum))
+    );
+    raw->_has_payload_sum = true;
+}
+
+void incremental_checksum::parsed_pseudo_header(PDU *transport, 
+  uint32_t pseudo_header_sum)
+{
+    if(!transport)
+        return;
+    if(transport->pdu_type() == PDU::TCP) {
+        static_cast<TCP*>(transport)->_checksum_state.store_payload_sum(
+            transport->inner_pdu(), pseudo_header_sum);
+    }
+    else if(transport->pdu_type() == PDU::UDP) {
+        static_cast<UDP*>(transport)->_checksum_state.store_payload_sum(
+            transport->inner_pdu(), pseudo_header_sum);
+    }
+}
+
+bool incremental_checksum::update(const uint8_t *header, uint32_t header_size,
+  uint32_t pseudo_header_sum, const PDU *inner, uint16_t &checksum)
+{
+    if(!inner || inner->pdu_type() != PDU::RAW)
+        return false;
+    const RawPDU *raw = static_cast<const RawPDU*>(inner);
+    if(!raw->_has_payload_sum)
+        return false;
+    uint32_t sum = raw->_payload_sum + pseudo_header_sum + 
+                    Utils::do_checksum(header, header + header_size);
+    checksum = ~fold_checksum(sum);
+    return true;
+}
+
 IPv4Address last_address_from_mask(IPv4Address addr, IPv4Address mask) {
     uint32_t addr_int = Endian::be_to_host<uint32_t>(addr),
             mask_int = Endian::be_to_host<uint32_t>(mask);
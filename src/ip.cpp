@@ -78,6 +78,7 @@ IP::IP(const uint8_t *buffer, uint32_t total_sz)
     buffer += head_len() * sizeof(uint32_t);
     
     _options_size = 0;
+    bool source_routed = false;
     //_padded_options_size = head_len() * sizeof(uint32_t) - sizeof(iphdr);
     /* While the end of the options is not reached read an option */
     while (ptr_buffer < buffer && (*ptr_buffer != 0)) {
@@ -85,6 +86,8 @@ IP::IP(const uint8_t *buffer, uint32_t total_sz)
         option_identifier opt_type;
         memcpy(&opt_type, ptr_buffer, sizeof(uint8_t));
         ptr_buffer++;
+        if(opt_type.number == LSRR || opt_type.number == SSRR)
+            source_routed = true;
         if(opt_type.number > NOOP) {
             /* Multibyte options with length as second byte */
             if(ptr_buffer == buffer || *ptr_buffer == 0)
@@ -139,6 +142,21 @@ IP::IP(const uint8_t *buffer, uint32_t total_sz)
                 if(!inner_pdu())
                     inner_pdu(new RawPDU(buffer, total_sz));
             }
+            // When using TCP segmentation offload, the transport 
+            // layer's checksum can't be trusted. If source routing is
+            // used, it covers the final destination, which isn't the 
+            // one in this header.
+            if(tot_len() != 0 && !source_routed) {
+                Internals::incremental_checksum::parsed_pseudo_header(
+                    inner_pdu(),
+                    Utils::pseudoheader_checksum(
+                        src_addr(),
+                        dst_addr(),
+                        total_sz,
+                        _ip.protocol
+                    )
+                );
+            }
         }
         else {
             // It's fragmented, just use RawPDU
@@ -450,12 +468,17 @@ bool IP::matches_response(const uint8_t *ptr, uint32_t total_sz) const {
         const uint8_t *pkt_ptr = ptr + sizeof(iphdr);
         uint32_t pkt_sz = total_sz - sizeof(iphdr);
         // It's an ICMP dest unreachable
-        if(pkt_sz > 4 && pkt_ptr[0] == 3) {
-            pkt_ptr += 4;
-            pkt_sz -= 4;
+        if(pkt_sz > 8 && pkt_ptr[0] == 3) {
+            // Skip the ICMP header
+            pkt_ptr += 8;
+            pkt_sz -= 8;
             // If our IP header is in the ICMP payload, then it's the same packet.
-            // This keeps in mind checksum and IP identifier, so I guess it's enough.
-            if(pkt_sz >= sizeof(iphdr) && std::memcmp(&_ip, pkt_ptr, sizeof(iphdr))) 
+            // Routers modify the TTL and checksum, so only the fields that
+            // identify the packet are compared.
+            const iphdr *inner_ptr = (const iphdr*)pkt_ptr;
+            if(pkt_sz >= sizeof(iphdr) && inner_ptr->saddr == _ip.saddr && 
+               inner_ptr->daddr == _ip.daddr && inner_ptr->id == _ip.id &&
+               inner_ptr->protocol == _ip.protocol) 
                 return true;
         }
     }
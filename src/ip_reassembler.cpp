@@ -27,86 +27,642 @@
  *
  */
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include "ip.h"
+#include "ipv6.h"
 #include "rawpdu.h"
+#include "endianness.h"
 #include "constants.h"
 #include "internals.h"
 #include "ip_reassembler.h"
 
 namespace Tins {
 namespace Internals {
-IPv4Stream::IPv4Stream() 
-: received_end(false), received_size(), total_size() 
-{ 
+namespace {
+void add_payload(fragment_buffer &buffer, uint32_t offset, PDU *pdu, 
+  bool last_fragment, fragment_buffer::overlap_policy policy = fragment_buffer::FIRST) 
+{
+    // Fragments are parsed as RawPDUs, so their payload can be copied
+    // straight into the buffer
+    if(pdu->pdu_type() == PDU::RAW) {
+        const RawPDU::payload_type &data = static_cast<RawPDU*>(pdu)->payload();
+        buffer.add(
+            offset, 
+            data.empty() ? 0 : &data[0], 
+            static_cast<uint32_t>(data.size()),
+            last_fragment,
+            policy
+        );
+    }
+    else {
+        const PDU::serialization_type data = pdu->serialize();
+        buffer.add(
+            offset, 
+            data.empty() ? 0 : &data[0], 
+            static_cast<uint32_t>(data.size()),
+            last_fragment,
+            policy
+        );
+    }
+}
 
+// These take an IPv6 fragment extension header
+uint32_t fragment_offset(const IPv6::ext_header &header) {
+    const uint8_t *ptr = header.data_ptr();
+    return ((ptr[0] << 8) | ptr[1]) & 0xfff8;
 }
 
-void IPv4Stream::add_fragment(IP *ip) {
-    fragments_type::iterator it = fragments.begin();
-    uint16_t offset = extract_offset(ip);
-    while(it != fragments.end() && offset > it->offset()) {
-        ++it;
+bool more_fragments(const IPv6::ext_header &header) {
+    return (header.data_ptr()[1] & 1) != 0;
+}
+
+uint32_t fragment_id(const IPv6::ext_header &header) {
+    uint32_t id;
+    std::memcpy(&id, header.data_ptr() + 2, sizeof(id));
+    return Endian::be_to_host(id);
+}
+} // namespace
+
+// fragment_buffer
+
+fragment_buffer::fragment_buffer()
+: received_end(false), has_overlaps(false)
+{
+    // Until the last fragment is seen, the datagram has no end
+    holes.push_back(hole(0, std::numeric_limits<uint32_t>::max()));
+}
+
+void fragment_buffer::add(uint32_t offset, const uint8_t *data, uint32_t size,
+  bool last_fragment, overlap_policy policy) 
+{
+    uint32_t end = offset + size;
+    if(last_fragment) {
+        if(!received_end)
+            set_end(end);
+        else if(end != buffer.size())
+            has_overlaps = true;
+    }
+    if(received_end && end > buffer.size()) {
+        // Data past the datagram's end is dropped
+        has_overlaps = true;
+        end = std::max(offset, static_cast<uint32_t>(buffer.size()));
+    }
+    else if(end > buffer.size()) {
+        buffer.resize(end);
+    }
+    const uint32_t filled = fill_holes(offset, end, data);
+    const bool overlaps = filled < end - offset;
+    if(filled < size && !has_overlaps) {
+        // Fragments that only repeat data already received are fine
+        if(filled != 0 || std::memcmp(&buffer[offset], data, size) != 0)
+            has_overlaps = true;
+    }
+    if(policy == LAST) {
+        if(overlaps)
+            std::memcpy(&buffer[offset], data, end - offset);
     }
-    // No duplicates plx
-    if(it != fragments.end() && it->offset() == offset) 
+    else if(policy != FIRST && end > offset) {
+        add_segment(offset, end, data, overlaps, policy);
+    }
+}
+
+uint32_t fragment_buffer::fill_holes(uint32_t offset, uint32_t end, 
+  const uint8_t *data) 
+{
+    uint32_t filled = 0;
+    holes_type::iterator it = holes.begin();
+    while(it != holes.end() && it->first < end) {
+        if(it->last <= offset) {
+            ++it;
+            continue;
+        }
+        const uint32_t first = std::max(it->first, offset);
+        const uint32_t last = std::min(it->last, end);
+        std::memcpy(&buffer[first], data + (first - offset), last - first);
+        filled += last - first;
+        if(it->first < offset && end < it->last) {
+            // The fragment splits this hole in two
+            const hole right(end, it->last);
+            it->last = offset;
+            holes.insert(it + 1, right);
+            break;
+        }
+        else if(it->first < offset) {
+            it->last = offset;
+            ++it;
+        }
+        else if(end < it->last) {
+            it->first = end;
+            break;
+        }
+        else {
+            it = holes.erase(it);
+        }
+    }
+    return filled;
+}
+
+void fragment_buffer::add_segment(uint32_t offset, uint32_t end, 
+  const uint8_t *data, bool overlaps, overlap_policy policy) 
+{
+    const segment fragment(offset, end, offset, end);
+    if(!overlaps) {
+        // Fragments usually arrive in order, so this is mostly an append
+        segments_type::iterator it = segments.end();
+        while(it != segments.begin() && offset < (it - 1)->first)
+            --it;
+        segments.insert(it, fragment);
         return;
-    fragments.insert(it, IPv4Fragment(ip->inner_pdu(), offset));
-    received_size += ip->inner_pdu()->size();
-    if(ip->flags() != IP::MORE_FRAGMENTS) {
-        total_size = offset + ip->inner_pdu()->size();
-        received_end = true;
     }
-    if(offset == 0)
-        transport_proto = ip->protocol();
+    // Every segment this fragment overlaps is either kept or replaced,
+    // the fragment gets whatever wasn't kept
+    segments_type output, kept;
+    for(segments_type::const_iterator it = segments.begin(); it != segments.end(); ++it) {
+        if(it->last <= offset || it->first >= end) {
+            output.push_back(*it);
+            continue;
+        }
+        if(!new_data_wins(policy, offset, end, *it)) {
+            output.push_back(*it);
+            kept.push_back(*it);
+            continue;
+        }
+        const uint32_t first = std::max(it->first, offset);
+        const uint32_t last = std::min(it->last, end);
+        std::memcpy(&buffer[first], data + (first - offset), last - first);
+        if(it->first < first)
+            output.push_back(segment(it->first, first, it->fragment_first, it->fragment_last));
+        if(last < it->last)
+            output.push_back(segment(last, it->last, it->fragment_first, it->fragment_last));
+    }
+    uint32_t current = offset;
+    for(segments_type::const_iterator it = kept.begin(); it != kept.end(); ++it) {
+        if(current < it->first)
+            output.push_back(segment(current, it->first, offset, end));
+        current = std::max(current, it->last);
+    }
+    if(current < end)
+        output.push_back(segment(current, end, offset, end));
+    std::sort(output.begin(), output.end());
+    segments.swap(output);
+}
+
+bool fragment_buffer::new_data_wins(overlap_policy policy, uint32_t first, 
+  uint32_t last, const segment &current) 
+{
+    switch(policy) {
+        case LAST:
+            return true;
+        case BSD:
+            return first < current.fragment_first;
+        case LINUX:
+            return first < current.fragment_first || 
+                   (first == current.fragment_first && last >= current.fragment_last);
+        case WINDOWS:
+            return first < current.fragment_first && last > current.fragment_last;
+        case SOLARIS:
+            return first < current.fragment_first && last >= current.fragment_last;
+        default:
+            return false;
+    }
+}
+
+void fragment_buffer::set_end(uint32_t end) {
+    received_end = true;
+    if(buffer.size() > end)
+        has_overlaps = true;
+    buffer.resize(end);
+    holes_type::iterator it = holes.begin();
+    while(it != holes.end() && it->last <= end)
+        ++it;
+    if(it != holes.end() && it->first < end) {
+        it->last = end;
+        ++it;
+    }
+    holes.erase(it, holes.end());
+    // Data past the end isn't part of the datagram
+    segments_type::iterator seg_it = segments.begin();
+    while(seg_it != segments.end() && seg_it->last <= end)
+        ++seg_it;
+    if(seg_it != segments.end() && seg_it->first < end) {
+        seg_it->last = end;
+        ++seg_it;
+    }
+    segments.erase(seg_it, segments.end());
+}
+
+// IPv4Stream
+
+IPv4Stream::IPv4Stream() 
+: transport_proto()
+{ 
+
+}
+
+void IPv4Stream::add_fragment(IP *ip, fragment_buffer::overlap_policy policy) {
+    transport_proto = ip->protocol();
+    add_payload(
+        payload, 
+        extract_offset(ip), 
+        ip->inner_pdu(), 
+        (ip->flags() & IP::MORE_FRAGMENTS) == 0,
+        policy
+    );
 }
 
 bool IPv4Stream::is_complete() const {
-    return received_end && received_size == total_size;
+    return payload.is_complete();
 }
 
 PDU *IPv4Stream::allocate_pdu() const {
-    PDU::serialization_type buffer;
-    buffer.reserve(total_size);
-    // Check if we actually have all the data we need. Otherwise return nullptr;
-    uint16_t expected = 0;
-    for(fragments_type::const_iterator it = fragments.begin(); it != fragments.end(); ++it) {
-        if(expected != it->offset())
-            return 0;
-        expected = static_cast<uint16_t>(it->offset() + it->payload().size());
-        buffer.insert(buffer.end(), it->payload().begin(), it->payload().end());
-    }
+    if(!payload.is_complete())
+        return 0;
     return Internals::pdu_from_flag(
         static_cast<Constants::IP::e>(transport_proto),
-        buffer.empty() ? 0 : &buffer[0],
-        static_cast<uint32_t>(buffer.size())
+        payload.data(),
+        static_cast<uint32_t>(payload.size())
     );
 }
 
-uint16_t IPv4Stream::extract_offset(const IP *ip) {
+uint32_t IPv4Stream::fragment_end(const IP *ip) {
+    return extract_offset(ip) + ip->inner_pdu()->size();
+}
+
+uint32_t IPv4Stream::extract_offset(const IP *ip) {
     return ip->fragment_offset() * 8;
 }
 
+// IPv6Stream
+
+IPv6Stream::IPv6Stream() 
+: next_header()
+{ 
+
+}
+
+void IPv6Stream::add_fragment(IPv6 *ip, const IPv6::ext_header &header) {
+    next_header = header.option();
+    add_payload(
+        payload, 
+        fragment_offset(header), 
+        ip->inner_pdu(), 
+        !more_fragments(header)
+    );
+}
+
+bool IPv6Stream::is_complete() const {
+    return payload.is_complete();
+}
+
+PDU *IPv6Stream::allocate_pdu() const {
+    if(!payload.is_complete())
+        return 0;
+    return Internals::pdu_from_flag(
+        static_cast<Constants::IP::e>(next_header),
+        payload.data(),
+        static_cast<uint32_t>(payload.size())
+    );
+}
+
+uint32_t IPv6Stream::fragment_end(const IPv6 *ip, const IPv6::ext_header &header) {
+    return fragment_offset(header) + ip->inner_pdu()->size();
+}
+
+// ipv4_fragment_key
+
+ipv4_fragment_key::ipv4_fragment_key(const IP *ip) 
+: src_addr(ip->src_addr()), dst_addr(ip->dst_addr()), id(ip->id()),
+  protocol(ip->protocol())
+{
+
+}
+
+uint32_t ipv4_fragment_key::hash() const {
+    return mix_hash(((static_cast<uint64_t>(src_addr) << 32) | dst_addr) ^
+                    (((static_cast<uint64_t>(id) << 8) | protocol) * 
+                        0x9e3779b97f4a7c15ULL));
+}
+
+// ipv6_fragment_key
+
+ipv6_fragment_key::ipv6_fragment_key() 
+: id(0)
+{
+    std::memset(src_addr, 0, sizeof(src_addr));
+    std::memset(dst_addr, 0, sizeof(dst_addr));
+}
+
+ipv6_fragment_key::ipv6_fragment_key(const IPv6 *ip, const IPv6::ext_header &header) 
+: id(fragment_id(header))
+{
+    const IPv6Address src = ip->src_addr(), dst = ip->dst_addr();
+    std::copy(src.begin(), src.end(), src_addr);
+    std::copy(dst.begin(), dst.end(), dst_addr);
+}
+
+uint32_t ipv6_fragment_key::hash() const {
+    uint64_t words[4];
+    std::memcpy(words, src_addr, sizeof(src_addr));
+    std::memcpy(words + 2, dst_addr, sizeof(dst_addr));
+    uint64_t value = id * 0x9e3779b97f4a7c15ULL;
+    for(size_t i = 0; i < 4; ++i)
+        value = (value ^ words[i]) * 0xff51afd7ed558ccdULL;
+    return mix_hash(value);
+}
+
+// fragment_table
+
+template<typename Key, typename Stream>
+const uint32_t fragment_table<Key, Stream>::npos;
+
+template<typename Key, typename Stream>
+fragment_table<Key, Stream>::fragment_table() 
+: free_head_(npos), head_(npos), tail_(npos), size_(0)
+{
+
+}
+
+template<typename Key, typename Stream>
+void fragment_table<Key, Stream>::clear() {
+    nodes_.clear();
+    slots_.clear();
+    free_head_ = head_ = tail_ = npos;
+    size_ = 0;
+}
+
+template<typename Key, typename Stream>
+uint32_t fragment_table<Key, Stream>::find(const key_type &key) const {
+    if(slots_.empty())
+        return npos;
+    const uint32_t hash = key.hash();
+    const size_t mask = slots_.size() - 1;
+    for(size_t i = hash & mask; slots_[i] != 0; i = (i + 1) & mask) {
+        const node &current = nodes_[slots_[i] - 1];
+        if(current.hash == hash && current.key == key)
+            return slots_[i] - 1;
+    }
+    return npos;
+}
+
+template<typename Key, typename Stream>
+uint32_t fragment_table<Key, Stream>::insert(const key_type &key, uint64_t now) {
+    // Keep the load factor at or below 1/2, so probe sequences are short
+    if((size_ + 1) * 2 > slots_.size())
+        rehash(std::max<size_t>(16, slots_.size() * 2));
+    uint32_t index;
+    if(free_head_ != npos) {
+        index = free_head_;
+        free_head_ = nodes_[index].next;
+    }
+    else {
+        index = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back(node());
+    }
+    node &new_node = nodes_[index];
+    new_node.key = key;
+    new_node.created = now;
+    new_node.hash = key.hash();
+    place(index);
+    push_front(index);
+    size_++;
+    return index;
+}
+
+template<typename Key, typename Stream>
+void fragment_table<Key, Stream>::remove(uint32_t index) {
+    const size_t mask = slots_.size() - 1;
+    size_t hole = nodes_[index].hash & mask;
+    while(slots_[hole] != index + 1)
+        hole = (hole + 1) & mask;
+    // Backward shift deletion: move back every entry in the probe
+    // sequence that'd become unreachable
+    for(size_t i = (hole + 1) & mask; slots_[i] != 0; i = (i + 1) & mask) {
+        const size_t ideal = nodes_[slots_[i] - 1].hash & mask;
+        if(((i - ideal) & mask) >= ((i - hole) & mask)) {
+            slots_[hole] = slots_[i];
+            hole = i;
+        }
+    }
+    slots_[hole] = 0;
+    unlink(index);
+    // Release the fragments now rather than when the node is reused
+    nodes_[index].stream = stream_type();
+    nodes_[index].next = free_head_;
+    free_head_ = index;
+    size_--;
+}
+
+template<typename Key, typename Stream>
+void fragment_table<Key, Stream>::unlink(uint32_t index) {
+    node &current = nodes_[index];
+    if(current.prev != npos)
+        nodes_[current.prev].next = current.next;
+    else
+        head_ = current.next;
+    if(current.next != npos)
+        nodes_[current.next].prev = current.prev;
+    else
+        tail_ = current.prev;
+}
+
+template<typename Key, typename Stream>
+void fragment_table<Key, Stream>::push_front(uint32_t index) {
+    node &current = nodes_[index];
+    current.prev = npos;
+    current.next = head_;
+    if(head_ != npos)
+        nodes_[head_].prev = index;
+    else
+        tail_ = index;
+    head_ = index;
+}
+
+template<typename Key, typename Stream>
+void fragment_table<Key, Stream>::rehash(size_t slot_count) {
+    slots_.assign(slot_count, 0);
+    for(uint32_t i = head_; i != npos; i = nodes_[i].next)
+        place(i);
+}
+
+template<typename Key, typename Stream>
+void fragment_table<Key, Stream>::place(uint32_t index) {
+    const size_t mask = slots_.size() - 1;
+    size_t i = nodes_[index].hash & mask;
+    while(slots_[i] != 0)
+        i = (i + 1) & mask;
+    slots_[i] = index + 1;
+}
+
+template class fragment_table<ipv4_fragment_key, IPv4Stream>;
+template class fragment_table<ipv6_fragment_key, IPv6Stream>;
+
+// fragment_store
+
+template<typename Key, typename Stream>
+const uint32_t fragment_store<Key, Stream>::npos;
+
+template<typename Key, typename Stream>
+fragment_store<Key, Stream>::fragment_store(uint32_t timeout, size_t max_buffer)
+: now_(0), timeout_(timeout), max_buffer_(max_buffer), buffered_size_(0)
+{
+
+}
+
+template<typename Key, typename Stream>
+void fragment_store<Key, Stream>::advance(uint64_t now, uint64_t &timed_out) {
+    now_ = now;
+    if(timeout_ == 0)
+        return;
+    const uint64_t timeout = static_cast<uint64_t>(timeout_) * 1000000;
+    uint32_t index = table_.oldest();
+    while(index != npos && table_.created(index) + timeout <= now_) {
+        remove(index);
+        timed_out++;
+        index = table_.oldest();
+    }
+}
+
+template<typename Key, typename Stream>
+uint32_t fragment_store<Key, Stream>::reserve(const key_type &key, 
+  uint32_t index, size_t growth, uint64_t &evicted) 
+{
+    if(!make_room(growth, index, evicted)) {
+        // This datagram would never fit
+        if(index != npos) {
+            remove(index);
+            evicted++;
+        }
+        return npos;
+    }
+    if(index == npos)
+        index = table_.insert(key, now_);
+    return index;
+}
+
+template<typename Key, typename Stream>
+bool fragment_store<Key, Stream>::make_room(size_t size, uint32_t current,
+  uint64_t &evicted) 
+{
+    if(max_buffer_ == 0)
+        return true;
+    // Evict the oldest datagrams, except for the one being added to
+    uint32_t index = table_.oldest();
+    while(buffered_size_ + size > max_buffer_ && index != npos) {
+        const uint32_t next = table_.newer(index);
+        if(index != current) {
+            remove(index);
+            evicted++;
+        }
+        index = next;
+    }
+    return buffered_size_ + size <= max_buffer_;
+}
+
+template<typename Key, typename Stream>
+void fragment_store<Key, Stream>::remove(uint32_t index) {
+    buffered_size_ -= table_.stream(index).buffered_size();
+    table_.remove(index);
+}
+
+template<typename Key, typename Stream>
+void fragment_store<Key, Stream>::clear() {
+    table_.clear();
+    buffered_size_ = 0;
+}
+
+template class fragment_store<ipv4_fragment_key, IPv4Stream>;
+template class fragment_store<ipv6_fragment_key, IPv6Stream>;
+
 } // namespace Internals
 
+// IPv4Reassembler
+
+namespace {
+Internals::fragment_buffer::overlap_policy to_overlap_policy(
+  IPv4Reassembler::overlapping_technique technique) 
+{
+    typedef Internals::fragment_buffer buffer_type;
+    switch(technique) {
+        case IPv4Reassembler::LAST:
+            return buffer_type::LAST;
+        case IPv4Reassembler::BSD:
+            return buffer_type::BSD;
+        case IPv4Reassembler::LINUX:
+            return buffer_type::LINUX;
+        case IPv4Reassembler::WINDOWS:
+            return buffer_type::WINDOWS;
+        case IPv4Reassembler::SOLARIS:
+            return buffer_type::SOLARIS;
+        default:
+            return buffer_type::FIRST;
+    }
+}
+} // namespace
+
+const uint32_t IPv4Reassembler::DEFAULT_TIMEOUT = 30;
+const size_t IPv4Reassembler::DEFAULT_MAX_BUFFER = 4 * 1024 * 1024;
+
+IPv4Reassembler::Stats::Stats()
+: reassembled(0), timed_out(0), evicted(0), overlapping(0)
+{
+
+}
+
 IPv4Reassembler::IPv4Reassembler(overlapping_technique technique)
-: technique(technique)
+: streams(DEFAULT_TIMEOUT, DEFAULT_MAX_BUFFER), technique(technique), 
+  policy(to_overlap_policy(technique))
 {
 
 }
 
 IPv4Reassembler::packet_status IPv4Reassembler::process(PDU &pdu) {
+    return process(pdu, static_cast<const Timestamp*>(0));
+}
+
+IPv4Reassembler::packet_status IPv4Reassembler::process(PDU &pdu, 
+  const Timestamp &ts) 
+{
+    return process(pdu, &ts);
+}
+
+IPv4Reassembler::packet_status IPv4Reassembler::process(Packet &packet) {
+    if(!packet.pdu())
+        return NOT_FRAGMENTED;
+    return process(*packet.pdu(), &packet.timestamp());
+}
+
+IPv4Reassembler::packet_status IPv4Reassembler::process(PDU &pdu, 
+  const Timestamp *ts) 
+{
+    if(ts) {
+        streams.advance(static_cast<uint64_t>(ts->seconds()) * 1000000 + 
+                        ts->microseconds(), stats_.timed_out);
+    }
     IP *ip = pdu.find_pdu<IP>();
     if(ip && ip->inner_pdu()) {
         // There's fragmentation
         if(ip->is_fragmented()) {
-            key_type key = make_key(ip);
-            // Create it or look it up, it's the same
-            Internals::IPv4Stream &stream = streams[key];
-            stream.add_fragment(ip);
+            const Internals::ipv4_fragment_key key(ip);
+            uint32_t index = streams.find(key);
+            const size_t growth = (index == streams_type::npos) ?
+                                  Internals::IPv4Stream::fragment_end(ip) :
+                                  streams.stream(index).growth(ip);
+            index = streams.reserve(key, index, growth, stats_.evicted);
+            if(index == streams_type::npos)
+                return FRAGMENTED;
+            Internals::IPv4Stream &stream = streams.stream(index);
+            const size_t previous_size = stream.buffered_size();
+            const bool previous_overlaps = stream.overlapped();
+            stream.add_fragment(ip, policy);
+            streams.resized(previous_size, stream.buffered_size());
+            if(!previous_overlaps && stream.overlapped())
+                stats_.overlapping++;
             if(stream.is_complete()) {
                 PDU *pdu = stream.allocate_pdu();
                 // Erase this stream, since it's already assembled
-                streams.erase(key);
+                streams.remove(index);
                 // The packet is corrupt
                 if(!pdu)  {
                     return FRAGMENTED;
@@ -114,6 +670,7 @@ IPv4Reassembler::packet_status IPv4Reassembler::process(PDU &pdu) {
                 ip->inner_pdu(pdu);
                 ip->fragment_offset(0);
                 ip->flags(static_cast<IP::Flags>(0));
+                stats_.reassembled++;
                 return REASSEMBLED;
             }
             else
@@ -123,31 +680,131 @@ IPv4Reassembler::packet_status IPv4Reassembler::process(PDU &pdu) {
     return NOT_FRAGMENTED;
 }
 
-IPv4Reassembler::key_type IPv4Reassembler::make_key(const IP *ip) const {
-    return std::make_pair(
-        ip->id(),
-        make_address_pair(ip->src_addr(), ip->dst_addr())
-    );
+void IPv4Reassembler::clear_streams() {
+    streams.clear();
 }
 
-IPv4Reassembler::address_pair IPv4Reassembler::make_address_pair(IPv4Address addr1, IPv4Address addr2) const {
-    if(addr1 < addr2)
-        return std::make_pair(addr1, addr2);
-    else
-        return std::make_pair(addr2, addr1);
+void IPv4Reassembler::remove_stream(uint16_t id, IPv4Address addr1, IPv4Address addr2) {
+    const uint32_t first = addr1, second = addr2;
+    uint32_t index = streams.oldest();
+    while(index != streams_type::npos) {
+        const uint32_t next = streams.newer(index);
+        const Internals::ipv4_fragment_key &key = streams.key(index);
+        if(key.id == id && 
+           ((key.src_addr == first && key.dst_addr == second) ||
+            (key.src_addr == second && key.dst_addr == first))) {
+            streams.remove(index);
+        }
+        index = next;
+    }
 }
 
-void IPv4Reassembler::clear_streams() {
+// IPv6Reassembler
+
+namespace {
+// Returns the fragment header if the packet is a fragment
+const IPv6::ext_header *find_fragment_header(const IPv6 *ip) {
+    const IPv6::ext_header *header = ip->search_header(IPv6::FRAGMENT);
+    if(!header || header->data_size() < 6)
+        return 0;
+    if(Internals::fragment_offset(*header) == 0 && 
+       !Internals::more_fragments(*header))
+        return 0;
+    return header;
+}
+} // namespace
+
+const uint32_t IPv6Reassembler::DEFAULT_TIMEOUT = 60;
+const size_t IPv6Reassembler::DEFAULT_MAX_BUFFER = 4 * 1024 * 1024;
+
+IPv6Reassembler::IPv6Reassembler()
+: streams(DEFAULT_TIMEOUT, DEFAULT_MAX_BUFFER), drop_overlapping_(true)
+{
+
+}
+
+IPv6Reassembler::packet_status IPv6Reassembler::process(PDU &pdu) {
+    return process(pdu, static_cast<const Timestamp*>(0));
+}
+
+IPv6Reassembler::packet_status IPv6Reassembler::process(PDU &pdu, 
+  const Timestamp &ts) 
+{
+    return process(pdu, &ts);
+}
+
+IPv6Reassembler::packet_status IPv6Reassembler::process(Packet &packet) {
+    if(!packet.pdu())
+        return NOT_FRAGMENTED;
+    return process(*packet.pdu(), &packet.timestamp());
+}
+
+IPv6Reassembler::packet_status IPv6Reassembler::process(PDU &pdu, 
+  const Timestamp *ts) 
+{
+    if(ts) {
+        streams.advance(static_cast<uint64_t>(ts->seconds()) * 1000000 + 
+                        ts->microseconds(), stats_.timed_out);
+    }
+    IPv6 *ip = pdu.find_pdu<IPv6>();
+    if(!ip || !ip->inner_pdu())
+        return NOT_FRAGMENTED;
+    const IPv6::ext_header *header = find_fragment_header(ip);
+    if(!header)
+        return NOT_FRAGMENTED;
+    const Internals::ipv6_fragment_key key(ip, *header);
+    uint32_t index = streams.find(key);
+    const size_t growth = (index == streams_type::npos) ?
+                          Internals::IPv6Stream::fragment_end(ip, *header) :
+                          streams.stream(index).growth(ip, *header);
+    index = streams.reserve(key, index, growth, stats_.evicted);
+    if(index == streams_type::npos)
+        return FRAGMENTED;
+    Internals::IPv6Stream &stream = streams.stream(index);
+    const size_t previous_size = stream.buffered_size();
+    const bool previous_overlaps = stream.overlapped();
+    stream.add_fragment(ip, *header);
+    streams.resized(previous_size, stream.buffered_size());
+    if(!previous_overlaps && stream.overlapped()) {
+        stats_.overlapping++;
+        // RFC 5722: the whole datagram is silently discarded
+        if(drop_overlapping_) {
+            streams.remove(index);
+            return FRAGMENTED;
+        }
+    }
+    if(!stream.is_complete())
+        return FRAGMENTED;
+    PDU *payload = stream.allocate_pdu();
+    // Erase this stream, since it's already assembled
+    streams.remove(index);
+    // The packet is corrupt
+    if(!payload)
+        return FRAGMENTED;
+    ip->remove_ext_header(IPv6::FRAGMENT);
+    ip->inner_pdu(payload);
+    stats_.reassembled++;
+    return REASSEMBLED;
+}
+
+void IPv6Reassembler::clear_streams() {
     streams.clear();
 }
 
-void IPv4Reassembler::remove_stream(uint16_t id, IPv4Address addr1, IPv4Address addr2) {
-    streams.erase(
-        std::make_pair(
-            id, 
-            make_address_pair(addr1, addr2)
-        )
-    );
+void IPv6Reassembler::remove_stream(uint32_t id, const IPv6Address &addr1, 
+  const IPv6Address &addr2) 
+{
+    uint32_t index = streams.oldest();
+    while(index != streams_type::npos) {
+        const uint32_t next = streams.newer(index);
+        const Internals::ipv6_fragment_key &key = streams.key(index);
+        const IPv6Address src(key.src_addr), dst(key.dst_addr);
+        if(key.id == id && 
+           ((src == addr1 && dst == addr2) || (src == addr2 && dst == addr1))) {
+            streams.remove(index);
+        }
+        index = next;
+    }
 }
 
 } // namespace Tins
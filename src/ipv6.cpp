@@ -44,9 +44,22 @@
 #include "rawpdu.h"
 #include "exceptions.h"
 #include "pdu_allocator.h"
+#include "utils.h"
 #include "internals.h"
 
 namespace Tins {
+namespace {
+// Both take a pointer to the fragment header, after its next header 
+// and reserved fields
+uint16_t fragment_header_offset(const uint8_t *ptr) {
+    return static_cast<uint16_t>(((ptr[0] << 8) | ptr[1]) & 0xfff8);
+}
+
+bool fragment_header_more(const uint8_t *ptr) {
+    return (ptr[1] & 1) != 0;
+}
+} // namespace
+
 
 IPv6::IPv6(address_type ip_dst, address_type ip_src, PDU *child) 
 : headers_size(0)
@@ -65,6 +78,7 @@ IPv6::IPv6(const uint8_t *buffer, uint32_t total_sz)
     buffer += sizeof(_header);
     total_sz -= sizeof(_header);
     uint8_t current_header = _header.next_header;
+    bool has_routing_header = false, is_fragment = false;
     while(total_sz) {
         if(is_extension_header(current_header)) {
             if(total_sz < 8)
@@ -79,10 +93,19 @@ IPv6::IPv6(const uint8_t *buffer, uint32_t total_sz)
             add_ext_header(
                 ext_header(buffer[0], size - sizeof(uint8_t)*2, buffer + 2)
             );
+            has_routing_header = has_routing_header || current_header == ROUTING;
+            if(current_header == FRAGMENT)
+                is_fragment = is_fragment || fragment_header_offset(buffer + 2) != 0 ||
+                              fragment_header_more(buffer + 2);
             current_header = buffer[0];
             buffer += size;
             total_sz -= size;
         }
+        // Don't try to decode it if it's fragmented
+        else if(is_fragment) {
+            inner_pdu(new Tins::RawPDU(buffer, total_sz));
+            total_sz = 0;
+        }
         else {
             inner_pdu(
                 Internals::pdu_from_flag(
@@ -103,6 +126,19 @@ IPv6::IPv6(const uint8_t *buffer, uint32_t total_sz)
                 if(!inner_pdu())
                     inner_pdu(new Tins::RawPDU(buffer, total_sz));
             }
+            // The transport layer's checksum uses the final destination,
+            // which isn't the one in this header if it's routed
+            if(!has_routing_header) {
+                Internals::incremental_checksum::parsed_pseudo_header(
+                    inner_pdu(),
+                    Utils::pseudoheader_checksum(
+                        src_addr(),
+                        dst_addr(),
+                        total_sz,
+                        current_header
+                    )
+                );
+            }
             total_sz = 0;
         }
     }
@@ -230,6 +266,35 @@ void IPv6::add_ext_header(const ext_header &header) {
     headers_size += static_cast<uint32_t>(header.data_size() + sizeof(uint8_t) * 2);
 }
 
+bool IPv6::remove_ext_header(ExtensionHeader id) {
+    uint8_t current_header = _header.next_header;
+    headers_type::iterator previous = ext_headers.end();
+    headers_type::iterator it = ext_headers.begin();
+    while(it != ext_headers.end() && current_header != id) {
+        current_header = it->option();
+        previous = it;
+        ++it;
+    }
+    if(it == ext_headers.end())
+        return false;
+    // Whatever pointed to the removed header now points to the next one
+    if(previous == ext_headers.end())
+        _header.next_header = it->option();
+    else
+        previous->option(it->option());
+    headers_size -= static_cast<uint32_t>(it->data_size() + sizeof(uint8_t) * 2);
+    ext_headers.erase(it);
+    return true;
+}
+
+bool IPv6::is_fragmented() const {
+    const ext_header *header = search_header(FRAGMENT);
+    if(!header || header->data_size() < 2)
+        return false;
+    return fragment_header_offset(header->data_ptr()) != 0 || 
+           fragment_header_more(header->data_ptr());
+}
+
 const IPv6::ext_header *IPv6::search_header(ExtensionHeader id) const {
     uint8_t current_header = _header.next_header;
     headers_type::const_iterator it = ext_headers.begin();
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+#include <cmath>
+#include <algorithm>
+#include "pacer.h"
+
+namespace Tins {
+
+Pacer::Stats::Stats()
+: packets(0), bytes(0), waits(0), wait_time(0), behind(0), max_lag(0), 
+  first_packet(0), last_packet(0)
+{
+
+}
+
+uint64_t Pacer::Stats::elapsed() const {
+    return last_packet - first_packet;
+}
+
+double Pacer::Stats::packets_per_second() const {
+    if(packets < 2 || elapsed() == 0)
+        return 0;
+    return (packets - 1) * 1e9 / elapsed();
+}
+
+double Pacer::Stats::bits_per_second() const {
+    if(packets < 2 || elapsed() == 0)
+        return 0;
+    // Approximate the last packet's size using the average one
+    const double bytes_sent = bytes - static_cast<double>(bytes) / packets;
+    return bytes_sent * 8e9 / elapsed();
+}
+
+Pacer::Pacer()
+: packet_interval_(0), byte_interval_(0), burst_(1), mode_(SLEEP), 
+  next_slot_(0)
+{
+
+}
+
+Pacer::Pacer(double packets_per_second, double bits_per_second, 
+  uint32_t burst, WaitMode mode)
+: packet_interval_(packets_per_second > 0 ? 1e9 / packets_per_second : 0),
+  byte_interval_(bits_per_second > 0 ? 8e9 / bits_per_second : 0),
+  burst_(burst > 0 ? burst : 1), mode_(mode), next_slot_(0)
+{
+
+}
+
+bool Pacer::enabled() const {
+    return packet_interval_ > 0 || byte_interval_ > 0;
+}
+
+double Pacer::packets_per_second() const {
+    return packet_interval_ > 0 ? 1e9 / packet_interval_ : 0;
+}
+
+double Pacer::bits_per_second() const {
+    return byte_interval_ > 0 ? 8e9 / byte_interval_ : 0;
+}
+
+uint32_t Pacer::burst() const {
+    return burst_;
+}
+
+Pacer::WaitMode Pacer::wait_mode() const {
+    return mode_;
+}
+
+void Pacer::pace(uint32_t size) {
+    if(enabled())
+        wait_until(reserve(size, clock()));
+}
+
+uint64_t Pacer::reserve(uint32_t size, uint64_t now) {
+    if(!enabled())
+        return now;
+    if(stats_.packets == 0) {
+        stats_.first_packet = now;
+        next_slot_ = 0;
+    }
+    const double interval = std::max(packet_interval_, byte_interval_ * size);
+    // Packets can be sent this long before their slot
+    const double tolerance = (burst_ - 1) * interval;
+    const double current = static_cast<double>(now - stats_.first_packet);
+    double send_time = current;
+    if(next_slot_ - tolerance > current) {
+        send_time = next_slot_ - tolerance;
+    }
+    else if(current > next_slot_) {
+        const double lag = current - next_slot_;
+        if(lag > interval)
+            ++stats_.behind;
+        stats_.max_lag = std::max(stats_.max_lag, static_cast<uint64_t>(lag));
+    }
+    // Being late fills up the bucket, so up to burst packets can be sent 
+    // right away to catch up
+    next_slot_ = std::max(next_slot_, send_time) + interval;
+
+    const uint64_t output = stats_.first_packet + static_cast<uint64_t>(std::ceil(send_time));
+    if(output > now) {
+        ++stats_.waits;
+        stats_.wait_time += output - now;
+    }
+    ++stats_.packets;
+    stats_.bytes += size;
+    stats_.last_packet = std::max(output, now);
+    return stats_.last_packet;
+}
+
+void Pacer::wait_until(uint64_t time) const {
+    wait_until(time, mode_);
+}
+
+void Pacer::wait_until(uint64_t time, WaitMode mode) {
+    uint64_t now = clock();
+    if(mode == BUSY_WAIT) {
+        while(now < time)
+            now = clock();
+        return;
+    }
+    // Sleeps can be interrupted, so keep going until the time is reached
+    while(now < time) {
+        #ifdef _WIN32
+            Sleep(static_cast<DWORD>((time - now) / 1000000));
+        #else
+            const uint64_t remaining = time - now;
+            struct timespec duration;
+            duration.tv_sec = static_cast<time_t>(remaining / 1000000000);
+            duration.tv_nsec = static_cast<long>(remaining % 1000000000);
+            nanosleep(&duration, 0);
+        #endif
+        now = clock();
+    }
+}
+
+const Pacer::Stats& Pacer::stats() const {
+    return stats_;
+}
+
+void Pacer::reset() {
+    stats_ = Stats();
+    next_slot_ = 0;
+}
+
+uint64_t Pacer::clock() {
+    #ifdef _WIN32
+        LARGE_INTEGER counter, frequency;
+        QueryPerformanceCounter(&counter);
+        QueryPerformanceFrequency(&frequency);
+        return static_cast<uint64_t>(
+            static_cast<double>(counter.QuadPart) * 1e9 / frequency.QuadPart
+        );
+    #else
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    #endif
+}
+
+} // Tins
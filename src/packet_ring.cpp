@@ -0,0 +1,532 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "packet_ring.h"
+
+#ifdef HAVE_PACKET_RING
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include "network_interface.h"
+#include "exceptions.h"
+#include "pdu.h"
+
+using std::string;
+using std::runtime_error;
+
+namespace Tins {
+const uint32_t RxPacketRing::DEFAULT_BLOCK_SIZE = 1 << 20;
+const uint32_t TxPacketRing::DEFAULT_FRAME_SIZE = 2048;
+const uint32_t TxPacketRing::DEFAULT_FRAME_COUNT = 256;
+
+namespace {
+// Maps an ARPHRD_* device type into a DLT_* link type
+int link_type_from_device(int socket, const string& iface) {
+    ifreq request;
+    std::memset(&request, 0, sizeof(request));
+    std::strncpy(request.ifr_name, iface.c_str(), sizeof(request.ifr_name) - 1);
+    if (ioctl(socket, SIOCGIFHWADDR, &request) < 0) {
+        throw runtime_error(strerror(errno));
+    }
+    switch (request.ifr_hwaddr.sa_family) {
+        case ARPHRD_ETHER:
+        case ARPHRD_LOOPBACK:
+            return DLT_EN10MB;
+        case ARPHRD_IEEE80211:
+            return DLT_IEEE802_11;
+        case ARPHRD_IEEE80211_RADIOTAP:
+            return DLT_IEEE802_11_RADIO;
+        default:
+            throw unknown_link_type();
+    };
+}
+} // namespace
+
+RxPacketRing::RxPacketRing(const string& iface, uint32_t block_size, 
+                           uint32_t block_count, uint32_t snap_len, 
+                           uint32_t timeout)
+: socket_(-1), wakeup_(-1), link_type_(0), if_index_(NetworkInterface(iface).id()), 
+  buffer_(0), block_size_(block_size), block_count_(block_count), 
+  snap_len_(snap_len), timeout_(timeout), current_block_(0), current_desc_(0), 
+  current_frame_(0), frames_left_(0), next_header_(), break_loop_(0)
+{
+    // A zero protocol is used, so nothing is queued on this socket until
+    // it's bound to the interface. Otherwise, frames from every interface
+    // could get into the ring.
+    socket_ = ::socket(AF_PACKET, SOCK_RAW, 0);
+    if (socket_ < 0) {
+        throw socket_open_error(strerror(errno));
+    }
+    try {
+        wakeup_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeup_ < 0) {
+            throw runtime_error(strerror(errno));
+        }
+        link_type_ = link_type_from_device(socket_, iface);
+
+        int version = TPACKET_V3;
+        if (setsockopt(socket_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+            throw runtime_error(strerror(errno));
+        }
+
+        // Frames have variable length on TPACKET_V3, so the frame size 
+        // is only used by the kernel to sanity check the request.
+        const uint32_t frame_size = TPACKET_ALIGN(TPACKET3_HDRLEN + 
+                                                  std::min<uint32_t>(snap_len, block_size / 2));
+        tpacket_req3 request;
+        std::memset(&request, 0, sizeof(request));
+        request.tp_block_size = block_size_;
+        request.tp_block_nr = block_count_;
+        request.tp_frame_size = frame_size;
+        request.tp_frame_nr = (block_size_ / frame_size) * block_count_;
+        request.tp_retire_blk_tov = timeout_;
+        if (setsockopt(socket_, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) < 0) {
+            throw runtime_error(strerror(errno));
+        }
+
+        void* ptr = mmap(0, (size_t)block_size_ * block_count_, PROT_READ | PROT_WRITE, 
+                         MAP_SHARED, socket_, 0);
+        if (ptr == MAP_FAILED) {
+            throw runtime_error(strerror(errno));
+        }
+        buffer_ = (uint8_t*)ptr;
+
+        sockaddr_ll address;
+        std::memset(&address, 0, sizeof(address));
+        address.sll_family = AF_PACKET;
+        address.sll_protocol = htons(ETH_P_ALL);
+        address.sll_ifindex = if_index_;
+        if (bind(socket_, (const sockaddr*)&address, sizeof(address)) < 0) {
+            throw socket_open_error(strerror(errno));
+        }
+    }
+    catch (...) {
+        cleanup();
+        throw;
+    }
+}
+
+RxPacketRing::~RxPacketRing() {
+    cleanup();
+}
+
+void RxPacketRing::cleanup() {
+    if (buffer_) {
+        munmap(buffer_, (size_t)block_size_ * block_count_);
+        buffer_ = 0;
+    }
+    if (socket_ >= 0) {
+        ::close(socket_);
+        socket_ = -1;
+    }
+    if (wakeup_ >= 0) {
+        ::close(wakeup_);
+        wakeup_ = -1;
+    }
+}
+
+tpacket_block_desc* RxPacketRing::block_at(uint32_t index) const {
+    return (tpacket_block_desc*)(buffer_ + (size_t)block_size_ * index);
+}
+
+void RxPacketRing::release_block() {
+    // Make sure every read on the block is done before handing it back
+    __sync_synchronize();
+    current_desc_->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    current_desc_ = 0;
+    current_block_ = (current_block_ + 1) % block_count_;
+}
+
+int RxPacketRing::acquire_block(bool wait) {
+    tpacket_block_desc* desc = block_at(current_block_);
+    while ((desc->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
+        if (!wait) {
+            return 0;
+        }
+        pollfd descriptors[2];
+        descriptors[0].fd = socket_;
+        descriptors[0].events = POLLIN | POLLERR;
+        descriptors[0].revents = 0;
+        descriptors[1].fd = wakeup_;
+        descriptors[1].events = POLLIN;
+        descriptors[1].revents = 0;
+        // Like libpcap, a timeout of 0 blocks until a block is retired
+        const int result = poll(descriptors, 2, timeout_ ? (int)timeout_ : -1);
+        if (result < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (descriptors[1].revents & POLLIN) {
+            // The caller will notice the break when this returns
+            if (__atomic_load_n(&break_loop_, __ATOMIC_ACQUIRE)) {
+                return 0;
+            }
+            // This wakeup belongs to a break which was already handled
+            uint64_t value;
+            ssize_t read_result = ::read(wakeup_, &value, sizeof(value));
+            (void)read_result;
+        }
+        // The timeout expired and no block was retired
+        if (result == 0 && (desc->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
+            return 0;
+        }
+    }
+    __sync_synchronize();
+    current_desc_ = desc;
+    frames_left_ = desc->hdr.bh1.num_pkts;
+    current_frame_ = (tpacket3_hdr*)((uint8_t*)desc + desc->hdr.bh1.offset_to_first_pkt);
+    return 1;
+}
+
+const u_char* RxPacketRing::consume_frame(pcap_pkthdr& header) {
+    header.ts.tv_sec = current_frame_->tp_sec;
+    header.ts.tv_usec = current_frame_->tp_nsec / 1000;
+    header.caplen = std::min(current_frame_->tp_snaplen, snap_len_);
+    header.len = current_frame_->tp_len;
+    const u_char* data = (const u_char*)current_frame_ + current_frame_->tp_mac;
+    current_frame_ = (tpacket3_hdr*)((uint8_t*)current_frame_ + current_frame_->tp_next_offset);
+    --frames_left_;
+    return data;
+}
+
+int RxPacketRing::dispatch(int max_packets, pcap_handler handler, u_char* user) {
+    int processed = 0;
+    while (max_packets <= 0 || processed < max_packets) {
+        if (take_break()) {
+            return -2;
+        }
+        if (!current_desc_) {
+            // Only wait for a block if nothing has been processed yet
+            const int result = acquire_block(processed == 0);
+            if (result < 0) {
+                return -1;
+            }
+            if (result == 0) {
+                break;
+            }
+        }
+        while (frames_left_ > 0 && (max_packets <= 0 || processed < max_packets)) {
+            pcap_pkthdr header;
+            const u_char* data = consume_frame(header);
+            ++processed;
+            handler(user, &header, data);
+        }
+        if (frames_left_ == 0) {
+            release_block();
+        }
+    }
+    return processed;
+}
+
+int RxPacketRing::next(pcap_pkthdr** header, const u_char** data) {
+    if (take_break()) {
+        return -2;
+    }
+    // The previous frame is no longer used, so its block can be released
+    if (current_desc_ && frames_left_ == 0) {
+        release_block();
+    }
+    if (!current_desc_) {
+        const int result = acquire_block(true);
+        if (result <= 0) {
+            return result;
+        }
+        if (frames_left_ == 0) {
+            release_block();
+            return 0;
+        }
+    }
+    *data = consume_frame(next_header_);
+    *header = &next_header_;
+    return 1;
+}
+
+int RxPacketRing::loop(int max_packets, pcap_handler handler, u_char* user) {
+    int processed = 0;
+    while (max_packets <= 0 || processed < max_packets) {
+        const int result = dispatch(max_packets <= 0 ? -1 : max_packets - processed, 
+                                    handler, user);
+        if (result < 0) {
+            return result;
+        }
+        processed += result;
+    }
+    return 0;
+}
+
+void RxPacketRing::break_loop() {
+    __atomic_store_n(&break_loop_, 1, __ATOMIC_RELEASE);
+    const uint64_t value = 1;
+    // This can only fail if the counter would overflow, in which case a 
+    // wakeup is already pending
+    ssize_t result = ::write(wakeup_, &value, sizeof(value));
+    (void)result;
+}
+
+bool RxPacketRing::take_break() {
+    if (!__atomic_load_n(&break_loop_, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    __atomic_store_n(&break_loop_, 0, __ATOMIC_RELAXED);
+    uint64_t value;
+    ssize_t result = ::read(wakeup_, &value, sizeof(value));
+    (void)result;
+    return true;
+}
+
+bool RxPacketRing::set_filter(const bpf_program& program) {
+    // bpf_insn and sock_filter share the same layout
+    sock_fprog filter;
+    filter.len = program.bf_len;
+    filter.filter = (sock_filter*)program.bf_insns;
+    return setsockopt(socket_, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) == 0;
+}
+
+void RxPacketRing::set_promisc_mode(bool enabled) {
+    packet_mreq request;
+    std::memset(&request, 0, sizeof(request));
+    request.mr_ifindex = if_index_;
+    request.mr_type = PACKET_MR_PROMISC;
+    const int option = enabled ? PACKET_ADD_MEMBERSHIP : PACKET_DROP_MEMBERSHIP;
+    if (setsockopt(socket_, SOL_PACKET, option, &request, sizeof(request)) < 0) {
+        throw runtime_error(strerror(errno));
+    }
+}
+
+int RxPacketRing::link_type() const {
+    return link_type_;
+}
+
+int RxPacketRing::get_fd() const {
+    return socket_;
+}
+
+// TxPacketRing
+
+// On TPACKET_V2 transmit rings, the frame data follows the frame header
+const uint32_t tx_frame_data_offset = TPACKET_ALIGN(sizeof(tpacket2_hdr));
+
+TxPacketRing::TxPacketRing(const NetworkInterface& iface, uint32_t frame_count, 
+                           uint32_t frame_size)
+: socket_(-1), buffer_(0), frame_size_(TPACKET_ALIGN(frame_size)), 
+  frame_count_(0), block_size_(0), block_count_(0), frames_per_block_(0),
+  current_frame_(0), pending_frames_(0)
+{
+    if (frame_size_ <= tx_frame_data_offset || frame_count == 0) {
+        throw runtime_error("Invalid transmit ring size");
+    }
+    // Frames can't span blocks, and blocks must be a multiple of the page size
+    const uint32_t page_size = sysconf(_SC_PAGESIZE);
+    block_size_ = ((frame_size_ + page_size - 1) / page_size) * page_size;
+    frames_per_block_ = block_size_ / frame_size_;
+    block_count_ = (frame_count + frames_per_block_ - 1) / frames_per_block_;
+    frame_count_ = block_count_ * frames_per_block_;
+
+    socket_ = ::socket(AF_PACKET, SOCK_RAW, 0);
+    if (socket_ < 0) {
+        throw socket_open_error(strerror(errno));
+    }
+    try {
+        int version = TPACKET_V2;
+        if (setsockopt(socket_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+            throw runtime_error(strerror(errno));
+        }
+        // Discard malformed frames rather than stopping the ring on them
+        int discard = 1;
+        if (setsockopt(socket_, SOL_PACKET, PACKET_LOSS, &discard, sizeof(discard)) < 0) {
+            throw runtime_error(strerror(errno));
+        }
+
+        tpacket_req request;
+        std::memset(&request, 0, sizeof(request));
+        request.tp_block_size = block_size_;
+        request.tp_block_nr = block_count_;
+        request.tp_frame_size = frame_size_;
+        request.tp_frame_nr = frame_count_;
+        if (setsockopt(socket_, SOL_PACKET, PACKET_TX_RING, &request, sizeof(request)) < 0) {
+            throw runtime_error(strerror(errno));
+        }
+
+        void* ptr = mmap(0, (size_t)block_size_ * block_count_, PROT_READ | PROT_WRITE, 
+                         MAP_SHARED, socket_, 0);
+        if (ptr == MAP_FAILED) {
+            throw runtime_error(strerror(errno));
+        }
+        buffer_ = (uint8_t*)ptr;
+
+        // A zero protocol is used, so nothing is received on this socket
+        sockaddr_ll address;
+        std::memset(&address, 0, sizeof(address));
+        address.sll_family = AF_PACKET;
+        address.sll_ifindex = iface.id();
+        if (bind(socket_, (const sockaddr*)&address, sizeof(address)) < 0) {
+            throw socket_open_error(strerror(errno));
+        }
+    }
+    catch (...) {
+        cleanup();
+        throw;
+    }
+}
+
+TxPacketRing::~TxPacketRing() {
+    cleanup();
+}
+
+void TxPacketRing::cleanup() {
+    if (buffer_) {
+        munmap(buffer_, (size_t)block_size_ * block_count_);
+        buffer_ = 0;
+    }
+    if (socket_ >= 0) {
+        ::close(socket_);
+        socket_ = -1;
+    }
+}
+
+tpacket2_hdr* TxPacketRing::frame_at(uint32_t index) const {
+    const uint32_t block = index / frames_per_block_;
+    const uint32_t offset = (index % frames_per_block_) * frame_size_;
+    return (tpacket2_hdr*)(buffer_ + (size_t)block_size_ * block + offset);
+}
+
+void TxPacketRing::wait_for_frame(tpacket2_hdr* frame) {
+    while (true) {
+        const uint32_t status = frame->tp_status;
+        // Malformed frames are discarded, so they can be reused as well
+        if (status == TP_STATUS_AVAILABLE || status == TP_STATUS_WRONG_FORMAT) {
+            break;
+        }
+        if (status == TP_STATUS_SEND_REQUEST) {
+            flush();
+        }
+        else {
+            // The kernel is still sending it
+            wait_until_writable();
+        }
+    }
+    __sync_synchronize();
+}
+
+void TxPacketRing::wait_until_writable() {
+    pollfd descriptor;
+    descriptor.fd = socket_;
+    descriptor.events = POLLOUT;
+    descriptor.revents = 0;
+    if (poll(&descriptor, 1, -1) < 0 && errno != EINTR) {
+        throw socket_write_error(strerror(errno));
+    }
+}
+
+bool TxPacketRing::write(PDU& pdu) {
+    const uint32_t size = pdu.size();
+    if (size > max_frame_size()) {
+        return false;
+    }
+    pdu.serialize_into(next_frame_data(), size);
+    commit_frame(size);
+    return true;
+}
+
+bool TxPacketRing::write(const uint8_t* data, uint32_t size) {
+    if (size > max_frame_size()) {
+        return false;
+    }
+    memcpy(next_frame_data(), data, size);
+    commit_frame(size);
+    return true;
+}
+
+uint8_t* TxPacketRing::next_frame_data() {
+    tpacket2_hdr* frame = frame_at(current_frame_);
+    wait_for_frame(frame);
+    return (uint8_t*)frame + tx_frame_data_offset;
+}
+
+void TxPacketRing::commit_frame(uint32_t size) {
+    tpacket2_hdr* frame = frame_at(current_frame_);
+    frame->tp_len = size;
+    // The data must be visible before the kernel sees the frame's status
+    __sync_synchronize();
+    frame->tp_status = TP_STATUS_SEND_REQUEST;
+    current_frame_ = (current_frame_ + 1) % frame_count_;
+    ++pending_frames_;
+}
+
+void TxPacketRing::flush() {
+    while (pending_frames_ > 0) {
+        // MSG_DONTWAIT avoids waiting for the frames' buffers to be 
+        // released, which is done in TxPacketRing::write when a frame
+        // is reused. It also makes the kernel stop taking frames once
+        // the socket's send buffer is full, so some may be left behind.
+        if (::send(socket_, 0, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && 
+            errno != EINTR) {
+            throw socket_write_error(strerror(errno));
+        }
+        __sync_synchronize();
+        // Frames are taken in order, so skip the ones that are gone
+        uint32_t index = (current_frame_ + frame_count_ - pending_frames_) % frame_count_;
+        while (pending_frames_ > 0 && 
+               frame_at(index)->tp_status != TP_STATUS_SEND_REQUEST) {
+            index = (index + 1) % frame_count_;
+            --pending_frames_;
+        }
+        if (pending_frames_ > 0) {
+            wait_until_writable();
+        }
+    }
+}
+
+uint32_t TxPacketRing::pending_frames() const {
+    return pending_frames_;
+}
+
+uint32_t TxPacketRing::max_frame_size() const {
+    return frame_size_ - tx_frame_data_offset;
+}
+
+int TxPacketRing::get_fd() const {
+    return socket_;
+}
+} // namespace Tins
+
+#endif // HAVE_PACKET_RING
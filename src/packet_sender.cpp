@@ -65,6 +65,8 @@
 #include "radiotap.h"
 #include "ieee802_3.h"
 #include "internals.h"
+#include "endianness.h"
+#include "packet_ring.h"
 
 using std::string;
 using std::runtime_error;
@@ -72,6 +74,7 @@ using std::runtime_error;
 namespace Tins {
 const int PacketSender::INVALID_RAW_SOCKET = -1;
 const uint32_t PacketSender::DEFAULT_TIMEOUT = 2;
+const uint32_t PacketSender::MAX_BATCH_MESSAGES = 64;
 
 #ifndef _WIN32
     typedef int socket_type;
@@ -94,13 +97,17 @@ PacketSender::PacketSender(const NetworkInterface &iface, uint32_t recv_timeout,
 #if !defined(BSD) && !defined(_WIN32) && !defined(__FreeBSD_kernel__)
   _ether_socket(INVALID_RAW_SOCKET),
 #endif
-  _timeout(recv_timeout), _timeout_usec(usec), default_iface(iface)
+  _batch_sent(0), _batch_completed(0), _timeout(recv_timeout), 
+  _timeout_usec(usec), default_iface(iface)
 {
     _types[IP_TCP_SOCKET] = IPPROTO_TCP;
     _types[IP_UDP_SOCKET] = IPPROTO_UDP;
     _types[IP_RAW_SOCKET] = IPPROTO_RAW;
     _types[IPV6_SOCKET] = IPPROTO_RAW;
     _types[ICMP_SOCKET] = IPPROTO_ICMP;
+    #ifdef HAVE_PACKET_RING
+        _tx_ring_enabled = false;
+    #endif // HAVE_PACKET_RING
 }
 
 PacketSender::~PacketSender() {
@@ -126,6 +133,9 @@ PacketSender::~PacketSender() {
         }
         pcap_handles.clear();
     #endif // HAVE_PACKET_SENDER_PCAP_SENDPACKET
+    #ifdef HAVE_PACKET_RING
+        close_tx_rings();
+    #endif // HAVE_PACKET_RING
 }
 
 void PacketSender::default_interface(const NetworkInterface &iface) {
@@ -136,6 +146,15 @@ const NetworkInterface& PacketSender::default_interface() const {
     return default_iface;
 }
 
+void PacketSender::pacer(const Pacer& value) {
+    _pacer = value;
+    _pacer.reset();
+}
+
+const Pacer& PacketSender::pacer() const {
+    return _pacer;
+}
+
 #if !defined(_WIN32) || defined(HAVE_PACKET_SENDER_PCAP_SENDPACKET)
 
 #ifndef _WIN32
@@ -221,6 +240,11 @@ void PacketSender::open_l2_socket(const NetworkInterface& iface) {
         if (_ether_socket == -1)
             throw socket_open_error(make_error_string());
     }
+    #ifdef HAVE_PACKET_RING
+        if (_tx_ring_enabled && iface && _tx_rings.count(iface.id()) == 0) {
+            _tx_rings.insert(std::make_pair(iface.id(), new TxPacketRing(iface)));
+        }
+    #endif // HAVE_PACKET_RING
     #endif
 }
 #endif // !_WIN32 || HAVE_PACKET_SENDER_PCAP_SENDPACKET
@@ -259,6 +283,13 @@ void PacketSender::close_socket(SocketType type, const NetworkInterface &iface)
         #elif !defined(_WIN32)
         if(_ether_socket == INVALID_RAW_SOCKET)
             throw invalid_socket_type();
+        #ifdef HAVE_PACKET_RING
+            TxRingMap::iterator ring = _tx_rings.find(iface.id());
+            if(ring != _tx_rings.end()) {
+                delete ring->second;
+                _tx_rings.erase(ring);
+            }
+        #endif // HAVE_PACKET_RING
         if(::close(_ether_socket) == -1)
             throw socket_close_error(make_error_string());
         _ether_socket = INVALID_RAW_SOCKET;
@@ -313,16 +344,55 @@ PDU *PacketSender::send_recv(PDU &pdu, const NetworkInterface &iface) {
 void PacketSender::send_l2(PDU &pdu, struct sockaddr* link_addr, 
   uint32_t len_addr, const NetworkInterface &iface) 
 {
-    PDU::serialization_type buffer = pdu.serialize();
-
+    if(_pacer.enabled())
+        pace(pdu.size());
     #ifdef HAVE_PACKET_SENDER_PCAP_SENDPACKET
+        PDU::serialization_type& buffer = _buffer;
+        pdu.serialize(buffer);
         open_l2_socket(iface);
         pcap_t* handle = pcap_handles[iface];
         if (pcap_sendpacket(handle, (u_char*)&buffer[0], static_cast<int>(buffer.size())) != 0) {
+            // Batched packets report errors through their results
+            if(_batch_sent)
+                return;
             throw runtime_error("Failed to send packet: " + string(pcap_geterr(handle)));
         }
+        if(_batch_sent)
+            batch_written(static_cast<uint32_t>(buffer.size()));
     #else // HAVE_PACKET_SENDER_PCAP_SENDPACKET
+        #ifdef HAVE_PACKET_RING
+        if(_tx_ring_enabled) {
+            // Linux PDUs only provide the interface through the address
+            const NetworkInterface ring_iface = link_addr 
+                ? NetworkInterface::from_index(((struct sockaddr_ll*)link_addr)->sll_ifindex)
+                : iface;
+            if(ring_iface) {
+                TxPacketRing& ring = get_tx_ring(ring_iface);
+                if(ring.write(pdu)) {
+                    if(_batch_sent)
+                        batch_written(pdu.size());
+                    else
+                        ring.flush();
+                    return;
+                }
+                // It doesn't fit in a frame. Send the pending frames first
+                // so packets are sent in order
+                ring.flush();
+            }
+        }
+        #endif // HAVE_PACKET_RING
         int sock = get_ether_socket(iface);
+        if(_batch_sent) {
+            #if defined(BSD) || defined(__FreeBSD_kernel__)
+            // BPF devices are written to, so there's no address
+            queue_message(sock, pdu, 0, 0);
+            #else
+            queue_message(sock, pdu, link_addr, len_addr);
+            #endif
+            return;
+        }
+        PDU::serialization_type& buffer = _buffer;
+        pdu.serialize(buffer);
         if(!buffer.empty()) {
             #if defined(BSD) || defined(__FreeBSD_kernel__)
             if(::write(sock, &buffer[0], buffer.size()) == -1)
@@ -334,6 +404,85 @@ void PacketSender::send_l2(PDU &pdu, struct sockaddr* link_addr,
     #endif // HAVE_PACKET_SENDER_PCAP_SENDPACKET
 }
 
+void PacketSender::send_frame(const uint8_t *data, uint32_t size, 
+  const NetworkInterface &iface) 
+{
+    pace(size);
+    #ifdef HAVE_PACKET_SENDER_PCAP_SENDPACKET
+        open_l2_socket(iface);
+        pcap_t* handle = pcap_handles[iface];
+        if (pcap_sendpacket(handle, (u_char*)data, static_cast<int>(size)) != 0) {
+            if(_batch_sent)
+                return;
+            throw runtime_error("Failed to send packet: " + string(pcap_geterr(handle)));
+        }
+        if(_batch_sent)
+            batch_written(size);
+    #else // HAVE_PACKET_SENDER_PCAP_SENDPACKET
+        #ifdef HAVE_PACKET_RING
+        if(_tx_ring_enabled) {
+            TxPacketRing& ring = get_tx_ring(iface);
+            if(ring.write(data, size)) {
+                if(_batch_sent)
+                    batch_written(size);
+                else
+                    ring.flush();
+                return;
+            }
+            ring.flush();
+        }
+        #endif // HAVE_PACKET_RING
+        int sock = get_ether_socket(iface);
+        #if defined(BSD) || defined(__FreeBSD_kernel__)
+            struct sockaddr *link_addr = 0;
+            uint32_t len_addr = 0;
+        #else
+            struct sockaddr_ll addr;
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sll_family = Endian::host_to_be<uint16_t>(PF_PACKET);
+            addr.sll_protocol = Endian::host_to_be<uint16_t>(ETH_P_ALL);
+            addr.sll_ifindex = iface.id();
+            struct sockaddr *link_addr = (struct sockaddr*)&addr;
+            uint32_t len_addr = sizeof(addr);
+        #endif
+        if(_batch_sent) {
+            uint8_t *buffer = queue_message(sock, size, link_addr, len_addr);
+            if(buffer)
+                std::memcpy(buffer, data, size);
+            return;
+        }
+        #if defined(BSD) || defined(__FreeBSD_kernel__)
+        if(::write(sock, data, size) == -1)
+        #else
+        if(::sendto(sock, data, size, 0, link_addr, len_addr) == -1)
+        #endif
+            throw socket_write_error(make_error_string());
+    #endif // HAVE_PACKET_SENDER_PCAP_SENDPACKET
+}
+
+size_t PacketSender::send_frames(const Frame *frames, size_t count, 
+  const NetworkInterface &iface, std::vector<uint32_t> &bytes_sent) 
+{
+    begin_batch(bytes_sent);
+    try {
+        for(size_t i = 0; i < count; ++i) {
+            bytes_sent.push_back(0);
+            send_frame(frames[i].data, frames[i].size, iface);
+        }
+    }
+    catch(...) {
+        abort_batch();
+        throw;
+    }
+    return end_batch();
+}
+
+size_t PacketSender::send_frames(const Frame *frames, size_t count, 
+  const NetworkInterface &iface) 
+{
+    return send_frames(frames, count, iface, _batch_results);
+}
+
 #endif // !_WIN32 || HAVE_PACKET_SENDER_PCAP_SENDPACKET
 
 #ifndef _WIN32
@@ -361,12 +510,208 @@ PDU *PacketSender::recv_l3(PDU &pdu, struct sockaddr* link_addr, uint32_t len_ad
 
 void PacketSender::send_l3(PDU &pdu, struct sockaddr* link_addr, uint32_t len_addr, SocketType type) {
     open_l3_socket(type);
+    if(_pacer.enabled())
+        pace(pdu.size());
     int sock = _sockets[type];
-    PDU::serialization_type buffer = pdu.serialize();
+    if(_batch_sent) {
+        queue_message(sock, pdu, link_addr, len_addr);
+        return;
+    }
+    PDU::serialization_type& buffer = _buffer;
+    pdu.serialize(buffer);
     if(sendto(sock, (const char*)&buffer[0], static_cast<int>(buffer.size()), 0, link_addr, len_addr) == -1)
         throw socket_write_error(make_error_string());
 }
 
+void PacketSender::begin_batch(std::vector<uint32_t> &bytes_sent) {
+    bytes_sent.clear();
+    _batch_sent = &bytes_sent;
+    _batch_completed = 0;
+}
+
+void PacketSender::batch_send(PDU &pdu, const NetworkInterface &iface) {
+    // The send_l2/send_l3 call performed by the PDU will queue it
+    _batch_sent->push_back(0);
+    send(pdu, iface);
+}
+
+uint8_t *PacketSender::queue_message(int sock, uint32_t size, struct sockaddr *addr, 
+  uint32_t len_addr) 
+{
+    if(_batch.size() == MAX_BATCH_MESSAGES)
+        flush_batch();
+    batch_message message;
+    message.socket = sock;
+    message.packet = static_cast<uint32_t>(_batch_sent->size() - 1);
+    message.data_offset = static_cast<uint32_t>(_batch_data.size());
+    message.data_size = size;
+    message.address_offset = static_cast<uint32_t>(_batch_addresses.size());
+    message.address_size = addr ? len_addr : 0;
+    _batch_data.resize(_batch_data.size() + size);
+    const uint8_t *addr_ptr = reinterpret_cast<const uint8_t*>(addr);
+    _batch_addresses.insert(_batch_addresses.end(), addr_ptr, addr_ptr + message.address_size);
+    _batch.push_back(message);
+    return size > 0 ? &_batch_data[message.data_offset] : 0;
+}
+
+void PacketSender::queue_message(int sock, PDU &pdu, struct sockaddr *addr, 
+  uint32_t len_addr) 
+{
+    const uint32_t size = pdu.size();
+    uint8_t *buffer = queue_message(sock, size, addr, len_addr);
+    if(buffer)
+        pdu.serialize_into(buffer, size);
+}
+
+void PacketSender::batch_written(uint32_t bytes) {
+    _batch_sent->back() = bytes;
+    ++_batch_completed;
+}
+
+void PacketSender::record_batch_result(const batch_message &message, uint32_t bytes) {
+    (*_batch_sent)[message.packet] = bytes;
+    if(bytes == message.data_size)
+        ++_batch_completed;
+}
+
+void PacketSender::flush_batch() {
+    uint8_t *data = _batch_data.empty() ? 0 : &_batch_data[0];
+    uint8_t *addresses = _batch_addresses.empty() ? 0 : &_batch_addresses[0];
+    #ifdef HAVE_SENDMMSG
+        struct mmsghdr headers[MAX_BATCH_MESSAGES];
+        struct iovec vectors[MAX_BATCH_MESSAGES];
+    #endif // HAVE_SENDMMSG
+    size_t index = 0;
+    while(index < _batch.size()) {
+        #ifdef HAVE_SENDMMSG
+            // Consecutive messages for the same socket are sent together
+            const int sock = _batch[index].socket;
+            unsigned count = 0;
+            while(index + count < _batch.size() && _batch[index + count].socket == sock) {
+                const batch_message &message = _batch[index + count];
+                vectors[count].iov_base = data + message.data_offset;
+                vectors[count].iov_len = message.data_size;
+                std::memset(&headers[count], 0, sizeof(headers[count]));
+                if(message.address_size) {
+                    headers[count].msg_hdr.msg_name = addresses + message.address_offset;
+                    headers[count].msg_hdr.msg_namelen = message.address_size;
+                }
+                headers[count].msg_hdr.msg_iov = &vectors[count];
+                headers[count].msg_hdr.msg_iovlen = 1;
+                ++count;
+            }
+            unsigned done = 0;
+            while(done < count) {
+                int result = ::sendmmsg(sock, headers + done, count - done, 0);
+                // sendmmsg fails only if the first message can't be sent.
+                // Skip it so the rest of them are still sent.
+                if(result == -1) {
+                    ++done;
+                    continue;
+                }
+                for(int i = 0; i < result; ++i)
+                    record_batch_result(_batch[index + done + i], headers[done + i].msg_len);
+                done += result;
+            }
+            index += count;
+        #else // HAVE_SENDMMSG
+            const batch_message &message = _batch[index++];
+            long result;
+            #if defined(BSD) || defined(__FreeBSD_kernel__)
+            if(message.address_size == 0)
+                result = ::write(message.socket, data + message.data_offset, message.data_size);
+            else
+            #endif // BSD
+            result = ::sendto(message.socket, (const char*)data + message.data_offset, 
+                static_cast<int>(message.data_size), 0, 
+                (struct sockaddr*)(addresses + message.address_offset), message.address_size);
+            if(result != -1)
+                record_batch_result(message, static_cast<uint32_t>(result));
+        #endif // HAVE_SENDMMSG
+    }
+    _batch.clear();
+    _batch_data.clear();
+    _batch_addresses.clear();
+}
+
+size_t PacketSender::end_batch() {
+    flush_batch();
+    _batch_sent = 0;
+    #ifdef HAVE_PACKET_RING
+        flush_tx_rings();
+    #endif // HAVE_PACKET_RING
+    return _batch_completed;
+}
+
+void PacketSender::abort_batch() {
+    _batch.clear();
+    _batch_data.clear();
+    _batch_addresses.clear();
+    _batch_sent = 0;
+    #ifdef HAVE_PACKET_RING
+        // Frames in the rings can't be taken back, so send them anyway
+        flush_tx_rings();
+    #endif // HAVE_PACKET_RING
+}
+
+void PacketSender::pace(uint32_t size) {
+    if(!_pacer.enabled())
+        return;
+    const uint64_t now = Pacer::clock();
+    const uint64_t send_time = _pacer.reserve(size, now);
+    if(send_time == now)
+        return;
+    // The packets queued so far are due, so send them before waiting
+    if(_batch_sent) {
+        flush_batch();
+        #ifdef HAVE_PACKET_RING
+            flush_tx_rings();
+        #endif // HAVE_PACKET_RING
+    }
+    _pacer.wait_until(send_time);
+}
+
+#ifdef HAVE_PACKET_RING
+void PacketSender::tx_ring(bool enabled) {
+    if(!enabled)
+        close_tx_rings();
+    _tx_ring_enabled = enabled;
+}
+
+bool PacketSender::tx_ring() const {
+    return _tx_ring_enabled;
+}
+
+TxPacketRing& PacketSender::get_tx_ring(const NetworkInterface& iface) {
+    TxRingMap::iterator it = _tx_rings.find(iface.id());
+    if(it == _tx_rings.end()) {
+        open_l2_socket(iface);
+        it = _tx_rings.find(iface.id());
+    }
+    return *it->second;
+}
+
+void PacketSender::flush_tx_rings() {
+    // This is only done while sending batches, whose packets were 
+    // already reported as sent. Errors aren't thrown, so the results
+    // are still returned and the other rings are still flushed.
+    for(TxRingMap::iterator it = _tx_rings.begin(); it != _tx_rings.end(); ++it) {
+        try {
+            it->second->flush();
+        }
+        catch(socket_write_error&) {
+
+        }
+    }
+}
+
+void PacketSender::close_tx_rings() {
+    for(TxRingMap::iterator it = _tx_rings.begin(); it != _tx_rings.end(); ++it)
+        delete it->second;
+    _tx_rings.clear();
+}
+#endif // HAVE_PACKET_RING
+
 PDU *PacketSender::recv_match_loop(const std::vector<int>& sockets, PDU &pdu, struct sockaddr* link_addr, uint32_t addrlen) {
     #ifdef _WIN32
         typedef int socket_len_type;
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <cstring>
+#include "packet_view.h"
+#include "constants.h"
+
+namespace Tins {
+const uint16_t ETHERNET_HEADER_SIZE = 14;
+const uint16_t SLL_HEADER_SIZE = 16;
+const uint16_t DOT1Q_HEADER_SIZE = 4;
+const uint16_t IPV6_HEADER_SIZE = 40;
+const uint16_t QINQ_TYPE = 0x88a8;
+const uint8_t NO_TRANSPORT_PROTOCOL = 0xff;
+
+PacketView::PacketView(const uint8_t* buffer, uint32_t total_sz, int link_type,
+                       const Timestamp& ts)
+: buffer_(buffer), size_(total_sz), link_type_(link_type), ts_(ts), level_(NOTHING),
+  network_offset_(0), network_end_(0), transport_offset_(0), payload_offset_(0), 
+  network_type_(0), transport_protocol_(NO_TRANSPORT_PROTOCOL)
+{
+
+}
+
+void PacketView::decode_link() const {
+    level_ = LINK;
+    uint32_t offset;
+    if (link_type_ == DLT_EN10MB) {
+        if (size_ < ETHERNET_HEADER_SIZE) {
+            return;
+        }
+        ethernet_.data_ = buffer_;
+        network_type_ = ethernet_.payload_type();
+        offset = ETHERNET_HEADER_SIZE;
+    }
+    else if (link_type_ == DLT_LINUX_SLL) {
+        if (size_ < SLL_HEADER_SIZE) {
+            return;
+        }
+        std::memcpy(&network_type_, buffer_ + 14, sizeof(network_type_));
+        network_type_ = Endian::be_to_host(network_type_);
+        offset = SLL_HEADER_SIZE;
+    }
+    else {
+        return;
+    }
+    // Skip up to 2 VLAN tags
+    for (int i = 0; i < 2; ++i) {
+        if (network_type_ != Constants::Ethernet::VLAN && network_type_ != QINQ_TYPE) {
+            break;
+        }
+        if (offset + DOT1Q_HEADER_SIZE > size_) {
+            network_type_ = 0;
+            return;
+        }
+        Dot1QHeader tag;
+        tag.data_ = buffer_ + offset;
+        if (!dot1q_.data_) {
+            dot1q_ = tag;
+        }
+        network_type_ = tag.payload_type();
+        offset += DOT1Q_HEADER_SIZE;
+    }
+    network_offset_ = payload_offset_ = offset;
+}
+
+void PacketView::decode_network() const {
+    if (level_ < LINK) {
+        decode_link();
+    }
+    level_ = NETWORK;
+    const uint32_t offset = network_offset_;
+    if (offset == 0) {
+        return;
+    }
+    const uint32_t available = size_ - offset;
+    if (network_type_ == Constants::Ethernet::IP) {
+        IPHeader header;
+        header.data_ = buffer_ + offset;
+        if (available < 20 || (header.data_[0] >> 4) != 4) {
+            return;
+        }
+        const uint32_t header_size = header.head_len() * 4;
+        // A total length of 0 is caused by TCP segmentation offload
+        uint32_t total_size = header.tot_len();
+        if (total_size == 0 || total_size > available) {
+            total_size = available;
+        }
+        if (header_size < 20 || header_size > total_size) {
+            return;
+        }
+        ip_ = header;
+        network_end_ = offset + total_size;
+        payload_offset_ = offset + header_size;
+        transport_protocol_ = header.protocol();
+        // Non-initial fragments don't contain the transport layer header
+        if (header.fragment_offset() == 0) {
+            transport_offset_ = payload_offset_;
+        }
+    }
+    else if (network_type_ == Constants::Ethernet::IPV6) {
+        IPv6Header header;
+        header.data_ = buffer_ + offset;
+        if (available < IPV6_HEADER_SIZE || (header.data_[0] >> 4) != 6) {
+            return;
+        }
+        uint32_t total_size = IPV6_HEADER_SIZE + header.payload_length();
+        if (header.payload_length() == 0 || total_size > available) {
+            total_size = available;
+        }
+        ipv6_ = header;
+        network_end_ = offset + total_size;
+        uint32_t current = offset + IPV6_HEADER_SIZE;
+        uint8_t next_header = header.next_header();
+        // Skip the extension headers
+        while (true) {
+            if (next_header == Constants::IP::PROTO_HOPOPTS ||
+                next_header == Constants::IP::PROTO_ROUTING ||
+                next_header == Constants::IP::PROTO_DSTOPTS ||
+                next_header == Constants::IP::PROTO_FRAGMENT ||
+                next_header == Constants::IP::PROTO_AH) {
+                if (current + 8 > network_end_) {
+                    return;
+                }
+                const uint8_t* ext_header = buffer_ + current;
+                uint32_t ext_size;
+                if (next_header == Constants::IP::PROTO_FRAGMENT) {
+                    ext_size = 8;
+                    // Non-initial fragment
+                    if (((ext_header[2] << 8) | (ext_header[3] & 0xf8)) != 0) {
+                        payload_offset_ = current + ext_size;
+                        transport_protocol_ = ext_header[0];
+                        return;
+                    }
+                }
+                else if (next_header == Constants::IP::PROTO_AH) {
+                    ext_size = (ext_header[1] + 2) * 4;
+                }
+                else {
+                    ext_size = (ext_header[1] + 1) * 8;
+                }
+                next_header = ext_header[0];
+                current += ext_size;
+                if (current > network_end_) {
+                    return;
+                }
+            }
+            else {
+                break;
+            }
+        }
+        payload_offset_ = transport_offset_ = current;
+        transport_protocol_ = next_header;
+    }
+}
+
+void PacketView::decode_transport() const {
+    if (level_ < NETWORK) {
+        decode_network();
+    }
+    level_ = TRANSPORT;
+    if (transport_offset_ == 0) {
+        return;
+    }
+    const uint32_t available = network_end_ - transport_offset_;
+    const uint8_t* header = buffer_ + transport_offset_;
+    if (transport_protocol_ == Constants::IP::PROTO_TCP) {
+        if (available < 20) {
+            return;
+        }
+        const uint32_t header_size = (header[12] >> 4) * 4;
+        if (header_size < 20 || header_size > available) {
+            return;
+        }
+        tcp_.data_ = header;
+        payload_offset_ = transport_offset_ + header_size;
+    }
+    else if (transport_protocol_ == Constants::IP::PROTO_UDP) {
+        if (available < 8) {
+            return;
+        }
+        udp_.data_ = header;
+        payload_offset_ = transport_offset_ + 8;
+    }
+    else if (transport_protocol_ == Constants::IP::PROTO_ICMP && ip_.data_) {
+        if (available < 8) {
+            return;
+        }
+        icmp_.data_ = header;
+        payload_offset_ = transport_offset_ + 8;
+    }
+}
+
+const PacketView::EthernetHeader* PacketView::ethernet() const {
+    if (level_ < LINK) {
+        decode_link();
+    }
+    return ethernet_.data_ ? &ethernet_ : 0;
+}
+
+const PacketView::Dot1QHeader* PacketView::dot1q() const {
+    if (level_ < LINK) {
+        decode_link();
+    }
+    return dot1q_.data_ ? &dot1q_ : 0;
+}
+
+const PacketView::IPHeader* PacketView::ip() const {
+    if (level_ < NETWORK) {
+        decode_network();
+    }
+    return ip_.data_ ? &ip_ : 0;
+}
+
+const PacketView::IPv6Header* PacketView::ipv6() const {
+    if (level_ < NETWORK) {
+        decode_network();
+    }
+    return ipv6_.data_ ? &ipv6_ : 0;
+}
+
+const PacketView::TCPHeader* PacketView::tcp() const {
+    if (level_ < TRANSPORT) {
+        decode_transport();
+    }
+    return tcp_.data_ ? &tcp_ : 0;
+}
+
+const PacketView::UDPHeader* PacketView::udp() const {
+    if (level_ < TRANSPORT) {
+        decode_transport();
+    }
+    return udp_.data_ ? &udp_ : 0;
+}
+
+const PacketView::ICMPHeader* PacketView::icmp() const {
+    if (level_ < TRANSPORT) {
+        decode_transport();
+    }
+    return icmp_.data_ ? &icmp_ : 0;
+}
+
+uint8_t PacketView::transport_protocol() const {
+    if (level_ < NETWORK) {
+        decode_network();
+    }
+    return transport_protocol_;
+}
+
+uint32_t PacketView::payload_offset() const {
+    if (level_ < TRANSPORT) {
+        decode_transport();
+    }
+    return payload_offset_;
+}
+
+uint32_t PacketView::payload_size() const {
+    if (level_ < TRANSPORT) {
+        decode_transport();
+    }
+    const uint32_t end = network_end_ ? network_end_ : size_;
+    return end - payload_offset_;
+}
+} // namespace Tins
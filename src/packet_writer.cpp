@@ -66,7 +66,7 @@ void PacketWriter::write(Packet &packet) {
 }
 
 void PacketWriter::write(PDU& pdu, const struct timeval& tv) {
-    PDU::serialization_type buffer = pdu.serialize();
+    pdu.serialize(buffer);
     struct pcap_pkthdr header = { 
         tv,
         static_cast<bpf_u_int32>(buffer.size()),
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "pcap_replayer.h"
+
+#if !defined(_WIN32) || defined(HAVE_PACKET_SENDER_PCAP_SENDPACKET)
+
+#include <stdexcept>
+#include <algorithm>
+#include <pcap.h>
+#include "network_interface.h"
+
+using std::string;
+using std::vector;
+using std::runtime_error;
+
+namespace Tins {
+
+const size_t PcapReplayer::MAX_BATCH_FRAMES = 256;
+
+PcapReplayer::Stats::Stats()
+: packets(0), bytes(0), failed(0), loops(0), max_lag(0), elapsed(0)
+{
+
+}
+
+double PcapReplayer::Stats::packets_per_second() const {
+    return elapsed ? packets * 1e9 / elapsed : 0;
+}
+
+double PcapReplayer::Stats::bits_per_second() const {
+    return elapsed ? bytes * 8e9 / elapsed : 0;
+}
+
+PcapReplayer::PcapReplayer(const string& file_name)
+: link_type_(0), speed_(0), loops_(1), wait_mode_(Pacer::SLEEP), stop_(false)
+{
+    char error[PCAP_ERRBUF_SIZE];
+    pcap_t* handle = pcap_open_offline(file_name.c_str(), error);
+    if (!handle) {
+        throw runtime_error(error);
+    }
+    link_type_ = pcap_datalink(handle);
+
+    // Frames point into the cache, which may be reallocated while 
+    // loading, so only their offsets are stored at first
+    vector<size_t> offsets;
+    struct pcap_pkthdr* header;
+    const u_char* data;
+    uint64_t first_time = 0, last_time = 0;
+    int result;
+    while ((result = pcap_next_ex(handle, &header, &data)) == 1) {
+        const uint64_t time = static_cast<uint64_t>(header->ts.tv_sec) * 1000000000 + 
+                              static_cast<uint64_t>(header->ts.tv_usec) * 1000;
+        if (times_.empty()) {
+            first_time = time;
+        }
+        // Frames whose timestamp goes backwards are sent right away
+        if (time > first_time) {
+            last_time = std::max(last_time, time - first_time);
+        }
+        times_.push_back(last_time);
+        offsets.push_back(cache_.size());
+        frames_.push_back(PacketSender::Frame(0, header->caplen));
+        cache_.insert(cache_.end(), data, data + header->caplen);
+    }
+    if (result == -1) {
+        const string message = pcap_geterr(handle);
+        pcap_close(handle);
+        throw runtime_error(message);
+    }
+    pcap_close(handle);
+    for (size_t i = 0; i < frames_.size(); ++i) {
+        frames_[i].data = cache_.empty() ? 0 : &cache_[0] + offsets[i];
+    }
+}
+
+size_t PcapReplayer::frame_count() const {
+    return frames_.size();
+}
+
+size_t PcapReplayer::cache_size() const {
+    return cache_.size();
+}
+
+uint64_t PcapReplayer::duration() const {
+    return times_.empty() ? 0 : times_.back();
+}
+
+int PcapReplayer::link_type() const {
+    return link_type_;
+}
+
+void PcapReplayer::speed(double multiplier) {
+    speed_ = std::max(multiplier, 0.0);
+}
+
+double PcapReplayer::speed() const {
+    return speed_;
+}
+
+void PcapReplayer::loops(uint32_t count) {
+    loops_ = count;
+}
+
+uint32_t PcapReplayer::loops() const {
+    return loops_;
+}
+
+void PcapReplayer::wait_mode(Pacer::WaitMode mode) {
+    wait_mode_ = mode;
+}
+
+Pacer::WaitMode PcapReplayer::wait_mode() const {
+    return wait_mode_;
+}
+
+void PcapReplayer::stop() {
+    set_stopped(true);
+}
+
+void PcapReplayer::set_stopped(bool value) {
+    #if TINS_IS_CXX11
+    stop_.store(value);
+    #else
+    __atomic_store_n(&stop_, value ? 1 : 0, __ATOMIC_SEQ_CST);
+    #endif // TINS_IS_CXX11
+}
+
+bool PcapReplayer::stopped() const {
+    #if TINS_IS_CXX11
+    return stop_.load();
+    #else
+    return __atomic_load_n(&stop_, __ATOMIC_SEQ_CST) != 0;
+    #endif // TINS_IS_CXX11
+}
+
+PcapReplayer::Stats PcapReplayer::replay(PacketSender& sender) {
+    return replay(sender, sender.default_interface());
+}
+
+PcapReplayer::Stats PcapReplayer::replay(PacketSender& sender, 
+                                         const NetworkInterface& iface) {
+    Stats stats;
+    set_stopped(false);
+    if (frames_.empty()) {
+        return stats;
+    }
+    const uint64_t start = Pacer::clock();
+    for (uint32_t loop = 0; (loops_ == 0 || loop < loops_) && !stopped(); ++loop) {
+        // Every loop starts right after the previous one ends
+        const uint64_t loop_start = Pacer::clock();
+        size_t index = 0;
+        while (index < frames_.size() && !stopped()) {
+            size_t count = std::min(MAX_BATCH_FRAMES, frames_.size() - index);
+            if (speed_ > 0) {
+                const uint64_t frame_time = loop_start + scheduled_time(index);
+                uint64_t now = Pacer::clock();
+                if (frame_time > now) {
+                    Pacer::wait_until(frame_time, wait_mode_);
+                    now = Pacer::clock();
+                }
+                stats.max_lag = std::max(stats.max_lag, now - std::min(now, frame_time));
+                // Send the following frames along with this one if 
+                // they're due as well
+                size_t due = 1;
+                while (due < count && loop_start + scheduled_time(index + due) <= now) {
+                    ++due;
+                }
+                count = due;
+            }
+            const size_t sent = sender.send_frames(&frames_[index], count, iface, results_);
+            stats.packets += sent;
+            stats.failed += count - sent;
+            for (size_t i = 0; i < results_.size(); ++i) {
+                stats.bytes += results_[i];
+            }
+            index += count;
+        }
+        if (index == frames_.size()) {
+            ++stats.loops;
+        }
+    }
+    stats.elapsed = Pacer::clock() - start;
+    return stats;
+}
+
+uint64_t PcapReplayer::scheduled_time(size_t index) const {
+    return static_cast<uint64_t>(times_[index] / speed_);
+}
+
+} // Tins
+
+#endif // !_WIN32 || HAVE_PACKET_SENDER_PCAP_SENDPACKET
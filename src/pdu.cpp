@@ -30,9 +30,11 @@
 #ifdef TINS_DEBUG
 #include <cassert>
 #endif
+#include <cstring>
 #include "pdu.h"
 #include "rawpdu.h"
 #include "packet_sender.h"
+#include "pdu_arena.h"
 
 namespace Tins {
 
@@ -55,6 +57,31 @@ PDU::~PDU() {
     delete _inner_pdu;
 }
 
+void* PDU::operator new(size_t size) {
+    return PDUArena::allocate(size);
+}
+
+void* PDU::operator new(size_t size, const std::nothrow_t&) throw() {
+    try {
+        return PDUArena::allocate(size);
+    }
+    catch (std::bad_alloc&) {
+        return 0;
+    }
+}
+
+void PDU::operator delete(void* ptr) {
+    PDUArena::deallocate(ptr);
+}
+
+void PDU::operator delete(void* ptr, size_t) {
+    PDUArena::deallocate(ptr);
+}
+
+void PDU::operator delete(void* ptr, const std::nothrow_t&) throw() {
+    PDUArena::deallocate(ptr);
+}
+
 void PDU::copy_inner_pdu(const PDU &pdu) {
     if(pdu.inner_pdu())
         inner_pdu(pdu.inner_pdu()->clone());
@@ -94,22 +121,38 @@ PDU *PDU::release_inner_pdu() {
 }
 
 PDU::serialization_type PDU::serialize() {
-    std::vector<uint8_t> buffer(size());
-    serialize(&buffer[0], static_cast<uint32_t>(buffer.size()), 0);
+    serialization_type buffer;
+    serialize(buffer);
     
     // Copy elision, do your magic
     return buffer;
 }
 
+void PDU::serialize(serialization_type &buffer) {
+    // Serializations rely on the buffer being zero initialized
+    buffer.assign(size(), 0);
+    serialize(buffer.empty() ? 0 : &buffer[0], static_cast<uint32_t>(buffer.size()), 0);
+}
+
+uint32_t PDU::serialize_into(uint8_t *buffer, size_t total_sz) {
+    const uint32_t sz = size();
+    if(total_sz < sz)
+        throw serialization_error();
+    std::memset(buffer, 0, sz);
+    serialize(buffer, sz, 0);
+    return sz;
+}
+
 void PDU::serialize(uint8_t *buffer, uint32_t total_sz, const PDU *parent) {
-    uint32_t sz = header_size() + trailer_size();
+    prepare_for_serialize(parent);
+    const uint32_t header_sz = header_size();
+    const uint32_t sz = header_sz + trailer_size();
     /* Must not happen... */
     #ifdef TINS_DEBUG
     assert(total_sz >= sz);
     #endif
-    prepare_for_serialize(parent);
     if(_inner_pdu)
-        _inner_pdu->serialize(buffer + header_size(), total_sz - sz, this);
+        _inner_pdu->serialize(buffer + header_sz, total_sz - sz, this);
     write_serialization(buffer, total_sz, parent);
 }
 }
@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <new>
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <pthread.h>
+#endif // _WIN32
+#include "pdu_arena.h"
+#include "cxxstd.h"
+
+namespace Tins {
+const size_t PDUArena::DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+// Every block is laid out as a block header, followed by the objects 
+// allocated on it. Every object is preceded by an allocation_header.
+//
+// refs holds the amount of objects living in the block, plus one while
+// it's the arena's current block. Since only the current block is 
+// allocated from, whichever thread drops it to 0 is the only one that 
+// can be using the block, and hands it back to its arena.
+struct PDUArena::block {
+    PDUArena* owner;
+    block* prev;
+    block* next;
+    volatile long refs;
+    size_t used;
+    size_t capacity;
+};
+
+namespace {
+// The alignment used for every allocation
+const size_t alignment = 16;
+
+struct allocation_header {
+    // The block this object was allocated on. 0 if it's on the heap
+    PDUArena::block* blk;
+};
+
+size_t align(size_t size) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+const size_t header_size = align(sizeof(allocation_header));
+
+TINS_THREAD_LOCAL PDUArena* current_arena = 0;
+
+#ifdef _WIN32
+long increment(volatile long* value) {
+    return InterlockedIncrement(value);
+}
+
+long decrement(volatile long* value) {
+    return InterlockedDecrement(value);
+}
+
+SRWLOCK blocks_lock = SRWLOCK_INIT;
+
+void lock_blocks() {
+    AcquireSRWLockExclusive(&blocks_lock);
+}
+
+void unlock_blocks() {
+    ReleaseSRWLockExclusive(&blocks_lock);
+}
+#else
+long increment(volatile long* value) {
+    return __sync_add_and_fetch(value, 1);
+}
+
+long decrement(volatile long* value) {
+    return __sync_sub_and_fetch(value, 1);
+}
+
+// Protects every arena's free and retired block lists, as blocks can 
+// be handed back from any thread. This is only taken once per block.
+pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void lock_blocks() {
+    pthread_mutex_lock(&blocks_lock);
+}
+
+void unlock_blocks() {
+    pthread_mutex_unlock(&blocks_lock);
+}
+#endif // _WIN32
+
+class blocks_guard {
+public:
+    blocks_guard() {
+        lock_blocks();
+    }
+
+    ~blocks_guard() {
+        unlock_blocks();
+    }
+};
+} // namespace
+
+PDUArena::Scope::Scope(PDUArena& arena) {
+    activate(&arena);
+}
+
+PDUArena::Scope::Scope(PDUArena* arena) {
+    activate(arena);
+}
+
+PDUArena::Scope::~Scope() {
+    if(active_)
+        current_arena = previous_;
+}
+
+void PDUArena::Scope::activate(PDUArena* arena) {
+    previous_ = current_arena;
+    active_ = arena != 0;
+    if(active_)
+        current_arena = arena;
+}
+
+PDUArena::PDUArena(size_t block_size)
+: current_block_(0), free_blocks_(0), retired_blocks_(0), 
+  block_size_(align(block_size)), block_count_(0)
+{
+
+}
+
+PDUArena::~PDUArena() {
+    block* last = current_block_;
+    {
+        blocks_guard guard;
+        while(free_blocks_) {
+            block* next = free_blocks_->next;
+            free_block(free_blocks_);
+            free_blocks_ = next;
+        }
+        if(current_block_)
+            retire_block(current_block_);
+        // Blocks that still contain PDUs are detached, and freed by 
+        // the last PDU that is deleted.
+        while(retired_blocks_) {
+            block* next = retired_blocks_->next;
+            retired_blocks_->owner = 0;
+            retired_blocks_->prev = retired_blocks_->next = 0;
+            retired_blocks_ = next;
+        }
+    }
+    if(last)
+        release_reference(last);
+}
+
+PDUArena* PDUArena::current() {
+    return current_arena;
+}
+
+void* PDUArena::allocate(size_t size) {
+    if(current_arena)
+        return current_arena->allocate_object(size);
+    allocation_header* header = static_cast<allocation_header*>(
+        ::operator new(header_size + size)
+    );
+    header->blk = 0;
+    return reinterpret_cast<uint8_t*>(header) + header_size;
+}
+
+void PDUArena::deallocate(void* ptr) {
+    if(!ptr)
+        return;
+    allocation_header* header = reinterpret_cast<allocation_header*>(
+        static_cast<uint8_t*>(ptr) - header_size
+    );
+    if(header->blk)
+        release_reference(header->blk);
+    else
+        ::operator delete(header);
+}
+
+void* PDUArena::allocate_object(size_t size) {
+    const size_t needed = header_size + align(size);
+    block* blk;
+    if(needed > block_size_) {
+        // Too large for a regular block, this one gets its own
+        blk = allocate_block(needed);
+        blk->refs = 0;
+        blocks_guard guard;
+        retire_block(blk);
+    }
+    else {
+        if(current_block_ && current_block_->used + needed > current_block_->capacity) {
+            // If only the arena's reference is left, nobody else can 
+            // touch it, so it's simply rewound
+            if(current_block_->refs == 1) {
+                current_block_->used = 0;
+            }
+            else {
+                {
+                    blocks_guard guard;
+                    retire_block(current_block_);
+                }
+                release_reference(current_block_);
+                current_block_ = 0;
+            }
+        }
+        if(!current_block_) {
+            {
+                blocks_guard guard;
+                if(free_blocks_) {
+                    current_block_ = free_blocks_;
+                    free_blocks_ = free_blocks_->next;
+                }
+            }
+            if(!current_block_)
+                current_block_ = allocate_block(block_size_);
+            current_block_->refs = 1;
+        }
+        blk = current_block_;
+    }
+    uint8_t* data = reinterpret_cast<uint8_t*>(blk) + align(sizeof(block));
+    allocation_header* header = reinterpret_cast<allocation_header*>(data + blk->used);
+    header->blk = blk;
+    blk->used += needed;
+    increment(&blk->refs);
+    return reinterpret_cast<uint8_t*>(header) + header_size;
+}
+
+PDUArena::block* PDUArena::allocate_block(size_t capacity) {
+    block* blk = static_cast<block*>(
+        ::operator new(align(sizeof(block)) + capacity)
+    );
+    blk->owner = this;
+    blk->prev = blk->next = 0;
+    blk->refs = 0;
+    blk->used = 0;
+    blk->capacity = capacity;
+    blocks_guard guard;
+    block_count_++;
+    return blk;
+}
+
+void PDUArena::retire_block(block* blk) {
+    blk->prev = 0;
+    blk->next = retired_blocks_;
+    if(retired_blocks_)
+        retired_blocks_->prev = blk;
+    retired_blocks_ = blk;
+}
+
+void PDUArena::release_reference(block* blk) {
+    if(decrement(&blk->refs) != 0)
+        return;
+    blocks_guard guard;
+    PDUArena* owner = blk->owner;
+    if(!owner) {
+        free_block(blk);
+        return;
+    }
+    if(blk->prev)
+        blk->prev->next = blk->next;
+    else
+        owner->retired_blocks_ = blk->next;
+    if(blk->next)
+        blk->next->prev = blk->prev;
+    if(blk->capacity == owner->block_size_) {
+        blk->used = 0;
+        blk->prev = 0;
+        blk->next = owner->free_blocks_;
+        owner->free_blocks_ = blk;
+    }
+    else {
+        owner->block_count_--;
+        free_block(blk);
+    }
+}
+
+void PDUArena::free_block(block* blk) {
+    ::operator delete(blk);
+}
+} // namespace Tins
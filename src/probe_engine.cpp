@@ -0,0 +1,711 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "probe_engine.h"
+
+#ifdef HAVE_PROBE_ENGINE
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include "packet_sender.h"
+#include "network_interface.h"
+#include "exceptions.h"
+#include "internals.h"
+#include "ip.h"
+#include "ipv6.h"
+#include "arp.h"
+#include "tcp.h"
+#include "udp.h"
+#include "icmp.h"
+#include "icmpv6.h"
+
+using std::runtime_error;
+
+namespace Tins {
+namespace Internals {
+namespace {
+
+const uint16_t ETHERTYPE_IP = 0x0800;
+const uint16_t ETHERTYPE_IPV6 = 0x86dd;
+const uint16_t ETHERTYPE_ARP = 0x0806;
+
+const uint8_t PROTO_ICMP = 1;
+const uint8_t PROTO_TCP = 6;
+const uint8_t PROTO_UDP = 17;
+const uint8_t PROTO_ICMPV6 = 58;
+
+uint16_t read_be16(const uint8_t* data) {
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+// Maps an ICMP reply type into the type of the request it answers,
+// or returns 0 if it's not a reply.
+uint8_t icmp_request_type(uint8_t reply_type) {
+    switch (reply_type) {
+        case ICMP::ECHO_REPLY:
+            return ICMP::ECHO_REQUEST;
+        case ICMP::TIMESTAMP_REPLY:
+            return ICMP::TIMESTAMP_REQUEST;
+        case ICMP::ADDRESS_MASK_REPLY:
+            return ICMP::ADDRESS_MASK_REQUEST;
+        default:
+            return 0;
+    };
+}
+
+bool is_icmp_request(uint8_t type) {
+    return type == ICMP::ECHO_REQUEST || type == ICMP::TIMESTAMP_REQUEST ||
+           type == ICMP::ADDRESS_MASK_REQUEST;
+}
+
+bool is_icmp_error(uint8_t type) {
+    return type == ICMP::DEST_UNREACHABLE || type == ICMP::SOURCE_QUENCH ||
+           type == ICMP::REDIRECT || type == ICMP::TIME_EXCEEDED || 
+           type == ICMP::PARAM_PROBLEM;
+}
+
+bool is_icmpv6_error(uint8_t type) {
+    return type == ICMPv6::DEST_UNREACHABLE || type == ICMPv6::PACKET_TOOBIG ||
+           type == ICMPv6::TIME_EXCEEDED || type == ICMPv6::PARAM_PROBLEM;
+}
+
+bool parse_ip_packet(const uint8_t* data, uint32_t size, bool quoted, 
+  probe_key& key);
+bool parse_ipv6_packet(const uint8_t* data, uint32_t size, bool quoted, 
+  probe_key& key);
+
+// Fills the protocol specific part of a key, given the transport layer
+// of a packet. If quoted is true, the packet is a probe contained in an
+// ICMP error, so it's already in the direction of the probe.
+bool parse_transport(uint8_t protocol, const uint8_t* data, uint32_t size, 
+  bool quoted, probe_key& key) 
+{
+    key.protocol = protocol;
+    if (protocol == PROTO_TCP || protocol == PROTO_UDP) {
+        // ICMP errors contain at least the first 8 bytes of the probe
+        if (size < 4) {
+            return false;
+        }
+        key.src_id = read_be16(data);
+        key.dst_id = read_be16(data + 2);
+        if (!quoted) {
+            std::swap(key.src_id, key.dst_id);
+        }
+        return true;
+    }
+    if (size < 8) {
+        return false;
+    }
+    const uint8_t type = data[0];
+    if (protocol == PROTO_ICMP) {
+        if (quoted) {
+            if (!is_icmp_request(type)) {
+                return false;
+            }
+            key.type = type;
+        }
+        else if ((key.type = icmp_request_type(type)) == 0) {
+            // This is not a reply. It could still be an error that
+            // contains the probe, in which case that one's key is used
+            if (!is_icmp_error(type)) {
+                return false;
+            }
+            key = probe_key();
+            return parse_ip_packet(data + 8, size - 8, true, key);
+        }
+    }
+    else if (protocol == PROTO_ICMPV6) {
+        if (quoted) {
+            if (type != ICMPv6::ECHO_REQUEST) {
+                return false;
+            }
+        }
+        else if (type != ICMPv6::ECHO_REPLY) {
+            if (!is_icmpv6_error(type)) {
+                return false;
+            }
+            key = probe_key();
+            return parse_ipv6_packet(data + 8, size - 8, true, key);
+        }
+        key.type = ICMPv6::ECHO_REQUEST;
+    }
+    else {
+        return false;
+    }
+    key.src_id = read_be16(data + 4);
+    key.dst_id = read_be16(data + 6);
+    return true;
+}
+
+bool parse_ip_packet(const uint8_t* data, uint32_t size, bool quoted, 
+  probe_key& key) 
+{
+    if (size < 20 || (data[0] >> 4) != 4) {
+        return false;
+    }
+    const uint32_t header_size = (data[0] & 0x0f) * 4;
+    // Only the first fragment contains the transport header
+    const uint16_t fragment_offset = read_be16(data + 6) & 0x1fff;
+    if (header_size < 20 || header_size > size || fragment_offset != 0) {
+        return false;
+    }
+    key.ether_type = ETHERTYPE_IP;
+    // Responses are stored in the direction of the probe
+    std::memcpy(key.src_addr, data + (quoted ? 12 : 16), 4);
+    std::memcpy(key.dst_addr, data + (quoted ? 16 : 12), 4);
+    return parse_transport(data[9], data + header_size, size - header_size, 
+                           quoted, key);
+}
+
+bool parse_ipv6_packet(const uint8_t* data, uint32_t size, bool quoted, 
+  probe_key& key) 
+{
+    if (size < 40 || (data[0] >> 4) != 6) {
+        return false;
+    }
+    key.ether_type = ETHERTYPE_IPV6;
+    std::memcpy(key.src_addr, data + (quoted ? 8 : 24), 16);
+    std::memcpy(key.dst_addr, data + (quoted ? 24 : 8), 16);
+    uint8_t next_header = data[6];
+    uint32_t offset = 40;
+    // Skip the extension headers that can precede the transport layer
+    while (true) {
+        if (next_header == IPv6::HOP_BY_HOP || next_header == IPv6::ROUTING ||
+            next_header == IPv6::DESTINATION_ROUTING_OPTIONS) {
+            if (offset + 8 > size) {
+                return false;
+            }
+            next_header = data[offset];
+            offset += (data[offset + 1] + 1) * 8;
+        }
+        else if (next_header == IPv6::FRAGMENT) {
+            if (offset + 8 > size || (read_be16(data + offset + 2) & 0xfff8) != 0) {
+                return false;
+            }
+            next_header = data[offset];
+            offset += 8;
+        }
+        else {
+            break;
+        }
+    }
+    if (offset > size) {
+        return false;
+    }
+    return parse_transport(next_header, data + offset, size - offset, quoted, key);
+}
+
+bool parse_arp_packet(const uint8_t* data, uint32_t size, probe_key& key) {
+    // Only IPv4 over ethernet replies are handled
+    if (size < 28 || read_be16(data + 2) != ETHERTYPE_IP || data[4] != 6 || 
+        data[5] != 4 || read_be16(data + 6) != ARP::REPLY) {
+        return false;
+    }
+    key.ether_type = ETHERTYPE_ARP;
+    // The reply's target is the request's sender
+    std::memcpy(key.src_addr, data + 24, 4);
+    std::memcpy(key.dst_addr, data + 14, 4);
+    return true;
+}
+
+void copy_address(const IPv4Address& address, uint8_t* output) {
+    const uint32_t value = address;
+    std::memcpy(output, &value, sizeof(value));
+}
+
+} // anonymous namespace
+
+probe_key::probe_key() {
+    std::memset(this, 0, sizeof(*this));
+}
+
+uint32_t probe_key::hash() const {
+    uint64_t words[sizeof(probe_key) / sizeof(uint64_t)];
+    std::memcpy(words, this, sizeof(words));
+    uint64_t value = 0;
+    for (size_t i = 0; i < sizeof(words) / sizeof(uint64_t); ++i) {
+        value = (value ^ words[i]) * 0x9e3779b97f4a7c15ULL;
+    }
+    return mix_hash(value);
+}
+
+bool probe_key::operator==(const probe_key& rhs) const {
+    return std::memcmp(this, &rhs, sizeof(*this)) == 0;
+}
+
+bool make_probe_key(PDU& probe, probe_key& key) {
+    key = probe_key();
+    if (const IP* ip = probe.find_pdu<IP>()) {
+        key.ether_type = ETHERTYPE_IP;
+        copy_address(ip->src_addr(), key.src_addr);
+        copy_address(ip->dst_addr(), key.dst_addr);
+    }
+    else if (const IPv6* ipv6 = probe.find_pdu<IPv6>()) {
+        key.ether_type = ETHERTYPE_IPV6;
+        ipv6->src_addr().copy(key.src_addr);
+        ipv6->dst_addr().copy(key.dst_addr);
+    }
+    else if (const ARP* arp = probe.find_pdu<ARP>()) {
+        if (arp->opcode() != ARP::REQUEST) {
+            return false;
+        }
+        key.ether_type = ETHERTYPE_ARP;
+        copy_address(arp->sender_ip_addr(), key.src_addr);
+        copy_address(arp->target_ip_addr(), key.dst_addr);
+        return true;
+    }
+    else {
+        return false;
+    }
+
+    if (const TCP* tcp = probe.find_pdu<TCP>()) {
+        key.protocol = PROTO_TCP;
+        key.src_id = tcp->sport();
+        key.dst_id = tcp->dport();
+    }
+    else if (const UDP* udp = probe.find_pdu<UDP>()) {
+        key.protocol = PROTO_UDP;
+        key.src_id = udp->sport();
+        key.dst_id = udp->dport();
+    }
+    else if (const ICMP* icmp = probe.find_pdu<ICMP>()) {
+        if (!is_icmp_request(icmp->type())) {
+            return false;
+        }
+        key.protocol = PROTO_ICMP;
+        key.type = icmp->type();
+        key.src_id = icmp->id();
+        key.dst_id = icmp->sequence();
+    }
+    else if (const ICMPv6* icmp = probe.find_pdu<ICMPv6>()) {
+        if (icmp->type() != ICMPv6::ECHO_REQUEST) {
+            return false;
+        }
+        key.protocol = PROTO_ICMPV6;
+        key.type = ICMPv6::ECHO_REQUEST;
+        key.src_id = icmp->identifier();
+        key.dst_id = icmp->sequence();
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+bool make_response_key(uint16_t ether_type, const uint8_t* data, 
+  uint32_t size, probe_key& key) 
+{
+    key = probe_key();
+    switch (ether_type) {
+        case ETHERTYPE_IP:
+            return parse_ip_packet(data, size, false, key);
+        case ETHERTYPE_IPV6:
+            return parse_ipv6_packet(data, size, false, key);
+        case ETHERTYPE_ARP:
+            return parse_arp_packet(data, size, key);
+        default:
+            return false;
+    };
+}
+} // namespace Internals
+
+// ProbeEngine
+
+namespace {
+
+// The amount of packets read on each recvmmsg call, and the maximum
+// size of each of them
+const uint32_t RECEIVE_BATCH = 64;
+const uint32_t MAX_PACKET_SIZE = 2048;
+// Responses are only read while dispatching, so they can pile up while
+// probes are being sent
+const int RECEIVE_BUFFER_SIZE = 8 << 20;
+// The amount of probes sent between reads of the socket
+const uint32_t SENDS_PER_READ = 64;
+
+uint64_t monotonic_now() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+} // anonymous namespace
+
+const uint32_t ProbeEngine::DEFAULT_TIMEOUT = 2000;
+
+ProbeEngine::ProbeEngine(PacketSender& sender, uint32_t timeout)
+: sender_(&sender), socket_(-1), epoll_fd_(-1), timeout_(timeout), next_id_(0),
+  buckets_(64, 0), buffer_(RECEIVE_BATCH * MAX_PACKET_SIZE), free_(0), 
+  head_(0), tail_(0), size_(0)
+{
+    // Cooked sockets provide packets starting at their network layer,
+    // no matter which interface they're received on.
+    socket_ = ::socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_ALL));
+    if (socket_ < 0) {
+        throw socket_open_error(strerror(errno));
+    }
+    #ifdef PACKET_IGNORE_OUTGOING
+        // Don't queue our own probes. This is only an optimization, 
+        // since outgoing packets are skipped when read anyway
+        int ignore = 1;
+        setsockopt(socket_, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignore, sizeof(ignore));
+    #endif // PACKET_IGNORE_OUTGOING
+    // Going beyond the system's limit requires CAP_NET_ADMIN
+    int buffer_size = RECEIVE_BUFFER_SIZE;
+    if (setsockopt(socket_, SOL_SOCKET, SO_RCVBUFFORCE, &buffer_size, sizeof(buffer_size)) < 0) {
+        setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    }
+    epoll_fd_ = epoll_create(1);
+    if (epoll_fd_ < 0) {
+        cleanup();
+        throw runtime_error(strerror(errno));
+    }
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = socket_;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket_, &event) < 0) {
+        cleanup();
+        throw runtime_error(strerror(errno));
+    }
+}
+
+ProbeEngine::~ProbeEngine() {
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        delete entries_[i].fallback;
+    }
+    release_results(results_);
+    cleanup();
+}
+
+void ProbeEngine::cleanup() {
+    if (epoll_fd_ >= 0) {
+        ::close(epoll_fd_);
+        epoll_fd_ = -1;
+    }
+    if (socket_ >= 0) {
+        ::close(socket_);
+        socket_ = -1;
+    }
+}
+
+uint32_t ProbeEngine::send(PDU& probe) {
+    sender_->send(probe);
+    return add_probe(probe);
+}
+
+uint32_t ProbeEngine::send(PDU& probe, const NetworkInterface& iface) {
+    sender_->send(probe, iface);
+    return add_probe(probe);
+}
+
+size_t ProbeEngine::outstanding() const {
+    return size_ + results_.size();
+}
+
+uint32_t ProbeEngine::timeout() const {
+    return timeout_;
+}
+
+int ProbeEngine::get_fd() const {
+    return epoll_fd_;
+}
+
+uint32_t ProbeEngine::add_probe(PDU& probe) {
+    // The key is built after sending, since fields such as the source 
+    // address are filled in while the probe is serialized
+    Internals::probe_key key;
+    const bool keyed = Internals::make_probe_key(probe, key);
+    const uint32_t index = allocate_entry();
+    probe_entry& entry = entries_[index];
+    entry.key = key;
+    entry.sent_at = monotonic_now();
+    entry.fallback = 0;
+    entry.fallback_match = 0;
+    entry.id = next_id_++;
+    entry.bucket_next = 0;
+    if (keyed) {
+        insert_keyed(index);
+    }
+    else {
+        // Responses are provided starting at the network layer
+        entry.fallback = probe.clone();
+        PDU* match = entry.fallback;
+        while (match && match->pdu_type() != PDU::IP && 
+               match->pdu_type() != PDU::IPv6 && match->pdu_type() != PDU::ARP) {
+            match = match->inner_pdu();
+        }
+        entry.fallback_match = match ? match : entry.fallback;
+        fallback_.push_back(index);
+    }
+    // Every probe has the same timeout, so this list is sorted by deadline
+    entry.prev = tail_;
+    entry.next = 0;
+    if (tail_) {
+        entries_[tail_ - 1].next = index + 1;
+    }
+    else {
+        head_ = index + 1;
+    }
+    tail_ = index + 1;
+    ++size_;
+    const uint32_t id = entry.id;
+    // The probe must be stored first, since its response may already
+    // be waiting in the socket
+    if (id % SENDS_PER_READ == 0) {
+        read_packets();
+    }
+    return id;
+}
+
+uint32_t ProbeEngine::allocate_entry() {
+    if (free_) {
+        const uint32_t index = free_ - 1;
+        free_ = entries_[index].bucket_next;
+        return index;
+    }
+    entries_.push_back(probe_entry());
+    return static_cast<uint32_t>(entries_.size() - 1);
+}
+
+void ProbeEngine::insert_keyed(uint32_t index) {
+    if (size_ >= buckets_.size()) {
+        rehash(buckets_.size() * 2);
+    }
+    // Probes that share a key are appended, so the oldest one is 
+    // matched first
+    uint32_t* slot = &buckets_[entries_[index].key.hash() & (buckets_.size() - 1)];
+    while (*slot) {
+        slot = &entries_[*slot - 1].bucket_next;
+    }
+    *slot = index + 1;
+}
+
+uint32_t ProbeEngine::find(const Internals::probe_key& key) const {
+    uint32_t current = buckets_[key.hash() & (buckets_.size() - 1)];
+    while (current && !(entries_[current - 1].key == key)) {
+        current = entries_[current - 1].bucket_next;
+    }
+    return current;
+}
+
+void ProbeEngine::rehash(size_t bucket_count) {
+    buckets_.assign(bucket_count, 0);
+    for (uint32_t current = head_; current; current = entries_[current - 1].next) {
+        probe_entry& entry = entries_[current - 1];
+        if (!entry.fallback) {
+            entry.bucket_next = 0;
+            insert_keyed(current - 1);
+        }
+    }
+}
+
+void ProbeEngine::remove(uint32_t index) {
+    probe_entry& entry = entries_[index];
+    if (entry.fallback) {
+        delete entry.fallback;
+        entry.fallback = 0;
+        fallback_.erase(std::find(fallback_.begin(), fallback_.end(), index));
+    }
+    else {
+        uint32_t* slot = &buckets_[entry.key.hash() & (buckets_.size() - 1)];
+        while (*slot != index + 1) {
+            slot = &entries_[*slot - 1].bucket_next;
+        }
+        *slot = entry.bucket_next;
+    }
+    if (entry.prev) {
+        entries_[entry.prev - 1].next = entry.next;
+    }
+    else {
+        head_ = entry.next;
+    }
+    if (entry.next) {
+        entries_[entry.next - 1].prev = entry.prev;
+    }
+    else {
+        tail_ = entry.prev;
+    }
+    entry.bucket_next = free_;
+    free_ = index + 1;
+    --size_;
+}
+
+size_t ProbeEngine::collect(int wait) {
+    // Probes completed while sending are delivered without waiting
+    if (!results_.empty()) {
+        read_packets();
+        expire(monotonic_now());
+        return results_.size();
+    }
+    uint64_t now = monotonic_now();
+    const uint64_t wait_end = now + (uint64_t)wait * 1000;
+    while (size_ > 0) {
+        // Wake up when the oldest probe times out, at the latest
+        const uint64_t deadline = entries_[head_ - 1].sent_at + (uint64_t)timeout_ * 1000;
+        int epoll_timeout = 0;
+        if (deadline > now) {
+            epoll_timeout = static_cast<int>((deadline - now + 999) / 1000);
+        }
+        if (wait >= 0) {
+            const int remaining = wait_end > now ? static_cast<int>((wait_end - now + 999) / 1000) : 0;
+            epoll_timeout = std::min(epoll_timeout, remaining);
+        }
+        epoll_event event;
+        const int ready = epoll_wait(epoll_fd_, &event, 1, epoll_timeout);
+        if (ready < 0 && errno != EINTR) {
+            throw runtime_error(strerror(errno));
+        }
+        if (ready > 0) {
+            read_packets();
+        }
+        now = monotonic_now();
+        expire(now);
+        if (!results_.empty() || (wait >= 0 && now >= wait_end)) {
+            break;
+        }
+    }
+    return results_.size();
+}
+
+void ProbeEngine::read_packets() {
+    mmsghdr headers[RECEIVE_BATCH];
+    iovec vectors[RECEIVE_BATCH];
+    sockaddr_ll addresses[RECEIVE_BATCH];
+    std::memset(headers, 0, sizeof(headers));
+    for (uint32_t i = 0; i < RECEIVE_BATCH; ++i) {
+        vectors[i].iov_base = &buffer_[i * MAX_PACKET_SIZE];
+        vectors[i].iov_len = MAX_PACKET_SIZE;
+        headers[i].msg_hdr.msg_iov = &vectors[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+        headers[i].msg_hdr.msg_name = &addresses[i];
+    }
+    while (true) {
+        for (uint32_t i = 0; i < RECEIVE_BATCH; ++i) {
+            headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_ll);
+        }
+        const int count = recvmmsg(socket_, headers, RECEIVE_BATCH, MSG_DONTWAIT, 0);
+        if (count <= 0) {
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            // Our own probes are seen as well
+            if (addresses[i].sll_pkttype == PACKET_OUTGOING) {
+                continue;
+            }
+            process_packet(ntohs(addresses[i].sll_protocol), &buffer_[i * MAX_PACKET_SIZE], 
+                           std::min(headers[i].msg_len, MAX_PACKET_SIZE));
+        }
+        if (count < static_cast<int>(RECEIVE_BATCH) || size_ == 0) {
+            break;
+        }
+    }
+}
+
+void ProbeEngine::process_packet(uint16_t ether_type, const uint8_t* data, 
+  uint32_t size) 
+{
+    Internals::probe_key key;
+    if (Internals::make_response_key(ether_type, data, size, key)) {
+        const uint32_t index = find(key);
+        if (index) {
+            complete(index - 1, ether_type, data, size);
+            return;
+        }
+    }
+    for (size_t i = 0; i < fallback_.size(); ++i) {
+        if (entries_[fallback_[i]].fallback_match->matches_response(data, size)) {
+            complete(fallback_[i], ether_type, data, size);
+            return;
+        }
+    }
+}
+
+void ProbeEngine::complete(uint32_t index, uint16_t ether_type, 
+  const uint8_t* data, uint32_t size) 
+{
+    PDU* response = 0;
+    try {
+        switch (ether_type) {
+            case Internals::ETHERTYPE_IP:
+                response = new IP(data, size);
+                break;
+            case Internals::ETHERTYPE_IPV6:
+                response = new IPv6(data, size);
+                break;
+            case Internals::ETHERTYPE_ARP:
+                response = new ARP(data, size);
+                break;
+            default:
+                return;
+        };
+    }
+    catch (malformed_packet&) {
+        return;
+    }
+    const probe_entry& entry = entries_[index];
+    Result result;
+    result.probe_id = entry.id;
+    result.response = response;
+    result.elapsed = static_cast<uint32_t>(monotonic_now() - entry.sent_at);
+    results_.push_back(result);
+    remove(index);
+}
+
+void ProbeEngine::expire(uint64_t now) {
+    const uint64_t timeout = (uint64_t)timeout_ * 1000;
+    while (head_ && entries_[head_ - 1].sent_at + timeout <= now) {
+        const probe_entry& entry = entries_[head_ - 1];
+        Result result;
+        result.probe_id = entry.id;
+        result.response = 0;
+        result.elapsed = static_cast<uint32_t>(now - entry.sent_at);
+        results_.push_back(result);
+        remove(head_ - 1);
+    }
+}
+
+void ProbeEngine::release_results(std::vector<Result>& results) {
+    for (size_t i = 0; i < results.size(); ++i) {
+        delete results[i].response;
+    }
+    results.clear();
+}
+} // namespace Tins
+
+#endif // HAVE_PROBE_ENGINE
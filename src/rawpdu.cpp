@@ -31,37 +31,167 @@
 #include <cassert>
 #endif
 #include <algorithm>
+#include <cstring>
 #include "rawpdu.h"
 
 
 namespace Tins {
+namespace {
+TINS_THREAD_LOCAL BorrowedPayloads* current_borrowed = 0;
+TINS_THREAD_LOCAL bool trust_checksums = false;
+} // namespace
+
 RawPDU::RawPDU(const uint8_t *pload, uint32_t size) 
-: _payload(pload, pload + size) 
+: _borrowed(0), _borrowed_size(0), _borrower(0), _prev_borrowed(0), 
+  _next_borrowed(0), _payload_sum(0),
+  _has_payload_sum(false)
 {
-    
+    BorrowedPayloads *borrowed = current_borrowed;
+    if(borrowed && size > 0) {
+        _borrowed = pload;
+        _borrowed_size = size;
+        borrowed->add(this);
+    }
+    else {
+        _payload.assign(pload, pload + size);
+    }
 }
 
 RawPDU::RawPDU(const std::string &data) 
-: _payload(data.begin(), data.end()) {
+: _payload(data.begin(), data.end()), _borrowed(0), _borrowed_size(0), 
+  _borrower(0), _prev_borrowed(0), _next_borrowed(0), _payload_sum(0),
+  _has_payload_sum(false)
+{
     
 }
 
+RawPDU::RawPDU(const RawPDU &other)
+: PDU(other), _borrowed(0), _borrowed_size(0), _borrower(0), 
+  _prev_borrowed(0), _next_borrowed(0), _payload_sum(0),
+  _has_payload_sum(false)
+{
+    const uint8_t *data = other.payload_data();
+    _payload.assign(data, data + other.payload_size());
+}
+
+RawPDU &RawPDU::operator=(const RawPDU &other) {
+    if(this != &other) {
+        PDU::operator=(other);
+        stop_borrowing();
+        _has_payload_sum = false;
+        const uint8_t *data = other.payload_data();
+        _payload.assign(data, data + other.payload_size());
+    }
+    return *this;
+}
+
+RawPDU::~RawPDU() {
+    stop_borrowing();
+}
+
 uint32_t RawPDU::header_size() const {
-    return static_cast<uint32_t>(_payload.size());
+    return payload_size();
 }
 
 void RawPDU::write_serialization(uint8_t *buffer, uint32_t total_sz, const PDU *) {
     #ifdef TINS_DEBUG
-    assert(total_sz >= _payload.size());
+    assert(total_sz >= payload_size());
     #endif
-    std::copy(_payload.begin(), _payload.end(), buffer);
+    if(payload_size() > 0)
+        std::memcpy(buffer, payload_data(), payload_size());
 }
 
 void RawPDU::payload(const payload_type &pload) {
+    stop_borrowing();
+    _has_payload_sum = false;
     _payload = pload;
 }
 
 bool RawPDU::matches_response(const uint8_t *ptr, uint32_t total_sz) const {
     return true;
 }
+
+void RawPDU::copy_borrowed() const {
+    const uint8_t *data = _borrowed;
+    _payload.assign(data, data + _borrowed_size);
+    stop_borrowing();
+}
+
+void RawPDU::stop_borrowing() const {
+    if(_borrower) {
+        _borrower->remove(this);
+        _borrowed = 0;
+        _borrowed_size = 0;
+    }
+}
+
+// BorrowedPayloads
+
+BorrowedPayloads::Scope::Scope(BorrowedPayloads &borrowed) 
+: previous_(current_borrowed)
+{
+    current_borrowed = &borrowed;
+}
+
+BorrowedPayloads::Scope::~Scope() {
+    current_borrowed = previous_;
+}
+
+BorrowedPayloads::BorrowedPayloads()
+: head_(0), size_(0)
+{
+
+}
+
+BorrowedPayloads::~BorrowedPayloads() {
+    release();
+}
+
+BorrowedPayloads *BorrowedPayloads::current() {
+    return current_borrowed;
+}
+
+void BorrowedPayloads::release() {
+    while(head_) {
+        head_->copy_borrowed();
+    }
+}
+
+void BorrowedPayloads::add(const RawPDU *pdu) {
+    pdu->_borrower = this;
+    pdu->_prev_borrowed = 0;
+    pdu->_next_borrowed = head_;
+    if(head_)
+        head_->_prev_borrowed = pdu;
+    head_ = pdu;
+    size_++;
+}
+
+void BorrowedPayloads::remove(const RawPDU *pdu) {
+    if(pdu->_prev_borrowed)
+        pdu->_prev_borrowed->_next_borrowed = pdu->_next_borrowed;
+    else
+        head_ = pdu->_next_borrowed;
+    if(pdu->_next_borrowed)
+        pdu->_next_borrowed->_prev_borrowed = pdu->_prev_borrowed;
+    pdu->_borrower = 0;
+    pdu->_prev_borrowed = pdu->_next_borrowed = 0;
+    size_--;
+}
+
+// TrustedChecksums
+
+TrustedChecksums::Scope::Scope(bool enabled)
+: previous_(trust_checksums)
+{
+    trust_checksums = enabled;
+}
+
+TrustedChecksums::Scope::~Scope() {
+    trust_checksums = previous_;
+}
+
+bool TrustedChecksums::enabled() {
+    return trust_checksums;
+}
 }
@@ -45,19 +45,31 @@
 #include "pktap.h"
 #include "sll.h"
 #include "ppi.h"
+#include "packet_ring.h"
+#include "pdu_arena.h"
 
 using std::string;
 using std::runtime_error;
 
 namespace Tins {
+const uint32_t BaseSniffer::DEFAULT_BATCH_SIZE = 64;
+
 BaseSniffer::BaseSniffer() 
-: handle(0), mask(0), extract_raw(false)
+: handle(0), mask(0), extract_raw(false), handler(0), ring(0), arena(0),
+  borrowed(0), trust_checksums(false)
 {
     
 }
     
 BaseSniffer::~BaseSniffer() 
 {
+    // Borrowed payloads are copied out of the capture buffers, so
+    // this has to be done while they're still mapped
+    delete borrowed;
+    #ifdef HAVE_PACKET_RING
+    delete ring;
+    #endif // HAVE_PACKET_RING
+    delete arena;
     if (handle) {
         pcap_close(handle);
     }
@@ -66,6 +78,7 @@ BaseSniffer::~BaseSniffer()
 void BaseSniffer::set_pcap_handle(pcap_t* const pcap_handle)
 {
     handle = pcap_handle;
+    handler = 0;
 }
 
 pcap_t* BaseSniffer::get_pcap_handle()
@@ -88,6 +101,19 @@ bpf_u_int32 BaseSniffer::get_if_mask() const
     return mask;
 }
 
+void BaseSniffer::set_packet_ring(RxPacketRing* packet_ring)
+{
+    #ifdef HAVE_PACKET_RING
+    delete ring;
+    #endif // HAVE_PACKET_RING
+    ring = packet_ring;
+}
+
+RxPacketRing* BaseSniffer::get_packet_ring()
+{
+    return ring;
+}
+
 struct sniff_data {
     struct timeval tv;
     PDU *pdu;
@@ -138,10 +164,75 @@ void sniff_loop_dot11_handler(u_char *user, const struct pcap_pkthdr *h, const u
 }
 #endif
 
-PtrPacket BaseSniffer::next_packet() {
+struct sniff_batch_data {
+    pcap_handler handler;
+    std::vector<Packet> *packets;
+};
+
+// Invokes the link layer handler and stores the result in the output vector
+void BaseSniffer::sniff_batch_handler(u_char *user, const struct pcap_pkthdr *h, 
+                                      const u_char *bytes) 
+{
+    sniff_batch_data *batch = (sniff_batch_data*)user;
+    sniff_data data;
+    batch->handler((u_char*)&data, h, bytes);
+    if(data.pdu) {
+        batch->packets->push_back(Packet());
+        batch->packets->back().pdu_ = data.pdu;
+        batch->packets->back().ts = data.tv;
+    }
+}
+
+#if TINS_IS_CXX11
+struct sniff_callback_data {
+    pcap_handler handler;
+    bool (*callback)(Packet& packet, void* user);
+    void *user;
+    bool stopped;
+};
+
+// Invokes the link layer handler and hands the result to the callback
+void BaseSniffer::sniff_callback_handler(u_char *user, const struct pcap_pkthdr *h, 
+                                         const u_char *bytes) 
+{
+    sniff_callback_data *callback = (sniff_callback_data*)user;
+    // The rest of the batch is discarded once the callback asks to stop
+    if(callback->stopped)
+        return;
     sniff_data data;
+    callback->handler((u_char*)&data, h, bytes);
+    if(data.pdu) {
+        Packet packet(data.pdu, data.tv, Packet::own_pdu());
+        if(!callback->callback(packet, callback->user))
+            callback->stopped = true;
+    }
+}
+
+bool BaseSniffer::dispatch_packets(uint32_t max_packets, packet_callback callback, 
+                                   void *user) 
+{
+    sniff_callback_data data;
+    data.handler = get_handler();
+    data.callback = callback;
+    data.user = user;
+    data.stopped = false;
+    PDUArena::Scope scope(arena);
+    TrustedChecksums::Scope checksums_scope(trust_checksums || TrustedChecksums::enabled());
+    const int result = read_dispatch(max_packets, &sniff_callback_handler, (u_char*)&data);
+    if(result < 0 || data.stopped)
+        return false;
+    // On live captures, 0 means the read timeout expired. On savefiles,
+    // it means there are no more packets to read.
+    return result != 0 || !pcap_file(handle);
+}
+#endif // TINS_IS_CXX11
+
+pcap_handler BaseSniffer::get_handler() {
+    // The handler is only resolved the first time it's required. Live 
+    // handles don't have a valid link type until they've been activated.
+    if(handler)
+        return handler;
     const int iface_type = pcap_datalink(handle);
-    pcap_handler handler = 0;
     if(extract_raw)
         handler = &sniff_loop_handler<RawPDU>;
     else if(iface_type == DLT_EN10MB)
@@ -173,24 +264,148 @@ PtrPacket BaseSniffer::next_packet() {
         handler = &sniff_loop_handler<PPI>;
     else
         throw unknown_link_type();
+    return handler;
+}
+
+int BaseSniffer::read_loop(int max_packets, pcap_handler link_handler, u_char* user) {
+    #ifdef HAVE_PACKET_RING
+    if(ring)
+        return ring->loop(max_packets, link_handler, user);
+    #endif // HAVE_PACKET_RING
+    return pcap_loop(handle, max_packets, link_handler, user);
+}
+
+int BaseSniffer::read_dispatch(int max_packets, pcap_handler link_handler, u_char* user) {
+    #ifdef HAVE_PACKET_RING
+    if(ring)
+        return ring->dispatch(max_packets, link_handler, user);
+    #endif // HAVE_PACKET_RING
+    return pcap_dispatch(handle, max_packets, link_handler, user);
+}
+
+PtrPacket BaseSniffer::next_packet() {
+    sniff_data data;
+    pcap_handler link_handler = get_handler();
+    PDUArena::Scope scope(arena);
+    TrustedChecksums::Scope checksums_scope(trust_checksums || TrustedChecksums::enabled());
+    if(borrowed) {
+        // The buffer used by the previous packet is about to be reused
+        borrowed->release();
+        BorrowedPayloads::Scope borrow_scope(*borrowed);
+        // The frame read by read_next stays valid until the next read,
+        // unlike the ones handed to read_loop's callback.
+        while(data.pdu == 0) {
+            pcap_pkthdr* header;
+            const u_char* bytes;
+            const int result = read_next(&header, &bytes);
+            if(result < 0)
+                return PtrPacket(0, Timestamp());
+            if(result > 0)
+                link_handler((u_char*)&data, header, bytes);
+        }
+        return PtrPacket(data.pdu, data.tv);
+    }
     // keep calling pcap_loop until a well-formed packet is found.
     while(data.pdu == 0 && data.packet_processed) {
         data.packet_processed = false;
-        if(pcap_loop(handle, 1, handler, (u_char*)&data) < 0)
+        if(read_loop(1, link_handler, (u_char*)&data) < 0)
             return PtrPacket(0, Timestamp());
     }
     return PtrPacket(data.pdu, data.tv);
 }
 
+size_t BaseSniffer::next_packets(std::vector<Packet>& packets, uint32_t max_packets) {
+    if(max_packets == 0)
+        return 0;
+    sniff_batch_data data;
+    data.handler = get_handler();
+    data.packets = &packets;
+    PDUArena::Scope scope(arena);
+    TrustedChecksums::Scope checksums_scope(trust_checksums || TrustedChecksums::enabled());
+    const size_t initial_size = packets.size();
+    // Make sure the vector is never reallocated while packets are being 
+    // pushed, otherwise every stored PDU would be cloned on C++03.
+    packets.reserve(initial_size + max_packets);
+    // keep dispatching until at least one well-formed packet is found.
+    while(packets.size() == initial_size) {
+        const int result = read_dispatch(max_packets, &sniff_batch_handler, (u_char*)&data);
+        if(result < 0) {
+            break;
+        }
+        // On live captures, 0 means the read timeout expired. On savefiles,
+        // it means there are no more packets to read.
+        if(result == 0 && pcap_file(handle)) {
+            break;
+        }
+    }
+    return packets.size() - initial_size;
+}
+
+int BaseSniffer::read_next(pcap_pkthdr** header, const u_char** data) {
+    #ifdef HAVE_PACKET_RING
+    if(ring)
+        return ring->next(header, data);
+    #endif // HAVE_PACKET_RING
+    return pcap_next_ex(handle, header, data);
+}
+
+bool BaseSniffer::next_packet_view(PacketView& view) {
+    pcap_pkthdr* header;
+    const u_char* data;
+    while(true) {
+        const int result = read_next(&header, &data);
+        if(result < 0)
+            return false;
+        // On live captures, 0 means the read timeout expired
+        if(result > 0) {
+            view = PacketView(data, header->caplen, link_type(), header->ts);
+            return true;
+        }
+    }
+}
+
 void BaseSniffer::set_extract_raw_pdus(bool value) {
     extract_raw = value;
+    handler = 0;
+}
+
+void BaseSniffer::set_pdu_arena(bool enabled) {
+    if(!enabled) {
+        delete arena;
+        arena = 0;
+    }
+    else if(!arena) {
+        arena = new PDUArena();
+    }
+}
+
+void BaseSniffer::set_borrow_payloads(bool enabled) {
+    if(!enabled) {
+        delete borrowed;
+        borrowed = 0;
+    }
+    else if(!borrowed) {
+        borrowed = new BorrowedPayloads();
+    }
+}
+
+void BaseSniffer::set_trust_checksums(bool enabled) {
+    trust_checksums = enabled;
 }
 
 void BaseSniffer::stop_sniff() {
+    #ifdef HAVE_PACKET_RING
+    if(ring)
+        ring->break_loop();
+    #endif // HAVE_PACKET_RING
     pcap_breakloop(handle);
 }
 
 int BaseSniffer::get_fd() {
+    #ifdef HAVE_PACKET_RING
+    if(ring)
+        return ring->get_fd();
+    #endif // HAVE_PACKET_RING
     #ifndef _WIN32
         return pcap_get_selectable_fd(handle);
     #else
@@ -215,7 +430,13 @@ bool BaseSniffer::set_filter(const std::string &filter) {
     if(pcap_compile(handle, &prog, filter.c_str(), 0, mask) == -1) {
         return false;
     }
-    bool result = pcap_setfilter(handle, &prog) != -1;
+    bool result;
+    #ifdef HAVE_PACKET_RING
+    if(ring)
+        result = ring->set_filter(prog);
+    else
+    #endif // HAVE_PACKET_RING
+        result = pcap_setfilter(handle, &prog) != -1;
     pcap_freecode(&prog);
     return result;
 }
@@ -228,6 +449,14 @@ void BaseSniffer::set_timeout(int ms) {
 
 Sniffer::Sniffer(const string &device, const SnifferConfiguration& configuration)
 {
+    #ifdef HAVE_PACKET_RING
+    if ((configuration._flags & SnifferConfiguration::PACKET_RING) != 0) {
+        configuration.configure_packet_ring(*this, device);
+        configuration.configure_sniffer_post_activation(*this);
+        return;
+    }
+    #endif // HAVE_PACKET_RING
+
     char error[PCAP_ERRBUF_SIZE];
     pcap_t* phandle = pcap_create(TINS_PREFIX_INTERFACE(device).c_str(), error);
     if (!phandle) {
@@ -449,6 +678,35 @@ void SnifferConfiguration::configure_sniffer_post_activation(Sniffer& sniffer) c
     }
 }
 
+#ifdef HAVE_PACKET_RING
+void SnifferConfiguration::configure_packet_ring(Sniffer& sniffer, 
+                                                 const std::string& device) const
+{
+    const uint32_t block_size = RxPacketRing::DEFAULT_BLOCK_SIZE;
+    uint32_t block_count = 4;
+    if ((_flags & BUFFER_SIZE) != 0) {
+        block_count = std::max<uint32_t>((_buffer_size + block_size - 1) / block_size, 1);
+    }
+    // On immediate mode, hand blocks to userspace as soon as possible
+    unsigned timeout = _timeout;
+    if ((_flags & IMMEDIATE_MODE) != 0 && _immediate_mode) {
+        timeout = 1;
+    }
+    RxPacketRing* ring = new RxPacketRing(device, block_size, block_count, 
+                                          _snap_len, timeout);
+    sniffer.set_packet_ring(ring);
+    // The pcap handle is only used to compile filters
+    pcap_t* phandle = pcap_open_dead(ring->link_type(), _snap_len);
+    if (!phandle) {
+        throw std::runtime_error("Failed to create the pcap handle");
+    }
+    sniffer.set_pcap_handle(phandle);
+    if ((_flags & PROMISCUOUS) != 0 && _promisc) {
+        ring->set_promisc_mode(true);
+    }
+}
+#endif // HAVE_PACKET_RING
+
 void SnifferConfiguration::set_snap_len(unsigned snap_len)
 {
     _snap_len = snap_len;
@@ -489,4 +747,16 @@ void SnifferConfiguration::set_immediate_mode(bool enabled)
     _immediate_mode = enabled;
 }
 
+#ifdef HAVE_PACKET_RING
+void SnifferConfiguration::set_packet_ring(bool enabled)
+{
+    if (enabled) {
+        _flags |= PACKET_RING;
+    }
+    else {
+        _flags &= ~PACKET_RING;
+    }
+}
+#endif // HAVE_PACKET_RING
+
 }
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2014, Matias Fontanini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following disclaimer
+ *   in the documentation and/or other materials provided with the
+ *   distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sniffer_group.h"
+
+#ifdef HAVE_PACKET_FANOUT
+
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <linux/if_packet.h>
+
+namespace Tins {
+
+namespace {
+// Used when the kernel can't allocate a unique identifier. Every group
+// in this process gets a different one, and the pid is mixed in so 
+// other processes using this same scheme start from a different one.
+uint16_t next_group_id() {
+    static uint32_t counter = 0;
+    const uint32_t value = __sync_add_and_fetch(&counter, 1);
+    const uint16_t id = static_cast<uint16_t>(getpid() * 40503u + value);
+    return id ? id : 1;
+}
+} // namespace
+
+SnifferGroup::SnifferGroup(const std::string& device, size_t size, fanout_mode mode,
+                           const SnifferConfiguration& configuration, 
+                           uint16_t group_id, bool defragment)
+: group_id_(group_id), fanout_type_(0)
+{
+    switch (mode) {
+        case CPU:
+            fanout_type_ = PACKET_FANOUT_CPU;
+            break;
+        case ROUND_ROBIN:
+            fanout_type_ = PACKET_FANOUT_LB;
+            break;
+        default:
+            fanout_type_ = PACKET_FANOUT_HASH;
+    };
+    if (defragment) {
+        fanout_type_ |= PACKET_FANOUT_FLAG_DEFRAG;
+    }
+    try {
+        for (size_t i = 0; i < size; ++i) {
+            sniffers_.push_back(0);
+            sniffers_.back() = new Sniffer(device, configuration);
+            join_fanout_group(*sniffers_.back());
+        }
+    }
+    catch (...) {
+        cleanup();
+        throw;
+    }
+}
+
+SnifferGroup::~SnifferGroup() {
+    cleanup();
+}
+
+void SnifferGroup::cleanup() {
+    for (size_t i = 0; i < sniffers_.size(); ++i) {
+        delete sniffers_[i];
+    }
+    sniffers_.clear();
+}
+
+void SnifferGroup::join_fanout_group(Sniffer& sniffer) {
+    const int fd = sniffer.get_fd();
+    if (group_id_ == 0) {
+        #ifdef PACKET_FANOUT_FLAG_UNIQUEID
+        // Let the kernel pick an identifier no other group is using
+        int option = (fanout_type_ | PACKET_FANOUT_FLAG_UNIQUEID) << 16;
+        if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &option, sizeof(option)) == 0) {
+            socklen_t length = sizeof(option);
+            if (getsockopt(fd, SOL_PACKET, PACKET_FANOUT, &option, &length) < 0) {
+                throw std::runtime_error(strerror(errno));
+            }
+            group_id_ = option & 0xffff;
+            return;
+        }
+        // Kernels older than 4.4 don't support it
+        if (errno != EINVAL) {
+            throw std::runtime_error(strerror(errno));
+        }
+        #endif // PACKET_FANOUT_FLAG_UNIQUEID
+        group_id_ = next_group_id();
+    }
+    int option = group_id_ | (fanout_type_ << 16);
+    if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &option, sizeof(option)) < 0) {
+        throw std::runtime_error(strerror(errno));
+    }
+}
+
+void SnifferGroup::stop_sniff() {
+    for (size_t i = 0; i < sniffers_.size(); ++i) {
+        sniffers_[i]->stop_sniff();
+    }
+}
+} // namespace Tins
+
+#endif // HAVE_PACKET_FANOUT
@@ -57,6 +57,7 @@ TCP::TCP(uint16_t dport, uint16_t sport)
 
 TCP::TCP(const uint8_t *buffer, uint32_t total_sz) 
 {
+    const uint8_t *tcp_start = buffer;
     if(total_sz < sizeof(tcphdr))
         throw malformed_packet();
     std::memcpy(&_tcp, buffer, sizeof(tcphdr));
@@ -95,6 +96,13 @@ TCP::TCP(const uint8_t *buffer, uint32_t total_sz)
     }
     if(total_sz)
         inner_pdu(new RawPDU(buffer, total_sz));
+    _checksum_state.parsed(
+        tcp_start,
+        static_cast<uint32_t>(header_end - tcp_start),
+        checksum(),
+        inner_pdu(),
+        true
+    );
 }
 
 void TCP::dport(uint16_t new_dport) {
@@ -299,30 +307,34 @@ void TCP::write_serialization(uint8_t *buffer, uint32_t total_sz, const PDU *par
 
     memcpy(tcp_start, &_tcp, sizeof(tcphdr));
 
+    uint32_t pseudo_header_sum;
     const Tins::IP *ip_packet = tins_cast<const Tins::IP*>(parent);
     if(ip_packet) {
-        uint32_t check = Utils::pseudoheader_checksum(ip_packet->src_addr(),  
+        pseudo_header_sum = Utils::pseudoheader_checksum(ip_packet->src_addr(),  
                                                          ip_packet->dst_addr(), 
-                                                         size(), Constants::IP::PROTO_TCP) +
-                            Utils::do_checksum(tcp_start, tcp_start + total_sz);
-        while (check >> 16)
-            check = (check & 0xffff) + (check >> 16);
-        checksum(~check);
-        ((tcphdr*)tcp_start)->check = _tcp.check;
+                                                         size(), Constants::IP::PROTO_TCP);
     }
     else {
         const Tins::IPv6 *ipv6_packet = tins_cast<const Tins::IPv6*>(parent);
-        if(ipv6_packet) {
-            uint32_t check = Utils::pseudoheader_checksum(ipv6_packet->src_addr(),  
+        if(!ipv6_packet)
+            return;
+        pseudo_header_sum = Utils::pseudoheader_checksum(ipv6_packet->src_addr(),  
                                                          ipv6_packet->dst_addr(), 
-                                                         size(), Constants::IP::PROTO_TCP) +
-                                        Utils::do_checksum(tcp_start, tcp_start + total_sz);
-            while (check >> 16)
-                check = (check & 0xffff) + (check >> 16);
-            checksum(~check);
-            ((tcphdr*)tcp_start)->check = _tcp.check;
-        }
+                                                         size(), Constants::IP::PROTO_TCP);
+    }
+    uint16_t new_check;
+    // Avoid summing the payload if its sum is known
+    if(!Internals::incremental_checksum::update(tcp_start, header_size(), 
+                                                pseudo_header_sum, inner_pdu(), 
+                                                new_check)) {
+        uint32_t check = pseudo_header_sum + 
+                            Utils::do_checksum(tcp_start, tcp_start + total_sz);
+        while (check >> 16)
+            check = (check & 0xffff) + (check >> 16);
+        new_check = ~check;
     }
+    checksum(new_check);
+    ((tcphdr*)tcp_start)->check = _tcp.check;
 }
 
 const TCP::option *TCP::search_option(OptionTypes type) const {
@@ -27,67 +27,525 @@
  *
  */
 
-#include <limits>
+#include <cstring>
 #include "rawpdu.h"
+#include "internals.h"
 #include "tcp_stream.h"
 
 namespace Tins {
 
-// As defined by RFC 1982 - 2 ^ (SERIAL_BITS - 1)
-static const uint32_t seq_number_diff = 2147483648U;
-// As defined by RFC 1982 - 2 ^ (SERIAL_BITS)
-static const uint32_t addition_modulo = std::numeric_limits<uint32_t>::max();
+// TCPStreamFollower
+
+const size_t TCPStreamFollower::DEFAULT_MAX_STREAM_BUFFER = 4 * 1024 * 1024;
+
+TCPStreamFollower::Stats::Stats() 
+: sessions_created(0), sessions_closed(0), timeout_evictions(0), 
+  capacity_evictions(0), skipped_bytes(0)
+{
+
+}
+
+TCPStreamFollower::TCPStreamFollower() 
+: last_identifier(0), now_(0), idle_timeout_(0), max_sessions_(0),
+  max_stream_buffer_(DEFAULT_MAX_STREAM_BUFFER)
+{
+    
+}
+
+TCPStreamFollower::TCPStreamFollower(const TCPStreamFollower &rhs) 
+: sessions(rhs.sessions), sessions_v6(rhs.sessions_v6), 
+  last_identifier(rhs.last_identifier), now_(rhs.now_), 
+  idle_timeout_(rhs.idle_timeout_), max_sessions_(rhs.max_sessions_), max_stream_buffer_(rhs.max_stream_buffer_),
+  budget_(rhs.budget_), stats_(rhs.stats_)
+{
+    rebind_buffers();
+}
+
+TCPStreamFollower &TCPStreamFollower::operator=(const TCPStreamFollower &rhs) {
+    if(this != &rhs) {
+        sessions = rhs.sessions;
+        sessions_v6 = rhs.sessions_v6;
+        last_identifier = rhs.last_identifier;
+        now_ = rhs.now_;
+        idle_timeout_ = rhs.idle_timeout_;
+        max_sessions_ = rhs.max_sessions_;
+        max_stream_buffer_ = rhs.max_stream_buffer_;
+        budget_ = rhs.budget_;
+        stats_ = rhs.stats_;
+        rebind_buffers();
+    }
+    return *this;
+}
+
+void TCPStreamFollower::rebind_buffers() {
+    // Copied streams don't use any budget, make them use ours
+    budget_.used = 0;
+    for(uint32_t i = sessions.oldest(); i != sessions_type::npos; i = sessions.newer(i))
+        sessions.stream(i).buffer_limits(max_stream_buffer_, &budget_);
+    for(uint32_t i = sessions_v6.oldest(); i != sessions_v6_type::npos; 
+      i = sessions_v6.newer(i))
+        sessions_v6.stream(i).buffer_limits(max_stream_buffer_, &budget_);
+}
+
+namespace Internals {
+
+// tcp_stream_buffer
+
+tcp_stream_buffer::tcp_stream_buffer()
+: head_(0), budget_(0), sink_(0), window_limit_(TCPStreamFollower::DEFAULT_MAX_STREAM_BUFFER), 
+  next_seq_(0), ring_start_(0)
+{
 
-// Sequence number add as defined by RFC 1982
-uint32_t add_sequence_numbers(uint32_t seq1, uint32_t seq2) {
-    return (static_cast<uint64_t>(seq1) + seq2) % addition_modulo;
 }
 
-// Subtract sequence numbers
-uint32_t subtract_sequence_numbers(uint32_t seq1, uint32_t seq2) {
-    if(seq1 > seq2)
-        return seq1 - seq2;
-    else 
-        // the numbers between seq2 and the maximum sequence number(including seq1)
-        // + the numbers between 0 and seq1
-        return (std::numeric_limits<uint32_t>::max() - seq2) + seq1 + 1;
+tcp_stream_buffer::tcp_stream_buffer(const tcp_stream_buffer &rhs) 
+: head_(0), budget_(0), sink_(0), window_limit_(rhs.window_limit_), next_seq_(0), 
+  ring_start_(0)
+{
+    *this = rhs;
 }
 
-// Compares sequence numbers as defined by RFC 1982.
-int compare_seq_numbers(uint32_t seq1, uint32_t seq2) {
-    if(seq1 == seq2)
+tcp_stream_buffer &tcp_stream_buffer::operator=(const tcp_stream_buffer &rhs) {
+    if(this != &rhs) {
+        payload_.assign(rhs.payload_.begin() + rhs.head_, rhs.payload_.end());
+        head_ = 0;
+        release_ring();
+        ring_ = rhs.ring_;
+        if(budget_)
+            budget_->used += ring_.size();
+        ranges_ = rhs.ranges_;
+        window_limit_ = rhs.window_limit_;
+        next_seq_ = rhs.next_seq_;
+        ring_start_ = rhs.ring_start_;
+    }
+    return *this;
+}
+
+tcp_stream_buffer::~tcp_stream_buffer() {
+    release_ring();
+}
+
+void tcp_stream_buffer::limits(size_t window_limit, tcp_buffer_budget *budget) {
+    window_limit_ = window_limit;
+    if(budget_)
+        budget_->used -= ring_.size();
+    budget_ = budget;
+    if(budget_)
+        budget_->used += ring_.size();
+}
+
+size_t tcp_stream_buffer::add(uint32_t seq, const uint8_t *data, size_t size) {
+    size_t added = 0;
+    for(;;) {
+        uint32_t offset = offset_of(seq);
+        // If it starts before the next expected byte, trim it
+        if(offset >= 0x80000000U) {
+            const uint32_t behind = next_seq_ - seq;
+            if(behind >= size)
+                return added;
+            data += behind;
+            size -= behind;
+            seq = next_seq_;
+            offset = 0;
+        }
+        if(size == 0)
+            return added;
+        // The usual case: it's the next chunk and there's nothing buffered
+        if(offset == 0 && ranges_.empty()) {
+            next_seq_ += static_cast<uint32_t>(size);
+            append(data, size);
+            return added + size;
+        }
+        const size_t required = static_cast<size_t>(offset) + size;
+        if(required <= window_limit_ && reserve(required))
+            break;
+        // It doesn't fit. Give up on the first hole and try again.
+        if(ranges_.empty()) {
+            skip(offset);
+        }
+        else {
+            skip(offset_of(ranges_.front().first));
+            added += drain();
+        }
+    }
+    const size_t mask = ring_.size() - 1;
+    const size_t position = (ring_start_ + offset_of(seq)) & mask;
+    const size_t first = std::min(size, ring_.size() - position);
+    std::memcpy(&ring_[position], data, first);
+    if(first < size)
+        std::memcpy(&ring_[0], data + first, size - first);
+    add_range(seq, seq + static_cast<uint32_t>(size));
+    return added + drain();
+}
+
+void tcp_stream_buffer::consume(size_t size) {
+    head_ += std::min(size, this->size());
+    if(head_ == payload_.size()) {
+        payload_.clear();
+        head_ = 0;
+    }
+}
+
+size_t tcp_stream_buffer::buffered_size() const {
+    size_t total = 0;
+    for(ranges_type::const_iterator it = ranges_.begin(); it != ranges_.end(); ++it)
+        total += it->second - it->first;
+    return total;
+}
+
+void tcp_stream_buffer::append(const uint8_t *data, size_t size) {
+    if(sink_) {
+        sink_->data(data, size);
+        return;
+    }
+    // Don't let consumed data pile up in front of the payload
+    if(head_ > payload_.size() / 2)
+        compact();
+    payload_.insert(payload_.end(), data, data + size);
+}
+
+void tcp_stream_buffer::compact() const {
+    if(head_) {
+        payload_.erase(payload_.begin(), payload_.begin() + head_);
+        head_ = 0;
+    }
+}
+
+bool tcp_stream_buffer::reserve(size_t size) {
+    if(size <= ring_.size())
+        return true;
+    size_t new_size = 4096;
+    while(new_size < size)
+        new_size *= 2;
+    if(budget_ && budget_->limit && 
+        budget_->used - ring_.size() + new_size > budget_->limit)
+        return false;
+    // Move the data so the next expected byte is at the start
+    std::vector<uint8_t> new_ring(new_size);
+    if(!ring_.empty()) {
+        std::copy(ring_.begin() + ring_start_, ring_.end(), new_ring.begin());
+        std::copy(ring_.begin(), ring_.begin() + ring_start_, 
+                  new_ring.begin() + (ring_.size() - ring_start_));
+    }
+    if(budget_)
+        budget_->used += new_size - ring_.size();
+    ring_.swap(new_ring);
+    ring_start_ = 0;
+    return true;
+}
+
+void tcp_stream_buffer::release_ring() {
+    if(budget_)
+        budget_->used -= ring_.size();
+    std::vector<uint8_t>().swap(ring_);
+    ring_start_ = 0;
+}
+
+void tcp_stream_buffer::skip(uint32_t size) {
+    if(budget_)
+        budget_->skipped_bytes += size;
+    next_seq_ += size;
+    if(!ring_.empty())
+        ring_start_ = (ring_start_ + size) & (ring_.size() - 1);
+}
+
+size_t tcp_stream_buffer::drain() {
+    if(ranges_.empty() || ranges_.front().first != next_seq_)
         return 0;
-    if(seq1 < seq2) {
-        return (seq2 - seq1 < seq_number_diff) ? -1 : 1;
+    // Ranges are merged, so only the first one can start here
+    const size_t size = ranges_.front().second - ranges_.front().first;
+    ranges_.erase(ranges_.begin());
+    const size_t first = std::min(size, ring_.size() - ring_start_);
+    append(&ring_[ring_start_], first);
+    if(first < size)
+        append(&ring_[0], size - first);
+    next_seq_ += static_cast<uint32_t>(size);
+    if(ranges_.empty())
+        release_ring();
+    else
+        ring_start_ = (ring_start_ + size) & (ring_.size() - 1);
+    return size;
+}
+
+void tcp_stream_buffer::add_range(uint32_t begin, uint32_t end) {
+    const uint32_t begin_offset = offset_of(begin), end_offset = offset_of(end);
+    ranges_type::iterator it = ranges_.begin();
+    // Skip the ranges that end before this one starts
+    while(it != ranges_.end() && offset_of(it->second) < begin_offset)
+        ++it;
+    // Merge every range that overlaps or touches this one
+    ranges_type::iterator last = it;
+    uint32_t new_begin = begin, new_end = end;
+    while(last != ranges_.end() && offset_of(last->first) <= end_offset) {
+        if(offset_of(last->first) < offset_of(new_begin))
+            new_begin = last->first;
+        if(offset_of(last->second) > offset_of(new_end))
+            new_end = last->second;
+        ++last;
+    }
+    if(it == last) {
+        ranges_.insert(it, std::make_pair(begin, end));
     }
     else {
-        return (seq1 - seq2 > seq_number_diff) ? -1 : 1;
+        it->first = new_begin;
+        it->second = new_end;
+        ranges_.erase(it + 1, last);
     }
 }
 
-template<typename Iterator, typename Container>
-Iterator erase_iterator(Iterator it, Container& cont) {
-    Iterator output = it;
-    ++output;
-    cont.erase(it);
-    if(output == cont.end())
-        output = cont.begin();
-    return output;
+// tcp_session_key
+
+tcp_session_key::tcp_session_key(IPv4Address src_addr, uint16_t sport, 
+  IPv4Address dst_addr, uint16_t dport)
+{
+    const uint32_t src = src_addr, dst = dst_addr;
+    if(src < dst || (src == dst && sport <= dport)) {
+        addr_a = src;
+        addr_b = dst;
+        port_a = sport;
+        port_b = dport;
+    }
+    else {
+        addr_a = dst;
+        addr_b = src;
+        port_a = dport;
+        port_b = sport;
+    }
 }
 
+uint32_t tcp_session_key::hash() const {
+    return mix_hash(((static_cast<uint64_t>(addr_a) << 32) | addr_b) ^
+                    (((static_cast<uint64_t>(port_a) << 16) | port_b) * 
+                        0x9e3779b97f4a7c15ULL));
+}
 
-// TCPStreamFollower
+// tcp_session_key_v6
 
-TCPStreamFollower::TCPStreamFollower() : last_identifier(0) {
-    
+tcp_session_key_v6::tcp_session_key_v6() 
+: port_a(0), port_b(0)
+{
+    std::memset(addr_a, 0, sizeof(addr_a));
+    std::memset(addr_b, 0, sizeof(addr_b));
 }
 
+tcp_session_key_v6::tcp_session_key_v6(const IPv6Address &src_addr, 
+  uint16_t sport, const IPv6Address &dst_addr, uint16_t dport)
+{
+    const int order = std::memcmp(src_addr.begin(), dst_addr.begin(), 
+                                  IPv6Address::address_size);
+    if(order < 0 || (order == 0 && sport <= dport)) {
+        src_addr.copy(addr_a);
+        dst_addr.copy(addr_b);
+        port_a = sport;
+        port_b = dport;
+    }
+    else {
+        dst_addr.copy(addr_a);
+        src_addr.copy(addr_b);
+        port_a = dport;
+        port_b = sport;
+    }
+}
+
+uint32_t tcp_session_key_v6::hash() const {
+    uint64_t words[4];
+    std::memcpy(words, addr_a, sizeof(addr_a));
+    std::memcpy(words + 2, addr_b, sizeof(addr_b));
+    uint64_t value = ((static_cast<uint64_t>(port_a) << 16) | port_b) * 
+                        0x9e3779b97f4a7c15ULL;
+    for(size_t i = 0; i < 4; ++i)
+        value = (value ^ words[i]) * 0xff51afd7ed558ccdULL;
+    return mix_hash(value);
+}
+
+// tcp_session_table
+
+template<typename Key>
+const uint32_t tcp_session_table<Key>::npos;
+
+template<typename Key>
+tcp_session_table<Key>::tcp_session_table() 
+: free_head_(npos), lru_head_(npos), lru_tail_(npos), size_(0)
+{
+
+}
+
+template<typename Key>
+tcp_session_table<Key>::tcp_session_table(const tcp_session_table &rhs) 
+: free_head_(npos), lru_head_(npos), lru_tail_(npos), size_(0)
+{
+    *this = rhs;
+}
+
+template<typename Key>
+tcp_session_table<Key> &tcp_session_table<Key>::operator=(const tcp_session_table &rhs) {
+    if(this != &rhs) {
+        clear();
+        // Inserting from the oldest one keeps the same LRU order
+        for(uint32_t i = rhs.lru_tail_; i != npos; i = rhs.nodes_[i].prev) {
+            const node &other = rhs.nodes_[i];
+            insert(other.key, new TCPStream(*other.stream), other.last_seen);
+        }
+    }
+    return *this;
+}
+
+template<typename Key>
+tcp_session_table<Key>::~tcp_session_table() {
+    clear();
+}
+
+template<typename Key>
+void tcp_session_table<Key>::clear() {
+    for(uint32_t i = lru_head_; i != npos; i = nodes_[i].next)
+        delete nodes_[i].stream;
+    nodes_.clear();
+    slots_.clear();
+    free_head_ = lru_head_ = lru_tail_ = npos;
+    size_ = 0;
+}
+
+template<typename Key>
+uint32_t tcp_session_table<Key>::find(const key_type &key) const {
+    if(slots_.empty())
+        return npos;
+    const uint32_t hash = key.hash();
+    const size_t mask = slots_.size() - 1;
+    for(size_t i = hash & mask; slots_[i] != 0; i = (i + 1) & mask) {
+        const node &current = nodes_[slots_[i] - 1];
+        if(current.hash == hash && current.key == key)
+            return slots_[i] - 1;
+    }
+    return npos;
+}
+
+template<typename Key>
+uint32_t tcp_session_table<Key>::insert(const key_type &key, TCPStream *stream, 
+  uint64_t now) 
+{
+    // Keep the load factor at or below 1/2, so probe sequences are short
+    if((size_ + 1) * 2 > slots_.size())
+        rehash(std::max<size_t>(16, slots_.size() * 2));
+    uint32_t index;
+    if(free_head_ != npos) {
+        index = free_head_;
+        free_head_ = nodes_[index].next;
+    }
+    else {
+        index = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back(node());
+    }
+    node &new_node = nodes_[index];
+    new_node.key = key;
+    new_node.stream = stream;
+    new_node.last_seen = now;
+    new_node.hash = key.hash();
+    place(index);
+    push_front(index);
+    size_++;
+    return index;
+}
+
+template<typename Key>
+void tcp_session_table<Key>::touch(uint32_t index, uint64_t now) {
+    nodes_[index].last_seen = now;
+    if(lru_head_ != index) {
+        unlink(index);
+        push_front(index);
+    }
+}
+
+template<typename Key>
+TCPStream *tcp_session_table<Key>::remove(uint32_t index) {
+    const size_t mask = slots_.size() - 1;
+    size_t hole = nodes_[index].hash & mask;
+    while(slots_[hole] != index + 1)
+        hole = (hole + 1) & mask;
+    // Backward shift deletion: move back every entry in the probe
+    // sequence that'd become unreachable
+    for(size_t i = (hole + 1) & mask; slots_[i] != 0; i = (i + 1) & mask) {
+        const size_t ideal = nodes_[slots_[i] - 1].hash & mask;
+        if(((i - ideal) & mask) >= ((i - hole) & mask)) {
+            slots_[hole] = slots_[i];
+            hole = i;
+        }
+    }
+    slots_[hole] = 0;
+    unlink(index);
+    TCPStream *stream = nodes_[index].stream;
+    nodes_[index].stream = 0;
+    nodes_[index].next = free_head_;
+    free_head_ = index;
+    size_--;
+    return stream;
+}
+
+template<typename Key>
+void tcp_session_table<Key>::unlink(uint32_t index) {
+    node &current = nodes_[index];
+    if(current.prev != npos)
+        nodes_[current.prev].next = current.next;
+    else
+        lru_head_ = current.next;
+    if(current.next != npos)
+        nodes_[current.next].prev = current.prev;
+    else
+        lru_tail_ = current.prev;
+}
+
+template<typename Key>
+void tcp_session_table<Key>::push_front(uint32_t index) {
+    node &current = nodes_[index];
+    current.prev = npos;
+    current.next = lru_head_;
+    if(lru_head_ != npos)
+        nodes_[lru_head_].prev = index;
+    else
+        lru_tail_ = index;
+    lru_head_ = index;
+}
+
+template<typename Key>
+void tcp_session_table<Key>::rehash(size_t slot_count) {
+    slots_.assign(slot_count, 0);
+    for(uint32_t i = lru_head_; i != npos; i = nodes_[i].next)
+        place(i);
+}
+
+template<typename Key>
+void tcp_session_table<Key>::place(uint32_t index) {
+    const size_t mask = slots_.size() - 1;
+    size_t i = nodes_[index].hash & mask;
+    while(slots_[i] != 0)
+        i = (i + 1) & mask;
+    slots_[i] = index + 1;
+}
+
+template class tcp_session_table<tcp_session_key>;
+template class tcp_session_table<tcp_session_key_v6>;
+} // namespace Internals
+
+namespace {
+uint32_t payload_size(const TCP *tcp) {
+    const RawPDU *raw = tcp->find_pdu<RawPDU>();
+    return raw ? raw->payload_size() : 0;
+}
+} // namespace
+
 
 
 TCPStream::StreamInfo::StreamInfo(IPv4Address client, 
   IPv4Address server, uint16_t cport, uint16_t sport) 
 : client_addr(client), server_addr(server), client_port(cport), 
-  server_port(sport)
+  server_port(sport), is_v6(false)
+{
+    
+}
+
+TCPStream::StreamInfo::StreamInfo(const IPv6Address &client, 
+  const IPv6Address &server, uint16_t cport, uint16_t sport) 
+: client_addr_v6(client), server_addr_v6(server), client_port(cport), 
+  server_port(sport), is_v6(true)
 {
     
 }
@@ -96,152 +554,160 @@ TCPStream::StreamInfo::StreamInfo(IPv4Address client,
 
 
 TCPStream::TCPStream(IP *ip, TCP *tcp, uint64_t identifier) 
-: client_seq(tcp->seq()), server_seq(0), info(ip->src_addr(), 
-  ip->dst_addr(), tcp->sport(), tcp->dport()), identifier(identifier), 
-  syn_ack_sent(false), fin_sent(false)
+: info(ip->src_addr(), ip->dst_addr(), tcp->sport(), tcp->dport()), 
+  identifier(identifier), first_seen_(0), last_seen_(0), syn_time_(0), 
+  handshake_rtt_(0), syn_ack_sent(false), fin_sent(false), 
+  handshake_done(false)
 {
-    
+    client_buffer.next_seq(tcp->seq());
+    client_stats_.segments++;
+    client_stats_.bytes += payload_size(tcp);
 }
 
-TCPStream::TCPStream(const TCPStream &rhs) {
-    *this = rhs;
+TCPStream::TCPStream(IPv6 *ip, TCP *tcp, uint64_t identifier) 
+: info(ip->src_addr(), ip->dst_addr(), tcp->sport(), tcp->dport()), 
+  identifier(identifier), first_seen_(0), last_seen_(0), syn_time_(0), 
+  handshake_rtt_(0), syn_ack_sent(false), fin_sent(false), 
+  handshake_done(false)
+{
+    client_buffer.next_seq(tcp->seq());
+    client_stats_.segments++;
+    client_stats_.bytes += payload_size(tcp);
+}
+
+TCPStream::TCPStream(const TCPStream &rhs) 
+: info(rhs.info), identifier(rhs.identifier), 
+  client_buffer(rhs.client_buffer), server_buffer(rhs.server_buffer),
+  client_stats_(rhs.client_stats_), server_stats_(rhs.server_stats_),
+  first_seen_(rhs.first_seen_), last_seen_(rhs.last_seen_), 
+  syn_time_(rhs.syn_time_), handshake_rtt_(rhs.handshake_rtt_),
+  syn_ack_sent(rhs.syn_ack_sent), fin_sent(rhs.fin_sent), 
+  handshake_done(rhs.handshake_done)
+{
+
 }
 
 TCPStream& TCPStream::operator=(const TCPStream &rhs) {
-    client_seq = rhs.client_seq;
-    server_seq = rhs.server_seq;
     info = rhs.info;
     identifier = rhs.identifier;
     syn_ack_sent = rhs.syn_ack_sent;
     fin_sent = rhs.fin_sent;
-    client_payload_ = rhs.client_payload_;
-    server_payload_ = rhs.server_payload_;
-    client_frags = clone_fragments(rhs.client_frags);
-    server_frags = clone_fragments(rhs.server_frags);
+    handshake_done = rhs.handshake_done;
+    client_buffer = rhs.client_buffer;
+    server_buffer = rhs.server_buffer;
+    client_stats_ = rhs.client_stats_;
+    server_stats_ = rhs.server_stats_;
+    first_seen_ = rhs.first_seen_;
+    last_seen_ = rhs.last_seen_;
+    syn_time_ = rhs.syn_time_;
+    handshake_rtt_ = rhs.handshake_rtt_;
     return *this;
 }
 
 TCPStream::~TCPStream() {
-    free_fragments(client_frags);
-    free_fragments(server_frags);
-}
 
-void TCPStream::free_fragments(fragments_type &frags) {
-    for(fragments_type::iterator it = frags.begin(); it != frags.end(); ++it)
-        delete it->second;
 }
 
-TCPStream::fragments_type TCPStream::clone_fragments(const fragments_type &frags) {
-    fragments_type new_frags;
-    for(fragments_type::const_iterator it = frags.begin(); it != frags.end(); ++it)
-        new_frags.insert(std::make_pair(it->first, it->second->clone()));
-    return new_frags;
+void TCPStream::buffer_limits(size_t window_limit, 
+  Internals::tcp_buffer_budget *budget) 
+{
+    client_buffer.limits(window_limit, budget);
+    server_buffer.limits(window_limit, budget);
 }
 
-void TCPStream::safe_insert(fragments_type &frags, uint32_t seq, RawPDU *raw)
+void TCPStream::data_sinks(Internals::tcp_data_sink *client, 
+  Internals::tcp_data_sink *server) 
 {
-    RawPDU*& stored_raw = frags[seq];
-    // New segment, insert it
-    if(stored_raw == 0)
-        stored_raw = raw;
-    else {
-        // There was a segment in this position. Keep the largest one.
-        if(stored_raw->payload_size() > raw->payload_size())
-            delete raw;
-        else {
-            delete stored_raw;
-            stored_raw = raw;
-        }
-    }
+    client_buffer.sink(client);
+    server_buffer.sink(server);
 }
 
-bool TCPStream::generic_process(uint32_t &my_seq, uint32_t &other_seq, 
-  payload_type &pload, fragments_type &frags, TCP *tcp) 
+bool TCPStream::generic_process(Internals::tcp_stream_buffer &buffer, 
+  DirectionStats &stats, TCP *tcp) 
 {
-    bool added_some(false);
     if(tcp->get_flag(TCP::FIN) || tcp->get_flag(TCP::RST))
         fin_sent = true;
-    RawPDU *raw = static_cast<RawPDU*>(tcp->release_inner_pdu()); 
-    if(raw) {
-        const uint32_t chunk_end = add_sequence_numbers(tcp->seq(), raw->payload_size());
-        // If the end of the chunk ends after our current sequence number, process it.
-        if(compare_seq_numbers(chunk_end, my_seq) >= 0) {
-            uint32_t seq = tcp->seq();
-            // If it starts before our sequence number, slice it
-            if(compare_seq_numbers(seq, my_seq) < 0) {
-                const uint32_t diff = subtract_sequence_numbers(my_seq, seq);
-                raw->payload().erase(
-                    raw->payload().begin(),
-                    raw->payload().begin() + diff
-                );
-                seq = my_seq;
-            }
-            safe_insert(frags, seq, raw);
-            fragments_type::iterator it = frags.find(my_seq);
-            // Keep looping while the fragments seq is lower or equal to our seq
-            while(it != frags.end() && compare_seq_numbers(it->first, my_seq) <= 0) {
-                // Does this fragment start before our sequence number?
-                if(compare_seq_numbers(it->first, my_seq) < 0) {
-                    uint32_t fragment_end = add_sequence_numbers(it->first, it->second->payload_size());
-                    int comparison = compare_seq_numbers(fragment_end, my_seq);
-                    // Does it end after our sequence number? 
-                    if(comparison > 0) {
-                        // Then slice it
-                        RawPDU::payload_type& payload = it->second->payload();
-                        payload.erase(
-                            payload.begin(),
-                            payload.begin() + subtract_sequence_numbers(my_seq, it->first)
-                        );
-                        safe_insert(frags, my_seq, it->second);
-                        it = erase_iterator(it, frags);
-                    }
-                    else {
-                        // Otherwise, we've seen this part of the payload. Erase it.
-                        delete it->second;
-                        it = erase_iterator(it, frags);
-                    }
-                }
-                else {
-                    // They're equal. Add this payload.
-                    pload.insert(
-                        pload.end(),
-                        it->second->payload().begin(), 
-                        it->second->payload().end()
-                    );
-                    my_seq += it->second->payload_size();
-                    delete it->second;
-                    it = erase_iterator(it, frags);
-                    added_some = true;
-                    if(frags.empty())
-                        break;
-                }
-            }
-        }
-        else
-            delete raw;
-    }
-    return added_some;
+    const RawPDU *raw = tcp->find_pdu<RawPDU>();
+    const uint32_t size = raw ? raw->payload_size() : 0;
+    stats.bytes += size;
+    // Data or a SYN starting before the next expected byte was sent 
+    // already
+    if((size > 0 || tcp->get_flag(TCP::SYN)) && 
+       static_cast<int32_t>(tcp->seq() - buffer.next_seq()) < 0)
+        stats.retransmissions++;
+    if(!size)
+        return false;
+    return buffer.add(tcp->seq(), raw->payload_data(), size) > 0;
 }
 
 bool TCPStream::update(IP *ip, TCP *tcp) {
+    return update_direction(
+        ip->src_addr() == info.client_addr && tcp->sport() == info.client_port,
+        tcp
+    );
+}
+
+bool TCPStream::update(IPv6 *ip, TCP *tcp) {
+    return update_direction(
+        tcp->sport() == info.client_port && ip->src_addr() == info.client_addr_v6,
+        tcp
+    );
+}
+
+bool TCPStream::update_direction(bool from_client, TCP *tcp) {
+    DirectionStats &stats = from_client ? client_stats_ : server_stats_;
+    stats.segments++;
     if(!syn_ack_sent) {
+        stats.bytes += payload_size(tcp);
         if(tcp->flags() == (TCP::SYN | TCP::ACK)) {
-            server_seq = tcp->seq() + 1;
-            client_seq = tcp->ack_seq();
+            server_buffer.next_seq(tcp->seq() + 1);
+            client_buffer.next_seq(tcp->ack_seq());
             syn_ack_sent = true;
         }
+        else if(from_client && tcp->get_flag(TCP::SYN)) {
+            // The RTT is measured from the last SYN
+            stats.retransmissions++;
+            syn_time_ = last_seen_;
+        }
         return false;
     }
     else {
-        if(ip->src_addr() == info.client_addr && tcp->sport() == info.client_port)
-            return generic_process(client_seq, server_seq, client_payload_, client_frags, tcp);
+        if(from_client) {
+            if(!handshake_done && tcp->get_flag(TCP::ACK)) {
+                handshake_rtt_ = last_seen_ - syn_time_;
+                handshake_done = true;
+            }
+            return generic_process(client_buffer, client_stats_, tcp);
+        }
         else {
-            return generic_process(server_seq, client_seq, server_payload_, server_frags, tcp);
+            return generic_process(server_buffer, server_stats_, tcp);
         }
     }
 }
 
+void TCPStream::start_time(uint64_t now) {
+    first_seen_ = last_seen_ = syn_time_ = now;
+}
+
+Timestamp TCPStream::make_timestamp(uint64_t microseconds) {
+    timeval tv;
+    tv.tv_sec = static_cast<long>(microseconds / 1000000);
+    tv.tv_usec = static_cast<long>(microseconds % 1000000);
+    return Timestamp(tv);
+}
+
 bool TCPStream::StreamInfo::operator<(const StreamInfo &rhs) const {
+    if(is_v6 != rhs.is_v6)
+        return rhs.is_v6;
+    if(is_v6) {
+        if(client_addr_v6 != rhs.client_addr_v6)
+            return client_addr_v6 < rhs.client_addr_v6;
+        if(server_addr_v6 != rhs.server_addr_v6)
+            return server_addr_v6 < rhs.server_addr_v6;
+        if(client_port != rhs.client_port)
+            return client_port < rhs.client_port;
+        return server_port < rhs.server_port;
+    }
     if(client_addr == rhs.client_addr) {
         if(server_addr == rhs.server_addr) {
             if(client_port == rhs.client_port) {
@@ -57,6 +57,17 @@ UDP::UDP(const uint8_t *buffer, uint32_t total_sz)
     total_sz -= sizeof(udphdr);
     if(total_sz)
         inner_pdu(new RawPDU(buffer + sizeof(udphdr), total_sz));
+    // A zero checksum means there's no checksum at all, so there's
+    // nothing to update
+    if(_udp.check != 0) {
+        _checksum_state.parsed(
+            buffer,
+            sizeof(udphdr),
+            checksum(),
+            inner_pdu(),
+            true
+        );
+    }
 }
 
 void UDP::dport(uint16_t new_dport) {
@@ -87,34 +98,40 @@ void UDP::write_serialization(uint8_t *buffer, uint32_t total_sz, const PDU *par
         length(static_cast<uint16_t>(sizeof(udphdr)));
     }
     std::memcpy(buffer, &_udp, sizeof(udphdr));
+    uint32_t pseudo_header_sum;
     const Tins::IP *ip_packet = tins_cast<const Tins::IP*>(parent);
     if(ip_packet) {
-        uint32_t checksum = Utils::pseudoheader_checksum(
+        pseudo_header_sum = Utils::pseudoheader_checksum(
                                 ip_packet->src_addr(), 
                                 ip_packet->dst_addr(), 
                                 size(), 
                                 Constants::IP::PROTO_UDP
-                            ) + Utils::do_checksum(buffer, buffer + total_sz);
-        while (checksum >> 16)
-            checksum = (checksum & 0xffff)+(checksum >> 16);
-        _udp.check = Endian::host_to_be<uint16_t>(~checksum);
-        ((udphdr*)buffer)->check = _udp.check;
+                            );
     }
     else {
         const Tins::IPv6 *ip6_packet = tins_cast<const Tins::IPv6*>(parent);
-        if(ip6_packet) {
-            uint32_t checksum = Utils::pseudoheader_checksum(
-                        ip6_packet->src_addr(), 
-                        ip6_packet->dst_addr(), 
-                        size(), 
-                        Constants::IP::PROTO_UDP
-                    ) + Utils::do_checksum(buffer, buffer + total_sz);
-            while (checksum >> 16)
-                checksum = (checksum & 0xffff)+(checksum >> 16);
-            _udp.check = Endian::host_to_be<uint16_t>(~checksum);
-            ((udphdr*)buffer)->check = _udp.check;
-        }
+        if(!ip6_packet)
+            return;
+        pseudo_header_sum = Utils::pseudoheader_checksum(
+                                ip6_packet->src_addr(), 
+                                ip6_packet->dst_addr(), 
+                                size(), 
+                                Constants::IP::PROTO_UDP
+                            );
+    }
+    uint16_t new_check;
+    // Avoid summing the payload if its sum is known
+    if(!Internals::incremental_checksum::update(buffer, sizeof(udphdr), 
+                                                pseudo_header_sum, inner_pdu(), 
+                                                new_check)) {
+        uint32_t checksum = pseudo_header_sum + 
+                                Utils::do_checksum(buffer, buffer + total_sz);
+        while (checksum >> 16)
+            checksum = (checksum & 0xffff)+(checksum >> 16);
+        new_check = ~checksum;
     }
+    _udp.check = Endian::host_to_be(new_check);
+    ((udphdr*)buffer)->check = _udp.check;
 }
 
 bool UDP::matches_response(const uint8_t *ptr, uint32_t total_sz) const {
@@ -32,6 +32,7 @@
 #include <memory>
 #include <cassert>
 #include <cstring>
+#include <algorithm>
 #include "utils.h"
 #ifndef _WIN32
     #if defined(BSD) || defined(__FreeBSD_kernel__)
@@ -57,6 +58,14 @@
 #include "network_interface.h"
 #include "packet_sender.h"
 #include "cxxstd.h"
+#include "internals.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+    #define TINS_CHECKSUM_X86
+    #include <immintrin.h>
+    #include <cpuid.h>
+#endif
 
 using namespace std;
 
@@ -90,6 +99,338 @@ addrinfo *resolve_domain(const std::string &to_resolve, int family) {
     }
 }
 
+// Internet checksum implementations.
+//
+// The checksum is the sum of every 16 bit big endian word in the buffer.
+// Every implementation returns the exact sum, truncated to 32 bits, so 
+// they're all interchangeable. The vectorized ones use the fact that 
+// it's the same as the sum of the bytes at even offsets, shifted 8 bits
+// to the left, plus the sum of the bytes at odd offsets, which maps 
+// nicely onto SIMD byte sums.
+namespace {
+typedef uint32_t (*checksum_function)(const uint8_t *start, const uint8_t *end);
+
+// Returns the sum of the 16 bit big endian words in [ptr, end)
+uint64_t checksum_add(const uint8_t *ptr, const uint8_t *end) {
+    const uint64_t mask = 0x0000ffff0000ffffULL;
+    uint64_t sum = 0;
+    while(end - ptr >= 8) {
+        // Words are accumulated into 32 bit lanes, which can hold the
+        // sum of 32768 pairs of them without overflowing
+        size_t blocks = std::min<size_t>((end - ptr) / 8, 32768);
+        uint64_t lanes = 0;
+        while(blocks--) {
+            uint64_t value;
+            std::memcpy(&value, ptr, sizeof(value));
+            value = Tins::Endian::be_to_host(value);
+            lanes += (value & mask) + ((value >> 16) & mask);
+            ptr += sizeof(value);
+        }
+        sum += (lanes & 0xffffffff) + (lanes >> 32);
+    }
+    if(end - ptr >= 4) {
+        uint32_t value;
+        std::memcpy(&value, ptr, sizeof(value));
+        value = Tins::Endian::be_to_host(value);
+        sum += (value & 0xffff) + (value >> 16);
+        ptr += sizeof(value);
+    }
+    if(end - ptr >= 2) {
+        sum += (ptr[0] << 8) | ptr[1];
+        ptr += 2;
+    }
+    // The last byte, if any, is padded with a zero
+    if(ptr < end)
+        sum += *ptr << 8;
+    return sum;
+}
+
+uint32_t checksum_scalar(const uint8_t *start, const uint8_t *end) {
+    return static_cast<uint32_t>(checksum_add(start, end));
+}
+
+#ifdef TINS_CHECKSUM_X86
+// The instruction sets the vectorized implementations use
+struct cpu_features {
+    bool sse2;
+    bool avx2;
+    bool pclmul;
+};
+
+cpu_features query_cpu_features() {
+    cpu_features features = { false, false, false };
+    unsigned int eax, ebx, ecx, edx;
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return features;
+    features.sse2 = (edx & bit_SSE2) != 0;
+    features.pclmul = (ecx & bit_PCLMUL) != 0;
+    // AVX registers can only be used if the OS saves them
+    bool ymm_enabled = false;
+    if((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+        unsigned int xcr0_low, xcr0_high;
+        __asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+        ymm_enabled = (xcr0_low & 6) == 6;
+    }
+    if(ymm_enabled && __get_cpuid_max(0, 0) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        features.avx2 = (ebx & bit_AVX2) != 0;
+    }
+    return features;
+}
+
+const cpu_features& cpu() {
+    // cpuid is slow, especially on virtual machines
+    static const cpu_features features = query_cpu_features();
+    return features;
+}
+
+__attribute__((target("sse2")))
+uint32_t checksum_sse2(const uint8_t *start, const uint8_t *end) {
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    const __m128i zero = _mm_setzero_si128();
+    const uint8_t *ptr = start;
+    __m128i even = zero, odd = zero;
+    while(end - ptr >= 16) {
+        const __m128i value = _mm_loadu_si128((const __m128i*)ptr);
+        // psadbw adds up 8 bytes into each 64 bit lane
+        even = _mm_add_epi64(even, _mm_sad_epu8(_mm_and_si128(value, mask), zero));
+        odd = _mm_add_epi64(odd, _mm_sad_epu8(_mm_srli_epi16(value, 8), zero));
+        ptr += 16;
+    }
+    uint64_t even_lanes[2], odd_lanes[2];
+    _mm_storeu_si128((__m128i*)even_lanes, even);
+    _mm_storeu_si128((__m128i*)odd_lanes, odd);
+    const uint64_t even_sum = even_lanes[0] + even_lanes[1];
+    const uint64_t odd_sum = odd_lanes[0] + odd_lanes[1];
+    return static_cast<uint32_t>((even_sum << 8) + odd_sum + checksum_add(ptr, end));
+}
+
+__attribute__((target("avx2")))
+uint32_t checksum_avx2(const uint8_t *start, const uint8_t *end) {
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    const __m256i zero = _mm256_setzero_si256();
+    const uint8_t *ptr = start;
+    __m256i even = zero, odd = zero;
+    while(end - ptr >= 32) {
+        const __m256i value = _mm256_loadu_si256((const __m256i*)ptr);
+        even = _mm256_add_epi64(even, _mm256_sad_epu8(_mm256_and_si256(value, mask), zero));
+        odd = _mm256_add_epi64(odd, _mm256_sad_epu8(_mm256_srli_epi16(value, 8), zero));
+        ptr += 32;
+    }
+    uint64_t even_lanes[4], odd_lanes[4];
+    _mm256_storeu_si256((__m256i*)even_lanes, even);
+    _mm256_storeu_si256((__m256i*)odd_lanes, odd);
+    // GCC doesn't always do this for functions that only enable AVX 
+    // through the target attribute. Otherwise, the SSE code that runs
+    // afterwards pays for the dirty upper halves of the YMM registers.
+    _mm256_zeroupper();
+    const uint64_t even_sum = even_lanes[0] + even_lanes[1] + even_lanes[2] + even_lanes[3];
+    const uint64_t odd_sum = odd_lanes[0] + odd_lanes[1] + odd_lanes[2] + odd_lanes[3];
+    return static_cast<uint32_t>((even_sum << 8) + odd_sum + checksum_add(ptr, end));
+}
+#endif // TINS_CHECKSUM_X86
+
+checksum_function checksum_implementation(Tins::Internals::checksum_implementation impl) {
+    switch(impl) {
+        #ifdef TINS_CHECKSUM_X86
+        case Tins::Internals::CHECKSUM_SSE2:
+            return cpu().sse2 ? &checksum_sse2 : 0;
+        case Tins::Internals::CHECKSUM_AVX2:
+            return cpu().avx2 ? &checksum_avx2 : 0;
+        #endif // TINS_CHECKSUM_X86
+        case Tins::Internals::CHECKSUM_SCALAR:
+            return &checksum_scalar;
+        default:
+            return 0;
+    }
+}
+
+checksum_function select_checksum() {
+    const Tins::Internals::checksum_implementation preferred[] = {
+        Tins::Internals::CHECKSUM_AVX2,
+        Tins::Internals::CHECKSUM_SSE2
+    };
+    for(size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); ++i) {
+        checksum_function function = checksum_implementation(preferred[i]);
+        if(function)
+            return function;
+    }
+    return &checksum_scalar;
+}
+
+checksum_function checksum_dispatch() {
+    // Resolved the first time a checksum is computed. Initializing a 
+    // local static is thread safe.
+    static const checksum_function function = select_checksum();
+    return function;
+}
+
+// CRC32 implementations.
+//
+// These compute the CRC32 used by Ethernet, 802.11 and zlib (reflected
+// polynomial 0xedb88320). They all take and return the CRC register 
+// before the final inversion, so a buffer can be processed in pieces by
+// different implementations.
+typedef uint32_t (*crc32_function)(uint32_t crc, const uint8_t *data, size_t size);
+
+uint32_t crc32_nibble(uint32_t crc, const uint8_t *data, size_t size) {
+    // This table includes the initial and final inversions, which are
+    // undone here so it works on the register as the others do
+    static const uint32_t crc_table[] = {
+        0x4DBDF21C, 0x500AE278, 0x76D3D2D4, 0x6B64C2B0,
+        0x3B61B38C, 0x26D6A3E8, 0x000F9344, 0x1DB88320,
+        0xA005713C, 0xBDB26158, 0x9B6B51F4, 0x86DC4190,
+        0xD6D930AC, 0xCB6E20C8, 0xEDB71064, 0xF0000000
+    };
+    crc = ~crc;
+    for(size_t i = 0; i < size; ++i) {
+        crc = (crc >> 4) ^ crc_table[(crc ^ data[i]) & 0x0F];
+        crc = (crc >> 4) ^ crc_table[(crc ^ (data[i] >> 4)) & 0x0F];
+    }
+    return ~crc;
+}
+
+// Tables for slicing-by-8. table[0] is the usual byte at a time table;
+// table[n][i] is the CRC of byte i followed by n zero bytes.
+struct crc32_tables {
+    crc32_tables() {
+        for(uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for(int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+            table[0][i] = crc;
+        }
+        for(uint32_t i = 0; i < 256; ++i) {
+            for(int n = 1; n < 8; ++n)
+                table[n][i] = (table[n - 1][i] >> 8) ^ table[0][table[n - 1][i] & 0xff];
+        }
+    }
+
+    uint32_t table[8][256];
+};
+
+const crc32_tables crc_tables;
+
+inline uint32_t read_le32(const uint8_t *ptr) {
+    return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32_t)ptr[3] << 24);
+}
+
+uint32_t crc32_slicing_by_8(uint32_t crc, const uint8_t *data, size_t size) {
+    const uint32_t (&table)[8][256] = crc_tables.table;
+    while(size >= 8) {
+        const uint32_t low = crc ^ read_le32(data);
+        const uint32_t high = read_le32(data + 4);
+        crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^
+              table[5][(low >> 16) & 0xff] ^ table[4][low >> 24] ^
+              table[3][high & 0xff] ^ table[2][(high >> 8) & 0xff] ^
+              table[1][(high >> 16) & 0xff] ^ table[0][high >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while(size--)
+        crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xff];
+    return crc;
+}
+
+#ifdef TINS_CHECKSUM_X86
+// Folds 64 bytes at a time using carry-less multiplications, as described 
+// in Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ 
+// Instruction". The constants are the bit reflected ones from that paper.
+__attribute__((target("sse2,pclmul")))
+uint32_t crc32_pclmul(uint32_t crc, const uint8_t *data, size_t size) {
+    if(size < 64)
+        return crc32_slicing_by_8(crc, data, size);
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+    const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x1 = _mm_loadu_si128((const __m128i*)data);
+    __m128i x2 = _mm_loadu_si128((const __m128i*)(data + 16));
+    __m128i x3 = _mm_loadu_si128((const __m128i*)(data + 32));
+    __m128i x4 = _mm_loadu_si128((const __m128i*)(data + 48));
+    __m128i x5, x6, x7, x8;
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    data += 64;
+    size -= 64;
+    while(size >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)data));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(data + 16)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(data + 32)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(data + 48)));
+        data += 64;
+        size -= 64;
+    }
+    // Fold the 4 accumulators into one
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+    while(size >= 16) {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)data)), x5);
+        data += 16;
+        size -= 16;
+    }
+    // Fold 128 bits into 64...
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    // ...and use a Barrett reduction to get to 32 bits
+    x2 = _mm_and_si128(x1, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    crc = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+    return crc32_slicing_by_8(crc, data, size);
+}
+#endif // TINS_CHECKSUM_X86
+
+crc32_function crc32_implementation(Tins::Internals::crc32_implementation impl) {
+    switch(impl) {
+        #ifdef TINS_CHECKSUM_X86
+        case Tins::Internals::CRC32_PCLMUL:
+            return cpu().pclmul && cpu().sse2 ? &crc32_pclmul : 0;
+        #endif // TINS_CHECKSUM_X86
+        case Tins::Internals::CRC32_SLICING_BY_8:
+            return &crc32_slicing_by_8;
+        case Tins::Internals::CRC32_NIBBLE:
+            return &crc32_nibble;
+        default:
+            return 0;
+    }
+}
+
+crc32_function select_crc32() {
+    crc32_function function = crc32_implementation(Tins::Internals::CRC32_PCLMUL);
+    return function ? function : &crc32_slicing_by_8;
+}
+
+crc32_function crc32_dispatch() {
+    // Resolved the first time a CRC32 is computed
+    static const crc32_function function = select_crc32();
+    return function;
+}
+} // namespace
+
 namespace Tins {
 
 /** \endcond */
@@ -221,24 +562,10 @@ std::string to_string(PDU::PDUType pduType) {
 }
 
 uint32_t do_checksum(const uint8_t *start, const uint8_t *end) {
-    uint32_t checksum(0);
-    const uint8_t *last = end;
-    uint16_t buffer = 0;
-    uint16_t padding = 0;
-    const uint8_t *ptr = start;
-
-    if(((end - start) & 1) == 1) {
-        last = end - 1;
-        padding = *(end - 1) << 8;
-    }
-
-    while(ptr < last) {
-        memcpy(&buffer, ptr, sizeof(uint16_t));
-        checksum += Endian::host_to_be(buffer);
-        ptr += sizeof(uint16_t);
-    }
-
-    return checksum + padding;
+    // Not worth setting up vector registers for small headers
+    if(end - start < 64)
+        return checksum_scalar(start, end);
+    return checksum_dispatch()(start, end);
 }
 
 uint32_t pseudoheader_checksum(IPv4Address source_ip, IPv4Address dest_ip, uint32_t len, uint32_t flag) {
@@ -271,20 +598,33 @@ uint32_t pseudoheader_checksum(IPv6Address source_ip, IPv6Address dest_ip, uint3
 }
 
 uint32_t crc32(const uint8_t* data, uint32_t data_size) {
-    uint32_t i, crc = 0;
-    static uint32_t crc_table[] = {
-        0x4DBDF21C, 0x500AE278, 0x76D3D2D4, 0x6B64C2B0,
-        0x3B61B38C, 0x26D6A3E8, 0x000F9344, 0x1DB88320,
-        0xA005713C, 0xBDB26158, 0x9B6B51F4, 0x86DC4190,
-        0xD6D930AC, 0xCB6E20C8, 0xEDB71064, 0xF0000000
-    };
+    return ~crc32_dispatch()(0xffffffff, data, data_size);
+}
+}
 
-    for (i = 0; i < data_size; ++i) {
-        crc = (crc >> 4) ^ crc_table[(crc ^ data[i]) & 0x0F];
-        crc = (crc >> 4) ^ crc_table[(crc ^ (data[i] >> 4)) & 0x0F];
-    }
+namespace Internals {
+bool checksum_implementation_supported(checksum_implementation impl) {
+    return ::checksum_implementation(impl) != 0;
+}
 
-    return crc;
+uint32_t do_checksum(const uint8_t *start, const uint8_t *end, 
+                     checksum_implementation impl)
+{
+    checksum_function function = ::checksum_implementation(impl);
+    if(!function)
+        throw std::runtime_error("Checksum implementation not supported");
+    return function(start, end);
 }
+
+bool crc32_implementation_supported(crc32_implementation impl) {
+    return ::crc32_implementation(impl) != 0;
+}
+
+uint32_t crc32(const uint8_t *data, uint32_t data_size, crc32_implementation impl) {
+    crc32_function function = ::crc32_implementation(impl);
+    if(!function)
+        throw std::runtime_error("CRC32 implementation not supported");
+    return ~function(0xffffffff, data, data_size);
 }
+} // Internals
 }
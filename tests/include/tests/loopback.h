@@ -0,0 +1,46 @@
+#ifndef TINS_LOOPBACK_TEST
+#define TINS_LOOPBACK_TEST
+
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+// Helpers for the tests that capture or send on the loopback interface. 
+// These need the privileges required to open packet sockets. Without 
+// them, the tests return early after calling skip_unprivileged_test.
+
+// Reports the current test as skipped, so it can't be mistaken for a 
+// test that passed.
+inline void skip_unprivileged_test() {
+    const testing::TestInfo* info = 
+        testing::UnitTest::GetInstance()->current_test_info();
+    std::cerr << "[  SKIPPED ] " << info->test_case_name() << "." 
+              << info->name() << ": packet sockets can't be opened" 
+              << std::endl;
+    testing::Test::RecordProperty("skipped", "packet sockets can't be opened");
+}
+
+// Sends UDP datagrams with the given payload to 127.0.0.1:port.
+inline void send_loopback_datagrams(uint16_t port, size_t count, 
+                                    const std::string& payload) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(sock, 0);
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (size_t i = 0; i < count; ++i) {
+        sendto(sock, payload.data(), payload.size(), 0, 
+               (const sockaddr*)&address, sizeof(address));
+    }
+    close(sock);
+}
+
+#endif // TINS_LOOPBACK_TEST
@@ -5,6 +5,7 @@
 #include "icmp.h"
 #include "ip.h"
 #include "ethernetII.h"
+#include "rawpdu.h"
 #include "utils.h"
 
 using namespace std;
@@ -286,3 +287,20 @@ TEST_F(ICMPTest, ConstructorFromBuffer) {
         test_equals(icmp1, icmp2);
     }
 }
+
+TEST_F(ICMPTest, IncrementalChecksum) {
+    ICMP icmp;
+    icmp.set_echo_request(1, 2);
+    IP pkt1 = IP("192.168.0.1", "192.168.0.100") / icmp / 
+                RawPDU(string(1471, 'A'));
+    PDU::serialization_type buffer = pkt1.serialize();
+
+    TrustedChecksums::Scope scope;
+    IP pkt2(&buffer[0], (uint32_t)buffer.size());
+    pkt2.rfind_pdu<ICMP>().set_echo_reply(0x1234, 0x5678);
+    PDU::serialization_type incremental = pkt2.serialize();
+
+    // Copies always sum the whole message again
+    IP pkt3(pkt2);
+    EXPECT_EQ(pkt3.serialize(), incremental);
+}
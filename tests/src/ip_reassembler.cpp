@@ -1,9 +1,12 @@
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <cstring>
 #include <string>
 #include <utility>
 #include "ip_reassembler.h"
 #include "ethernetII.h"
+#include "ip.h"
+#include "ipv6.h"
 #include "udp.h"
 #include "rawpdu.h"
 
@@ -15,6 +18,23 @@ public:
     static const size_t packet_sizes[], orderings[][11];
     
     void test_packets(const std::vector<std::pair<const uint8_t*, size_t> > &vt);
+
+    static Timestamp at(long seconds) {
+        timeval tv = timeval();
+        tv.tv_sec = seconds;
+        return Timestamp(tv);
+    }
+
+    static IP make_fragment(const IPv4Address &src, const IPv4Address &dst,
+      uint16_t id, uint16_t offset, size_t size, bool more_fragments,
+      char fill = 'a')
+    {
+        IP ip = IP(dst, src) / RawPDU(std::string(size, fill));
+        ip.id(id);
+        ip.fragment_offset(offset / 8);
+        ip.flags(more_fragments ? IP::MORE_FRAGMENTS : static_cast<IP::Flags>(0));
+        return ip;
+    }
 };
 
 const uint8_t IPv4ReassemblerTest::packets[][1514] = {
@@ -74,3 +94,356 @@ TEST_F(IPv4ReassemblerTest, Reassemble) {
         test_packets(vt);
     }
 }
+
+TEST_F(IPv4ReassemblerTest, FragmentsAreKeyedByDirection) {
+    IPv4Reassembler reassembler;
+    IP first = make_fragment("1.1.1.1", "2.2.2.2", 1, 0, 16, true);
+    IP second = make_fragment("2.2.2.2", "1.1.1.1", 1, 16, 16, false);
+    EXPECT_EQ(IPv4Reassembler::FRAGMENTED, reassembler.process(first));
+    EXPECT_EQ(IPv4Reassembler::FRAGMENTED, reassembler.process(second));
+    EXPECT_EQ(2U, reassembler.pending_datagrams());
+    EXPECT_EQ(48U, reassembler.buffered_size());
+
+    IP last = make_fragment("1.1.1.1", "2.2.2.2", 1, 16, 16, false);
+    EXPECT_EQ(IPv4Reassembler::REASSEMBLED, reassembler.process(last));
+    EXPECT_EQ(32U, last.rfind_pdu<RawPDU>().payload().size());
+    EXPECT_EQ(1U, reassembler.pending_datagrams());
+    EXPECT_EQ(32U, reassembler.buffered_size());
+    EXPECT_EQ(1U, reassembler.stats().reassembled);
+}
+
+TEST_F(IPv4ReassemblerTest, Timeout) {
+    IPv4Reassembler reassembler;
+    reassembler.timeout(10);
+    IP first = make_fragment("1.1.1.1", "2.2.2.2", 1, 0, 16, true);
+    IP second = make_fragment("1.1.1.1", "2.2.2.2", 2, 0, 16, true);
+    reassembler.process(first, at(1));
+    reassembler.process(second, at(5));
+    EXPECT_EQ(2U, reassembler.pending_datagrams());
+
+    // Only the first datagram has been there for 10 seconds
+    IP third = make_fragment("1.1.1.1", "2.2.2.2", 3, 0, 16, true);
+    reassembler.process(third, at(11));
+    EXPECT_EQ(2U, reassembler.pending_datagrams());
+    EXPECT_EQ(1U, reassembler.stats().timed_out);
+
+    // The rest of the first datagram starts a new one
+    IP last = make_fragment("1.1.1.1", "2.2.2.2", 1, 16, 16, false);
+    EXPECT_EQ(
+        IPv4Reassembler::FRAGMENTED, 
+        reassembler.process(last, at(11))
+    );
+    EXPECT_EQ(3U, reassembler.pending_datagrams());
+
+    // Untimed processing never expires datagrams
+    reassembler.timeout(0);
+    IP other = make_fragment("1.1.1.1", "2.2.2.2", 4, 0, 16, true);
+    reassembler.process(other, at(100));
+    EXPECT_EQ(4U, reassembler.pending_datagrams());
+    EXPECT_EQ(1U, reassembler.stats().timed_out);
+}
+
+TEST_F(IPv4ReassemblerTest, MaxBuffer) {
+    IPv4Reassembler reassembler;
+    reassembler.max_buffer(100);
+    for(uint16_t id = 0; id < 3; ++id) {
+        IP ip = make_fragment("1.1.1.1", "2.2.2.2", id, 0, 40, true);
+        reassembler.process(ip);
+    }
+    // The oldest datagram is dropped to make room for the third one
+    EXPECT_EQ(2U, reassembler.pending_datagrams());
+    EXPECT_EQ(80U, reassembler.buffered_size());
+    EXPECT_EQ(1U, reassembler.stats().evicted);
+
+    // The rest of the evicted datagram starts a new one. Its buffer
+    // spans the whole datagram, so the other two are evicted
+    IP last = make_fragment("1.1.1.1", "2.2.2.2", 0, 40, 40, false);
+    EXPECT_EQ(IPv4Reassembler::FRAGMENTED, reassembler.process(last));
+    EXPECT_EQ(3U, reassembler.stats().evicted);
+    EXPECT_EQ(1U, reassembler.pending_datagrams());
+    EXPECT_EQ(80U, reassembler.buffered_size());
+    IP first = make_fragment("1.1.1.1", "2.2.2.2", 0, 0, 40, true);
+    EXPECT_EQ(IPv4Reassembler::REASSEMBLED, reassembler.process(first));
+    EXPECT_EQ(0U, reassembler.buffered_size());
+
+    // Datagrams larger than the limit are dropped
+    IP large = make_fragment("1.1.1.1", "2.2.2.2", 5, 0, 200, true);
+    EXPECT_EQ(IPv4Reassembler::FRAGMENTED, reassembler.process(large));
+    EXPECT_EQ(0U, reassembler.pending_datagrams());
+    large = make_fragment("1.1.1.1", "2.2.2.2", 6, 0, 60, true);
+    reassembler.process(large);
+    large = make_fragment("1.1.1.1", "2.2.2.2", 6, 60, 60, true);
+    EXPECT_EQ(IPv4Reassembler::FRAGMENTED, reassembler.process(large));
+    EXPECT_EQ(0U, reassembler.pending_datagrams());
+    EXPECT_EQ(0U, reassembler.buffered_size());
+    EXPECT_EQ(4U, reassembler.stats().evicted);
+}
+
+TEST_F(IPv4ReassemblerTest, OverlappingFragments) {
+    IPv4Reassembler reassembler;
+    IP first = make_fragment("1.1.1.1", "2.2.2.2", 1, 0, 24, true);
+    reassembler.process(first);
+    // Exact duplicates are not overlaps
+    reassembler.process(first);
+    EXPECT_EQ(0U, reassembler.stats().overlapping);
+    IP second = make_fragment("1.1.1.1", "2.2.2.2", 1, 16, 16, true);
+    reassembler.process(second);
+    IP third = make_fragment("1.1.1.1", "2.2.2.2", 1, 8, 8, true);
+    reassembler.process(third);
+    // Counted once per datagram
+    EXPECT_EQ(1U, reassembler.stats().overlapping);
+}
+
+TEST_F(IPv4ReassemblerTest, RemoveStream) {
+    IPv4Reassembler reassembler;
+    IP first = make_fragment("1.1.1.1", "2.2.2.2", 1, 0, 16, true);
+    IP second = make_fragment("2.2.2.2", "1.1.1.1", 1, 0, 16, true);
+    IP third = make_fragment("1.1.1.1", "2.2.2.2", 2, 0, 16, true);
+    reassembler.process(first);
+    reassembler.process(second);
+    reassembler.process(third);
+    reassembler.remove_stream(1, "1.1.1.1", "2.2.2.2");
+    EXPECT_EQ(1U, reassembler.pending_datagrams());
+    EXPECT_EQ(16U, reassembler.buffered_size());
+    reassembler.clear_streams();
+    EXPECT_EQ(0U, reassembler.pending_datagrams());
+    EXPECT_EQ(0U, reassembler.buffered_size());
+}
+
+TEST_F(IPv4ReassemblerTest, OverlappingFragmentsKeepFirstData) {
+    IPv4Reassembler reassembler;
+    IP ip = IP("2.2.2.2", "1.1.1.1") / RawPDU(std::string(16, 'b'));
+    ip.id(1);
+    ip.fragment_offset(1);
+    ip.flags(IP::MORE_FRAGMENTS);
+    reassembler.process(ip);
+    IP first = make_fragment("1.1.1.1", "2.2.2.2", 1, 0, 16, true);
+    reassembler.process(first);
+    IP last = make_fragment("1.1.1.1", "2.2.2.2", 1, 16, 16, false);
+    ASSERT_EQ(IPv4Reassembler::REASSEMBLED, reassembler.process(last));
+    const RawPDU::payload_type &payload = last.rfind_pdu<RawPDU>().payload();
+    EXPECT_EQ(
+        std::string(8, 'a') + std::string(16, 'b') + std::string(8, 'a'),
+        std::string(payload.begin(), payload.end())
+    );
+    EXPECT_EQ(1U, reassembler.stats().overlapping);
+}
+
+struct overlap_fragment {
+    uint16_t offset, size;
+    char fill;
+    bool more_fragments;
+};
+
+struct overlap_case {
+    overlap_fragment fragments[4];
+    // The payload, where X is replaced by each technique's data for 
+    // the overlapped bytes
+    const char *payload;
+    // The overlapped data kept by FIRST, LAST, BSD, LINUX, WINDOWS 
+    // and SOLARIS
+    const char *kept;
+};
+
+TEST_F(IPv4ReassemblerTest, OverlappingTechniques) {
+    const IPv4Reassembler::overlapping_technique techniques[] = {
+        IPv4Reassembler::FIRST, IPv4Reassembler::LAST, IPv4Reassembler::BSD,
+        IPv4Reassembler::LINUX, IPv4Reassembler::WINDOWS, IPv4Reassembler::SOLARIS
+    };
+    const overlap_case cases[] = {
+        // The new fragment starts before the old one and ends inside it
+        {
+            { { 8, 16, 'A', true }, { 0, 16, 'B', true }, { 24, 8, 'D', false } },
+            "BBBBBBBBXXXXXXXXAAAAAAAADDDDDDDD", "ABBBAA"
+        },
+        // Both start at the same offset, the new one ends after
+        {
+            { { 8, 8, 'A', true }, { 8, 16, 'B', true }, { 0, 8, 'C', true }, 
+              { 24, 8, 'D', false } },
+            "CCCCCCCCXXXXXXXXBBBBBBBBDDDDDDDD", "ABABAA"
+        },
+        // The new fragment covers the old one
+        {
+            { { 8, 8, 'A', true }, { 0, 24, 'B', true }, { 24, 8, 'D', false } },
+            "BBBBBBBBXXXXXXXXBBBBBBBBDDDDDDDD", "ABBBBB"
+        },
+        // The new fragment starts before the old one and ends with it
+        {
+            { { 8, 8, 'A', true }, { 0, 16, 'B', true }, { 16, 8, 'C', true }, 
+              { 24, 8, 'D', false } },
+            "BBBBBBBBXXXXXXXXCCCCCCCCDDDDDDDD", "ABBBAB"
+        },
+        // The new fragment starts inside the old one
+        {
+            { { 0, 16, 'A', true }, { 8, 24, 'B', false } },
+            "AAAAAAAAXXXXXXXXBBBBBBBBBBBBBBBB", "ABAAAA"
+        }
+    };
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        for(size_t j = 0; j < sizeof(techniques) / sizeof(techniques[0]); ++j) {
+            IPv4Reassembler reassembler(techniques[j]);
+            std::string expected = cases[i].payload;
+            std::replace(expected.begin(), expected.end(), 'X', cases[i].kept[j]);
+            IPv4Reassembler::packet_status status = IPv4Reassembler::NOT_FRAGMENTED;
+            IP ip;
+            for(size_t k = 0; k < 4 && cases[i].fragments[k].size != 0; ++k) {
+                const overlap_fragment &fragment = cases[i].fragments[k];
+                ip = make_fragment("1.1.1.1", "2.2.2.2", 1, fragment.offset,
+                                   fragment.size, fragment.more_fragments,
+                                   fragment.fill);
+                status = reassembler.process(ip);
+            }
+            ASSERT_EQ(IPv4Reassembler::REASSEMBLED, status) << i << " " << j;
+            const RawPDU::payload_type &payload = ip.rfind_pdu<RawPDU>().payload();
+            EXPECT_EQ(expected, std::string(payload.begin(), payload.end())) 
+                << "case " << i << ", technique " << j;
+            EXPECT_EQ(1U, reassembler.stats().overlapping);
+        }
+    }
+}
+
+class IPv6ReassemblerTest : public testing::Test {
+public:
+    static IPv6 make_datagram(size_t payload_size) {
+        return IPv6("::2", "::1") / UDP(53, 1024) / 
+               RawPDU(std::string(payload_size, 'a'));
+    }
+
+    // Builds a fragment carrying the given range of the datagram's 
+    // payload
+    static IPv6 make_fragment(IPv6 &datagram, uint32_t id, uint16_t offset, 
+      uint16_t size, bool more_fragments)
+    {
+        const PDU::serialization_type buffer = datagram.serialize();
+        const size_t header_size = 40;
+        PDU::serialization_type fragment(buffer.begin(), buffer.begin() + header_size);
+        const uint16_t payload_length = size + 8;
+        fragment[4] = payload_length >> 8;
+        fragment[5] = payload_length & 0xff;
+        fragment[6] = IPv6::FRAGMENT;
+        fragment.push_back(buffer[6]);
+        fragment.push_back(0);
+        fragment.push_back(offset >> 8);
+        fragment.push_back((offset & 0xf8) | (more_fragments ? 1 : 0));
+        for(int i = 3; i >= 0; --i)
+            fragment.push_back((id >> (i * 8)) & 0xff);
+        fragment.insert(
+            fragment.end(), 
+            buffer.begin() + header_size + offset, 
+            buffer.begin() + header_size + offset + size
+        );
+        return IPv6(&fragment[0], (uint32_t)fragment.size());
+    }
+};
+
+TEST_F(IPv6ReassemblerTest, Reassemble) {
+    // 8 bytes of UDP header plus 2992 of payload
+    IPv6 datagram = make_datagram(2992);
+    const uint16_t orderings[][3] = {
+        { 0, 1, 2 },
+        { 2, 1, 0 },
+        { 1, 2, 0 }
+    };
+    for(size_t i = 0; i < 3; ++i) {
+        IPv6Reassembler reassembler;
+        for(size_t j = 0; j < 3; ++j) {
+            const uint16_t index = orderings[i][j];
+            IPv6 fragment = make_fragment(datagram, 7, index * 1000, 1000, index != 2);
+            EXPECT_TRUE(fragment.is_fragmented());
+            EXPECT_TRUE(fragment.find_pdu<UDP>() == NULL);
+            IPv6Reassembler::packet_status status = reassembler.process(fragment);
+            if(j != 2) {
+                EXPECT_EQ(IPv6Reassembler::FRAGMENTED, status);
+                continue;
+            }
+            ASSERT_EQ(IPv6Reassembler::REASSEMBLED, status);
+            EXPECT_TRUE(fragment.search_header(IPv6::FRAGMENT) == NULL);
+            ASSERT_TRUE(fragment.find_pdu<UDP>() != NULL);
+            EXPECT_EQ(53, fragment.rfind_pdu<UDP>().dport());
+            EXPECT_EQ(2992U, fragment.rfind_pdu<RawPDU>().payload().size());
+            EXPECT_EQ(datagram.serialize(), fragment.serialize());
+        }
+        EXPECT_EQ(0U, reassembler.pending_datagrams());
+        EXPECT_EQ(0U, reassembler.buffered_size());
+        EXPECT_EQ(1U, reassembler.stats().reassembled);
+    }
+}
+
+TEST_F(IPv6ReassemblerTest, NotFragmented) {
+    IPv6Reassembler reassembler;
+    IPv6 datagram = make_datagram(100);
+    EXPECT_EQ(IPv6Reassembler::NOT_FRAGMENTED, reassembler.process(datagram));
+    // Atomic fragments are processed on their own
+    IPv6 fragment = make_fragment(datagram, 1, 0, 108, false);
+    EXPECT_FALSE(fragment.is_fragmented());
+    EXPECT_TRUE(fragment.find_pdu<UDP>() != NULL);
+    EXPECT_EQ(IPv6Reassembler::NOT_FRAGMENTED, reassembler.process(fragment));
+}
+
+TEST_F(IPv6ReassemblerTest, FragmentsAreKeyedById) {
+    IPv6Reassembler reassembler;
+    IPv6 datagram = make_datagram(992);
+    IPv6 first = make_fragment(datagram, 1, 0, 500, true);
+    IPv6 other = make_fragment(datagram, 2, 504, 496, false);
+    EXPECT_EQ(IPv6Reassembler::FRAGMENTED, reassembler.process(first));
+    EXPECT_EQ(IPv6Reassembler::FRAGMENTED, reassembler.process(other));
+    EXPECT_EQ(2U, reassembler.pending_datagrams());
+    reassembler.remove_stream(2, "::2", "::1");
+    EXPECT_EQ(1U, reassembler.pending_datagrams());
+    EXPECT_EQ(500U, reassembler.buffered_size());
+}
+
+TEST_F(IPv6ReassemblerTest, TimeoutAndMaxBuffer) {
+    IPv6Reassembler reassembler;
+    reassembler.timeout(60);
+    reassembler.max_buffer(1000);
+    IPv6 datagram = make_datagram(992);
+    timeval tv = timeval();
+    for(uint32_t id = 0; id < 3; ++id) {
+        tv.tv_sec = id;
+        IPv6 fragment = make_fragment(datagram, id, 0, 400, true);
+        reassembler.process(fragment, Timestamp(tv));
+    }
+    EXPECT_EQ(2U, reassembler.pending_datagrams());
+    EXPECT_EQ(1U, reassembler.stats().evicted);
+
+    tv.tv_sec = 61;
+    IPv6 fragment = make_fragment(datagram, 5, 0, 400, true);
+    reassembler.process(fragment, Timestamp(tv));
+    EXPECT_EQ(2U, reassembler.pending_datagrams());
+    EXPECT_EQ(1U, reassembler.stats().timed_out);
+    EXPECT_EQ(800U, reassembler.buffered_size());
+}
+
+TEST_F(IPv6ReassemblerTest, OverlappingFragmentsAreDropped) {
+    IPv6Reassembler reassembler;
+    EXPECT_TRUE(reassembler.drop_overlapping());
+    IPv6 datagram = make_datagram(992);
+    IPv6 first = make_fragment(datagram, 1, 0, 504, true);
+    IPv6 duplicate = make_fragment(datagram, 1, 0, 504, true);
+    IPv6 overlapping = make_fragment(datagram, 1, 496, 504, true);
+    IPv6 last = make_fragment(datagram, 1, 504, 496, false);
+    EXPECT_EQ(IPv6Reassembler::FRAGMENTED, reassembler.process(first));
+    // Exact duplicates are not overlaps
+    EXPECT_EQ(IPv6Reassembler::FRAGMENTED, reassembler.process(duplicate));
+    EXPECT_EQ(0U, reassembler.stats().overlapping);
+    EXPECT_EQ(IPv6Reassembler::FRAGMENTED, reassembler.process(overlapping));
+    EXPECT_EQ(1U, reassembler.stats().overlapping);
+    EXPECT_EQ(0U, reassembler.pending_datagrams());
+    EXPECT_EQ(0U, reassembler.buffered_size());
+    // The rest of the datagram can't be used to reassemble it
+    EXPECT_EQ(IPv6Reassembler::FRAGMENTED, reassembler.process(last));
+    EXPECT_EQ(0U, reassembler.stats().reassembled);
+}
+
+TEST_F(IPv6ReassemblerTest, OverlappingFragmentsKeepFirstData) {
+    IPv6Reassembler reassembler;
+    reassembler.drop_overlapping(false);
+    IPv6 datagram = make_datagram(992);
+    IPv6 first = make_fragment(datagram, 1, 0, 504, true);
+    IPv6 overlapping = make_fragment(datagram, 1, 496, 504, false);
+    EXPECT_EQ(IPv6Reassembler::FRAGMENTED, reassembler.process(first));
+    EXPECT_EQ(IPv6Reassembler::REASSEMBLED, reassembler.process(overlapping));
+    EXPECT_EQ(1U, reassembler.stats().overlapping);
+    EXPECT_EQ(datagram.serialize(), overlapping.serialize());
+}
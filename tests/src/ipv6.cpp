@@ -8,6 +8,8 @@
 #include "icmp.h"
 #include "icmpv6.h"
 #include "ipv6_address.h"
+#include "rawpdu.h"
+#include "constants.h"
 #include "utils.h"
 
 using namespace std;
@@ -175,3 +177,25 @@ TEST_F(IPv6Test, DestinationAddress) {
     EXPECT_EQ(ipv6.dst_addr(), "99af:1293::1");
 }
 
+
+TEST_F(IPv6Test, RemoveExtensionHeader) {
+    IPv6 ipv6(expected_packet2, sizeof(expected_packet2));
+    EXPECT_FALSE(ipv6.remove_ext_header(IPv6::FRAGMENT));
+    EXPECT_TRUE(ipv6.remove_ext_header(IPv6::HOP_BY_HOP));
+    EXPECT_TRUE(ipv6.search_header(IPv6::HOP_BY_HOP) == NULL);
+    EXPECT_EQ(ipv6.next_header(), Constants::IP::PROTO_ICMPV6);
+    EXPECT_EQ(40U, ipv6.header_size());
+}
+
+TEST_F(IPv6Test, FragmentsAreNotDecoded) {
+    const uint8_t fragment[] = {
+        96, 0, 0, 0, 0, 16, 44, 64, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 
+        0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 
+        17, 0, 0, 1, 0, 0, 0, 7, 4, 0, 0, 53, 0, 8, 0, 0
+    };
+    IPv6 ipv6(fragment, sizeof(fragment));
+    EXPECT_TRUE(ipv6.is_fragmented());
+    EXPECT_TRUE(ipv6.find_pdu<UDP>() == NULL);
+    ASSERT_TRUE(ipv6.find_pdu<RawPDU>() != NULL);
+    EXPECT_EQ(8U, ipv6.rfind_pdu<RawPDU>().payload().size());
+}
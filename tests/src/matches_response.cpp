@@ -66,6 +66,23 @@ TEST_F(MatchesResponseTest, UDPMatchesICMPResponse2) {
     EXPECT_TRUE(ip.matches_response(udp_pkt_resp, sizeof(udp_pkt_resp)));
 }
 
+TEST_F(MatchesResponseTest, UDPDoesNotMatchOtherICMPResponse) {
+    const uint8_t udp_pkt[] = {
+        69, 0, 0, 33, 0, 1, 0, 0, 128, 17, 185, 21, 192, 168, 0, 100, 
+        192, 168, 0, 1, 0, 0, 13, 5, 0, 13, 62, 59, 98, 111, 105, 110, 
+        103
+    }, 
+    // Port unreachable for a packet sent to 192.168.0.2
+    udp_pkt_resp[] = {
+        69, 192, 0, 61, 150, 255, 0, 0, 64, 1, 97, 75, 192, 168, 0, 1, 
+        192, 168, 0, 100, 3, 3, 126, 209, 0, 0, 0, 0, 69, 0, 0, 33, 0, 
+        1, 0, 0, 128, 17, 185, 21, 192, 168, 0, 100, 192, 168, 0, 2, 0, 
+        0, 13, 5, 0, 13, 62, 59, 98, 111, 105, 110, 103
+    };
+    IP ip(udp_pkt, sizeof(udp_pkt));
+    EXPECT_FALSE(ip.matches_response(udp_pkt_resp, sizeof(udp_pkt_resp)));
+}
+
 TEST_F(MatchesResponseTest, DHCP) {
     uint8_t dhcp_discover[] = {
         255, 255, 255, 255, 255, 255, 0, 1, 1, 0, 0, 1, 8, 0, 69, 0, 1, 
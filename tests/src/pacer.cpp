@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include "pacer.h"
+
+using namespace Tins;
+
+class PacerTest : public testing::Test {
+public:
+    static const uint64_t start = 1000000000;
+    static const uint64_t millisecond = 1000000;
+};
+
+const uint64_t PacerTest::start;
+const uint64_t PacerTest::millisecond;
+
+TEST_F(PacerTest, DefaultConstructor) {
+    Pacer pacer;
+    EXPECT_FALSE(pacer.enabled());
+    EXPECT_EQ(start, pacer.reserve(100, start));
+    EXPECT_EQ(start, pacer.reserve(100, start));
+    EXPECT_EQ(0U, pacer.stats().packets);
+}
+
+TEST_F(PacerTest, Constructor) {
+    Pacer pacer(1000, 8000, 4, Pacer::BUSY_WAIT);
+    EXPECT_TRUE(pacer.enabled());
+    EXPECT_DOUBLE_EQ(1000, pacer.packets_per_second());
+    EXPECT_DOUBLE_EQ(8000, pacer.bits_per_second());
+    EXPECT_EQ(4U, pacer.burst());
+    EXPECT_EQ(Pacer::BUSY_WAIT, pacer.wait_mode());
+}
+
+TEST_F(PacerTest, PacketRate) {
+    Pacer pacer(1000);
+    EXPECT_EQ(start, pacer.reserve(100, start));
+    EXPECT_EQ(start + millisecond, pacer.reserve(100, start));
+    EXPECT_EQ(start + 2 * millisecond, pacer.reserve(100, start + millisecond));
+    // Sent on time
+    EXPECT_EQ(start + 3 * millisecond, pacer.reserve(100, start + 3 * millisecond));
+
+    const Pacer::Stats& stats = pacer.stats();
+    EXPECT_EQ(4U, stats.packets);
+    EXPECT_EQ(400U, stats.bytes);
+    EXPECT_EQ(2U, stats.waits);
+    EXPECT_EQ(2 * millisecond, stats.wait_time);
+    EXPECT_EQ(0U, stats.behind);
+    EXPECT_EQ(3 * millisecond, stats.elapsed());
+    EXPECT_DOUBLE_EQ(1000, stats.packets_per_second());
+    EXPECT_DOUBLE_EQ(800000, stats.bits_per_second());
+}
+
+TEST_F(PacerTest, BitRate) {
+    // 1000 bytes per second
+    Pacer pacer(0, 8000);
+    EXPECT_EQ(start, pacer.reserve(500, start));
+    EXPECT_EQ(start + 500 * millisecond, pacer.reserve(250, start));
+    EXPECT_EQ(start + 750 * millisecond, pacer.reserve(100, start));
+}
+
+TEST_F(PacerTest, MostRestrictiveRate) {
+    // 1 ms per packet, 1 ms per 1000 bytes
+    Pacer pacer(1000, 8000000);
+    EXPECT_EQ(start, pacer.reserve(100, start));
+    EXPECT_EQ(start + millisecond, pacer.reserve(3000, start));
+    EXPECT_EQ(start + 4 * millisecond, pacer.reserve(100, start));
+}
+
+TEST_F(PacerTest, Burst) {
+    Pacer pacer(1000, 0, 4);
+    for(int i = 0; i < 4; ++i)
+        EXPECT_EQ(start, pacer.reserve(100, start));
+    EXPECT_EQ(start + millisecond, pacer.reserve(100, start));
+    EXPECT_EQ(start + 2 * millisecond, pacer.reserve(100, start));
+    EXPECT_EQ(0U, pacer.stats().behind);
+}
+
+TEST_F(PacerTest, CatchUpAfterFallingBehind) {
+    Pacer pacer(1000, 0, 4);
+    EXPECT_EQ(start, pacer.reserve(100, start));
+    // 4 packets can be sent right away to catch up. The next one has 
+    // to wait again.
+    const uint64_t now = start + 3 * millisecond + millisecond / 2;
+    for(int i = 0; i < 4; ++i)
+        EXPECT_EQ(now, pacer.reserve(100, now));
+    EXPECT_EQ(now + millisecond, pacer.reserve(100, now));
+
+    const Pacer::Stats& stats = pacer.stats();
+    EXPECT_EQ(1U, stats.behind);
+    EXPECT_EQ(2 * millisecond + millisecond / 2, stats.max_lag);
+}
+
+TEST_F(PacerTest, Reset) {
+    Pacer pacer(1000);
+    pacer.reserve(100, start);
+    pacer.reserve(100, start);
+    pacer.reset();
+    EXPECT_EQ(0U, pacer.stats().packets);
+    EXPECT_EQ(start, pacer.reserve(100, start));
+}
+
+TEST_F(PacerTest, Pace) {
+    Pacer pacer(10000, 0, 1, Pacer::BUSY_WAIT);
+    const uint64_t before = Pacer::clock();
+    for(int i = 0; i < 11; ++i)
+        pacer.pace(100);
+    // 10 intervals of 100 microseconds
+    EXPECT_GE(Pacer::clock() - before, millisecond);
+    EXPECT_EQ(11U, pacer.stats().packets);
+    EXPECT_GE(pacer.stats().elapsed(), millisecond);
+}
@@ -0,0 +1,159 @@
+#include "config.h"
+
+#ifdef HAVE_PACKET_RING
+
+#include <gtest/gtest.h>
+#include <ctime>
+#include "packet_ring.h"
+#include "packet_view.h"
+#include "cxxstd.h"
+#include "exceptions.h"
+#include "tests/loopback.h"
+#include "ethernetII.h"
+#include "ip.h"
+#include "udp.h"
+#include "rawpdu.h"
+#include "network_interface.h"
+#if TINS_IS_CXX11
+    #include <thread>
+    #include <chrono>
+#endif // TINS_IS_CXX11
+
+using namespace Tins;
+
+// These tests capture on the loopback interface. See tests/loopback.h.
+class PacketRingTest : public testing::Test {
+public:
+    static const uint16_t port = 47813;
+
+    static RxPacketRing* make_ring(uint32_t timeout) {
+        try {
+            return new RxPacketRing("lo", RxPacketRing::DEFAULT_BLOCK_SIZE, 4, 
+                                    2048, timeout);
+        }
+        catch (socket_open_error&) {
+            skip_unprivileged_test();
+            return 0;
+        }
+    }
+
+    static void send_datagrams(size_t count) {
+        send_loopback_datagrams(port, count, "packet ring test");
+    }
+};
+
+const uint16_t PacketRingTest::port;
+
+struct count_datagrams {
+    size_t count;
+
+    count_datagrams() : count(0) { }
+
+    static void handler(u_char* user, const pcap_pkthdr* header, const u_char* data) {
+        PacketView view(data, header->caplen);
+        if (view.udp() && view.udp()->dport() == PacketRingTest::port) {
+            ++((count_datagrams*)user)->count;
+        }
+    }
+};
+
+TEST_F(PacketRingTest, Dispatch) {
+    RxPacketRing* ring = make_ring(10);
+    if (!ring) {
+        return;
+    }
+    EXPECT_EQ(DLT_EN10MB, ring->link_type());
+    send_datagrams(5);
+    count_datagrams counter;
+    // Loopback packets are seen both when sent and when received
+    const time_t deadline = time(0) + 5;
+    while (counter.count < 10 && time(0) < deadline) {
+        ASSERT_GE(ring->dispatch(-1, &count_datagrams::handler, (u_char*)&counter), 0);
+    }
+    EXPECT_EQ(10U, counter.count);
+    delete ring;
+}
+
+TEST_F(PacketRingTest, Next) {
+    RxPacketRing* ring = make_ring(10);
+    if (!ring) {
+        return;
+    }
+    send_datagrams(3);
+    count_datagrams counter;
+    const time_t deadline = time(0) + 5;
+    while (counter.count < 6 && time(0) < deadline) {
+        pcap_pkthdr* header;
+        const u_char* data;
+        const int result = ring->next(&header, &data);
+        ASSERT_GE(result, 0);
+        if (result == 1) {
+            count_datagrams::handler((u_char*)&counter, header, data);
+        }
+    }
+    EXPECT_EQ(6U, counter.count);
+    delete ring;
+}
+
+TEST_F(PacketRingTest, BreakLoop) {
+    RxPacketRing* ring = make_ring(10);
+    if (!ring) {
+        return;
+    }
+    ring->break_loop();
+    count_datagrams counter;
+    EXPECT_EQ(-2, ring->loop(-1, &count_datagrams::handler, (u_char*)&counter));
+    // The break is only applied once
+    send_datagrams(1);
+    EXPECT_EQ(0, ring->loop(2, &count_datagrams::handler, (u_char*)&counter));
+    delete ring;
+}
+
+TEST_F(PacketRingTest, TxFlushSendsEveryFrame) {
+    RxPacketRing* ring = make_ring(10);
+    if (!ring) {
+        return;
+    }
+    const size_t frame_count = 48;
+    TxPacketRing tx_ring(NetworkInterface("lo"), 64);
+    EthernetII packet = EthernetII() / IP("127.0.0.1", "127.0.0.1") / 
+                        UDP(port, 1000) / RawPDU("packet ring test");
+    for (size_t i = 0; i < frame_count; ++i) {
+        ASSERT_TRUE(tx_ring.write(packet));
+    }
+    EXPECT_EQ(frame_count, tx_ring.pending_frames());
+    tx_ring.flush();
+    EXPECT_EQ(0U, tx_ring.pending_frames());
+    count_datagrams counter;
+    const time_t deadline = time(0) + 5;
+    while (counter.count < frame_count && time(0) < deadline) {
+        ASSERT_GE(ring->dispatch(-1, &count_datagrams::handler, (u_char*)&counter), 0);
+    }
+    EXPECT_LE(frame_count, counter.count);
+    delete ring;
+}
+
+#if TINS_IS_CXX11
+TEST_F(PacketRingTest, BreakLoopWakesUpBlockedReader) {
+    // A timeout of 0 blocks until a block is retired, rather than polling
+    RxPacketRing* ring = make_ring(0);
+    if (!ring) {
+        return;
+    }
+    std::thread breaker([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        ring->break_loop();
+    });
+    const std::clock_t cpu_start = std::clock();
+    count_datagrams counter;
+    const int result = ring->loop(-1, &count_datagrams::handler, (u_char*)&counter);
+    const double cpu_time = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    breaker.join();
+    EXPECT_EQ(-2, result);
+    // Waiting must not spin
+    EXPECT_LT(cpu_time, 0.1);
+    delete ring;
+}
+#endif // TINS_IS_CXX11
+
+#endif // HAVE_PACKET_RING
@@ -0,0 +1,134 @@
+#include "config.h"
+
+#ifndef _WIN32
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstring>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include "packet_sender.h"
+#include "ip.h"
+#include "ipv6.h"
+#include "tcp.h"
+#include "udp.h"
+#include "icmp.h"
+#include "rawpdu.h"
+#include "exceptions.h"
+#include "tests/loopback.h"
+
+using namespace std;
+using namespace Tins;
+
+// These tests send through raw sockets on the loopback interface. See 
+// tests/loopback.h.
+class PacketSenderTest : public testing::Test {
+public:
+    static const uint16_t port = 47816;
+
+    PacketSenderTest() : receiver(-1) { }
+
+    ~PacketSenderTest() {
+        for (size_t i = 0; i < packets.size(); ++i) {
+            delete packets[i];
+        }
+        if (receiver >= 0) {
+            close(receiver);
+        }
+    }
+
+    // Binds a UDP socket to 127.0.0.1:port, so the datagrams sent can 
+    // be read back
+    void open_receiver() {
+        receiver = socket(AF_INET, SOCK_DGRAM, 0);
+        ASSERT_GE(receiver, 0);
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(0, bind(receiver, (const sockaddr*)&address, sizeof(address)));
+        timeval timeout = { 1, 0 };
+        setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    string receive() {
+        char buffer[256];
+        const ssize_t size = recv(receiver, buffer, sizeof(buffer), 0);
+        return size > 0 ? string(buffer, size) : string();
+    }
+
+    static string payload(size_t index) {
+        ostringstream output;
+        output << "batch " << index;
+        return output.str();
+    }
+
+    vector<PDU*> packets;
+    int receiver;
+};
+
+const uint16_t PacketSenderTest::port;
+
+TEST_F(PacketSenderTest, SendBatchMixedLayer3) {
+    open_receiver();
+    // Runs of packets that go through the same raw socket are submitted
+    // together, so the socket used changes every few packets
+    const char kinds[] = "uuuiittuu6u6iu";
+    vector<size_t> datagrams;
+    for (size_t i = 0; kinds[i]; ++i) {
+        switch (kinds[i]) {
+            case 'u':
+                packets.push_back(new IP("127.0.0.1", "127.0.0.1"));
+                *packets.back() /= UDP(port, 40000) / RawPDU(payload(i));
+                datagrams.push_back(i);
+                break;
+            case 'i':
+                packets.push_back(new IP("127.0.0.1", "127.0.0.1"));
+                *packets.back() /= ICMP(ICMP::ECHO_REQUEST);
+                break;
+            case 't':
+                packets.push_back(new IP("127.0.0.1", "127.0.0.1"));
+                *packets.back() /= TCP(port + 1, 40000);
+                break;
+            default:
+                packets.push_back(new IPv6("::1", "::1"));
+                *packets.back() /= UDP(port + 1, 40000) / RawPDU(payload(i));
+        }
+    }
+    PacketSender sender;
+    vector<uint32_t> bytes_sent(3, 1234);
+    size_t sent;
+    try {
+        sent = sender.send_batch(packets.begin(), packets.end(), 
+                                 sender.default_interface(), bytes_sent);
+    }
+    catch (socket_open_error&) {
+        skip_unprivileged_test();
+        return;
+    }
+    EXPECT_EQ(packets.size(), sent);
+    // The vector is cleared before the results are stored
+    ASSERT_EQ(packets.size(), bytes_sent.size());
+    for (size_t i = 0; i < packets.size(); ++i) {
+        EXPECT_EQ(packets[i]->size(), bytes_sent[i]) << "packet " << i;
+    }
+    // Every datagram arrives, in order
+    for (size_t i = 0; i < datagrams.size(); ++i) {
+        EXPECT_EQ(payload(datagrams[i]), receive());
+    }
+}
+
+TEST_F(PacketSenderTest, SendBatchEmpty) {
+    PacketSender sender;
+    vector<uint32_t> bytes_sent(3, 1234);
+    EXPECT_EQ(0U, sender.send_batch(packets.begin(), packets.end(), 
+                                    sender.default_interface(), bytes_sent));
+    EXPECT_TRUE(bytes_sent.empty());
+}
+
+#endif // _WIN32
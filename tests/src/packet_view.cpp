@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <stdint.h>
+#include "packet_view.h"
+#include "ethernetII.h"
+#include "dot1q.h"
+#include "ip.h"
+#include "ipv6.h"
+#include "tcp.h"
+#include "udp.h"
+#include "icmp.h"
+#include "rawpdu.h"
+
+using namespace std;
+using namespace Tins;
+
+class PacketViewTest : public testing::Test {
+public:
+
+};
+
+TEST_F(PacketViewTest, EthernetIPTCP) {
+    EthernetII eth = EthernetII("00:01:02:03:04:05", "06:07:08:09:0a:0b") / 
+                     IP("192.168.0.1", "10.0.0.1") / TCP(22, 12345) / 
+                     RawPDU("hello world");
+    eth.rfind_pdu<IP>().ttl(17);
+    eth.rfind_pdu<IP>().id(0x1234);
+    eth.rfind_pdu<TCP>().seq(0x12345678);
+    eth.rfind_pdu<TCP>().ack_seq(0x87654321);
+    eth.rfind_pdu<TCP>().flags(TCP::SYN | TCP::ACK);
+    eth.rfind_pdu<TCP>().window(4321);
+    PDU::serialization_type buffer = eth.serialize();
+    const EthernetII parsed(&buffer[0], buffer.size());
+    PacketView view(&buffer[0], buffer.size());
+
+    ASSERT_TRUE(view.ethernet() != 0);
+    EXPECT_EQ(eth.dst_addr(), view.ethernet()->dst_addr());
+    EXPECT_EQ(eth.src_addr(), view.ethernet()->src_addr());
+    EXPECT_EQ(eth.payload_type(), view.ethernet()->payload_type());
+    EXPECT_TRUE(view.dot1q() == 0);
+    EXPECT_TRUE(view.ipv6() == 0);
+
+    const IP& ip = parsed.rfind_pdu<IP>();
+    ASSERT_TRUE(view.ip() != 0);
+    EXPECT_EQ(ip.src_addr(), view.ip()->src_addr());
+    EXPECT_EQ(ip.dst_addr(), view.ip()->dst_addr());
+    EXPECT_EQ(ip.ttl(), view.ip()->ttl());
+    EXPECT_EQ(ip.id(), view.ip()->id());
+    EXPECT_EQ(ip.tot_len(), view.ip()->tot_len());
+    EXPECT_EQ(ip.head_len(), view.ip()->head_len());
+    EXPECT_EQ(ip.checksum(), view.ip()->checksum());
+    EXPECT_EQ(ip.protocol(), view.transport_protocol());
+
+    const TCP& tcp = parsed.rfind_pdu<TCP>();
+    ASSERT_TRUE(view.tcp() != 0);
+    EXPECT_EQ(tcp.sport(), view.tcp()->sport());
+    EXPECT_EQ(tcp.dport(), view.tcp()->dport());
+    EXPECT_EQ(tcp.seq(), view.tcp()->seq());
+    EXPECT_EQ(tcp.ack_seq(), view.tcp()->ack_seq());
+    EXPECT_EQ(tcp.flags(), view.tcp()->flags());
+    EXPECT_EQ(tcp.window(), view.tcp()->window());
+    EXPECT_EQ(tcp.checksum(), view.tcp()->checksum());
+    EXPECT_TRUE(view.udp() == 0);
+    EXPECT_TRUE(view.icmp() == 0);
+
+    EXPECT_EQ(14U + 20 + 20, view.payload_offset());
+    EXPECT_EQ(11U, view.payload_size());
+    EXPECT_EQ("hello world", string(view.payload(), view.payload() + view.payload_size()));
+}
+
+TEST_F(PacketViewTest, Dot1QIPUDP) {
+    EthernetII eth = EthernetII() / Dot1Q(123) / IP("1.2.3.4", "4.3.2.1") / 
+                     UDP(53, 1234) / RawPDU("abc");
+    eth.rfind_pdu<Dot1Q>().priority(5);
+    PDU::serialization_type buffer = eth.serialize();
+    // Ethernet trailer shouldn't be considered part of the payload
+    buffer.resize(buffer.size() + 10);
+    PacketView view(&buffer[0], buffer.size());
+
+    ASSERT_TRUE(view.dot1q() != 0);
+    EXPECT_EQ(123, view.dot1q()->id());
+    EXPECT_EQ(5, view.dot1q()->priority());
+    EXPECT_EQ(0x0800, view.dot1q()->payload_type());
+    ASSERT_TRUE(view.ip() != 0);
+    EXPECT_EQ(IPv4Address("1.2.3.4"), view.ip()->dst_addr());
+    ASSERT_TRUE(view.udp() != 0);
+    EXPECT_EQ(53, view.udp()->dport());
+    EXPECT_EQ(1234, view.udp()->sport());
+    EXPECT_EQ(11, view.udp()->length());
+    EXPECT_EQ(3U, view.payload_size());
+}
+
+TEST_F(PacketViewTest, IPICMP) {
+    EthernetII eth = EthernetII() / IP("1.2.3.4", "4.3.2.1") / ICMP(ICMP::ECHO_REQUEST);
+    eth.rfind_pdu<ICMP>().id(0x1122);
+    eth.rfind_pdu<ICMP>().sequence(0x3344);
+    PDU::serialization_type buffer = eth.serialize();
+    PacketView view(&buffer[0], buffer.size());
+
+    ASSERT_TRUE(view.icmp() != 0);
+    EXPECT_EQ(ICMP::ECHO_REQUEST, view.icmp()->type());
+    EXPECT_EQ(0x1122, view.icmp()->id());
+    EXPECT_EQ(0x3344, view.icmp()->sequence());
+    EXPECT_EQ(0U, view.payload_size());
+}
+
+TEST_F(PacketViewTest, IPv6ExtensionHeadersTCP) {
+    const uint8_t padding[] = { 1, 4, 0, 0, 0, 0 };
+    IPv6 ipv6("fe80::1", "fe80::2");
+    ipv6.next_header(Constants::IP::PROTO_DSTOPTS);
+    ipv6.add_ext_header(IPv6::ext_header(0, sizeof(padding), padding));
+    EthernetII eth = EthernetII() / ipv6 / TCP(80, 8080) / RawPDU("data");
+    eth.rfind_pdu<IPv6>().hop_limit(9);
+    PDU::serialization_type buffer = eth.serialize();
+    PacketView view(&buffer[0], buffer.size());
+
+    EXPECT_TRUE(view.ip() == 0);
+    ASSERT_TRUE(view.ipv6() != 0);
+    EXPECT_EQ(IPv6Address("fe80::1"), view.ipv6()->dst_addr());
+    EXPECT_EQ(IPv6Address("fe80::2"), view.ipv6()->src_addr());
+    EXPECT_EQ(9, view.ipv6()->hop_limit());
+    EXPECT_EQ(Constants::IP::PROTO_TCP, view.transport_protocol());
+    ASSERT_TRUE(view.tcp() != 0);
+    EXPECT_EQ(80, view.tcp()->dport());
+    EXPECT_EQ(8080, view.tcp()->sport());
+    EXPECT_EQ("data", string(view.payload(), view.payload() + view.payload_size()));
+}
+
+TEST_F(PacketViewTest, NonInitialFragment) {
+    EthernetII eth = EthernetII() / IP("1.2.3.4", "4.3.2.1") / RawPDU("fragment");
+    eth.rfind_pdu<IP>().protocol(Constants::IP::PROTO_TCP);
+    eth.rfind_pdu<IP>().fragment_offset(10);
+    PDU::serialization_type buffer = eth.serialize();
+    PacketView view(&buffer[0], buffer.size());
+
+    ASSERT_TRUE(view.ip() != 0);
+    EXPECT_EQ(10, view.ip()->fragment_offset());
+    EXPECT_TRUE(view.tcp() == 0);
+    EXPECT_EQ(Constants::IP::PROTO_TCP, view.transport_protocol());
+    EXPECT_EQ(8U, view.payload_size());
+}
+
+TEST_F(PacketViewTest, Truncated) {
+    EthernetII eth = EthernetII() / IP("1.2.3.4", "4.3.2.1") / TCP(1, 2);
+    PDU::serialization_type buffer = eth.serialize();
+    PacketView view(&buffer[0], 14 + 20 + 10);
+    ASSERT_TRUE(view.ip() != 0);
+    EXPECT_TRUE(view.tcp() == 0);
+
+    PacketView short_view(&buffer[0], 10);
+    EXPECT_TRUE(short_view.ethernet() == 0);
+    EXPECT_TRUE(short_view.ip() == 0);
+    EXPECT_TRUE(short_view.tcp() == 0);
+}
+
+TEST_F(PacketViewTest, UnknownLinkType) {
+    EthernetII eth = EthernetII() / IP("1.2.3.4", "4.3.2.1") / TCP(1, 2);
+    PDU::serialization_type buffer = eth.serialize();
+    PacketView view(&buffer[0], buffer.size(), DLT_IEEE802_11);
+    EXPECT_TRUE(view.ethernet() == 0);
+    EXPECT_TRUE(view.ip() == 0);
+    EXPECT_TRUE(view.tcp() == 0);
+}
@@ -0,0 +1,111 @@
+#include "config.h"
+
+#if !defined(_WIN32) || defined(HAVE_PACKET_SENDER_PCAP_SENDPACKET)
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include "pcap_replayer.h"
+#include "packet_writer.h"
+#include "packet.h"
+#include "ethernetII.h"
+#include "ip.h"
+#include "udp.h"
+#include "rawpdu.h"
+
+using namespace Tins;
+
+class PcapReplayerTest : public testing::Test {
+public:
+    static const std::string file_name;
+
+    ~PcapReplayerTest() {
+        std::remove(file_name.c_str());
+    }
+
+    static EthernetII make_frame(size_t payload_size) {
+        return EthernetII("00:01:02:03:04:05", "00:01:02:03:04:06") / 
+               IP("10.0.0.1", "10.0.0.2") / UDP(53, 1000) / 
+               RawPDU(std::string(payload_size, 'a'));
+    }
+
+    static void write(PacketWriter& writer, const PDU& pdu, long seconds, long microseconds) {
+        timeval time;
+        time.tv_sec = seconds;
+        time.tv_usec = microseconds;
+        Packet packet(&pdu, Timestamp(time));
+        writer.write(packet);
+    }
+};
+
+const std::string PcapReplayerTest::file_name = "pcap_replayer_test.pcap";
+
+TEST_F(PcapReplayerTest, LoadFrames) {
+    EthernetII frame1 = make_frame(10), frame2 = make_frame(100), frame3 = make_frame(1000);
+    {
+        PacketWriter writer(file_name, DataLinkType<EthernetII>());
+        write(writer, frame1, 100, 0);
+        write(writer, frame2, 100, 500000);
+        write(writer, frame3, 101, 500000);
+    }
+    PcapReplayer replayer(file_name);
+    EXPECT_EQ(3U, replayer.frame_count());
+    EXPECT_EQ(frame1.size() + frame2.size() + frame3.size(), replayer.cache_size());
+    EXPECT_EQ(1500000000ULL, replayer.duration());
+    EXPECT_EQ(DLT_EN10MB, replayer.link_type());
+}
+
+TEST_F(PcapReplayerTest, TimestampsGoingBackwards) {
+    EthernetII frame = make_frame(10);
+    {
+        PacketWriter writer(file_name, DataLinkType<EthernetII>());
+        write(writer, frame, 100, 0);
+        write(writer, frame, 102, 0);
+        write(writer, frame, 99, 0);
+        write(writer, frame, 101, 0);
+    }
+    PcapReplayer replayer(file_name);
+    EXPECT_EQ(4U, replayer.frame_count());
+    EXPECT_EQ(2000000000ULL, replayer.duration());
+}
+
+TEST_F(PcapReplayerTest, Settings) {
+    {
+        PacketWriter writer(file_name, DataLinkType<EthernetII>());
+    }
+    PcapReplayer replayer(file_name);
+    EXPECT_EQ(0, replayer.speed());
+    EXPECT_EQ(1U, replayer.loops());
+    EXPECT_EQ(Pacer::SLEEP, replayer.wait_mode());
+
+    replayer.speed(2.5);
+    replayer.loops(0);
+    replayer.wait_mode(Pacer::BUSY_WAIT);
+    EXPECT_EQ(2.5, replayer.speed());
+    EXPECT_EQ(0U, replayer.loops());
+    EXPECT_EQ(Pacer::BUSY_WAIT, replayer.wait_mode());
+
+    replayer.speed(-1);
+    EXPECT_EQ(0, replayer.speed());
+}
+
+TEST_F(PcapReplayerTest, ReplayEmptyCapture) {
+    {
+        PacketWriter writer(file_name, DataLinkType<EthernetII>());
+    }
+    PcapReplayer replayer(file_name);
+    EXPECT_EQ(0U, replayer.frame_count());
+    EXPECT_EQ(0U, replayer.duration());
+    replayer.loops(0);
+    PacketSender sender;
+    PcapReplayer::Stats stats = replayer.replay(sender);
+    EXPECT_EQ(0U, stats.packets);
+    EXPECT_EQ(0U, stats.loops);
+}
+
+TEST_F(PcapReplayerTest, InvalidFile) {
+    EXPECT_THROW(PcapReplayer("/this/file/does/not/exist.pcap"), std::runtime_error);
+}
+
+#endif // !_WIN32 || HAVE_PACKET_SENDER_PCAP_SENDPACKET
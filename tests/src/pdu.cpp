@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <cstring>
 #include <string>
 #include <stdint.h>
 #include "ip.h"
@@ -79,3 +80,29 @@ TEST_F(PDUTest, TinsCast) {
     EXPECT_THROW(tins_cast<UDP>(*pdu), bad_tins_cast);
 }
 
+
+TEST_F(PDUTest, SerializeIntoVector) {
+    IP ip = IP("192.168.0.1", "192.168.0.2") / TCP(22, 52) / RawPDU("Test");
+    PDU::serialization_type expected = ip.serialize();
+    // Start with a larger, dirty buffer
+    PDU::serialization_type buffer(expected.size() * 2, 0xff);
+    const uint8_t* data = &buffer[0];
+    ip.serialize(buffer);
+    EXPECT_EQ(expected, buffer);
+    EXPECT_EQ(data, &buffer[0]);
+
+    IP small = IP("192.168.0.1", "192.168.0.2") / UDP(22, 52);
+    small.serialize(buffer);
+    EXPECT_EQ(small.serialize(), buffer);
+}
+
+TEST_F(PDUTest, SerializeIntoBuffer) {
+    IP ip = IP("192.168.0.1", "192.168.0.2") / TCP(22, 52) / RawPDU("Test");
+    PDU::serialization_type expected = ip.serialize();
+    uint8_t buffer[128];
+    memset(buffer, 0xff, sizeof(buffer));
+    EXPECT_EQ(expected.size(), ip.serialize_into(buffer, sizeof(buffer)));
+    EXPECT_TRUE(equal(expected.begin(), expected.end(), buffer));
+    EXPECT_EQ(0xff, buffer[expected.size()]);
+    EXPECT_THROW(ip.serialize_into(buffer, expected.size() - 1), serialization_error);
+}
@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "pdu_arena.h"
+#include "ethernetII.h"
+#include "ip.h"
+#include "tcp.h"
+#include "rawpdu.h"
+#include "cxxstd.h"
+#if TINS_IS_CXX11
+    #include <thread>
+#endif // TINS_IS_CXX11
+
+using namespace std;
+using namespace Tins;
+
+class PDUArenaTest : public testing::Test {
+public:
+    static PDU::serialization_type make_packet() {
+        EthernetII eth = EthernetII("00:01:02:03:04:05", "06:07:08:09:0a:0b") / 
+                         IP("192.168.0.1", "10.0.0.1") / TCP(22, 12345) / 
+                         RawPDU("hello world");
+        return eth.serialize();
+    }
+};
+
+TEST_F(PDUArenaTest, ParsedChainIsAllocatedFromArena) {
+    PDU::serialization_type buffer = make_packet();
+    PDUArena arena;
+    EXPECT_EQ(0U, arena.block_count());
+    {
+        PDUArena::Scope scope(arena);
+        EXPECT_EQ(&arena, PDUArena::current());
+        EthernetII* eth = new EthernetII(&buffer[0], buffer.size());
+        EXPECT_EQ(1U, arena.block_count());
+        ASSERT_TRUE(eth->find_pdu<TCP>() != 0);
+        EXPECT_EQ(buffer, eth->serialize());
+        delete eth;
+    }
+    EXPECT_TRUE(PDUArena::current() == 0);
+}
+
+TEST_F(PDUArenaTest, BlocksAreReused) {
+    PDU::serialization_type buffer = make_packet();
+    PDUArena arena(1024);
+    PDUArena::Scope scope(arena);
+    for (size_t i = 0; i < 1000; ++i) {
+        vector<PDU*> pdus;
+        for (size_t j = 0; j < 8; ++j) {
+            pdus.push_back(new EthernetII(&buffer[0], buffer.size()));
+        }
+        for (size_t j = 0; j < pdus.size(); ++j) {
+            delete pdus[j];
+        }
+    }
+    EXPECT_GE(8U, arena.block_count());
+}
+
+TEST_F(PDUArenaTest, ReleasedPDUOutlivesArena) {
+    PDU::serialization_type buffer = make_packet();
+    PDU* ip = 0;
+    {
+        PDUArena arena;
+        PDUArena::Scope scope(arena);
+        EthernetII eth(&buffer[0], buffer.size());
+        ip = eth.release_inner_pdu();
+    }
+    ASSERT_TRUE(ip != 0);
+    EXPECT_EQ(IPv4Address("192.168.0.1"), ip->rfind_pdu<IP>().dst_addr());
+    EXPECT_EQ(22, ip->rfind_pdu<TCP>().dport());
+    EXPECT_EQ(12345, ip->rfind_pdu<TCP>().sport());
+    delete ip;
+}
+
+TEST_F(PDUArenaTest, NestedScopes) {
+    PDUArena outer, inner;
+    {
+        PDUArena::Scope outer_scope(outer);
+        {
+            PDUArena::Scope inner_scope(inner);
+            EXPECT_EQ(&inner, PDUArena::current());
+            {
+                PDUArena::Scope null_scope(0);
+                EXPECT_EQ(&inner, PDUArena::current());
+            }
+        }
+        EXPECT_EQ(&outer, PDUArena::current());
+    }
+    EXPECT_TRUE(PDUArena::current() == 0);
+}
+
+TEST_F(PDUArenaTest, LargeAllocation) {
+    PDUArena arena(256);
+    PDUArena::Scope scope(arena);
+    vector<PDU*> pdus;
+    for (size_t i = 0; i < 16; ++i) {
+        pdus.push_back(new RawPDU(string(100, 'a')));
+        pdus.push_back(new IP("1.2.3.4"));
+    }
+    for (size_t i = 0; i < pdus.size(); ++i) {
+        delete pdus[i];
+    }
+}
+
+TEST_F(PDUArenaTest, CloneOutsideScope) {
+    PDU::serialization_type buffer = make_packet();
+    PDU* cloned = 0;
+    {
+        PDUArena arena;
+        {
+            PDUArena::Scope scope(arena);
+            EthernetII eth(&buffer[0], buffer.size());
+            EthernetII* parsed = new EthernetII(&buffer[0], buffer.size());
+            cloned = parsed->clone();
+            delete parsed;
+        }
+    }
+    ASSERT_TRUE(cloned != 0);
+    EXPECT_EQ(buffer, cloned->serialize());
+    delete cloned;
+}
+
+TEST_F(PDUArenaTest, NothrowNew) {
+    PDUArena arena;
+    PDUArena::Scope scope(arena);
+    IP* ip = new (std::nothrow) IP("1.2.3.4");
+    ASSERT_TRUE(ip != 0);
+    EXPECT_EQ(1U, arena.block_count());
+    EXPECT_EQ("1.2.3.4", ip->dst_addr().to_string());
+    delete ip;
+}
+
+TEST_F(PDUArenaTest, PlacementNew) {
+    PDUArena arena;
+    PDUArena::Scope scope(arena);
+    union {
+        uint8_t data[sizeof(IP)];
+        uint64_t align;
+    } storage;
+    IP* ip = new (storage.data) IP("1.2.3.4");
+    EXPECT_EQ(static_cast<void*>(storage.data), static_cast<void*>(ip));
+    EXPECT_EQ(0U, arena.block_count());
+    ip->~IP();
+}
+
+#if TINS_IS_CXX11
+TEST_F(PDUArenaTest, DeleteOnOtherThreads) {
+    PDU::serialization_type buffer = make_packet();
+    PDUArena arena(1024);
+    for (size_t i = 0; i < 200; ++i) {
+        vector<PDU*> pdus;
+        {
+            PDUArena::Scope scope(arena);
+            for (size_t j = 0; j < 16; ++j) {
+                pdus.push_back(new EthernetII(&buffer[0], buffer.size()));
+            }
+        }
+        // Half of them are deleted here, while the rest are deleted
+        // concurrently by another thread
+        std::thread worker([&]() {
+            for (size_t j = 0; j < pdus.size(); j += 2) {
+                delete pdus[j];
+            }
+        });
+        for (size_t j = 1; j < pdus.size(); j += 2) {
+            delete pdus[j];
+        }
+        worker.join();
+    }
+    // Every block was handed back and reused
+    EXPECT_GE(8U, arena.block_count());
+}
+
+TEST_F(PDUArenaTest, DeleteOnOtherThreadAfterArenaIsDestroyed) {
+    PDU::serialization_type buffer = make_packet();
+    vector<PDU*> pdus;
+    {
+        PDUArena arena(1024);
+        PDUArena::Scope scope(arena);
+        for (size_t i = 0; i < 64; ++i) {
+            pdus.push_back(new EthernetII(&buffer[0], buffer.size()));
+        }
+    }
+    std::thread worker([&]() {
+        for (size_t i = 0; i < pdus.size(); ++i) {
+            EXPECT_EQ(buffer, pdus[i]->serialize());
+            delete pdus[i];
+        }
+    });
+    worker.join();
+}
+#endif // TINS_IS_CXX11
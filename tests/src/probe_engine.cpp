@@ -0,0 +1,182 @@
+#include "config.h"
+
+#ifdef HAVE_PROBE_ENGINE
+
+#include <gtest/gtest.h>
+#include "probe_engine.h"
+#include "ethernetII.h"
+#include "ip.h"
+#include "ipv6.h"
+#include "arp.h"
+#include "tcp.h"
+#include "udp.h"
+#include "icmp.h"
+#include "icmpv6.h"
+#include "rawpdu.h"
+
+using namespace Tins;
+using Internals::probe_key;
+
+class ProbeEngineTest : public testing::Test {
+public:
+    static probe_key make_probe_key(PDU& probe) {
+        probe_key key;
+        EXPECT_TRUE(Internals::make_probe_key(probe, key));
+        return key;
+    }
+
+    static bool make_response_key(uint16_t ether_type, PDU& response, 
+      probe_key& key) 
+    {
+        PDU::serialization_type buffer = response.serialize();
+        return Internals::make_response_key(ether_type, &buffer[0], 
+                                            static_cast<uint32_t>(buffer.size()), 
+                                            key);
+    }
+
+    static IP make_icmp_error(ICMP::Flags type, PDU& probe) {
+        PDU::serialization_type buffer = probe.serialize();
+        return IP("10.0.0.2", "10.9.9.9") / ICMP(type) / 
+               RawPDU(&buffer[0], static_cast<uint32_t>(buffer.size()));
+    }
+};
+
+TEST_F(ProbeEngineTest, TCPResponse) {
+    IP probe = IP("10.0.0.1", "10.0.0.2") / TCP(80, 4000);
+    const probe_key key = make_probe_key(probe);
+    probe_key response_key;
+
+    IP response = IP("10.0.0.2", "10.0.0.1") / TCP(4000, 80);
+    ASSERT_TRUE(make_response_key(0x0800, response, response_key));
+    EXPECT_TRUE(key == response_key);
+    EXPECT_EQ(key.hash(), response_key.hash());
+
+    // Same ports, different address
+    IP other = IP("10.0.0.2", "10.0.0.3") / TCP(4000, 80);
+    ASSERT_TRUE(make_response_key(0x0800, other, response_key));
+    EXPECT_FALSE(key == response_key);
+
+    // UDP using the same ports
+    IP udp = IP("10.0.0.2", "10.0.0.1") / UDP(4000, 80);
+    ASSERT_TRUE(make_response_key(0x0800, udp, response_key));
+    EXPECT_FALSE(key == response_key);
+}
+
+TEST_F(ProbeEngineTest, ICMPErrorContainingProbe) {
+    IP probe = IP("10.0.0.1", "10.0.0.2") / UDP(53, 4000);
+    const probe_key key = make_probe_key(probe);
+    probe_key response_key;
+
+    IP response = make_icmp_error(ICMP::DEST_UNREACHABLE, probe);
+    ASSERT_TRUE(make_response_key(0x0800, response, response_key));
+    EXPECT_TRUE(key == response_key);
+
+    // An ICMP error for some other packet
+    IP other_probe = IP("10.0.0.1", "10.0.0.2") / UDP(54, 4000);
+    IP other = make_icmp_error(ICMP::DEST_UNREACHABLE, other_probe);
+    ASSERT_TRUE(make_response_key(0x0800, other, response_key));
+    EXPECT_FALSE(key == response_key);
+}
+
+TEST_F(ProbeEngineTest, ICMPEcho) {
+    IP probe = IP("10.0.0.1", "10.0.0.2") / ICMP(ICMP::ECHO_REQUEST);
+    probe.rfind_pdu<ICMP>().id(0x1234);
+    probe.rfind_pdu<ICMP>().sequence(7);
+    const probe_key key = make_probe_key(probe);
+    probe_key response_key;
+
+    IP reply = IP("10.0.0.2", "10.0.0.1") / ICMP(ICMP::ECHO_REPLY);
+    reply.rfind_pdu<ICMP>().id(0x1234);
+    reply.rfind_pdu<ICMP>().sequence(7);
+    ASSERT_TRUE(make_response_key(0x0800, reply, response_key));
+    EXPECT_TRUE(key == response_key);
+
+    // Routers report the probe on TTL exceeded errors
+    IP exceeded = make_icmp_error(ICMP::TIME_EXCEEDED, probe);
+    ASSERT_TRUE(make_response_key(0x0800, exceeded, response_key));
+    EXPECT_TRUE(key == response_key);
+
+    reply.rfind_pdu<ICMP>().sequence(8);
+    ASSERT_TRUE(make_response_key(0x0800, reply, response_key));
+    EXPECT_FALSE(key == response_key);
+
+    // Timestamp replies don't answer echo requests
+    reply.rfind_pdu<ICMP>().type(ICMP::TIMESTAMP_REPLY);
+    reply.rfind_pdu<ICMP>().sequence(7);
+    ASSERT_TRUE(make_response_key(0x0800, reply, response_key));
+    EXPECT_FALSE(key == response_key);
+
+    // Requests are not responses
+    IP request = IP("10.0.0.2", "10.0.0.1") / ICMP(ICMP::ECHO_REQUEST);
+    EXPECT_FALSE(make_response_key(0x0800, request, response_key));
+}
+
+TEST_F(ProbeEngineTest, IPv6) {
+    IPv6 probe = IPv6("fe80::1", "fe80::2") / TCP(22, 5000);
+    probe_key key = make_probe_key(probe);
+    probe_key response_key;
+
+    IPv6 response = IPv6("fe80::2", "fe80::1") / TCP(5000, 22);
+    ASSERT_TRUE(make_response_key(0x86dd, response, response_key));
+    EXPECT_TRUE(key == response_key);
+
+    IPv6 echo = IPv6("fe80::1", "fe80::2") / ICMPv6(ICMPv6::ECHO_REQUEST);
+    echo.rfind_pdu<ICMPv6>().identifier(99);
+    echo.rfind_pdu<ICMPv6>().sequence(3);
+    key = make_probe_key(echo);
+
+    IPv6 reply = IPv6("fe80::2", "fe80::1") / ICMPv6(ICMPv6::ECHO_REPLY);
+    reply.rfind_pdu<ICMPv6>().identifier(99);
+    reply.rfind_pdu<ICMPv6>().sequence(3);
+    ASSERT_TRUE(make_response_key(0x86dd, reply, response_key));
+    EXPECT_TRUE(key == response_key);
+
+    PDU::serialization_type buffer = echo.serialize();
+    IPv6 exceeded = IPv6("fe80::1", "fe80::9") / ICMPv6(ICMPv6::TIME_EXCEEDED) /
+                    RawPDU(&buffer[0], static_cast<uint32_t>(buffer.size()));
+    ASSERT_TRUE(make_response_key(0x86dd, exceeded, response_key));
+    EXPECT_TRUE(key == response_key);
+}
+
+TEST_F(ProbeEngineTest, ARP) {
+    EthernetII probe = ARP::make_arp_request("10.0.0.2", "10.0.0.1", 
+                                             "00:01:02:03:04:05");
+    const probe_key key = make_probe_key(probe);
+    probe_key response_key;
+
+    EthernetII reply = ARP::make_arp_reply("10.0.0.1", "10.0.0.2", 
+                                           "00:01:02:03:04:05", 
+                                           "00:01:02:03:04:06");
+    ASSERT_TRUE(make_response_key(0x0806, reply.rfind_pdu<ARP>(), response_key));
+    EXPECT_TRUE(key == response_key);
+
+    // Requests are not responses
+    EXPECT_FALSE(make_response_key(0x0806, probe.rfind_pdu<ARP>(), response_key));
+}
+
+TEST_F(ProbeEngineTest, ProbesWithoutKey) {
+    probe_key key;
+    IP raw = IP("10.0.0.1", "10.0.0.2") / RawPDU("payload");
+    EXPECT_FALSE(Internals::make_probe_key(raw, key));
+    IP reply = IP("10.0.0.1", "10.0.0.2") / ICMP(ICMP::ECHO_REPLY);
+    EXPECT_FALSE(Internals::make_probe_key(reply, key));
+    RawPDU payload("payload");
+    EXPECT_FALSE(Internals::make_probe_key(payload, key));
+}
+
+TEST_F(ProbeEngineTest, MalformedResponses) {
+    probe_key key;
+    IP response = IP("10.0.0.2", "10.0.0.1") / TCP(4000, 80);
+    PDU::serialization_type buffer = response.serialize();
+    for (uint32_t size = 0; size < 24; ++size) {
+        EXPECT_FALSE(Internals::make_response_key(0x0800, &buffer[0], size, key));
+    }
+    EXPECT_FALSE(Internals::make_response_key(0x86dd, &buffer[0], 
+                                              static_cast<uint32_t>(buffer.size()), 
+                                              key));
+    // Non first fragments don't contain the transport header
+    response.fragment_offset(10);
+    EXPECT_FALSE(make_response_key(0x0800, response, key));
+}
+
+#endif // HAVE_PROBE_ENGINE
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "rawpdu.h"
+#include "ethernetII.h"
+#include "ip.h"
+#include "tcp.h"
+#include "udp.h"
+
+using namespace std;
+using namespace Tins;
+
+class RawPDUTest : public testing::Test {
+public:
+    static PDU::serialization_type make_packet() {
+        EthernetII eth = EthernetII("00:01:02:03:04:05", "06:07:08:09:0a:0b") / 
+                         IP("192.168.0.1", "10.0.0.1") / TCP(22, 12345) / 
+                         RawPDU("hello world");
+        return eth.serialize();
+    }
+};
+
+TEST_F(RawPDUTest, ConstructorCopiesPayload) {
+    const uint8_t data[] = { 1, 2, 3, 4 };
+    RawPDU raw(data, sizeof(data));
+    EXPECT_FALSE(raw.borrows_payload());
+    EXPECT_NE(data, raw.payload_data());
+    EXPECT_EQ(RawPDU::payload_type(data, data + sizeof(data)), raw.payload());
+}
+
+TEST_F(RawPDUTest, BorrowedPayload) {
+    PDU::serialization_type buffer = make_packet();
+    BorrowedPayloads borrowed;
+    BorrowedPayloads::Scope scope(borrowed);
+    EthernetII eth(&buffer[0], buffer.size());
+    const RawPDU& raw = eth.rfind_pdu<RawPDU>();
+    EXPECT_TRUE(raw.borrows_payload());
+    EXPECT_EQ(1U, borrowed.size());
+    EXPECT_EQ(&buffer[buffer.size() - 11], raw.payload_data());
+    EXPECT_EQ(11U, raw.payload_size());
+    EXPECT_EQ(buffer, eth.serialize());
+}
+
+TEST_F(RawPDUTest, BorrowedPayloadCopiedOnAccess) {
+    PDU::serialization_type buffer = make_packet();
+    BorrowedPayloads borrowed;
+    BorrowedPayloads::Scope scope(borrowed);
+    EthernetII eth(&buffer[0], buffer.size());
+    RawPDU& raw = eth.rfind_pdu<RawPDU>();
+    raw.payload()[0] = 'j';
+    EXPECT_FALSE(raw.borrows_payload());
+    EXPECT_EQ(0U, borrowed.size());
+    EXPECT_EQ('h', buffer[buffer.size() - 11]);
+    EXPECT_EQ(string("jello world"), string(raw.payload().begin(), raw.payload().end()));
+}
+
+TEST_F(RawPDUTest, ReleaseCopiesPayloads) {
+    PDU::serialization_type buffer = make_packet();
+    BorrowedPayloads borrowed;
+    PDU* pdu = 0;
+    {
+        BorrowedPayloads::Scope scope(borrowed);
+        pdu = new EthernetII(&buffer[0], buffer.size());
+        EthernetII other(&buffer[0], buffer.size());
+        EXPECT_EQ(2U, borrowed.size());
+    }
+    EXPECT_EQ(1U, borrowed.size());
+    borrowed.release();
+    EXPECT_EQ(0U, borrowed.size());
+    PDU::serialization_type expected = buffer;
+    fill(buffer.begin(), buffer.end(), 0);
+    const RawPDU& raw = pdu->rfind_pdu<RawPDU>();
+    EXPECT_FALSE(raw.borrows_payload());
+    EXPECT_EQ(string("hello world"), string(raw.payload().begin(), raw.payload().end()));
+    EXPECT_EQ(expected, pdu->serialize());
+    delete pdu;
+}
+
+TEST_F(RawPDUTest, CloneOwnsPayload) {
+    PDU::serialization_type buffer = make_packet();
+    BorrowedPayloads borrowed;
+    BorrowedPayloads::Scope scope(borrowed);
+    EthernetII eth(&buffer[0], buffer.size());
+    EthernetII copy(eth);
+    EXPECT_FALSE(copy.rfind_pdu<RawPDU>().borrows_payload());
+    EXPECT_EQ(1U, borrowed.size());
+    EXPECT_EQ(eth.serialize(), copy.serialize());
+}
+
+TEST_F(RawPDUTest, To) {
+    UDP udp(53, 1234);
+    udp.sport(4321);
+    PDU::serialization_type buffer = udp.serialize();
+    BorrowedPayloads borrowed;
+    BorrowedPayloads::Scope scope(borrowed);
+    RawPDU raw(&buffer[0], buffer.size());
+    EXPECT_TRUE(raw.borrows_payload());
+    UDP parsed = raw.to<UDP>();
+    EXPECT_EQ(53, parsed.dport());
+    EXPECT_EQ(4321, parsed.sport());
+}
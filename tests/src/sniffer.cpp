@@ -0,0 +1,198 @@
+#include "config.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <stdint.h>
+#include "sniffer.h"
+#include "packet_writer.h"
+#include "packet.h"
+#include "ethernetII.h"
+#include "ip.h"
+#include "udp.h"
+#include "rawpdu.h"
+#include "exceptions.h"
+#ifdef HAVE_PACKET_RING
+    #include <ctime>
+    #include "tests/loopback.h"
+#endif // HAVE_PACKET_RING
+
+using namespace std;
+using namespace Tins;
+
+class SnifferTest : public testing::Test {
+public:
+    static const string file_name;
+    static const uint16_t packet_count = 10;
+
+    SnifferTest() {
+        PacketWriter writer(file_name, DataLinkType<EthernetII>());
+        for(uint16_t i = 0; i < packet_count; ++i) {
+            EthernetII eth = make_packet(i);
+            writer.write(eth);
+        }
+    }
+
+    ~SnifferTest() {
+        remove(file_name.c_str());
+    }
+
+    static EthernetII make_packet(uint16_t index) {
+        return EthernetII() / IP("1.2.3.4", "4.3.2.1") / UDP(index, 53) / 
+               RawPDU("payload");
+    }
+
+    static uint16_t packet_index(const PDU& pdu) {
+        return pdu.rfind_pdu<UDP>().dport();
+    }
+};
+
+const string SnifferTest::file_name = "sniffer_test.pcap";
+const uint16_t SnifferTest::packet_count;
+
+struct collect_ports {
+    collect_ports(vector<uint16_t>& ports, size_t stop_after = 0) 
+    : ports(&ports), stop_after(stop_after) { }
+
+    bool operator()(PDU& pdu) {
+        ports->push_back(pdu.rfind_pdu<UDP>().dport());
+        return stop_after == 0 || ports->size() < stop_after;
+    }
+
+    vector<uint16_t>* ports;
+    size_t stop_after;
+};
+
+TEST_F(SnifferTest, NextPackets) {
+    FileSniffer sniffer(file_name);
+    vector<Packet> packets;
+    EXPECT_EQ(4U, sniffer.next_packets(packets, 4));
+    ASSERT_EQ(4U, packets.size());
+    // New packets are appended to the ones already in the vector
+    EXPECT_EQ(4U, sniffer.next_packets(packets, 4));
+    EXPECT_EQ(2U, sniffer.next_packets(packets, 4));
+    EXPECT_EQ(0U, sniffer.next_packets(packets, 4));
+    ASSERT_EQ(packet_count, packets.size());
+    for(uint16_t i = 0; i < packet_count; ++i) {
+        EXPECT_EQ(i, packet_index(*packets[i].pdu()));
+    }
+}
+
+TEST_F(SnifferTest, NextPacketsZeroPackets) {
+    FileSniffer sniffer(file_name);
+    vector<Packet> packets;
+    EXPECT_EQ(0U, sniffer.next_packets(packets, 0));
+    EXPECT_EQ(packet_count, sniffer.next_packets(packets, packet_count));
+}
+
+TEST_F(SnifferTest, SniffLoopBatch) {
+    FileSniffer sniffer(file_name);
+    vector<uint16_t> ports;
+    sniffer.sniff_loop_batch(collect_ports(ports), 3);
+    ASSERT_EQ(packet_count, ports.size());
+    for(uint16_t i = 0; i < packet_count; ++i) {
+        EXPECT_EQ(i, ports[i]);
+    }
+}
+
+TEST_F(SnifferTest, SniffLoopBatchMaxPackets) {
+    FileSniffer sniffer(file_name);
+    vector<uint16_t> ports;
+    sniffer.sniff_loop_batch(collect_ports(ports), 4, 6);
+    EXPECT_EQ(6U, ports.size());
+    // The packets which were not read are still available
+    vector<Packet> packets;
+    EXPECT_EQ(4U, sniffer.next_packets(packets, packet_count));
+    EXPECT_EQ(6, packet_index(*packets[0].pdu()));
+}
+
+TEST_F(SnifferTest, SniffLoopBatchStop) {
+    FileSniffer sniffer(file_name);
+    vector<uint16_t> ports;
+    sniffer.sniff_loop_batch(collect_ports(ports, 5), 4);
+    EXPECT_EQ(5U, ports.size());
+}
+
+struct throw_at_port {
+    throw_at_port(vector<uint16_t>& ports, uint16_t port) 
+    : ports(&ports), port(port) { }
+
+    bool operator()(PDU& pdu) {
+        const uint16_t current = pdu.rfind_pdu<UDP>().dport();
+        if(current == port) {
+            throw std::runtime_error("stop");
+        }
+        ports->push_back(current);
+        return true;
+    }
+
+    vector<uint16_t>* ports;
+    uint16_t port;
+};
+
+TEST_F(SnifferTest, SniffLoopBatchRethrows) {
+    FileSniffer sniffer(file_name);
+    vector<uint16_t> ports;
+    EXPECT_THROW(sniffer.sniff_loop_batch(throw_at_port(ports, 5), 4), 
+                 std::runtime_error);
+    EXPECT_EQ(5U, ports.size());
+    // The rest of the batch is discarded
+    vector<Packet> packets;
+    EXPECT_EQ(2U, sniffer.next_packets(packets, packet_count));
+    EXPECT_EQ(8, packet_index(*packets[0].pdu()));
+}
+
+TEST_F(SnifferTest, BorrowedPayloadsOutliveSniffer) {
+    vector<Packet> packets;
+    {
+        FileSniffer sniffer(file_name);
+        sniffer.set_borrow_payloads(true);
+        for(uint16_t i = 0; i < packet_count; ++i) {
+            packets.push_back(sniffer.next_packet());
+        }
+    }
+    ASSERT_EQ(packet_count, packets.size());
+    for(uint16_t i = 0; i < packet_count; ++i) {
+        const RawPDU& raw = packets[i].pdu()->rfind_pdu<RawPDU>();
+        EXPECT_EQ("payload", string(raw.payload().begin(), raw.payload().end()));
+    }
+}
+
+#ifdef HAVE_PACKET_RING
+// This captures on the loopback interface. See tests/loopback.h.
+TEST_F(SnifferTest, BorrowedPayloadsOutlivePacketRingSniffer) {
+    const uint16_t port = 47815;
+    const string payload = "borrowed from the ring";
+    SnifferConfiguration config;
+    config.set_packet_ring(true);
+    config.set_timeout(10);
+    Sniffer* sniffer;
+    try {
+        sniffer = new Sniffer("lo", config);
+    }
+    catch (socket_open_error&) {
+        skip_unprivileged_test();
+        return;
+    }
+    sniffer->set_borrow_payloads(true);
+    send_loopback_datagrams(port, 1, payload);
+
+    // Only the last packet read borrows its payload from the ring
+    Packet packet;
+    const time_t deadline = time(0) + 5;
+    const UDP* udp = 0;
+    while (!udp && time(0) < deadline) {
+        packet = sniffer->next_packet();
+        udp = packet ? packet.pdu()->find_pdu<UDP>() : 0;
+        if (udp && udp->dport() != port) {
+            udp = 0;
+        }
+    }
+    // The ring is unmapped here, so the payload must have been copied
+    delete sniffer;
+    ASSERT_TRUE(udp != 0);
+    const RawPDU& raw = udp->rfind_pdu<RawPDU>();
+    EXPECT_EQ(payload, string(raw.payload().begin(), raw.payload().end()));
+}
+#endif // HAVE_PACKET_RING
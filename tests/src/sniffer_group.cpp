@@ -0,0 +1,152 @@
+#include "config.h"
+
+#if defined(HAVE_PACKET_FANOUT) && defined(HAVE_PACKET_RING)
+
+#include <gtest/gtest.h>
+#include <ctime>
+#include <stdexcept>
+#include "sniffer_group.h"
+#include "udp.h"
+#include "cxxstd.h"
+#include "exceptions.h"
+#include "tests/loopback.h"
+#if TINS_IS_CXX11
+    #include <thread>
+    #include <chrono>
+    #include <atomic>
+#endif // TINS_IS_CXX11
+
+using namespace Tins;
+
+// These tests capture on the loopback interface. See tests/loopback.h.
+class SnifferGroupTest : public testing::Test {
+public:
+    static const uint16_t port = 47814;
+
+    static SnifferGroup* make_group(size_t size, uint16_t group_id = 0) {
+        SnifferConfiguration config;
+        config.set_packet_ring(true);
+        config.set_timeout(10);
+        try {
+            return new SnifferGroup("lo", size, SnifferGroup::HASH, config, 
+                                    group_id);
+        }
+        catch (socket_open_error&) {
+            skip_unprivileged_test();
+            return 0;
+        }
+    }
+
+    static void send_datagrams(size_t count) {
+        send_loopback_datagrams(port, count, "sniffer group test");
+    }
+};
+
+const uint16_t SnifferGroupTest::port;
+
+TEST_F(SnifferGroupTest, DefaultGroupIdsAreUnique) {
+    SnifferGroup* group1 = make_group(2);
+    if (!group1) {
+        return;
+    }
+    // Before, both groups used an identifier derived from the process 
+    // id, so the second one failed to join a group of a different type
+    SnifferGroup* group2 = make_group(2);
+    ASSERT_TRUE(group2 != 0);
+    EXPECT_NE(0, group1->group_id());
+    EXPECT_NE(0, group2->group_id());
+    EXPECT_NE(group1->group_id(), group2->group_id());
+    EXPECT_EQ(2U, group1->size());
+    EXPECT_EQ(2U, group2->size());
+    delete group2;
+    delete group1;
+}
+
+TEST_F(SnifferGroupTest, ExplicitGroupId) {
+    SnifferGroup* group = make_group(2, 0x4a21);
+    if (!group) {
+        return;
+    }
+    EXPECT_EQ(0x4a21, group->group_id());
+    delete group;
+}
+
+#if TINS_IS_CXX11
+
+struct throw_on_datagram {
+    bool operator()(PDU& pdu) {
+        const UDP* udp = pdu.find_pdu<UDP>();
+        if (udp && udp->dport() == SnifferGroupTest::port) {
+            throw std::runtime_error("stop");
+        }
+        return true;
+    }
+};
+
+TEST_F(SnifferGroupTest, SniffLoopStopsEveryMemberWhenOneThrows) {
+    SnifferGroup* group = make_group(4);
+    if (!group) {
+        return;
+    }
+    std::thread sender([]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        send_datagrams(1);
+    });
+    // Only one of the sniffers sees the datagram. If the rest were not 
+    // stopped, this would never return.
+    EXPECT_THROW(group->sniff_loop(throw_on_datagram()), std::runtime_error);
+    sender.join();
+    delete group;
+}
+
+TEST_F(SnifferGroupTest, SniffLoopStopsEveryMemberWhenOneReturns) {
+    SnifferGroup* group = make_group(4);
+    if (!group) {
+        return;
+    }
+    std::thread sender([]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        send_datagrams(1);
+    });
+    group->sniff_loop([](PDU& pdu) {
+        const UDP* udp = pdu.find_pdu<UDP>();
+        return !udp || udp->dport() != SnifferGroupTest::port;
+    });
+    sender.join();
+    delete group;
+}
+
+TEST_F(SnifferGroupTest, SniffLoopCanBeRunAgain) {
+    SnifferGroup* group = make_group(2);
+    if (!group) {
+        return;
+    }
+    for (size_t round = 0; round < 2; ++round) {
+        std::atomic<bool> done(false);
+        std::thread sender([&]() {
+            while (!done) {
+                send_datagrams(1);
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        });
+        std::atomic<size_t> seen(0);
+        // A sniffer whose loop already ended must not be left stopped, 
+        // or the next loop would return before seeing anything
+        group->sniff_loop([&](PDU& pdu) {
+            const UDP* udp = pdu.find_pdu<UDP>();
+            if (udp && udp->dport() == SnifferGroupTest::port) {
+                ++seen;
+                return false;
+            }
+            return true;
+        });
+        done = true;
+        sender.join();
+        EXPECT_LT(0U, seen.load()) << "round " << round;
+    }
+    delete group;
+}
+
+#endif // TINS_IS_CXX11
+
+#endif // HAVE_PACKET_FANOUT && HAVE_PACKET_RING
@@ -6,6 +6,7 @@
 #include "tcp.h"
 #include "ip.h"
 #include "ethernetII.h"
+#include "rawpdu.h"
 #include "utils.h"
 
 using namespace std;
@@ -282,3 +283,104 @@ TEST_F(TCPTest, RemoveOption) {
     PDU::serialization_type new_buffer = tcp.serialize();
     EXPECT_EQ(old_buffer, new_buffer);
 }
+
+TEST_F(TCPTest, IncrementalChecksum) {
+    IP pkt1 = IP("192.168.0.1", "192.168.0.100") / TCP(80, 40000) / 
+                RawPDU(string(1459, 'A'));
+    PDU::serialization_type buffer = pkt1.serialize();
+
+    TrustedChecksums::Scope scope;
+    IP pkt2(&buffer[0], (uint32_t)buffer.size());
+    pkt2.src_addr("10.0.0.1");
+    pkt2.ttl(12);
+    pkt2.rfind_pdu<TCP>().sport(1234);
+    pkt2.rfind_pdu<TCP>().seq(0x12345678);
+    pkt2.rfind_pdu<TCP>().mss(1400);
+    PDU::serialization_type incremental = pkt2.serialize();
+
+    // Copies always sum the whole segment again
+    IP pkt3(pkt2);
+    PDU::serialization_type full = pkt3.serialize();
+    EXPECT_EQ(full, incremental);
+}
+
+TEST_F(TCPTest, IncrementalChecksumModifiedPayload) {
+    IP pkt1 = IP("192.168.0.1", "192.168.0.100") / TCP(80, 40000) / 
+                RawPDU(string(100, 'A'));
+    PDU::serialization_type buffer = pkt1.serialize();
+
+    TrustedChecksums::Scope scope;
+    IP pkt2(&buffer[0], (uint32_t)buffer.size());
+    pkt2.rfind_pdu<TCP>().sport(1234);
+    pkt2.rfind_pdu<RawPDU>().payload()[10] = 'B';
+    PDU::serialization_type serialized = pkt2.serialize();
+
+    IP pkt3(pkt2);
+    EXPECT_EQ(pkt3.serialize(), serialized);
+}
+
+TEST_F(TCPTest, IncrementalChecksumMovedPayload) {
+    IP pkt1 = IP("192.168.0.1", "192.168.0.100") / TCP(80, 40000) / 
+                RawPDU(string(100, 'A'));
+    PDU::serialization_type buffer = pkt1.serialize();
+
+    TrustedChecksums::Scope scope;
+    IP pkt2(&buffer[0], (uint32_t)buffer.size());
+    IP pkt3 = IP("10.0.0.1", "10.0.0.2") / TCP(22, 1234);
+    pkt3.rfind_pdu<TCP>().inner_pdu(pkt2.rfind_pdu<TCP>().release_inner_pdu());
+    PDU::serialization_type serialized = pkt3.serialize();
+
+    IP pkt4(pkt3);
+    EXPECT_EQ(pkt4.serialize(), serialized);
+}
+
+TEST_F(TCPTest, ParsedChecksumIsNotTrustedByDefault) {
+    IP pkt1 = IP("192.168.0.1", "192.168.0.100") / TCP(80, 40000) / 
+                RawPDU(string(100, 'A'));
+    PDU::serialization_type buffer = pkt1.serialize();
+    // Corrupt the checksum
+    buffer[20 + 16] ^= 0x5a;
+
+    IP pkt2(&buffer[0], (uint32_t)buffer.size());
+    pkt2.rfind_pdu<TCP>().sport(1234);
+    PDU::serialization_type serialized = pkt2.serialize();
+
+    IP pkt3(pkt2);
+    EXPECT_EQ(pkt3.serialize(), serialized);
+}
+
+TEST_F(TCPTest, TrustedChecksumKeepsInvalidChecksum) {
+    IP pkt1 = IP("192.168.0.1", "192.168.0.100") / TCP(80, 40000) / 
+                RawPDU(string(100, 'A'));
+    PDU::serialization_type buffer = pkt1.serialize();
+    buffer[20 + 16] ^= 0x5a;
+
+    TrustedChecksums::Scope scope;
+    IP pkt2(&buffer[0], (uint32_t)buffer.size());
+    pkt2.rfind_pdu<TCP>().sport(1234);
+    PDU::serialization_type serialized = pkt2.serialize();
+
+    IP pkt3(pkt2);
+    EXPECT_NE(pkt3.serialize(), serialized);
+}
+
+TEST_F(TCPTest, IncrementalChecksumSourceRoute) {
+    // The checksum covers the final destination...
+    IP pkt1 = IP("10.0.0.9", "192.168.0.1") / TCP(80, 40000) / 
+                RawPDU(string(100, 'A'));
+    IP::lsrr_type route(4);
+    route.routes.push_back("10.0.0.9");
+    pkt1.lsrr(route);
+    PDU::serialization_type buffer = pkt1.serialize();
+    // ...while the header contains the next hop
+    const uint8_t next_hop[] = { 192, 168, 0, 100 };
+    std::copy(next_hop, next_hop + sizeof(next_hop), buffer.begin() + 16);
+
+    TrustedChecksums::Scope scope;
+    IP pkt2(&buffer[0], (uint32_t)buffer.size());
+    pkt2.rfind_pdu<TCP>().sport(1234);
+    PDU::serialization_type serialized = pkt2.serialize();
+
+    IP pkt3(pkt2);
+    EXPECT_EQ(pkt3.serialize(), serialized);
+}
@@ -5,6 +5,8 @@
 #include "tcp_stream.h"
 #include "tcp.h"
 #include "ethernetII.h"
+#include "ipv6.h"
+#include "rawpdu.h"
 #include "utils.h"
 
 using namespace Tins;
@@ -180,3 +182,371 @@ TEST_F(TCPStreamTest, FollowOverlappedStreams5) {
     follower.follow_streams(overlapped_packets5, overlapped_packets5 + 8, data_handle, &TCPStreamTest::overlapped_end_handle);
     EXPECT_TRUE(processed_stream);
 }
+
+std::string client_data, server_data;
+
+void span_handle(TCPStream&, TCPStream::Direction direction, 
+  const uint8_t *data, size_t size) 
+{
+    std::string &output = (direction == TCPStream::CLIENT_TO_SERVER) ? 
+                          client_data : server_data;
+    output.append(data, data + size);
+}
+
+void span_end_handle(TCPStream& session) {
+    TCPStreamTest::processed_stream = true;
+    EXPECT_TRUE(session.client_payload().empty());
+    EXPECT_TRUE(session.server_payload().empty());
+}
+
+TEST_F(TCPStreamTest, FollowStreamData) {
+    TCPStreamFollower follower;
+    for(index = 0; index < (sizeof(indexes) / sizeof(indexes[0])); index++) {
+        std::vector<EthernetII> pdus;
+        for(size_t i = 0; i < num_packets; ++i)
+            pdus.push_back(packets[indexes[index][i]]);
+        processed_stream = false;
+        client_data.clear();
+        server_data.clear();
+        follower.follow_stream_data(pdus.begin(), pdus.end(), span_handle, 
+                                    span_end_handle);
+        EXPECT_TRUE(processed_stream);
+        EXPECT_EQ(payload, client_data) << "Payload differs for index " << index;
+        EXPECT_TRUE(server_data.empty());
+    }
+}
+
+TEST_F(TCPStreamTest, FollowOverlappedStreamData) {
+    TCPStreamFollower follower;
+    processed_stream = false;
+    client_data.clear();
+    follower.follow_stream_data(overlapped_packets1, overlapped_packets1 + 10, 
+                                span_handle, span_end_handle);
+    EXPECT_TRUE(processed_stream);
+    EXPECT_EQ("TEST1234567890", client_data);
+}
+
+std::vector<TCPStream::StreamInfo> removed_streams;
+
+void removed_stream_handle(TCPStream& session) {
+    removed_streams.push_back(session.stream_info());
+}
+
+Packet make_packet(uint16_t client_port, uint8_t flags, int seconds, 
+  bool from_server = false) 
+{
+    TCP tcp(80, client_port);
+    IP ip("10.0.0.1", "10.0.0.2");
+    if(from_server) {
+        tcp = TCP(client_port, 80);
+        ip = IP("10.0.0.2", "10.0.0.1");
+    }
+    tcp.flags(flags);
+    EthernetII eth = EthernetII() / ip / tcp;
+    timeval tv;
+    tv.tv_sec = seconds;
+    tv.tv_usec = 0;
+    return Packet(&eth, tv);
+}
+
+Packet make_packet_v6(uint16_t client_port, uint8_t flags, uint32_t seq, 
+  const std::string &payload, bool from_server = false) 
+{
+    TCP tcp(80, client_port);
+    IPv6 ip("fe80::2", "fe80::1");
+    if(from_server) {
+        tcp = TCP(client_port, 80);
+        ip = IPv6("fe80::1", "fe80::2");
+    }
+    tcp.flags(flags);
+    tcp.seq(seq);
+    EthernetII eth = EthernetII() / ip / tcp;
+    if(!payload.empty())
+        eth /= RawPDU(payload);
+    timeval tv;
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    return Packet(&eth, tv);
+}
+
+void v6_end_handle(TCPStream& session) {
+    TCPStreamTest::processed_stream = true;
+    const TCPStream::StreamInfo &info = session.stream_info();
+    EXPECT_TRUE(info.is_v6);
+    EXPECT_EQ(IPv6Address("fe80::1"), info.client_addr_v6);
+    EXPECT_EQ(IPv6Address("fe80::2"), info.server_addr_v6);
+    EXPECT_EQ(1000, info.client_port);
+    EXPECT_EQ(80, info.server_port);
+    std::string client(session.client_payload().begin(), session.client_payload().end());
+    std::string server(session.server_payload().begin(), session.server_payload().end());
+    EXPECT_EQ("hello world", client);
+    EXPECT_EQ("hi", server);
+}
+
+TEST_F(TCPStreamTest, FollowIPv6Streams) {
+    TCPStreamFollower follower;
+    std::vector<Packet> packets;
+    packets.push_back(make_packet_v6(1000, TCP::SYN, 100, ""));
+    packets.push_back(make_packet_v6(1000, TCP::SYN | TCP::ACK, 500, "", true));
+    packets.back().pdu()->rfind_pdu<TCP>().ack_seq(101);
+    // Out of order
+    packets.push_back(make_packet_v6(1000, TCP::ACK, 107, "world"));
+    packets.push_back(make_packet_v6(1000, TCP::ACK, 101, "hello "));
+    packets.push_back(make_packet_v6(1000, TCP::ACK, 501, "hi", true));
+    packets.push_back(make_packet_v6(1000, TCP::FIN | TCP::ACK, 112, ""));
+    processed_stream = false;
+    follower.follow_streams(packets.begin(), packets.end(), data_handle, 
+                            v6_end_handle);
+    EXPECT_TRUE(processed_stream);
+    EXPECT_EQ(0U, follower.active_sessions());
+    EXPECT_EQ(1U, follower.stats().sessions_created);
+}
+
+TEST_F(TCPStreamTest, MaxSessionsMixedFamilies) {
+    TCPStreamFollower follower;
+    follower.max_sessions(2);
+    removed_streams.clear();
+    std::vector<Packet> packets;
+    packets.push_back(make_packet(1000, TCP::SYN, 1));
+    packets.push_back(make_packet_v6(1000, TCP::SYN, 0, ""));
+    packets.push_back(make_packet(1000, TCP::ACK, 2));
+    packets.push_back(make_packet(1001, TCP::SYN, 3));
+    follower.follow_streams(packets.begin(), packets.end(), data_handle, 
+                            removed_stream_handle);
+    EXPECT_EQ(2U, follower.active_sessions());
+    ASSERT_EQ(1U, removed_streams.size());
+    EXPECT_TRUE(removed_streams[0].is_v6);
+}
+
+TEST_F(TCPStreamTest, IdleTimeout) {
+    TCPStreamFollower follower;
+    follower.idle_timeout(10);
+    removed_streams.clear();
+    std::vector<Packet> packets;
+    packets.push_back(make_packet(1000, TCP::SYN, 100));
+    packets.push_back(make_packet(1001, TCP::SYN, 105));
+    packets.push_back(make_packet(1001, TCP::ACK, 109));
+    packets.push_back(make_packet(1002, TCP::SYN, 112));
+    follower.follow_streams(packets.begin(), packets.end(), data_handle, 
+                            removed_stream_handle);
+    EXPECT_EQ(2U, follower.active_sessions());
+    ASSERT_EQ(1U, removed_streams.size());
+    EXPECT_EQ(1000, removed_streams[0].client_port);
+    EXPECT_EQ(3U, follower.stats().sessions_created);
+    EXPECT_EQ(1U, follower.stats().timeout_evictions);
+    EXPECT_EQ(0U, follower.stats().capacity_evictions);
+
+    packets.clear();
+    packets.push_back(make_packet(1003, TCP::SYN, 125));
+    follower.follow_streams(packets.begin(), packets.end(), data_handle, 
+                            removed_stream_handle);
+    EXPECT_EQ(1U, follower.active_sessions());
+    EXPECT_EQ(3U, follower.stats().timeout_evictions);
+}
+
+TEST_F(TCPStreamTest, MaxSessions) {
+    TCPStreamFollower follower;
+    follower.max_sessions(2);
+    removed_streams.clear();
+    std::vector<Packet> packets;
+    packets.push_back(make_packet(1000, TCP::SYN, 1));
+    packets.push_back(make_packet(1001, TCP::SYN, 2));
+    // Session 1000 is now the most recently seen one
+    packets.push_back(make_packet(1000, TCP::ACK, 3));
+    packets.push_back(make_packet(1002, TCP::SYN, 4));
+    follower.follow_streams(packets.begin(), packets.end(), data_handle, 
+                            removed_stream_handle);
+    EXPECT_EQ(2U, follower.active_sessions());
+    ASSERT_EQ(1U, removed_streams.size());
+    EXPECT_EQ(1001, removed_streams[0].client_port);
+    EXPECT_EQ(1U, follower.stats().capacity_evictions);
+}
+
+Packet make_timed_packet(uint8_t flags, uint32_t seq, uint32_t ack, 
+  const std::string &payload, bool from_server, uint64_t microseconds) 
+{
+    TCP tcp(80, 1000);
+    IP ip("10.0.0.1", "10.0.0.2");
+    if(from_server) {
+        tcp = TCP(1000, 80);
+        ip = IP("10.0.0.2", "10.0.0.1");
+    }
+    tcp.flags(flags);
+    tcp.seq(seq);
+    tcp.ack_seq(ack);
+    EthernetII eth = EthernetII() / ip / tcp;
+    if(!payload.empty())
+        eth /= RawPDU(payload);
+    timeval tv;
+    tv.tv_sec = static_cast<long>(microseconds / 1000000);
+    tv.tv_usec = static_cast<long>(microseconds % 1000000);
+    return Packet(&eth, tv);
+}
+
+struct stream_copier {
+    stream_copier(std::vector<TCPStream> &streams) : streams(&streams) { }
+
+    void operator()(TCPStream &stream) const {
+        streams->push_back(stream);
+    }
+
+    std::vector<TCPStream> *streams;
+};
+
+TEST_F(TCPStreamTest, StreamTimesAndCounters) {
+    std::vector<Packet> packets;
+    packets.push_back(make_timed_packet(TCP::SYN, 100, 0, "", false, 1000000));
+    packets.push_back(make_timed_packet(TCP::SYN, 100, 0, "", false, 1500000));
+    packets.push_back(make_timed_packet(TCP::SYN | TCP::ACK, 500, 101, "", true, 1520000));
+    packets.push_back(make_timed_packet(TCP::ACK, 101, 501, "", false, 1530000));
+    packets.push_back(make_timed_packet(TCP::ACK, 101, 501, "hello", false, 1540000));
+    packets.push_back(make_timed_packet(TCP::ACK, 101, 501, "hello", false, 1550000));
+    packets.push_back(make_timed_packet(TCP::ACK, 501, 106, "hi", true, 1560000));
+    packets.push_back(make_timed_packet(TCP::ACK, 106, 503, "!", false, 1570000));
+    packets.push_back(make_timed_packet(TCP::FIN | TCP::ACK, 107, 503, "", false, 2000000));
+
+    TCPStreamFollower follower;
+    std::vector<TCPStream> closed;
+    for(size_t i = 0; i < packets.size(); ++i)
+        follower.process(packets[i], data_handle, stream_copier(closed));
+    ASSERT_EQ(1U, closed.size());
+    const TCPStream &stream = closed[0];
+    EXPECT_EQ(1, stream.first_seen().seconds());
+    EXPECT_EQ(0, stream.first_seen().microseconds());
+    EXPECT_EQ(2, stream.last_seen().seconds());
+    // Measured from the retransmitted SYN
+    EXPECT_EQ(30000U, stream.handshake_rtt());
+
+    EXPECT_EQ(7U, stream.client_stats().segments);
+    EXPECT_EQ(11U, stream.client_stats().bytes);
+    EXPECT_EQ(2U, stream.client_stats().retransmissions);
+    EXPECT_EQ(2U, stream.server_stats().segments);
+    EXPECT_EQ(2U, stream.server_stats().bytes);
+    EXPECT_EQ(0U, stream.server_stats().retransmissions);
+
+    // Without timestamps, times stay at the last one the follower saw
+    closed.clear();
+    for(size_t i = 0; i < packets.size(); ++i)
+        follower.process(*packets[i].pdu(), data_handle, stream_copier(closed));
+    ASSERT_EQ(1U, closed.size());
+    EXPECT_EQ(7U, closed[0].client_stats().segments);
+    EXPECT_EQ(2, closed[0].first_seen().seconds());
+    EXPECT_EQ(0U, closed[0].handshake_rtt());
+}
+
+TEST_F(TCPStreamTest, ManySessions) {
+    TCPStreamFollower follower;
+    removed_streams.clear();
+    const uint16_t session_count = 2000;
+    std::vector<Packet> packets;
+    for(uint16_t i = 0; i < session_count; ++i) {
+        packets.push_back(make_packet(i + 1, TCP::SYN, 1));
+        packets.push_back(make_packet(i + 1, TCP::SYN | TCP::ACK, 1, true));
+    }
+    // Close every odd session
+    for(uint16_t i = 1; i < session_count; i += 2)
+        packets.push_back(make_packet(i + 1, TCP::RST, 2));
+    follower.follow_streams(packets.begin(), packets.end(), data_handle, 
+                            removed_stream_handle);
+    EXPECT_EQ(session_count / 2U, follower.active_sessions());
+    EXPECT_EQ(session_count / 2U, follower.stats().sessions_closed);
+
+    // The remaining ones must still be found
+    packets.clear();
+    for(uint16_t i = 0; i < session_count; i += 2)
+        packets.push_back(make_packet(i + 1, TCP::FIN, 3));
+    follower.follow_streams(packets.begin(), packets.end(), data_handle, 
+                            removed_stream_handle);
+    EXPECT_EQ(0U, follower.active_sessions());
+    EXPECT_EQ(session_count, follower.stats().sessions_closed);
+    EXPECT_EQ(session_count, removed_streams.size());
+}
+
+std::vector<uint8_t> make_stream_data(size_t size) {
+    std::vector<uint8_t> data(size);
+    uint32_t seed = 0x12345678;
+    for(size_t i = 0; i < size; ++i) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = static_cast<uint8_t>(seed >> 16);
+    }
+    return data;
+}
+
+TEST_F(TCPStreamTest, BufferOutOfOrder) {
+    const std::vector<uint8_t> data = make_stream_data(20000);
+    // Make it wrap around
+    const uint32_t initial_seq = 0xffffff00;
+    // Overlapping segments, in reverse order, with every 7th one repeated
+    std::vector<std::pair<uint32_t, uint32_t> > segments;
+    for(uint32_t offset = 0; offset < data.size(); offset += 500) {
+        const uint32_t end = std::min<uint32_t>(offset + 700, data.size());
+        segments.push_back(std::make_pair(offset, end));
+        if(segments.size() % 7 == 0)
+            segments.push_back(std::make_pair(offset, end));
+    }
+    std::reverse(segments.begin(), segments.end());
+
+    Internals::tcp_stream_buffer buffer;
+    buffer.next_seq(initial_seq);
+    size_t added = 0;
+    for(size_t i = 0; i < segments.size(); ++i) {
+        const uint32_t offset = segments[i].first;
+        added += buffer.add(initial_seq + offset, &data[offset], 
+                            segments[i].second - offset);
+    }
+    EXPECT_EQ(data.size(), added);
+    EXPECT_EQ(0U, buffer.buffered_size());
+    EXPECT_EQ(static_cast<uint32_t>(initial_seq + data.size()), buffer.next_seq());
+    EXPECT_EQ(data, buffer.payload());
+}
+
+TEST_F(TCPStreamTest, BufferConsume) {
+    const std::vector<uint8_t> data = make_stream_data(100);
+    Internals::tcp_stream_buffer buffer;
+    buffer.next_seq(1);
+    // Retransmissions of data already seen are ignored
+    EXPECT_EQ(60U, buffer.add(1, &data[0], 60));
+    EXPECT_EQ(0U, buffer.add(1, &data[0], 60));
+    buffer.consume(50);
+    ASSERT_EQ(10U, buffer.size());
+    EXPECT_TRUE(std::equal(data.begin() + 50, data.begin() + 60, buffer.data()));
+    EXPECT_EQ(40U, buffer.add(41, &data[40], 60));
+    ASSERT_EQ(50U, buffer.size());
+    EXPECT_TRUE(std::equal(data.begin() + 50, data.end(), buffer.data()));
+    buffer.consume(100);
+    EXPECT_EQ(0U, buffer.size());
+    EXPECT_TRUE(buffer.payload().empty());
+}
+
+TEST_F(TCPStreamTest, BufferSkipsHoles) {
+    const std::vector<uint8_t> data = make_stream_data(20000);
+    Internals::tcp_buffer_budget budget;
+    Internals::tcp_stream_buffer buffer;
+    buffer.limits(8192, &budget);
+    buffer.next_seq(0);
+    // Bytes [0, 1000) never show up
+    size_t added = 0;
+    for(uint32_t offset = 1000; offset < data.size(); offset += 1000)
+        added += buffer.add(offset, &data[offset], 1000);
+    EXPECT_EQ(1000U, budget.skipped_bytes);
+    EXPECT_EQ(data.size() - 1000, added);
+    EXPECT_TRUE(std::equal(data.begin() + 1000, data.end(), buffer.payload().begin()));
+    EXPECT_EQ(0U, budget.used);
+}
+
+TEST_F(TCPStreamTest, BufferBudget) {
+    const std::vector<uint8_t> data = make_stream_data(10000);
+    Internals::tcp_buffer_budget budget;
+    budget.limit = 8192;
+    Internals::tcp_stream_buffer buffer1, buffer2;
+    buffer1.limits(65536, &budget);
+    buffer2.limits(65536, &budget);
+    EXPECT_EQ(0U, buffer1.add(100, &data[100], 5000));
+    EXPECT_EQ(5000U, buffer1.buffered_size());
+    EXPECT_EQ(8192U, budget.used);
+    // There's no room for this one
+    EXPECT_EQ(100U, buffer2.add(100, &data[100], 100));
+    EXPECT_EQ(100U, budget.skipped_bytes);
+    EXPECT_EQ(5100U, buffer1.add(0, &data[0], 100));
+    EXPECT_EQ(0U, budget.used);
+}
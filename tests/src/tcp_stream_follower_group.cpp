@@ -0,0 +1,225 @@
+#include "cxxstd.h"
+
+#if TINS_IS_CXX11
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "tcp_stream_follower_group.h"
+#include "ethernetII.h"
+#include "ip.h"
+#include "tcp.h"
+#include "rawpdu.h"
+#include "packet_writer.h"
+#include "sniffer.h"
+#include "radiotap.h"
+#include "snap.h"
+#include "dot11/dot11_data.h"
+
+using namespace std;
+using namespace Tins;
+
+class TCPStreamFollowerGroupTest : public testing::Test {
+public:
+    static const uint16_t session_count = 64;
+    static const size_t chunk_count = 20;
+
+    static Packet make_packet(uint16_t client_port, uint8_t flags, uint32_t seq,
+      uint32_t ack, const string &payload, bool from_server)
+    {
+        TCP tcp(80, client_port);
+        IP ip("10.0.0.2", "10.0.0.1");
+        if(from_server) {
+            tcp = TCP(client_port, 80);
+            ip = IP("10.0.0.1", "10.0.0.2");
+        }
+        tcp.flags(flags);
+        tcp.seq(seq);
+        tcp.ack_seq(ack);
+        EthernetII eth = EthernetII() / ip / tcp;
+        if(!payload.empty())
+            eth /= RawPDU(payload);
+        return Packet(eth);
+    }
+
+    static string chunk(uint16_t client_port, size_t index) {
+        return "port " + to_string(client_port) + " chunk " + to_string(index) + ";";
+    }
+
+    // Builds several sessions whose segments are interleaved. Each
+    // client sends chunk_count chunks, then closes the connection.
+    static vector<Packet> make_sessions() {
+        vector<Packet> packets;
+        vector<uint32_t> seqs;
+        for(uint16_t i = 0; i < session_count; ++i) {
+            const uint16_t port = 1000 + i;
+            packets.push_back(make_packet(port, TCP::SYN, 100, 0, "", false));
+            packets.push_back(make_packet(port, TCP::SYN | TCP::ACK, 500, 101, "", true));
+            seqs.push_back(101);
+        }
+        for(size_t c = 0; c < chunk_count; ++c) {
+            for(uint16_t i = 0; i < session_count; ++i) {
+                const string data = chunk(1000 + i, c);
+                packets.push_back(make_packet(1000 + i, TCP::ACK, seqs[i], 501, data, false));
+                seqs[i] += data.size();
+            }
+        }
+        for(uint16_t i = 0; i < session_count; ++i)
+            packets.push_back(make_packet(1000 + i, TCP::FIN | TCP::ACK, seqs[i], 501, "", false));
+        return packets;
+    }
+
+    static string expected_payload(uint16_t client_port) {
+        string output;
+        for(size_t c = 0; c < chunk_count; ++c)
+            output += chunk(client_port, c);
+        return output;
+    }
+};
+
+const uint16_t TCPStreamFollowerGroupTest::session_count;
+const size_t TCPStreamFollowerGroupTest::chunk_count;
+
+struct collected_streams {
+    mutex lock;
+    map<uint16_t, string> payloads;
+    map<uint16_t, thread::id> threads;
+};
+
+TEST_F(TCPStreamFollowerGroupTest, FollowStreams) {
+    vector<Packet> packets = make_sessions();
+    collected_streams collected;
+    TCPStreamFollowerGroup group(4);
+    EXPECT_EQ(4U, group.size());
+    group.follow_streams(
+        packets.begin(), packets.end(),
+        [](TCPStream&) { },
+        [&](TCPStream& stream) {
+            lock_guard<mutex> _(collected.lock);
+            const uint16_t port = stream.stream_info().client_port;
+            collected.payloads[port].assign(stream.client_payload().begin(),
+                                            stream.client_payload().end());
+        }
+    );
+    ASSERT_EQ(session_count, collected.payloads.size());
+    for(uint16_t i = 0; i < session_count; ++i)
+        EXPECT_EQ(expected_payload(1000 + i), collected.payloads[1000 + i]);
+    EXPECT_EQ(session_count, group.stats().sessions_created);
+    EXPECT_EQ(session_count, group.stats().sessions_closed);
+    EXPECT_EQ(0U, group.active_sessions());
+}
+
+TEST_F(TCPStreamFollowerGroupTest, FollowStreamData) {
+    vector<Packet> packets = make_sessions();
+    collected_streams collected;
+    bool same_thread = true;
+    TCPStreamFollowerGroup group(3, 16);
+    group.follow_stream_data(
+        packets.begin(), packets.end(),
+        [&](TCPStream& stream, TCPStream::Direction direction,
+            const uint8_t *data, size_t size)
+        {
+            EXPECT_EQ(TCPStream::CLIENT_TO_SERVER, direction);
+            lock_guard<mutex> _(collected.lock);
+            const uint16_t port = stream.stream_info().client_port;
+            collected.payloads[port].append(data, data + size);
+            // Every session must be handled by a single worker
+            map<uint16_t, thread::id>::iterator it = collected.threads.find(port);
+            if(it == collected.threads.end())
+                collected.threads[port] = this_thread::get_id();
+            else if(it->second != this_thread::get_id())
+                same_thread = false;
+        }
+    );
+    ASSERT_EQ(session_count, collected.payloads.size());
+    for(uint16_t i = 0; i < session_count; ++i)
+        EXPECT_EQ(expected_payload(1000 + i), collected.payloads[1000 + i]);
+    EXPECT_TRUE(same_thread);
+}
+
+TEST_F(TCPStreamFollowerGroupTest, FollowStreamsFromSniffer) {
+    // Frames read from a sniffer are parsed by the workers
+    const string file_name = "tcp_stream_follower_group_test.pcap";
+    {
+        vector<Packet> packets = make_sessions();
+        PacketWriter writer(file_name, DataLinkType<EthernetII>());
+        for(size_t i = 0; i < packets.size(); ++i)
+            writer.write(packets[i]);
+    }
+    collected_streams collected;
+    TCPStreamFollowerGroup group(4);
+    FileSniffer sniffer(file_name);
+    group.follow_stream_data(
+        sniffer,
+        [&](TCPStream& stream, TCPStream::Direction, const uint8_t *data, 
+            size_t size)
+        {
+            lock_guard<mutex> _(collected.lock);
+            const uint16_t port = stream.stream_info().client_port;
+            collected.payloads[port].append(data, data + size);
+        }
+    );
+    remove(file_name.c_str());
+    ASSERT_EQ(session_count, collected.payloads.size());
+    for(uint16_t i = 0; i < session_count; ++i)
+        EXPECT_EQ(expected_payload(1000 + i), collected.payloads[1000 + i]);
+    EXPECT_EQ(session_count, group.stats().sessions_closed);
+}
+
+#ifdef HAVE_DOT11
+
+TEST_F(TCPStreamFollowerGroupTest, FollowStreamsFromParsingSniffer) {
+    // Radiotap frames are parsed by the reading thread. Borrowed payloads
+    // must be copied before being handed over, as the capture buffer is 
+    // reused by the next read.
+    const string file_name = "tcp_stream_follower_group_parsed_test.pcap";
+    {
+        vector<Packet> packets = make_sessions();
+        PacketWriter writer(file_name, DataLinkType<RadioTap>());
+        for(size_t i = 0; i < packets.size(); ++i) {
+            RadioTap radio = RadioTap() / Dot11Data() / SNAP() /
+                packets[i].pdu()->rfind_pdu<IP>();
+            writer.write(radio);
+        }
+    }
+    collected_streams collected;
+    TCPStreamFollowerGroup group(4);
+    FileSniffer sniffer(file_name);
+    sniffer.set_borrow_payloads(true);
+    sniffer.set_pdu_arena(true);
+    group.follow_stream_data(
+        sniffer,
+        [&](TCPStream& stream, TCPStream::Direction, const uint8_t *data, 
+            size_t size)
+        {
+            lock_guard<mutex> _(collected.lock);
+            const uint16_t port = stream.stream_info().client_port;
+            collected.payloads[port].append(data, data + size);
+        }
+    );
+    remove(file_name.c_str());
+    ASSERT_EQ(session_count, collected.payloads.size());
+    for(uint16_t i = 0; i < session_count; ++i)
+        EXPECT_EQ(expected_payload(1000 + i), collected.payloads[1000 + i]);
+    EXPECT_EQ(session_count, group.stats().sessions_closed);
+}
+
+#endif // HAVE_DOT11
+
+TEST_F(TCPStreamFollowerGroupTest, ExceptionsAreRethrown) {
+    vector<Packet> packets = make_sessions();
+    TCPStreamFollowerGroup group(2);
+    EXPECT_THROW(
+        group.follow_streams(
+            packets.begin(), packets.end(),
+            [](TCPStream&) { throw runtime_error("stop"); }
+        ),
+        runtime_error
+    );
+}
+
+#endif // TINS_IS_CXX11
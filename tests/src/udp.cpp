@@ -1,9 +1,12 @@
 #include <gtest/gtest.h>
 #include <cstring>
+#include <string>
 #include <stdint.h>
 #include "udp.h"
 #include "ip.h"
 #include "ethernetII.h"
+#include "ipv6.h"
+#include "rawpdu.h"
 
 using namespace std;
 using namespace Tins;
@@ -148,3 +151,34 @@ TEST_F(UDPTest, ConstructorFromBuffer) {
     EXPECT_EQ(udp1.size(), udp2.size());
     EXPECT_EQ(udp1.header_size(), udp2.header_size());
 }
+
+TEST_F(UDPTest, IncrementalChecksum) {
+    IP pkt1 = IP("192.168.0.1", "192.168.0.100") / UDP(53, 40000) / 
+                RawPDU(string(1471, 'A'));
+    PDU::serialization_type buffer = pkt1.serialize();
+
+    TrustedChecksums::Scope scope;
+    IP pkt2(&buffer[0], (uint32_t)buffer.size());
+    pkt2.dst_addr("10.0.0.1");
+    pkt2.rfind_pdu<UDP>().sport(1234);
+    PDU::serialization_type incremental = pkt2.serialize();
+
+    // Copies always sum the whole datagram again
+    IP pkt3(pkt2);
+    EXPECT_EQ(pkt3.serialize(), incremental);
+}
+
+TEST_F(UDPTest, IncrementalChecksumIPv6) {
+    IPv6 pkt1 = IPv6("fe80::1", "fe80::2") / UDP(53, 40000) / 
+                RawPDU(string(1200, 'A'));
+    PDU::serialization_type buffer = pkt1.serialize();
+
+    TrustedChecksums::Scope scope;
+    IPv6 pkt2(&buffer[0], (uint32_t)buffer.size());
+    pkt2.src_addr("fe80::1234");
+    pkt2.rfind_pdu<UDP>().dport(5353);
+    PDU::serialization_type incremental = pkt2.serialize();
+
+    IPv6 pkt3(pkt2);
+    EXPECT_EQ(pkt3.serialize(), incremental);
+}
@@ -1,7 +1,10 @@
 #include <iostream>
 #include <stdexcept>
+#include <vector>
+#include <cstring>
 #include <gtest/gtest.h>
 #include "utils.h"
+#include "internals.h"
 #include "endianness.h"
 #include "ip_address.h"
 #include "ipv6_address.h"
@@ -19,6 +22,9 @@ public:
     static const uint8_t data[];
     static const uint32_t data_len;
 
+    static uint32_t reference_checksum(const uint8_t *start, const uint8_t *end);
+    static void test_checksum(Internals::checksum_implementation impl);
+    static void test_crc32(Internals::crc32_implementation impl);
 };
 
 const uint32_t UtilsTest::zero_int_ip = 0; // "0.0.0.0"
@@ -71,3 +77,123 @@ TEST_F(UtilsTest, Crc32) {
 
     EXPECT_EQ(crc, 0x78840f54U);
 }
+
+// Every implementation is checked against the nibble based one
+void UtilsTest::test_crc32(Internals::crc32_implementation impl) {
+    if(!Internals::crc32_implementation_supported(impl))
+        return;
+    std::vector<uint8_t> buffer(9001 + 16);
+    uint32_t seed = 0x12345678;
+    for(size_t i = 0; i < buffer.size(); ++i) {
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = static_cast<uint8_t>(seed >> 16);
+    }
+    const uint8_t *ptr = &buffer[0];
+    for(uint32_t offset = 0; offset < 4; ++offset) {
+        for(uint32_t size = 0; size < 300; ++size) {
+            EXPECT_EQ(
+                Internals::crc32(ptr + offset, size, Internals::CRC32_NIBBLE),
+                Internals::crc32(ptr + offset, size, impl)
+            ) << "size " << size << ", offset " << offset;
+        }
+    }
+    const uint32_t large_sizes[] = { 1500, 2346, 9001 };
+    for(size_t i = 0; i < sizeof(large_sizes) / sizeof(large_sizes[0]); ++i) {
+        EXPECT_EQ(
+            Internals::crc32(ptr + 1, large_sizes[i], Internals::CRC32_NIBBLE),
+            Internals::crc32(ptr + 1, large_sizes[i], impl)
+        );
+    }
+    EXPECT_EQ(0x78840f54U, Internals::crc32(data, data_len, impl));
+    // The standard check value
+    EXPECT_EQ(0xcbf43926U, Internals::crc32((const uint8_t*)"123456789", 9, impl));
+}
+
+TEST_F(UtilsTest, Crc32Nibble) {
+    EXPECT_TRUE(Internals::crc32_implementation_supported(Internals::CRC32_NIBBLE));
+    EXPECT_EQ(0xcbf43926U, Internals::crc32((const uint8_t*)"123456789", 9, 
+                                            Internals::CRC32_NIBBLE));
+}
+
+TEST_F(UtilsTest, Crc32SlicingBy8) {
+    EXPECT_TRUE(Internals::crc32_implementation_supported(Internals::CRC32_SLICING_BY_8));
+    test_crc32(Internals::CRC32_SLICING_BY_8);
+}
+
+TEST_F(UtilsTest, Crc32PCLMUL) {
+    test_crc32(Internals::CRC32_PCLMUL);
+}
+
+// The original 16 bit at a time implementation
+uint32_t UtilsTest::reference_checksum(const uint8_t *start, const uint8_t *end) {
+    uint32_t checksum(0);
+    const uint8_t *last = end;
+    uint16_t buffer = 0;
+    uint16_t padding = 0;
+    const uint8_t *ptr = start;
+
+    if(((end - start) & 1) == 1) {
+        last = end - 1;
+        padding = *(end - 1) << 8;
+    }
+
+    while(ptr < last) {
+        memcpy(&buffer, ptr, sizeof(uint16_t));
+        checksum += Endian::host_to_be(buffer);
+        ptr += sizeof(uint16_t);
+    }
+
+    return checksum + padding;
+}
+
+void UtilsTest::test_checksum(Internals::checksum_implementation impl) {
+    if(!Internals::checksum_implementation_supported(impl))
+        return;
+    std::vector<uint8_t> buffer(70000 + 64);
+    uint32_t seed = 0x12345678;
+    for(size_t i = 0; i < buffer.size(); ++i) {
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = static_cast<uint8_t>(seed >> 16);
+    }
+    const uint8_t *ptr = &buffer[0];
+    for(size_t offset = 0; offset < 4; ++offset) {
+        for(size_t size = 0; size < 600; ++size) {
+            EXPECT_EQ(
+                reference_checksum(ptr + offset, ptr + offset + size),
+                Internals::do_checksum(ptr + offset, ptr + offset + size, impl)
+            ) << "size " << size << ", offset " << offset;
+        }
+    }
+    const size_t large_sizes[] = { 1500, 9001, 65535, 65536, 70000 };
+    for(size_t i = 0; i < sizeof(large_sizes) / sizeof(large_sizes[0]); ++i) {
+        EXPECT_EQ(
+            reference_checksum(ptr + 1, ptr + 1 + large_sizes[i]),
+            Internals::do_checksum(ptr + 1, ptr + 1 + large_sizes[i], impl)
+        );
+    }
+    // Worst case for the accumulators
+    std::vector<uint8_t> ones(70001, 0xff);
+    EXPECT_EQ(
+        reference_checksum(&ones[0], &ones[0] + ones.size()),
+        Internals::do_checksum(&ones[0], &ones[0] + ones.size(), impl)
+    );
+}
+
+TEST_F(UtilsTest, Checksum) {
+    EXPECT_EQ(reference_checksum(data, data + data_len), Utils::do_checksum(data, data + data_len));
+    EXPECT_EQ(reference_checksum(data, data + data_len - 1), Utils::do_checksum(data, data + data_len - 1));
+    EXPECT_EQ(0U, Utils::do_checksum(data, data));
+}
+
+TEST_F(UtilsTest, ChecksumScalar) {
+    EXPECT_TRUE(Internals::checksum_implementation_supported(Internals::CHECKSUM_SCALAR));
+    test_checksum(Internals::CHECKSUM_SCALAR);
+}
+
+TEST_F(UtilsTest, ChecksumSSE2) {
+    test_checksum(Internals::CHECKSUM_SSE2);
+}
+
+TEST_F(UtilsTest, ChecksumAVX2) {
+    test_checksum(Internals::CHECKSUM_AVX2);
+}